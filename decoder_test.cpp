@@ -0,0 +1,289 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <zlib.h>
+#include "net/http/decoder.h"
+#include "string/buffer.h"
+
+// Decodes compressed bodies (gzip, deflate with the zlib header and raw
+// deflate, as some servers send it) received in fragments of different
+// sizes, the way the clients decode them, and checks the decoded data.
+// The fixtures are compressed with zlib: an empty body, a body of a single
+// byte and a text body. It also checks that a truncated body is not
+// complete, that the data after the end of the stream is ignored and that
+// a wrong checksum is detected.
+
+// Size of the output buffer (as client::kDecodeBufferSize).
+static const size_t kOutputSize = 16 * 1024;
+
+// Size of the text body.
+static const size_t kTextSize = 256 * 1024;
+
+// Fragment sizes (0: the whole body at once).
+static const size_t kFragments[] = {1, 2, 3, 7, 1448, 64 * 1024, 0};
+static const unsigned kNumberFragments = sizeof(kFragments) /
+                                         sizeof(kFragments[0]);
+
+struct format {
+  const char* name;
+  net::http::decoder::encoding encoding;
+  int window_bits;
+};
+
+static const format formats[] = {
+  {"gzip", net::http::decoder::encoding::kGzip, 15 + 16},
+  {"deflate", net::http::decoder::encoding::kDeflate, 15},
+  {"raw deflate", net::http::decoder::encoding::kDeflate, -15}
+};
+
+static const unsigned kNumberFormats = sizeof(formats) / sizeof(formats[0]);
+
+// Build a text body (compressible, but not trivially).
+static bool text(string::buffer& body)
+{
+  static const char* words[] = {
+    "downloader", "connection", "response", "header", "body", "chunk",
+    "deflate", "gzip", "host", "worker", "timer", "selector", "range"
+  };
+
+  static const unsigned kNumberWords = sizeof(words) / sizeof(words[0]);
+
+  uint32_t state = 1;
+
+  for (unsigned line = 0; body.length() < kTextSize; line++) {
+    if (!body.format("%u:", line)) {
+      return false;
+    }
+
+    for (unsigned i = 0; i < 8; i++) {
+      state = state * 1103515245 + 12345;
+
+      if (!body.format(" %s", words[(state >> 16) % kNumberWords])) {
+        return false;
+      }
+    }
+
+    if (!body.append('\n')) {
+      return false;
+    }
+  }
+
+  body.length(kTextSize);
+
+  return true;
+}
+
+// Compress.
+static bool compress(const format& fmt,
+                     const string::buffer& body,
+                     string::buffer& compressed)
+{
+  z_stream stream;
+  memset(&stream, 0, sizeof(z_stream));
+
+  if (deflateInit2(&stream,
+                   Z_DEFAULT_COMPRESSION,
+                   Z_DEFLATED,
+                   fmt.window_bits,
+                   8,
+                   Z_DEFAULT_STRATEGY) != Z_OK) {
+    return false;
+  }
+
+  size_t size = deflateBound(&stream, body.length());
+
+  compressed.clear();
+
+  if (!compressed.allocate(size)) {
+    deflateEnd(&stream);
+    return false;
+  }
+
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(body.data()));
+  stream.avail_in = static_cast<uInt>(body.length());
+  stream.next_out = reinterpret_cast<Bytef*>(compressed.data());
+  stream.avail_out = static_cast<uInt>(size);
+
+  int ret = deflate(&stream, Z_FINISH);
+
+  compressed.length(size - stream.avail_out);
+
+  deflateEnd(&stream);
+
+  return (ret == Z_STREAM_END);
+}
+
+// Decode a fragment (as client::decode()).
+static bool decode(net::http::decoder& decoder,
+                   const char* data,
+                   size_t len,
+                   string::buffer& out)
+{
+  char buf[kOutputSize];
+  size_t inlen, outlen;
+
+  do {
+    inlen = len;
+    outlen = sizeof(buf);
+
+    if (!decoder.decode(data, inlen, buf, outlen)) {
+      return false;
+    }
+
+    if ((outlen > 0) && (!out.append(buf, outlen))) {
+      return false;
+    }
+
+    data += inlen;
+    len -= inlen;
+  } while ((outlen == sizeof(buf)) || ((len > 0) && (inlen > 0)));
+
+  // The data which has not been consumed is lost (it can only be data
+  // after the end of the stream).
+  return ((len == 0) || (decoder.complete()));
+}
+
+// Decode a body received in fragments of 'fragment' bytes.
+static bool decode(const format& fmt,
+                   const char* data,
+                   size_t len,
+                   size_t fragment,
+                   string::buffer& out,
+                   bool& complete)
+{
+  net::http::decoder decoder;
+  if (!decoder.init(fmt.encoding)) {
+    return false;
+  }
+
+  out.clear();
+
+  if (fragment == 0) {
+    fragment = len;
+  }
+
+  for (size_t off = 0; off < len; off += fragment) {
+    size_t n = (len - off < fragment) ? len - off : fragment;
+
+    if (!decode(decoder, data + off, n, out)) {
+      return false;
+    }
+  }
+
+  complete = decoder.complete();
+
+  return true;
+}
+
+static bool equal(const string::buffer& a, const string::buffer& b)
+{
+  return ((a.length() == b.length()) &&
+          (memcmp(a.data(), b.data(), a.length()) == 0));
+}
+
+static bool test(const format& fmt, const string::buffer& body)
+{
+  string::buffer compressed;
+  if (!compress(fmt, body, compressed)) {
+    fprintf(stderr, "Error compressing body.\n");
+    return false;
+  }
+
+  printf("%s, %zu bytes (%zu compressed): ",
+         fmt.name,
+         body.length(),
+         compressed.length());
+
+  string::buffer out;
+  bool complete;
+
+  for (unsigned i = 0; i < kNumberFragments; i++) {
+    if ((!decode(fmt,
+                 compressed.data(),
+                 compressed.length(),
+                 kFragments[i],
+                 out,
+                 complete)) ||
+        (!complete) ||
+        (!equal(body, out))) {
+      printf("FAILED (fragments of %zu bytes).\n", kFragments[i]);
+      return false;
+    }
+  }
+
+  // Truncated body: the decoded data is a prefix of the body.
+  if ((compressed.length() > 4) &&
+      ((!decode(fmt,
+                compressed.data(),
+                compressed.length() - 4,
+                1448,
+                out,
+                complete)) ||
+       (complete) ||
+       (out.length() > body.length()) ||
+       (memcmp(out.data(), body.data(), out.length()) != 0))) {
+    printf("FAILED (truncated body).\n");
+    return false;
+  }
+
+  // Data after the end of the stream.
+  string::buffer trailing;
+  if ((!trailing.append(compressed.data(), compressed.length())) ||
+      (!trailing.append("garbage", 7))) {
+    fprintf(stderr, "Error allocating memory.\n");
+    return false;
+  }
+
+  if ((!decode(fmt,
+               trailing.data(),
+               trailing.length(),
+               1448,
+               out,
+               complete)) ||
+      (!complete) ||
+      (!equal(body, out))) {
+    printf("FAILED (data after the end of the stream).\n");
+    return false;
+  }
+
+  // Wrong checksum (raw deflate data has no checksum).
+  if (fmt.window_bits > 0) {
+    compressed.data()[compressed.length() - 1] ^= 0x55;
+
+    if ((decode(fmt,
+                compressed.data(),
+                compressed.length(),
+                1448,
+                out,
+                complete)) &&
+        (complete)) {
+      printf("FAILED (wrong checksum).\n");
+      return false;
+    }
+  }
+
+  printf("OK.\n");
+
+  return true;
+}
+
+int main()
+{
+  string::buffer empty, byte, body;
+  if ((!byte.append('x')) || (!text(body))) {
+    fprintf(stderr, "Error allocating memory.\n");
+    return -1;
+  }
+
+  int ret = 0;
+
+  for (unsigned i = 0; i < kNumberFormats; i++) {
+    if ((!test(formats[i], empty)) ||
+        (!test(formats[i], byte)) ||
+        (!test(formats[i], body))) {
+      ret = -1;
+    }
+  }
+
+  return ret;
+}
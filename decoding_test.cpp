@@ -0,0 +1,511 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <ftw.h>
+#include <pthread.h>
+#include <zlib.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "net/http/downloader.h"
+#include "net/http/url_index.h"
+#include "fs/file.h"
+#include "string/buffer.h"
+#include "string/memcasemem.h"
+
+// Downloads compressed responses from a stub HTTP server on 127.0.0.1 (in
+// another thread) with the downloader and checks that the requests have
+// Accept-Encoding, that the bodies are saved decompressed without the
+// Content-Encoding and Content-Length headers and marked as decoded in the
+// index, and that the responses whose compressed body is truncated are not
+// saved (they are errors):
+//   /gzip:            gzip with Content-Length.
+//   /deflate:         deflate (zlib header) with Content-Length.
+//   /gzip-close:      gzip, the end of the body is signaled by closing the
+//                     connection.
+//   /identity:        not compressed (saved as received).
+//   /truncated:       gzip cut in half with Content-Length.
+//   /truncated-close: gzip cut in half, closing the connection.
+
+// Size of the text body.
+static const size_t kTextSize = 64 * 1024;
+
+// Time to let the downloader save the last response (milliseconds).
+static const unsigned kGraceTime = 1500;
+
+// Maximum duration of the test (seconds).
+static const unsigned kMaxDuration = 20;
+
+struct test {
+  const char* path;
+  int window_bits; // 0: not compressed.
+  bool content_length;
+  bool truncated;
+
+  // Results.
+  unsigned requests;
+  bool accept_encoding;
+};
+
+static test tests[] = {
+  {"/gzip", 15 + 16, true, false},
+  {"/deflate", 15, true, false},
+  {"/gzip-close", 15 + 16, false, false},
+  {"/identity", 0, true, false},
+  {"/truncated", 15 + 16, true, true},
+  {"/truncated-close", 15 + 16, false, true}
+};
+
+static const unsigned kNumberTests = sizeof(tests) / sizeof(tests[0]);
+
+static net::http::downloader downloader;
+
+static string::buffer body;
+
+static int listener = -1;
+static unsigned short port;
+
+static unsigned served;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Build a text body (compressible, but not trivially).
+static bool text(string::buffer& body)
+{
+  uint32_t state = 1;
+
+  for (unsigned line = 0; body.length() < kTextSize; line++) {
+    state = state * 1103515245 + 12345;
+
+    if (!body.format("%u: %08x the body is decoded as it is received\n",
+                     line,
+                     state)) {
+      return false;
+    }
+  }
+
+  body.length(kTextSize);
+
+  return true;
+}
+
+// Compress.
+static bool compress(int window_bits,
+                     const string::buffer& body,
+                     string::buffer& compressed)
+{
+  z_stream stream;
+  memset(&stream, 0, sizeof(z_stream));
+
+  if (deflateInit2(&stream,
+                   Z_DEFAULT_COMPRESSION,
+                   Z_DEFLATED,
+                   window_bits,
+                   8,
+                   Z_DEFAULT_STRATEGY) != Z_OK) {
+    return false;
+  }
+
+  size_t size = deflateBound(&stream, body.length());
+
+  compressed.clear();
+
+  if (!compressed.allocate(size)) {
+    deflateEnd(&stream);
+    return false;
+  }
+
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(body.data()));
+  stream.avail_in = static_cast<uInt>(body.length());
+  stream.next_out = reinterpret_cast<Bytef*>(compressed.data());
+  stream.avail_out = static_cast<uInt>(size);
+
+  int ret = deflate(&stream, Z_FINISH);
+
+  compressed.length(size - stream.avail_out);
+
+  deflateEnd(&stream);
+
+  return (ret == Z_STREAM_END);
+}
+
+static bool send_all(int fd, const char* data, size_t len)
+{
+  while (len > 0) {
+    ssize_t ret;
+    if ((ret = send(fd, data, len, MSG_NOSIGNAL)) <= 0) {
+      return false;
+    }
+
+    data += ret;
+    len -= ret;
+  }
+
+  return true;
+}
+
+// Serve a request (one per connection).
+static void serve(int fd)
+{
+  char req[4096];
+  size_t len = 0;
+
+  do {
+    ssize_t ret;
+    if ((ret = recv(fd, req + len, sizeof(req) - 1 - len, 0)) <= 0) {
+      return;
+    }
+
+    len += ret;
+    req[len] = 0;
+  } while ((!strstr(req, "\r\n\r\n")) && (len < sizeof(req) - 1));
+
+  const char* path = strchr(req, ' ');
+  if (!path) {
+    return;
+  }
+
+  path++;
+
+  const char* end = strchr(path, ' ');
+  if (!end) {
+    return;
+  }
+
+  test* t = NULL;
+  for (unsigned i = 0; i < kNumberTests; i++) {
+    if ((strlen(tests[i].path) == static_cast<size_t>(end - path)) &&
+        (memcmp(tests[i].path, path, end - path) == 0)) {
+      t = &tests[i];
+      break;
+    }
+  }
+
+  if (!t) {
+    static const char kNotFound[] = "HTTP/1.1 404 Not Found\r\n"
+                                    "Content-Length: 0\r\n"
+                                    "\r\n";
+
+    send_all(fd, kNotFound, sizeof(kNotFound) - 1);
+    return;
+  }
+
+  string::buffer compressed, response;
+  const string::buffer* b = &body;
+
+  if (t->window_bits != 0) {
+    if (!compress(t->window_bits, body, compressed)) {
+      return;
+    }
+
+    if (t->truncated) {
+      compressed.length(compressed.length() / 2);
+    }
+
+    b = &compressed;
+  }
+
+  static const char kHeader[] = "HTTP/1.1 200 OK\r\n"
+                                "Content-Type: text/plain\r\n"
+                                "Connection: close\r\n";
+
+  if ((!response.append(kHeader, sizeof(kHeader) - 1)) ||
+      ((t->window_bits != 0) &&
+       (!response.format("Content-Encoding: %s\r\n",
+                         (t->window_bits > 15) ? "gzip" : "deflate"))) ||
+      ((t->content_length) &&
+       (!response.format("Content-Length: %zu\r\n", b->length()))) ||
+      (!response.append("\r\n", 2))) {
+    return;
+  }
+
+  pthread_mutex_lock(&mutex);
+
+  t->requests++;
+  t->accept_encoding = (strcasestr(req, "\r\nAccept-Encoding: gzip") !=
+                        NULL);
+
+  pthread_mutex_unlock(&mutex);
+
+  send_all(fd, response.data(), response.length());
+  send_all(fd, b->data(), b->length());
+}
+
+static void* server(void* arg)
+{
+  do {
+    int fd;
+    if ((fd = accept(listener, NULL, NULL)) < 0) {
+      return NULL;
+    }
+
+    serve(fd);
+    close(fd);
+
+    pthread_mutex_lock(&mutex);
+    served++;
+    pthread_mutex_unlock(&mutex);
+  } while (true);
+}
+
+// Stop the downloader when every URL has been requested.
+static void* stopper(void* arg)
+{
+  for (unsigned i = 0; i < kMaxDuration * 10; i++) {
+    usleep(100 * 1000);
+
+    pthread_mutex_lock(&mutex);
+    unsigned n = served;
+    pthread_mutex_unlock(&mutex);
+
+    if (n >= kNumberTests) {
+      break;
+    }
+  }
+
+  usleep(kGraceTime * 1000);
+
+  downloader.stop();
+
+  return NULL;
+}
+
+static bool start_server()
+{
+  if ((listener = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+    return false;
+  }
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(struct sockaddr_in));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  socklen_t addrlen = sizeof(struct sockaddr_in);
+
+  if ((bind(listener,
+            reinterpret_cast<const struct sockaddr*>(&addr),
+            addrlen) < 0) ||
+      (listen(listener, 16) < 0) ||
+      (getsockname(listener,
+                   reinterpret_cast<struct sockaddr*>(&addr),
+                   &addrlen) < 0)) {
+    return false;
+  }
+
+  port = ntohs(addr.sin_port);
+
+  return true;
+}
+
+static bool url(const test& t, char* buf, size_t size)
+{
+  int ret = snprintf(buf, size, "http://127.0.0.1:%u%s", port, t.path);
+  return ((ret > 0) && (static_cast<size_t>(ret) < size));
+}
+
+// Check the saved response.
+static bool check(const char* dir, const test& t)
+{
+  char u[256];
+  if (!url(t, u, sizeof(u))) {
+    return false;
+  }
+
+  printf("%s: ", t.path);
+
+  if (t.requests == 0) {
+    printf("FAILED (not requested).\n");
+    return false;
+  }
+
+  if (!t.accept_encoding) {
+    printf("FAILED (no Accept-Encoding).\n");
+    return false;
+  }
+
+  net::http::url_index::entry e;
+  char path[PATH_MAX];
+  bool found = net::http::url_index::find(dir,
+                                          string::slice(u, strlen(u)),
+                                          e,
+                                          path,
+                                          sizeof(path));
+
+  if (t.truncated) {
+    if (found) {
+      printf("FAILED (the truncated response has been saved).\n");
+      return false;
+    }
+
+    printf("OK (error).\n");
+    return true;
+  }
+
+  if (!found) {
+    printf("FAILED (not saved).\n");
+    return false;
+  }
+
+  bool decoded = (t.window_bits != 0);
+
+  if (((e.flags & net::http::url_index::kDecoded) != 0) != decoded) {
+    printf("FAILED (wrong flags %u).\n", e.flags);
+    return false;
+  }
+
+  string::buffer record;
+  if (!fs::file::read_all(path, record)) {
+    printf("FAILED (error reading '%s').\n", path);
+    return false;
+  }
+
+  const char* data = record.data();
+  const char* hdrend;
+  if ((hdrend = static_cast<const char*>(memmem(data,
+                                                record.length(),
+                                                "\r\n\r\n",
+                                                4))) == NULL) {
+    printf("FAILED (no end of header).\n");
+    return false;
+  }
+
+  hdrend += 4;
+
+  // The headers have to describe the saved body.
+  size_t hdrlen = hdrend - data;
+  bool encoding = (string::memcasemem(data,
+                                      hdrlen,
+                                      "\r\nContent-Encoding:",
+                                      19) != NULL);
+
+  bool length = (string::memcasemem(data,
+                                    hdrlen,
+                                    "\r\nContent-Length:",
+                                    17) != NULL);
+
+  if ((encoding) || (length != !decoded)) {
+    printf("FAILED (wrong headers).\n");
+    return false;
+  }
+
+  if ((e.content_length != body.length()) ||
+      (record.length() - hdrlen != body.length()) ||
+      (memcmp(hdrend, body.data(), body.length()) != 0)) {
+    printf("FAILED (wrong body).\n");
+    return false;
+  }
+
+  printf("OK (%u request%s).\n", t.requests, (t.requests == 1) ? "" : "s");
+
+  return true;
+}
+
+static int remove_file(const char* pathname,
+                       const struct stat* sbuf,
+                       int type,
+                       struct FTW* ftwbuf)
+{
+  return remove(pathname);
+}
+
+int main()
+{
+  char workdir[] = "/tmp/decoding_test.XXXXXX";
+  if (!mkdtemp(workdir)) {
+    fprintf(stderr, "Error creating temporary directory.\n");
+    return -1;
+  }
+
+  char urls_file[PATH_MAX];
+  char dir[PATH_MAX];
+  snprintf(urls_file, sizeof(urls_file), "%s/urls.txt", workdir);
+  snprintf(dir, sizeof(dir), "%s/data", workdir);
+
+  int ret = -1;
+
+  do {
+    if (!text(body)) {
+      fprintf(stderr, "Error allocating memory.\n");
+      break;
+    }
+
+    if (!start_server()) {
+      fprintf(stderr, "Error listening on 127.0.0.1.\n");
+      break;
+    }
+
+    // Write the file with the URLs.
+    string::buffer urls;
+    unsigned i;
+    for (i = 0; i < kNumberTests; i++) {
+      char u[256];
+      if ((!url(tests[i], u, sizeof(u))) || (!urls.format("%s\n", u))) {
+        break;
+      }
+    }
+
+    fs::file file;
+    if ((i < kNumberTests) ||
+        (!file.open(urls_file, O_CREAT | O_TRUNC | O_WRONLY, 0644)) ||
+        (file.write(urls.data(), urls.length()) !=
+         static_cast<ssize_t>(urls.length()))) {
+      fprintf(stderr, "Error writing file '%s'.\n", urls_file);
+      break;
+    }
+
+    file.close();
+
+    // The hosts are IP addresses, the name server is not used.
+    net::socket_address nameserver;
+    nameserver.build("127.0.0.1", 53);
+
+    downloader.nameserver(nameserver);
+    downloader.accept_encoding(
+      net::http::client::content_encoding::kDecoded
+    );
+
+    // Don't reuse connections (the server handles a request per
+    // connection).
+    downloader.idle_timeout(0);
+
+    if (!downloader.create(urls_file, dir)) {
+      fprintf(stderr, "Couldn't create downloader.\n");
+      break;
+    }
+
+    pthread_t server_thread, stopper_thread;
+    if (pthread_create(&server_thread, NULL, server, NULL) != 0) {
+      fprintf(stderr, "Error creating thread.\n");
+      break;
+    }
+
+    if (pthread_create(&stopper_thread, NULL, stopper, NULL) != 0) {
+      fprintf(stderr, "Error creating thread.\n");
+      break;
+    }
+
+    if (!downloader.start()) {
+      fprintf(stderr, "Couldn't start downloader.\n");
+      break;
+    }
+
+    pthread_join(stopper_thread, NULL);
+
+    printf("\n");
+
+    ret = 0;
+
+    for (i = 0; i < kNumberTests; i++) {
+      if (!check(dir, tests[i])) {
+        ret = -1;
+      }
+    }
+  } while (false);
+
+  nftw(workdir, remove_file, 16, FTW_DEPTH | FTW_PHYS);
+
+  return ret;
+}
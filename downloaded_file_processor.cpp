@@ -1,21 +1,43 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include "net/http/downloaded_file_processor.h"
+#include "util/number.h"
 
 int main(int argc, const char** argv)
 {
   // Check usage.
-  if (argc != 2) {
-    printf("Usage: %s <filename>\n", argv[0]);
+  if ((argc != 2) && (argc != 3)) {
+    printf("Usage: %s <filename> [<offset of the record in the segment>]\n",
+           argv[0]);
+
     return -1;
   }
 
   net::http::downloaded_file_processor downloaded_file_processor;
 
   // Open downloaded file.
-  if (!downloaded_file_processor.open(argv[1])) {
-    fprintf(stderr, "Error opening file '%s'.\n", argv[1]);
-    return -1;
+  if (argc == 2) {
+    if (!downloaded_file_processor.open(argv[1])) {
+      fprintf(stderr, "Error opening file '%s'.\n", argv[1]);
+      return -1;
+    }
+  } else {
+    int64_t offset;
+    if (util::number::parse(argv[2], strlen(argv[2]), offset, 0) !=
+        util::number::parse_result::kSucceeded) {
+      fprintf(stderr, "Invalid offset '%s'.\n", argv[2]);
+      return -1;
+    }
+
+    if (!downloaded_file_processor.open(argv[1], offset)) {
+      fprintf(stderr,
+              "Error opening record at offset %s of file '%s'.\n",
+              argv[2],
+              argv[1]);
+
+      return -1;
+    }
   }
 
   // Read title.
@@ -225,3 +225,24 @@ bool fs::file::truncate(off_t length)
 
   return (ret == 0);
 }
+
+bool fs::file::allocate(off_t offset, off_t len)
+{
+#if HAVE_POSIX_FALLOCATE
+  int ret;
+
+  do {
+    ret = posix_fallocate(_M_fd, offset, len);
+  } while (ret == EINTR);
+
+  return (ret == 0);
+#else
+  struct stat buf;
+  if (fstat(_M_fd, &buf) < 0) {
+    return false;
+  }
+
+  // Just extend the file.
+  return ((buf.st_size >= offset + len) || (truncate(offset + len)));
+#endif
+}
@@ -69,6 +69,12 @@ namespace fs {
       // Truncate file.
       bool truncate(off_t length);
 
+      // Allocate disk space (the file is extended if needed).
+      bool allocate(off_t offset, off_t len);
+
+      // Flush the data of the file to disk.
+      bool sync();
+
       // Get file descriptor.
       int fd() const;
 
@@ -115,6 +121,11 @@ namespace fs {
     return (fstat(_M_fd, &buf) == 0);
   }
 
+  inline bool file::sync()
+  {
+    return (fsync(_M_fd) == 0);
+  }
+
   inline int file::fd() const
   {
     return _M_fd;
@@ -0,0 +1,208 @@
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "fs/uring_writer.h"
+
+bool fs::uring_writer::create(net::selector& sel, unsigned entries)
+{
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(struct io_uring_params));
+
+  if ((_M_fd = syscall(__NR_io_uring_setup, entries, &params)) < 0) {
+    _M_fd = -1;
+    return false;
+  }
+
+  // IORING_OP_WRITE is available since the same kernel version as
+  // IORING_FEAT_RW_CUR_POS (5.6).
+  if ((params.features & IORING_FEAT_RW_CUR_POS) == 0) {
+    free();
+    return false;
+  }
+
+  _M_sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  _M_cq_ring_size = params.cq_off.cqes +
+                    params.cq_entries * sizeof(struct io_uring_cqe);
+
+  // If both rings can be mapped with a single mmap()...
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    if (_M_cq_ring_size > _M_sq_ring_size) {
+      _M_sq_ring_size = _M_cq_ring_size;
+    }
+  }
+
+  if ((_M_sq_ring = mmap(NULL,
+                         _M_sq_ring_size,
+                         PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE,
+                         _M_fd,
+                         IORING_OFF_SQ_RING)) == MAP_FAILED) {
+    _M_sq_ring = NULL;
+
+    free();
+    return false;
+  }
+
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    _M_cq_ring = _M_sq_ring;
+  } else if ((_M_cq_ring = mmap(NULL,
+                                _M_cq_ring_size,
+                                PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_POPULATE,
+                                _M_fd,
+                                IORING_OFF_CQ_RING)) == MAP_FAILED) {
+    _M_cq_ring = NULL;
+
+    free();
+    return false;
+  }
+
+  void* sqes;
+  if ((sqes = mmap(NULL,
+                   params.sq_entries * sizeof(struct io_uring_sqe),
+                   PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE,
+                   _M_fd,
+                   IORING_OFF_SQES)) == MAP_FAILED) {
+    free();
+    return false;
+  }
+
+  _M_sqes = static_cast<struct io_uring_sqe*>(sqes);
+
+  uint8_t* sq = static_cast<uint8_t*>(_M_sq_ring);
+  _M_sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+  _M_sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+  _M_sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+  _M_sq_entries = params.sq_entries;
+  _M_sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+  uint8_t* cq = static_cast<uint8_t*>(_M_cq_ring);
+  _M_cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+  _M_cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+  _M_cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+  _M_cq_entries = params.cq_entries;
+  _M_cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+
+  // The descriptor becomes readable when there are completions.
+  if (!sel.add(_M_fd, net::fdtype::kFdIoUring, this, io::event::kRead)) {
+    free();
+    return false;
+  }
+
+  return true;
+}
+
+bool fs::uring_writer::write(int fd,
+                             const void* buf,
+                             size_t count,
+                             off_t offset,
+                             uint64_t user_data)
+{
+  // The completion queue cannot overflow.
+  if (_M_inflight == _M_cq_entries) {
+    return false;
+  }
+
+  unsigned tail = *_M_sq_tail;
+
+  // If the submission queue is full...
+  if (tail - __atomic_load_n(_M_sq_head, __ATOMIC_ACQUIRE) == _M_sq_entries) {
+    // Submit the queued writes to make room.
+    submit();
+
+    if (tail - __atomic_load_n(_M_sq_head, __ATOMIC_ACQUIRE) ==
+        _M_sq_entries) {
+      return false;
+    }
+  }
+
+  unsigned idx = tail & _M_sq_mask;
+
+  struct io_uring_sqe* sqe = &_M_sqes[idx];
+  memset(sqe, 0, sizeof(struct io_uring_sqe));
+
+  sqe->opcode = IORING_OP_WRITE;
+  sqe->fd = fd;
+  sqe->addr = reinterpret_cast<uintptr_t>(buf);
+  sqe->len = count;
+  sqe->off = offset;
+  sqe->user_data = user_data;
+
+  _M_sq_array[idx] = idx;
+
+  __atomic_store_n(_M_sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+  _M_queued++;
+  _M_inflight++;
+
+  return true;
+}
+
+bool fs::uring_writer::completion(uint64_t& user_data, int& res)
+{
+  unsigned head = *_M_cq_head;
+
+  if (head == __atomic_load_n(_M_cq_tail, __ATOMIC_ACQUIRE)) {
+    return false;
+  }
+
+  const struct io_uring_cqe* cqe = &_M_cqes[head & _M_cq_mask];
+
+  user_data = cqe->user_data;
+  res = cqe->res;
+
+  __atomic_store_n(_M_cq_head, head + 1, __ATOMIC_RELEASE);
+
+  _M_inflight--;
+
+  return true;
+}
+
+int fs::uring_writer::enter(unsigned to_submit,
+                            unsigned min_complete,
+                            unsigned flags)
+{
+  int ret;
+  do {
+    ret = syscall(__NR_io_uring_enter,
+                  _M_fd,
+                  to_submit,
+                  min_complete,
+                  flags,
+                  NULL,
+                  0);
+  } while ((ret < 0) && (errno == EINTR));
+
+  if (ret > 0) {
+    _M_queued -= ret;
+  }
+
+  return ret;
+}
+
+void fs::uring_writer::free()
+{
+  if (_M_sqes) {
+    munmap(_M_sqes, _M_sq_entries * sizeof(struct io_uring_sqe));
+    _M_sqes = NULL;
+  }
+
+  if ((_M_cq_ring) && (_M_cq_ring != _M_sq_ring)) {
+    munmap(_M_cq_ring, _M_cq_ring_size);
+  }
+
+  _M_cq_ring = NULL;
+
+  if (_M_sq_ring) {
+    munmap(_M_sq_ring, _M_sq_ring_size);
+    _M_sq_ring = NULL;
+  }
+
+  if (_M_fd != -1) {
+    close(_M_fd);
+    _M_fd = -1;
+  }
+}
@@ -0,0 +1,142 @@
+#ifndef FS_URING_WRITER_H
+#define FS_URING_WRITER_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <linux/io_uring.h>
+#include "net/selector.h"
+#include "io/event_handler.h"
+
+namespace fs {
+  // Asynchronous file writes (io_uring): the writes are queued, submitted
+  // in batches with a single system call and their completions are
+  // collected later. The descriptor of the ring is readable when there
+  // are completions.
+  class uring_writer : public io::event_handler {
+    public:
+      static const unsigned kDefaultEntries = 256;
+
+      // Constructor.
+      uring_writer();
+
+      // Destructor.
+      ~uring_writer();
+
+      // Create (fails if io_uring is not available).
+      bool create(net::selector& sel, unsigned entries = kDefaultEntries);
+
+      // Has the writer been created?
+      bool created() const;
+
+      // Queue write (returns false if there is no room, the write has to
+      // be done synchronously then).
+      bool write(int fd,
+                 const void* buf,
+                 size_t count,
+                 off_t offset,
+                 uint64_t user_data);
+
+      // Submit the queued writes.
+      void submit();
+
+      // Get next completion (returns false if there is none).
+      bool completion(uint64_t& user_data, int& res);
+
+      // Wait for at least one completion.
+      bool wait();
+
+      // Get number of writes which have not completed yet.
+      unsigned inflight() const;
+
+      // On I/O (the completions are collected with completion()).
+      io::event_handler::result on_io(io::event events);
+
+    private:
+      int _M_fd;
+
+      // Submission queue.
+      void* _M_sq_ring;
+      size_t _M_sq_ring_size;
+      unsigned* _M_sq_head;
+      unsigned* _M_sq_tail;
+      unsigned _M_sq_mask;
+      unsigned _M_sq_entries;
+      unsigned* _M_sq_array;
+
+      struct io_uring_sqe* _M_sqes;
+
+      // Completion queue (shares the mapping of the submission queue if
+      // the kernel supports it).
+      void* _M_cq_ring;
+      size_t _M_cq_ring_size;
+      unsigned* _M_cq_head;
+      unsigned* _M_cq_tail;
+      unsigned _M_cq_mask;
+      unsigned _M_cq_entries;
+      struct io_uring_cqe* _M_cqes;
+
+      // Number of queued writes which have not been submitted yet.
+      unsigned _M_queued;
+
+      unsigned _M_inflight;
+
+      // Enter the kernel.
+      int enter(unsigned to_submit, unsigned min_complete, unsigned flags);
+
+      // Free resources.
+      void free();
+
+      // Disable copy constructor and assignment operator.
+      uring_writer(const uring_writer&) = delete;
+      uring_writer& operator=(const uring_writer&) = delete;
+  };
+
+  inline uring_writer::uring_writer()
+    : _M_fd(-1),
+      _M_sq_ring(NULL),
+      _M_sq_ring_size(0),
+      _M_sq_entries(0),
+      _M_sqes(NULL),
+      _M_cq_ring(NULL),
+      _M_cq_ring_size(0),
+      _M_cq_entries(0),
+      _M_queued(0),
+      _M_inflight(0)
+  {
+  }
+
+  inline uring_writer::~uring_writer()
+  {
+    free();
+  }
+
+  inline bool uring_writer::created() const
+  {
+    return (_M_fd != -1);
+  }
+
+  inline void uring_writer::submit()
+  {
+    if (_M_queued > 0) {
+      enter(_M_queued, 0, 0);
+    }
+  }
+
+  inline bool uring_writer::wait()
+  {
+    return (enter(_M_queued, 1, IORING_ENTER_GETEVENTS) >= 0);
+  }
+
+  inline unsigned uring_writer::inflight() const
+  {
+    return _M_inflight;
+  }
+
+  inline io::event_handler::result uring_writer::on_io(io::event events)
+  {
+    return io::event_handler::result::kSuccess;
+  }
+}
+
+#endif // FS_URING_WRITER_H
@@ -0,0 +1,92 @@
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/inotify.h>
+#include "fs/watcher.h"
+
+bool fs::watcher::create(net::selector& sel, const char* pathname)
+{
+  char dir[PATH_MAX];
+  const char* filename;
+
+  // Split pathname into directory and filename.
+  const char* last_slash;
+  if ((last_slash = strrchr(pathname, '/')) != NULL) {
+    size_t dirlen = last_slash - pathname + 1;
+    if (dirlen >= sizeof(dir)) {
+      return false;
+    }
+
+    memcpy(dir, pathname, dirlen);
+    dir[dirlen] = 0;
+
+    filename = last_slash + 1;
+  } else {
+    dir[0] = '.';
+    dir[1] = 0;
+
+    filename = pathname;
+  }
+
+  size_t len;
+  if ((len = strlen(filename)) >= sizeof(_M_filename)) {
+    return false;
+  }
+
+  memcpy(_M_filename, filename, len + 1);
+
+  if ((_M_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) {
+    return false;
+  }
+
+  // The file is ready when the writer closes it or when it is moved into
+  // the directory.
+  if (inotify_add_watch(_M_fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+    close(_M_fd);
+    _M_fd = -1;
+
+    return false;
+  }
+
+  if (!sel.add(_M_fd, net::fdtype::kFdInotify, this, io::event::kRead)) {
+    close(_M_fd);
+    _M_fd = -1;
+
+    return false;
+  }
+
+  return true;
+}
+
+io::event_handler::result fs::watcher::on_io(io::event events)
+{
+  char buf[16 * (sizeof(struct inotify_event) + NAME_MAX + 1)];
+
+  do {
+    ssize_t ret;
+    if ((ret = read(_M_fd, buf, sizeof(buf))) < 0) {
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+        return io::event_handler::result::kSuccess;
+      } else if (errno != EINTR) {
+        return io::event_handler::result::kError;
+      }
+    } else {
+      const char* ptr = buf;
+      const char* end = buf + ret;
+
+      while (ptr < end) {
+        const struct inotify_event* ev =
+          reinterpret_cast<const struct inotify_event*>(ptr);
+
+        // If events have been lost or the file has been written /
+        // moved...
+        if ((ev->mask & IN_Q_OVERFLOW) ||
+            ((ev->len > 0) && (strcmp(ev->name, _M_filename) == 0))) {
+          _M_changed = true;
+        }
+
+        ptr += sizeof(struct inotify_event) + ev->len;
+      }
+    }
+  } while (true);
+}
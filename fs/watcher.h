@@ -0,0 +1,60 @@
+#ifndef FS_WATCHER_H
+#define FS_WATCHER_H
+
+#include <limits.h>
+#include "net/selector.h"
+#include "io/event_handler.h"
+
+namespace fs {
+  // Notifies when a file has been written or moved into its directory
+  // (inotify).
+  class watcher : public io::event_handler {
+    public:
+      // Constructor.
+      watcher();
+
+      // Destructor.
+      ~watcher();
+
+      // Create.
+      bool create(net::selector& sel, const char* pathname);
+
+      // Has the file been written or moved since the last call?
+      bool changed();
+
+      // On I/O.
+      io::event_handler::result on_io(io::event events);
+
+    private:
+      int _M_fd;
+
+      char _M_filename[NAME_MAX + 1];
+
+      bool _M_changed;
+
+      // Disable copy constructor and assignment operator.
+      watcher(const watcher&) = delete;
+      watcher& operator=(const watcher&) = delete;
+  };
+
+  inline watcher::watcher()
+    : _M_fd(-1),
+      _M_changed(false)
+  {
+  }
+
+  inline watcher::~watcher()
+  {
+    // The descriptor is closed by the selector.
+  }
+
+  inline bool watcher::changed()
+  {
+    bool changed = _M_changed;
+    _M_changed = false;
+
+    return changed;
+  }
+}
+
+#endif // FS_WATCHER_H
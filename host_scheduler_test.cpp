@@ -0,0 +1,417 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <inttypes.h>
+#include "net/http/host_scheduler.h"
+
+// Feeds a file sorted by host (a slow host with many URLs followed by a few
+// fast hosts) to a host_scheduler, like a worker does, and checks that the
+// fast hosts keep the connections busy while the slow host still has URLs
+// queued. It is run twice: without spilling, taking URLs from the input
+// only while fewer than kMaxQueuedUrls are queued (as the workers did), and
+// with a spill file.
+// A second run checks the delay between requests to the same host with
+// many hosts waiting for their delay.
+
+static const unsigned kConnections = 40;
+static const unsigned kMaxHostConnections = 8;
+
+static const size_t kMaxQueuedUrls = 1024;
+static const size_t kMaxHostQueuedUrls = 64;
+
+// URLs taken from the input per tick (size of the queue of a worker).
+static const size_t kQueueSize = 1024;
+
+static const unsigned kSlowUrls = 20000;
+static const unsigned kSlowTicks = 10; // Duration of a request.
+
+static const unsigned kFastHosts = 4;
+static const unsigned kFastUrls = 500;
+
+static const unsigned kMaxTicks = 100000;
+
+static const unsigned kDelayHosts = 1000;
+static const unsigned kDelayUrls = 3;
+static const unsigned kDelay = 100; // Ticks.
+
+struct url {
+  char host[16];
+  unsigned n;
+
+  bool save(string::buffer& buf) const
+  {
+    return buf.format("%s %u", host, n);
+  }
+
+  bool load(const char* line, size_t len)
+  {
+    const char* space;
+    if ((space = static_cast<const char*>(memchr(line, ' ', len))) == NULL) {
+      return false;
+    }
+
+    size_t hostlen = space - line;
+    if ((hostlen == 0) || (hostlen >= sizeof(host))) {
+      return false;
+    }
+
+    memcpy(host, line, hostlen);
+    host[hostlen] = 0;
+
+    n = strtoul(space + 1, NULL, 10);
+
+    return true;
+  }
+};
+
+struct result {
+  // Ticks at which the first and the last URL of the fast hosts were sent.
+  unsigned fast_start;
+  unsigned fast_done;
+
+  // Busy connections (%) in between.
+  unsigned busy;
+
+  // Were the URLs of each host sent once and in order?
+  bool ordered;
+
+  size_t max_spilled;
+};
+
+static void input(unsigned i, url& u)
+{
+  if (i < kSlowUrls) {
+    strcpy(u.host, "slow");
+    u.n = i;
+  } else {
+    i -= kSlowUrls;
+
+    snprintf(u.host, sizeof(u.host), "fast%u", i / kFastUrls);
+    u.n = i % kFastUrls;
+  }
+}
+
+static bool run(bool spill, result& res)
+{
+  net::http::host_scheduler<url> hosts;
+  if (!hosts.create(kConnections,
+                    spill ? "host_scheduler_test.spill" : NULL)) {
+    fprintf(stderr, "Error creating host scheduler.\n");
+    return false;
+  }
+
+  hosts.max_connections(kMaxHostConnections);
+
+  if (spill) {
+    hosts.max_queued(kMaxHostQueuedUrls, kMaxQueuedUrls);
+  }
+
+  // End of the request of each connection.
+  unsigned ends[kConnections];
+  bool used[kConnections];
+  memset(used, 0, sizeof(used));
+
+  // Next URL expected from each host (0: slow host).
+  unsigned next[1 + kFastHosts];
+  memset(next, 0, sizeof(next));
+
+  const unsigned total = kSlowUrls + kFastHosts * kFastUrls;
+  unsigned read = 0;
+  unsigned fast_sent = 0;
+  uint64_t busy = 0;
+
+  res.fast_start = 0;
+  res.fast_done = 0;
+  res.ordered = true;
+  res.max_spilled = 0;
+
+  for (unsigned tick = 0; tick < kMaxTicks; tick++) {
+    // Finished requests.
+    for (unsigned fd = 0; fd < kConnections; fd++) {
+      if ((used[fd]) && (ends[fd] == tick)) {
+        hosts.release(fd, tick);
+        used[fd] = false;
+      }
+    }
+
+    // Take URLs from the input.
+    for (size_t i = 0;
+         (i < kQueueSize) &&
+         (read < total) &&
+         ((spill) || (hosts.count() < kMaxQueuedUrls));
+         i++) {
+      url u;
+      input(read++, u);
+
+      if (!hosts.push(string::slice(u.host, strlen(u.host)),
+                      80,
+                      util::move(u))) {
+        fprintf(stderr, "Error queueing URL.\n");
+        return false;
+      }
+    }
+
+    if (hosts.spilled() > res.max_spilled) {
+      res.max_spilled = hosts.spilled();
+    }
+
+    // Send requests.
+    for (unsigned fd = 0; fd < kConnections; fd++) {
+      if (!used[fd]) {
+        url u;
+        if (!hosts.pop(tick, u)) {
+          break;
+        }
+
+        if (!hosts.acquire(fd,
+                           string::slice(u.host, strlen(u.host)),
+                           80,
+                           tick)) {
+          fprintf(stderr, "Error acquiring connection.\n");
+          return false;
+        }
+
+        unsigned h = (strcmp(u.host, "slow") == 0) ?
+                       0 :
+                       1 + atoi(u.host + 4);
+
+        if (u.n != next[h]++) {
+          res.ordered = false;
+        }
+
+        ends[fd] = tick + ((h == 0) ? kSlowTicks : 1);
+        used[fd] = true;
+
+        if (h != 0) {
+          if (fast_sent++ == 0) {
+            res.fast_start = tick;
+          }
+
+          if (fast_sent == kFastHosts * kFastUrls) {
+            res.fast_done = tick;
+          }
+        }
+      }
+    }
+
+    if (fast_sent > 0) {
+      for (unsigned fd = 0; fd < kConnections; fd++) {
+        if (used[fd]) {
+          busy++;
+        }
+      }
+
+      if (res.fast_done) {
+        res.busy = (busy * 100) /
+                   ((res.fast_done - res.fast_start + 1) * kConnections);
+
+        break;
+      }
+    }
+  }
+
+  if (!res.fast_done) {
+    fprintf(stderr, "The URLs of the fast hosts were not sent.\n");
+    return false;
+  }
+
+  // Drain the slow host (the connections are not used anymore).
+  for (unsigned fd = 0; fd < kConnections; fd++) {
+    hosts.release(fd, res.fast_done);
+  }
+
+  url u;
+  while (hosts.pop(res.fast_done, u)) {
+    if ((strcmp(u.host, "slow") != 0) || (u.n != next[0]++)) {
+      res.ordered = false;
+    }
+
+    // Take the rest of the input.
+    while ((read < total) &&
+           ((spill) || (hosts.count() < kMaxQueuedUrls))) {
+      url in;
+      input(read++, in);
+
+      if (!hosts.push(string::slice(in.host, strlen(in.host)),
+                      80,
+                      util::move(in))) {
+        return false;
+      }
+    }
+  }
+
+  if (next[0] != kSlowUrls) {
+    res.ordered = false;
+  }
+
+  return true;
+}
+
+// Send the URLs of kDelayHosts hosts (one connection per host, requests of
+// a tick) and check that each host is sent a request every kDelay ticks.
+static bool run_delay(unsigned& done, uint64_t& failed_pop)
+{
+  net::http::host_scheduler<url> hosts;
+  if (!hosts.create(kDelayHosts, NULL)) {
+    fprintf(stderr, "Error creating host scheduler.\n");
+    return false;
+  }
+
+  hosts.max_connections(1);
+  hosts.delay(kDelay);
+
+  for (unsigned n = 0; n < kDelayUrls; n++) {
+    for (unsigned i = 0; i < kDelayHosts; i++) {
+      url u;
+      snprintf(u.host, sizeof(u.host), "d%u", i);
+      u.n = n;
+
+      if (!hosts.push(string::slice(u.host, strlen(u.host)),
+                      80,
+                      util::move(u))) {
+        fprintf(stderr, "Error queueing URL.\n");
+        return false;
+      }
+    }
+  }
+
+  // Tick at which each host was sent its last request.
+  unsigned last[kDelayHosts];
+  unsigned next[kDelayHosts];
+  memset(next, 0, sizeof(next));
+
+  unsigned sent = 0;
+  bool ok = true;
+
+  for (unsigned tick = 0;
+       (tick < kMaxTicks) && (sent < kDelayHosts * kDelayUrls);
+       tick++) {
+    // The requests of the previous tick have finished.
+    for (unsigned fd = 0; fd < kDelayHosts; fd++) {
+      hosts.release(fd, tick);
+    }
+
+    for (unsigned fd = 0; fd < kDelayHosts; fd++) {
+      url u;
+      if (!hosts.pop(tick, u)) {
+        break;
+      }
+
+      if (!hosts.acquire(fd,
+                         string::slice(u.host, strlen(u.host)),
+                         80,
+                         tick)) {
+        fprintf(stderr, "Error acquiring connection.\n");
+        return false;
+      }
+
+      unsigned h = atoi(u.host + 1);
+
+      if ((u.n != next[h]++) || ((u.n > 0) && (tick - last[h] < kDelay))) {
+        ok = false;
+      }
+
+      last[h] = tick;
+      done = tick;
+
+      sent++;
+    }
+  }
+
+  // Cost of a pop when all the hosts are waiting for their delay.
+  for (unsigned i = 0; i < kDelayHosts; i++) {
+    url u;
+    snprintf(u.host, sizeof(u.host), "d%u", i);
+    u.n = 0;
+
+    if (!hosts.push(string::slice(u.host, strlen(u.host)),
+                    80,
+                    util::move(u))) {
+      return false;
+    }
+  }
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  static const unsigned kPops = 100000;
+  for (unsigned i = 0; i < kPops; i++) {
+    url u;
+    if (hosts.pop(done, u)) {
+      ok = false;
+    }
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  failed_pop = ((end.tv_sec - start.tv_sec) * 1000000000ull +
+                end.tv_nsec - start.tv_nsec) / kPops;
+
+  return ((ok) && (sent == kDelayHosts * kDelayUrls));
+}
+
+int main()
+{
+  result without, with;
+  if ((!run(false, without)) || (!run(true, with))) {
+    return -1;
+  }
+
+  printf("Without spilling: the fast hosts were sent requests from tick %u "
+         "to tick %u, %u%% of the connections busy.\n",
+         without.fast_start,
+         without.fast_done,
+         without.busy);
+
+  printf("With spilling: the fast hosts were sent requests from tick %u to "
+         "tick %u, %u%% of the connections busy, %zu URLs spilled.\n",
+         with.fast_start,
+         with.fast_done,
+         with.busy,
+         with.max_spilled);
+
+  // The input is read in ticks of kQueueSize URLs, and each fast host is
+  // sent kMaxHostConnections requests per tick.
+  const unsigned total = kSlowUrls + kFastHosts * kFastUrls;
+  const unsigned read = (total + kQueueSize - 1) / kQueueSize;
+  const unsigned send = (kFastUrls + kMaxHostConnections - 1) /
+                        kMaxHostConnections;
+
+  if ((!with.ordered) || (!without.ordered)) {
+    printf("FAILED: the URLs of a host were not sent once and in order.\n");
+    return -1;
+  }
+
+  if ((with.fast_start > read) ||
+      (with.fast_done - with.fast_start > send) ||
+      (with.busy < 90)) {
+    printf("FAILED: the fast hosts didn't keep the connections busy.\n");
+    return -1;
+  }
+
+  unsigned done;
+  uint64_t failed_pop;
+  if (!run_delay(done, failed_pop)) {
+    printf("FAILED: the delay between requests to a host was not kept.\n");
+    return -1;
+  }
+
+  printf("Delay: %u hosts, %u URLs each, the last URL was sent at tick %u, "
+         "%" PRIu64 " ns per pop while all the hosts are delayed.\n",
+         kDelayHosts,
+         kDelayUrls,
+         done,
+         failed_pop);
+
+  // The last URLs can be sent kDelay ticks after the previous ones.
+  if (done > (kDelayUrls - 1) * (kDelay + 1)) {
+    printf("FAILED: the hosts were not sent requests when their delay "
+           "expired.\n");
+    return -1;
+  }
+
+  printf("OK.\n");
+
+  return 0;
+}
@@ -10,6 +10,47 @@
 
 static net::http::downloader downloader;
 
+// Options for setting the timeouts of the phases of the requests.
+struct timeout_option {
+  const char* name;
+  net::http::client::phase phase;
+  unsigned default_value;
+};
+
+static const timeout_option timeout_options[] = {
+  {
+    "--connect-timeout",
+    net::http::client::phase::kConnecting,
+    net::http::downloader::kDefaultConnectTimeout
+  },
+  {
+    "--handshake-timeout",
+    net::http::client::phase::kPerformingHandshake,
+    net::http::downloader::kDefaultHandshakeTimeout
+  },
+  {
+    "--first-byte-timeout",
+    net::http::client::phase::kWaitingForResponse,
+    net::http::downloader::kDefaultFirstByteTimeout
+  },
+  {
+    "--headers-timeout",
+    net::http::client::phase::kReceivingHeaders,
+    net::http::downloader::kDefaultHeadersTimeout
+  },
+  {
+    "--body-timeout",
+    net::http::client::phase::kReceivingBody,
+    net::http::downloader::kDefaultBodyTimeout
+  },
+  {
+    "--write-timeout",
+    net::http::client::phase::kWritingFile,
+    net::http::downloader::kDefaultWriteTimeout
+  }
+};
+
+static const timeout_option* find_timeout_option(const char* name);
 static void usage(const char* program);
 static void signal_handler(int nsignal);
 
@@ -29,6 +70,30 @@ int main(int argc, const char** argv)
 #endif
 
   const char* user_agent = NULL;
+  const char* nameserver = NULL;
+
+  uint32_t idle_timeout = net::http::downloader::kDefaultIdleTimeout;
+  uint32_t pipelining_depth = net::http::downloader::kDefaultPipeliningDepth;
+  uint32_t max_host_connections =
+             net::http::downloader::kDefaultHostConnections;
+  uint32_t host_delay = net::http::downloader::kDefaultHostDelay;
+  uint32_t ranges = net::http::downloader::kDefaultRanges;
+  uint32_t ranges_min_size = net::http::downloader::kDefaultRangesMinSize;
+  uint32_t segment_size = net::http::downloader::kDefaultSegmentSize;
+  uint32_t flush_threshold = net::http::downloader::kDefaultFlushThreshold;
+  uint32_t max_body_size = net::http::downloader::kDefaultMaxBodySize;
+  uint32_t resume_min_size = net::http::downloader::kDefaultResumeMinSize;
+  net::http::client::body_limit_action body_limit_action =
+    net::http::client::body_limit_action::kDiscard;
+  uint32_t threads = net::http::downloader::kDefaultThreads;
+  uint32_t checkpoint_interval =
+    net::http::downloader::kDefaultCheckpointInterval;
+  net::http::seen_set::mode dedup = net::http::seen_set::mode::kNone;
+  uint32_t dedup_memory = net::http::downloader::kDefaultDedupMemory;
+  uint32_t total_timeout = net::http::downloader::kDefaultTotalTimeout;
+  uint32_t min_speed = net::http::downloader::kDefaultMinSpeed;
+
+  const timeout_option* opt;
 
   // Check arguments.
   int i = 1;
@@ -80,6 +145,446 @@ int main(int argc, const char** argv)
 
       user_agent = argv[i + 1];
 
+      i += 2;
+    } else if (strcasecmp(argv[i], "--nameserver") == 0) {
+      // Last argument?
+      if (i + 1 == argc) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      nameserver = argv[i + 1];
+
+      i += 2;
+    } else if (strcasecmp(argv[i], "--idle-timeout") == 0) {
+      // Last argument?
+      if (i + 1 == argc) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      if (util::number::parse(argv[i + 1],
+                              strlen(argv[i + 1]),
+                              idle_timeout,
+                              0,
+                              net::http::downloader::kMaxIdleTimeout) !=
+          util::number::parse_result::kSucceeded) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      i += 2;
+    } else if (strcasecmp(argv[i], "--pipelining-depth") == 0) {
+      // Last argument?
+      if (i + 1 == argc) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      if (util::number::parse(argv[i + 1],
+                              strlen(argv[i + 1]),
+                              pipelining_depth,
+                              net::http::downloader::kMinPipeliningDepth,
+                              net::http::downloader::kMaxPipeliningDepth) !=
+          util::number::parse_result::kSucceeded) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      i += 2;
+    } else if (strcasecmp(argv[i], "--max-host-connections") == 0) {
+      // Last argument?
+      if (i + 1 == argc) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      if (util::number::parse(argv[i + 1],
+                              strlen(argv[i + 1]),
+                              max_host_connections,
+                              net::http::downloader::kMinHostConnections,
+                              net::http::downloader::kMaxHostConnections) !=
+          util::number::parse_result::kSucceeded) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      i += 2;
+    } else if (strcasecmp(argv[i], "--host-delay") == 0) {
+      // Last argument?
+      if (i + 1 == argc) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      if (util::number::parse(argv[i + 1],
+                              strlen(argv[i + 1]),
+                              host_delay,
+                              0,
+                              net::http::downloader::kMaxHostDelay) !=
+          util::number::parse_result::kSucceeded) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      i += 2;
+    } else if (strcasecmp(argv[i], "--ranges") == 0) {
+      // Last argument?
+      if (i + 1 == argc) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      if (util::number::parse(argv[i + 1],
+                              strlen(argv[i + 1]),
+                              ranges,
+                              net::http::downloader::kMinRanges,
+                              net::http::downloader::kMaxRanges) !=
+          util::number::parse_result::kSucceeded) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      i += 2;
+    } else if (strcasecmp(argv[i], "--ranges-min-size") == 0) {
+      // Last argument?
+      if (i + 1 == argc) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      if (util::number::parse(argv[i + 1],
+                              strlen(argv[i + 1]),
+                              ranges_min_size,
+                              net::http::downloader::kMinRangesMinSize,
+                              net::http::downloader::kMaxRangesMinSize) !=
+          util::number::parse_result::kSucceeded) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      i += 2;
+    } else if (strcasecmp(argv[i], "--output") == 0) {
+      // Last argument?
+      if (i + 1 == argc) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      if (strcasecmp(argv[i + 1], "files") == 0) {
+        downloader.output(net::http::worker::output_mode::kFiles);
+      } else if (strcasecmp(argv[i + 1], "archive") == 0) {
+        downloader.output(net::http::worker::output_mode::kArchive);
+      } else {
+        usage(argv[0]);
+        return -1;
+      }
+
+      i += 2;
+    } else if (strcasecmp(argv[i], "--segment-size") == 0) {
+      // Last argument?
+      if (i + 1 == argc) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      if (util::number::parse(argv[i + 1],
+                              strlen(argv[i + 1]),
+                              segment_size,
+                              net::http::downloader::kMinSegmentSize,
+                              net::http::downloader::kMaxSegmentSize) !=
+          util::number::parse_result::kSucceeded) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      i += 2;
+    } else if (strcasecmp(argv[i], "--flush-threshold") == 0) {
+      // Last argument?
+      if (i + 1 == argc) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      if (util::number::parse(argv[i + 1],
+                              strlen(argv[i + 1]),
+                              flush_threshold,
+                              net::http::downloader::kMinFlushThreshold,
+                              net::http::downloader::kMaxFlushThreshold) !=
+          util::number::parse_result::kSucceeded) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      i += 2;
+    } else if (strcasecmp(argv[i], "--content-encoding") == 0) {
+      // Last argument?
+      if (i + 1 == argc) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      if (strcasecmp(argv[i + 1], "identity") == 0) {
+        downloader.accept_encoding(
+          net::http::client::content_encoding::kIdentity
+        );
+      } else if (strcasecmp(argv[i + 1], "raw") == 0) {
+        downloader.accept_encoding(net::http::client::content_encoding::kRaw);
+#if HAVE_ZLIB
+      } else if (strcasecmp(argv[i + 1], "decoded") == 0) {
+        downloader.accept_encoding(
+          net::http::client::content_encoding::kDecoded
+        );
+#endif
+      } else {
+        usage(argv[0]);
+        return -1;
+      }
+
+      i += 2;
+    } else if (strcasecmp(argv[i], "--max-body-size") == 0) {
+      // Last argument?
+      if (i + 1 == argc) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      if (util::number::parse(argv[i + 1],
+                              strlen(argv[i + 1]),
+                              max_body_size,
+                              0,
+                              net::http::downloader::kMaxMaxBodySize) !=
+          util::number::parse_result::kSucceeded) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      i += 2;
+    } else if (strcasecmp(argv[i], "--oversized-body") == 0) {
+      // Last argument?
+      if (i + 1 == argc) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      if (strcasecmp(argv[i + 1], "discard") == 0) {
+        body_limit_action = net::http::client::body_limit_action::kDiscard;
+      } else if (strcasecmp(argv[i + 1], "truncate") == 0) {
+        body_limit_action = net::http::client::body_limit_action::kTruncate;
+      } else {
+        usage(argv[0]);
+        return -1;
+      }
+
+      i += 2;
+    } else if (strcasecmp(argv[i], "--filter-status") == 0) {
+      // Last argument?
+      if (i + 1 == argc) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      if (!downloader.filter_status_codes(argv[i + 1])) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      i += 2;
+    } else if (strcasecmp(argv[i], "--filter-content-type") == 0) {
+      // Last argument?
+      if (i + 1 == argc) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      if (!downloader.filter_content_types(argv[i + 1])) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      i += 2;
+    } else if (strcasecmp(argv[i], "--filter-content-length") == 0) {
+      // Last argument?
+      if (i + 1 == argc) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      uint32_t kilobytes;
+      if (util::number::parse(argv[i + 1],
+                              strlen(argv[i + 1]),
+                              kilobytes,
+                              0,
+                              net::http::downloader::kMaxFilterContentLength) !=
+          util::number::parse_result::kSucceeded) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      downloader.filter_content_length(kilobytes);
+
+      i += 2;
+    } else if (strcasecmp(argv[i], "--resume-min-size") == 0) {
+      // Last argument?
+      if (i + 1 == argc) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      if (util::number::parse(argv[i + 1],
+                              strlen(argv[i + 1]),
+                              resume_min_size,
+                              0,
+                              net::http::downloader::kMaxResumeMinSize) !=
+          util::number::parse_result::kSucceeded) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      i += 2;
+    } else if (strcasecmp(argv[i], "--revisit") == 0) {
+      // Last argument?
+      if (i + 1 == argc) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      // Open the indexes of the previous run.
+      if (!downloader.revisit(argv[i + 1])) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      i += 2;
+    } else if (strcasecmp(argv[i], "--threads") == 0) {
+      // Last argument?
+      if (i + 1 == argc) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      if (util::number::parse(argv[i + 1],
+                              strlen(argv[i + 1]),
+                              threads,
+                              net::http::downloader::kMinThreads,
+                              net::http::downloader::kMaxThreads) !=
+          util::number::parse_result::kSucceeded) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      i += 2;
+    } else if (strcasecmp(argv[i], "--checkpoint-interval") == 0) {
+      // Last argument?
+      if (i + 1 == argc) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      if (util::number::parse(argv[i + 1],
+                              strlen(argv[i + 1]),
+                              checkpoint_interval,
+                              0,
+                              net::http::downloader::kMaxCheckpointInterval) !=
+          util::number::parse_result::kSucceeded) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      i += 2;
+    } else if (strcasecmp(argv[i], "--dedup") == 0) {
+      // Last argument?
+      if (i + 1 == argc) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      if (strcasecmp(argv[i + 1], "none") == 0) {
+        dedup = net::http::seen_set::mode::kNone;
+      } else if (strcasecmp(argv[i + 1], "filter") == 0) {
+        dedup = net::http::seen_set::mode::kFilter;
+      } else if (strcasecmp(argv[i + 1], "exact") == 0) {
+        dedup = net::http::seen_set::mode::kExact;
+      } else {
+        usage(argv[0]);
+        return -1;
+      }
+
+      i += 2;
+    } else if (strcasecmp(argv[i], "--dedup-memory") == 0) {
+      // Last argument?
+      if (i + 1 == argc) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      if (util::number::parse(argv[i + 1],
+                              strlen(argv[i + 1]),
+                              dedup_memory,
+                              net::http::downloader::kMinDedupMemory,
+                              net::http::downloader::kMaxDedupMemory) !=
+          util::number::parse_result::kSucceeded) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      i += 2;
+    } else if ((opt = find_timeout_option(argv[i])) != NULL) {
+      // Last argument?
+      if (i + 1 == argc) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      uint32_t timeout;
+      if (util::number::parse(argv[i + 1],
+                              strlen(argv[i + 1]),
+                              timeout,
+                              net::http::downloader::kMinTimeout,
+                              net::http::downloader::kMaxTimeout) !=
+          util::number::parse_result::kSucceeded) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      downloader.timeout(opt->phase, timeout);
+
+      i += 2;
+    } else if (strcasecmp(argv[i], "--total-timeout") == 0) {
+      // Last argument?
+      if (i + 1 == argc) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      if (util::number::parse(argv[i + 1],
+                              strlen(argv[i + 1]),
+                              total_timeout,
+                              0,
+                              net::http::downloader::kMaxTotalTimeout) !=
+          util::number::parse_result::kSucceeded) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      i += 2;
+    } else if (strcasecmp(argv[i], "--min-speed") == 0) {
+      // Last argument?
+      if (i + 1 == argc) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      if (util::number::parse(argv[i + 1],
+                              strlen(argv[i + 1]),
+                              min_speed,
+                              0,
+                              net::http::downloader::kMaxMinSpeed) !=
+          util::number::parse_result::kSucceeded) {
+        usage(argv[0]);
+        return -1;
+      }
+
       i += 2;
     } else {
       usage(argv[0]);
@@ -87,6 +592,33 @@ int main(int argc, const char** argv)
     }
   }
 
+  if (nameserver) {
+    net::socket_address addr;
+    if ((!addr.build(nameserver, net::dns::resolver::kDefaultPort)) &&
+        (!addr.build(nameserver))) {
+      usage(argv[0]);
+      return -1;
+    }
+
+    downloader.nameserver(addr);
+  }
+
+  downloader.max_connections(max_connections);
+  downloader.idle_timeout(idle_timeout);
+  downloader.total_timeout(total_timeout);
+  downloader.min_speed(min_speed);
+  downloader.pipelining_depth(pipelining_depth);
+  downloader.max_host_connections(max_host_connections);
+  downloader.host_delay(host_delay);
+  downloader.ranges(ranges, ranges_min_size);
+  downloader.segment_size(segment_size);
+  downloader.flush_threshold(flush_threshold);
+  downloader.max_body_size(max_body_size, body_limit_action);
+  downloader.resume_min_size(resume_min_size);
+  downloader.threads(threads);
+  downloader.checkpoint_interval(checkpoint_interval);
+  downloader.dedup(dedup, dedup_memory);
+
   if (!downloader.create(urls_file, dir)) {
     fprintf(stderr, "Couldn't create downloader.\n");
     return -1;
@@ -97,8 +629,6 @@ int main(int argc, const char** argv)
     return -1;
   }
 
-  downloader.max_connections(max_connections);
-
 #if HAVE_SSL
   if (!net::ssl_socket::init_ssl_library()) {
     fprintf(stderr, "Couldn't initialize SSL library.\n");
@@ -116,13 +646,31 @@ int main(int argc, const char** argv)
   sigaction(SIGTERM, &act, NULL);
   sigaction(SIGINT, &act, NULL);
 
-  downloader.start();
+  int ret = 0;
+
+  if (!downloader.start()) {
+    fprintf(stderr, "Couldn't start downloader.\n");
+    ret = -1;
+  }
 
 #if HAVE_SSL
   net::ssl_socket::free_ssl_library();
 #endif
 
-  return 0;
+  return ret;
+}
+
+const timeout_option* find_timeout_option(const char* name)
+{
+  for (size_t i = 0;
+       i < sizeof(timeout_options) / sizeof(timeout_options[0]);
+       i++) {
+    if (strcasecmp(name, timeout_options[i].name) == 0) {
+      return &timeout_options[i];
+    }
+  }
+
+  return NULL;
 }
 
 void usage(const char* program)
@@ -142,6 +690,94 @@ void usage(const char* program)
          net::http::downloader::kDefaultConnections);
 
   printf("\t--user-agent <user-agent> (default: \"\").\n");
+  printf("\t--nameserver <address>[:<port>] (default: from %s).\n",
+         net::dns::resolver::kResolvConf);
+  printf("\t--idle-timeout <seconds> (0 - %u, default: %u, 0: don't reuse "
+         "connections).\n",
+         net::http::downloader::kMaxIdleTimeout,
+         net::http::downloader::kDefaultIdleTimeout);
+  printf("\t--pipelining-depth <depth> (%u - %u, default: %u).\n",
+         net::http::downloader::kMinPipeliningDepth,
+         net::http::downloader::kMaxPipeliningDepth,
+         net::http::downloader::kDefaultPipeliningDepth);
+  printf("\t--max-host-connections <max-connections> (%u - %u, "
+         "default: %u).\n",
+         net::http::downloader::kMinHostConnections,
+         net::http::downloader::kMaxHostConnections,
+         net::http::downloader::kDefaultHostConnections);
+  printf("\t--host-delay <milliseconds> (0 - %u, default: %u).\n",
+         net::http::downloader::kMaxHostDelay,
+         net::http::downloader::kDefaultHostDelay);
+  printf("\t--ranges <ranges> (%u - %u, default: %u).\n",
+         net::http::downloader::kMinRanges,
+         net::http::downloader::kMaxRanges,
+         net::http::downloader::kDefaultRanges);
+  printf("\t--ranges-min-size <kilobytes> (%u - %u, default: %u).\n",
+         net::http::downloader::kMinRangesMinSize,
+         net::http::downloader::kMaxRangesMinSize,
+         net::http::downloader::kDefaultRangesMinSize);
+  printf("\t--output <files|archive> (default: files).\n");
+  printf("\t--segment-size <megabytes> (%u - %u, default: %u).\n",
+         net::http::downloader::kMinSegmentSize,
+         net::http::downloader::kMaxSegmentSize,
+         net::http::downloader::kDefaultSegmentSize);
+  printf("\t--flush-threshold <kilobytes> (%u - %u, default: %u).\n",
+         net::http::downloader::kMinFlushThreshold,
+         net::http::downloader::kMaxFlushThreshold,
+         net::http::downloader::kDefaultFlushThreshold);
+#if HAVE_ZLIB
+  printf("\t--content-encoding <identity|raw|decoded> (default: decoded).\n");
+#else
+  printf("\t--content-encoding <identity|raw> (default: identity).\n");
+#endif
+  printf("\t--max-body-size <kilobytes> (0 - %u, default: %u, 0: no "
+         "limit).\n",
+         net::http::downloader::kMaxMaxBodySize,
+         net::http::downloader::kDefaultMaxBodySize);
+  printf("\t--oversized-body <discard|truncate> (default: discard).\n");
+  printf("\t--filter-status <codes> (e.g. 200,300-399, default: all).\n");
+  printf("\t--filter-content-type <types> (e.g. text/html,text/*, "
+         "default: all).\n");
+  printf("\t--filter-content-length <kilobytes> (0 - %u, default: no "
+         "limit).\n",
+         net::http::downloader::kMaxFilterContentLength);
+  printf("\t--resume-min-size <kilobytes> (0 - %u, default: %u, 0: don't "
+         "resume).\n",
+         net::http::downloader::kMaxResumeMinSize,
+         net::http::downloader::kDefaultResumeMinSize);
+  printf("\t--revisit <directory of a previous run> (default: don't "
+         "revisit).\n");
+  printf("\t--threads <threads> (%u - %u, default: %u).\n",
+         net::http::downloader::kMinThreads,
+         net::http::downloader::kMaxThreads,
+         net::http::downloader::kDefaultThreads);
+  printf("\t--checkpoint-interval <seconds> (0 - %u, default: %u, 0: no "
+         "checkpoints).\n",
+         net::http::downloader::kMaxCheckpointInterval,
+         net::http::downloader::kDefaultCheckpointInterval);
+  printf("\t--dedup <none|filter|exact> (default: none).\n");
+  printf("\t--dedup-memory <megabytes> (%u - %u, default: %u).\n",
+         net::http::downloader::kMinDedupMemory,
+         net::http::downloader::kMaxDedupMemory,
+         net::http::downloader::kDefaultDedupMemory);
+
+  for (size_t i = 0;
+       i < sizeof(timeout_options) / sizeof(timeout_options[0]);
+       i++) {
+    printf("\t%s <seconds> (%u - %u, default: %u).\n",
+           timeout_options[i].name,
+           net::http::downloader::kMinTimeout,
+           net::http::downloader::kMaxTimeout,
+           timeout_options[i].default_value);
+  }
+
+  printf("\t--total-timeout <seconds> (0 - %u, default: %u, 0: no limit).\n",
+         net::http::downloader::kMaxTotalTimeout,
+         net::http::downloader::kDefaultTotalTimeout);
+  printf("\t--min-speed <bytes/second> (0 - %u, default: %u, 0: no "
+         "minimum).\n",
+         net::http::downloader::kMaxMinSpeed,
+         net::http::downloader::kDefaultMinSpeed);
   printf("\n");
 }
 
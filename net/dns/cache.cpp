@@ -0,0 +1,168 @@
+#include <string.h>
+#include "net/dns/cache.h"
+#include "util/ctype.h"
+
+bool net::dns::cache::create(size_t size)
+{
+  if (size == 0) {
+    return false;
+  }
+
+  if ((_M_entries = reinterpret_cast<entry*>(
+                      malloc(size * sizeof(entry))
+                    )) == NULL) {
+    return false;
+  }
+
+  // Number of buckets: power of two >= size.
+  size_t nbuckets = 1;
+  while (nbuckets < size) {
+    nbuckets <<= 1;
+  }
+
+  if ((_M_buckets = reinterpret_cast<entry**>(
+                      calloc(nbuckets, sizeof(entry*))
+                    )) == NULL) {
+    return false;
+  }
+
+  _M_size = size;
+  _M_mask = nbuckets - 1;
+
+  return true;
+}
+
+net::dns::cache::result net::dns::cache::find(const void* key,
+                                              size_t len,
+                                              uint64_t current_msec,
+                                              struct in_addr& addr)
+{
+  entry* e;
+  if (((e = search(key, len, hash(key, len))) == NULL) ||
+      (e->expiration_time <= current_msec)) {
+    // Expired entries are overwritten when the host is resolved again or
+    // evicted when the cache is full.
+    _M_misses++;
+    return result::kMiss;
+  }
+
+  // Move entry to the front of the LRU list.
+  lru_unlink(e);
+  lru_link(e);
+
+  _M_hits++;
+
+  if (e->negative) {
+    _M_negative_hits++;
+    return result::kNegativeHit;
+  }
+
+  addr = e->addr;
+
+  return result::kHit;
+}
+
+void net::dns::cache::add(const void* key,
+                          size_t len,
+                          const struct in_addr& addr,
+                          unsigned ttl,
+                          uint64_t current_msec)
+{
+  if (ttl < kMinTtl) {
+    ttl = kMinTtl;
+  } else if (ttl > kMaxTtl) {
+    ttl = kMaxTtl;
+  }
+
+  entry* e;
+  if ((e = insert(key, len)) != NULL) {
+    e->negative = false;
+    e->addr = addr;
+    e->expiration_time = current_msec + (static_cast<uint64_t>(ttl) * 1000);
+  }
+}
+
+uint32_t net::dns::cache::hash(const void* key, size_t len)
+{
+  // FNV-1a.
+  const uint8_t* k = reinterpret_cast<const uint8_t*>(key);
+  uint32_t h = 2166136261u;
+
+  for (size_t i = 0; i < len; i++) {
+    h ^= util::to_lower(k[i]);
+    h *= 16777619u;
+  }
+
+  return h;
+}
+
+net::dns::cache::entry* net::dns::cache::search(const void* key,
+                                                size_t len,
+                                                uint32_t h) const
+{
+  const uint8_t* k = reinterpret_cast<const uint8_t*>(key);
+
+  for (entry* e = _M_buckets[h & _M_mask]; e; e = e->next) {
+    if ((e->hash == h) && (e->keylen == len)) {
+      size_t i;
+      for (i = 0;
+           (i < len) && (util::to_lower(e->key[i]) == util::to_lower(k[i]));
+           i++);
+
+      if (i == len) {
+        return e;
+      }
+    }
+  }
+
+  return NULL;
+}
+
+net::dns::cache::entry* net::dns::cache::insert(const void* key, size_t len)
+{
+  if ((len == 0) || (len > kMaxKeyLen) || (!_M_entries)) {
+    return NULL;
+  }
+
+  uint32_t h = hash(key, len);
+
+  entry* e;
+  if ((e = search(key, len, h)) != NULL) {
+    lru_unlink(e);
+    lru_link(e);
+
+    return e;
+  }
+
+  if (_M_used < _M_size) {
+    e = &_M_entries[_M_used++];
+  } else {
+    // Evict the least recently used entry.
+    e = _M_lru.lru_prev;
+    remove(e);
+  }
+
+  memcpy(e->key, key, len);
+  e->keylen = static_cast<uint8_t>(len);
+  e->hash = h;
+
+  entry** bucket = &_M_buckets[h & _M_mask];
+  e->next = *bucket;
+  *bucket = e;
+
+  lru_link(e);
+
+  return e;
+}
+
+void net::dns::cache::remove(entry* e)
+{
+  entry** ptr = &_M_buckets[e->hash & _M_mask];
+  while (*ptr != e) {
+    ptr = &(*ptr)->next;
+  }
+
+  *ptr = e->next;
+
+  lru_unlink(e);
+}
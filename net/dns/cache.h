@@ -0,0 +1,195 @@
+#ifndef NET_DNS_CACHE_H
+#define NET_DNS_CACHE_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <netinet/in.h>
+
+namespace net {
+  namespace dns {
+    class cache {
+      public:
+        static const size_t kDefaultSize = 16 * 1024; // Entries.
+        static const size_t kMaxKeyLen = 255;
+
+        static const unsigned kMinTtl = 5; // Seconds.
+        static const unsigned kMaxTtl = 24 * 60 * 60; // Seconds.
+        static const unsigned kNegativeTtl = 30; // Seconds.
+
+        // Constructor.
+        cache();
+
+        // Destructor.
+        ~cache();
+
+        // Create.
+        bool create(size_t size = kDefaultSize);
+
+        // Find.
+        enum class result {
+          kMiss,
+          kHit,
+          kNegativeHit
+        };
+
+        result find(const void* key,
+                    size_t len,
+                    uint64_t current_msec,
+                    struct in_addr& addr);
+
+        // Add address.
+        void add(const void* key,
+                 size_t len,
+                 const struct in_addr& addr,
+                 unsigned ttl,
+                 uint64_t current_msec);
+
+        // Add negative entry (the host doesn't exist).
+        void add_negative(const void* key, size_t len, uint64_t current_msec);
+
+        // Get number of hits (positive and negative).
+        uint64_t hits() const;
+
+        // Get number of negative hits.
+        uint64_t negative_hits() const;
+
+        // Get number of misses.
+        uint64_t misses() const;
+
+        // Reset statistics.
+        void reset_statistics();
+
+      private:
+        struct entry {
+          uint8_t key[kMaxKeyLen];
+          uint8_t keylen;
+
+          bool negative;
+
+          struct in_addr addr;
+
+          uint64_t expiration_time;
+
+          uint32_t hash;
+
+          // Hash chain.
+          entry* next;
+
+          // LRU list.
+          entry* lru_prev;
+          entry* lru_next;
+        };
+
+        entry* _M_entries;
+        size_t _M_size;
+        size_t _M_used;
+
+        entry** _M_buckets;
+        size_t _M_mask;
+
+        // LRU list (most recently used first).
+        entry _M_lru;
+
+        uint64_t _M_hits;
+        uint64_t _M_negative_hits;
+        uint64_t _M_misses;
+
+        // Hash function (case-insensitive).
+        static uint32_t hash(const void* key, size_t len);
+
+        // Search entry.
+        entry* search(const void* key, size_t len, uint32_t h) const;
+
+        // Get entry for insertion.
+        entry* insert(const void* key, size_t len);
+
+        // Remove entry.
+        void remove(entry* e);
+
+        // Unlink entry from the LRU list.
+        static void lru_unlink(entry* e);
+
+        // Link entry at the front of the LRU list.
+        void lru_link(entry* e);
+
+        // Disable copy constructor and assignment operator.
+        cache(const cache&) = delete;
+        cache& operator=(const cache&) = delete;
+    };
+
+    inline cache::cache()
+      : _M_entries(NULL),
+        _M_size(0),
+        _M_used(0),
+        _M_buckets(NULL),
+        _M_mask(0),
+        _M_hits(0),
+        _M_negative_hits(0),
+        _M_misses(0)
+    {
+      _M_lru.lru_prev = &_M_lru;
+      _M_lru.lru_next = &_M_lru;
+    }
+
+    inline cache::~cache()
+    {
+      if (_M_entries) {
+        free(_M_entries);
+      }
+
+      if (_M_buckets) {
+        free(_M_buckets);
+      }
+    }
+
+    inline void cache::add_negative(const void* key,
+                                    size_t len,
+                                    uint64_t current_msec)
+    {
+      entry* e;
+      if ((e = insert(key, len)) != NULL) {
+        e->negative = true;
+        e->expiration_time = current_msec + (kNegativeTtl * 1000);
+      }
+    }
+
+    inline uint64_t cache::hits() const
+    {
+      return _M_hits;
+    }
+
+    inline uint64_t cache::negative_hits() const
+    {
+      return _M_negative_hits;
+    }
+
+    inline uint64_t cache::misses() const
+    {
+      return _M_misses;
+    }
+
+    inline void cache::reset_statistics()
+    {
+      _M_hits = 0;
+      _M_negative_hits = 0;
+      _M_misses = 0;
+    }
+
+    inline void cache::lru_unlink(entry* e)
+    {
+      e->lru_prev->lru_next = e->lru_next;
+      e->lru_next->lru_prev = e->lru_prev;
+    }
+
+    inline void cache::lru_link(entry* e)
+    {
+      e->lru_prev = &_M_lru;
+      e->lru_next = _M_lru.lru_next;
+
+      _M_lru.lru_next->lru_prev = e;
+      _M_lru.lru_next = e;
+    }
+  }
+}
+
+#endif // NET_DNS_CACHE_H
@@ -0,0 +1,19 @@
+#ifndef NET_DNS_OBSERVER_H
+#define NET_DNS_OBSERVER_H
+
+#include "net/socket_address.h"
+
+namespace net {
+  namespace dns {
+    class observer {
+      public:
+        // On host resolved.
+        virtual void on_resolved(unsigned id, const socket_address& addr) = 0;
+
+        // On resolution error.
+        virtual void on_resolve_error(unsigned id) = 0;
+    };
+  }
+}
+
+#endif // NET_DNS_OBSERVER_H
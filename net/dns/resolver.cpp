@@ -0,0 +1,553 @@
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <new>
+#include "net/dns/resolver.h"
+#include "net/ipv4_address.h"
+
+const char* net::dns::resolver::kResolvConf = "/etc/resolv.conf";
+
+bool net::dns::resolver::create(selector& sel, size_t max_queries)
+{
+  if ((max_queries == 0) || (max_queries > kMaxQueries)) {
+    return false;
+  }
+
+  if (!_M_have_nameserver) {
+    if (!load_nameserver()) {
+      // Fall back to a local name server.
+      if (!_M_nameserver.build("127.0.0.1", kDefaultPort)) {
+        return false;
+      }
+    }
+
+    _M_have_nameserver = true;
+  }
+
+  if (!_M_cache.create()) {
+    return false;
+  }
+
+  if ((_M_queries = new (std::nothrow) query[max_queries]) == NULL) {
+    return false;
+  }
+
+  _M_size = max_queries;
+
+  // Build free list.
+  for (size_t i = 0; i < _M_size; i++) {
+    _M_queries[i].next = (i + 1 < _M_size) ? &_M_queries[i + 1] : NULL;
+  }
+
+  _M_free = _M_queries;
+
+  if ((_M_txids = new (std::nothrow) query*[kMaxTransactionIds]) == NULL) {
+    return false;
+  }
+
+  for (size_t i = 0; i < kMaxTransactionIds; i++) {
+    _M_txids[i] = NULL;
+  }
+
+  // The number of buckets is a power of two (at least the maximum number
+  // of queries).
+  size_t nbuckets = 1;
+  while (nbuckets < max_queries) {
+    nbuckets *= 2;
+  }
+
+  if ((_M_ids = new (std::nothrow) query*[nbuckets]) == NULL) {
+    return false;
+  }
+
+  for (size_t i = 0; i < nbuckets; i++) {
+    _M_ids[i] = NULL;
+  }
+
+  _M_ids_mask = nbuckets - 1;
+
+  if (!_M_random.create()) {
+    return false;
+  }
+
+  if (!_M_socket.create(_M_nameserver.ss_family, socket::type::kDatagram)) {
+    return false;
+  }
+
+  // The source port is not predictable either.
+  if (!bind()) {
+    _M_socket.close();
+    _M_socket.fd(-1);
+
+    return false;
+  }
+
+  if (!sel.add(_M_socket.fd(), fdtype::kFdDatagram, this, io::event::kRead)) {
+    _M_socket.close();
+    _M_socket.fd(-1);
+
+    return false;
+  }
+
+  return true;
+}
+
+net::dns::cache::result
+net::dns::resolver::lookup(const char* host,
+                           size_t len,
+                           uint64_t current_msec,
+                           socket_address& addr)
+{
+  uint8_t qname[kMaxNameLen];
+  size_t qnamelen;
+  if (!encode(host, len, qname, qnamelen)) {
+    return cache::result::kMiss;
+  }
+
+  struct in_addr in;
+  cache::result res;
+  if ((res = _M_cache.find(qname,
+                           qnamelen,
+                           current_msec,
+                           in)) == cache::result::kHit) {
+    ipv4_address* ipv4_addr = reinterpret_cast<ipv4_address*>(&addr);
+
+    ipv4_addr->sin_family = AF_INET;
+    ipv4_addr->sin_port = 0;
+    ipv4_addr->sin_addr = in;
+
+#ifndef __minix
+    memset(ipv4_addr->sin_zero, 0, sizeof(ipv4_addr->sin_zero));
+#endif // !__minix
+  }
+
+  return res;
+}
+
+bool net::dns::resolver::resolve(const char* host,
+                                 size_t len,
+                                 unsigned id,
+                                 uint64_t current_msec)
+{
+  if (!_M_free) {
+    return false;
+  }
+
+  query* q = _M_free;
+
+  if ((!encode(host, len, q->qname, q->qnamelen)) || (!assign_txid(q))) {
+    return false;
+  }
+
+  _M_free = q->next;
+
+  q->id = id;
+  q->attempts = 1;
+  q->used = true;
+
+  // Add the query to the bucket of its id.
+  query** bucket = &_M_ids[id & _M_ids_mask];
+
+  q->prev_id = NULL;
+  q->next_id = *bucket;
+
+  if (*bucket) {
+    (*bucket)->prev_id = q;
+  }
+
+  *bucket = q;
+
+  _M_current_msec = current_msec;
+
+  send(q);
+
+  _M_scheduler.schedule(0, &q->timeout, current_msec + kQueryTimeout);
+
+  return true;
+}
+
+void net::dns::resolver::cancel(unsigned id)
+{
+  if (!_M_ids) {
+    return;
+  }
+
+  for (query* q = _M_ids[id & _M_ids_mask]; q; q = q->next_id) {
+    if (q->id == id) {
+      _M_scheduler.erase(&q->timeout);
+      release(q);
+
+      return;
+    }
+  }
+}
+
+io::event_handler::result net::dns::resolver::on_io(io::event events)
+{
+  uint8_t msg[kMaxMessageLen];
+
+  do {
+    socket_address addr;
+    ssize_t ret;
+    if ((ret = _M_socket.recvfrom(msg, sizeof(msg), addr, 0)) < 0) {
+      return io::event_handler::result::kSuccess;
+    }
+
+    // Ignore datagrams which don't come from the name server.
+    if (addr == _M_nameserver) {
+      process(msg, ret);
+    }
+  } while (true);
+}
+
+void net::dns::resolver::on_timer(timer::event_handler* handler)
+{
+  query* q = static_cast<query*>(handler);
+
+  // Retransmit?
+  if (q->attempts < kMaxAttempts) {
+    q->attempts++;
+
+    send(q);
+
+    _M_scheduler.schedule(0, &q->timeout, _M_current_msec + kQueryTimeout);
+  } else {
+    unsigned id = q->id;
+
+    release(q);
+
+    if (_M_observer) {
+      _M_observer->on_resolve_error(id);
+    }
+  }
+}
+
+bool net::dns::resolver::load_nameserver()
+{
+  FILE* file;
+  if ((file = fopen(kResolvConf, "r")) == NULL) {
+    return false;
+  }
+
+  char line[512];
+  while (fgets(line, sizeof(line), file)) {
+    const char* ptr = line;
+    while ((*ptr == ' ') || (*ptr == '\t')) {
+      ptr++;
+    }
+
+    if (strncmp(ptr, "nameserver", 10) != 0) {
+      continue;
+    }
+
+    ptr += 10;
+
+    if ((*ptr != ' ') && (*ptr != '\t')) {
+      continue;
+    }
+
+    while ((*ptr == ' ') || (*ptr == '\t')) {
+      ptr++;
+    }
+
+    const char* end = ptr;
+    while (*end > ' ') {
+      end++;
+    }
+
+    char address[64];
+    size_t len;
+    if (((len = end - ptr) == 0) || (len >= sizeof(address))) {
+      continue;
+    }
+
+    memcpy(address, ptr, len);
+    address[len] = 0;
+
+    if (_M_nameserver.build(address, kDefaultPort)) {
+      fclose(file);
+      return true;
+    }
+  }
+
+  fclose(file);
+
+  return false;
+}
+
+bool net::dns::resolver::encode(const char* host,
+                                size_t len,
+                                uint8_t* qname,
+                                size_t& qnamelen)
+{
+  // Remove trailing dot (if any).
+  if ((len > 0) && (host[len - 1] == '.')) {
+    len--;
+  }
+
+  if ((len == 0) || (len > kMaxHostLen)) {
+    return false;
+  }
+
+  const char* end = host + len;
+  size_t n = 0;
+
+  do {
+    const char* label = host;
+    while ((host < end) && (*host != '.')) {
+      host++;
+    }
+
+    size_t labellen;
+    if (((labellen = host - label) == 0) || (labellen > 63)) {
+      return false;
+    }
+
+    qname[n++] = static_cast<uint8_t>(labellen);
+    memcpy(qname + n, label, labellen);
+    n += labellen;
+
+    if (host == end) {
+      break;
+    }
+
+    // Skip dot.
+    host++;
+  } while (true);
+
+  qname[n++] = 0;
+
+  qnamelen = n;
+
+  return true;
+}
+
+bool net::dns::resolver::bind()
+{
+  socket_address addr;
+  if (!addr.build((_M_nameserver.ss_family == AF_INET) ? "0.0.0.0" : "::",
+                  0)) {
+    return false;
+  }
+
+  for (unsigned i = 0; i < kMaxBindAttempts; i++) {
+    uint16_t n;
+    if (!_M_random.next(n)) {
+      return false;
+    }
+
+    in_port_t port = kMinSourcePort + (n % (65536 - kMinSourcePort));
+
+    if (addr.ss_family == AF_INET) {
+      reinterpret_cast<struct sockaddr_in*>(&addr)->sin_port = htons(port);
+    } else {
+      reinterpret_cast<struct sockaddr_in6*>(&addr)->sin6_port = htons(port);
+    }
+
+    // If the port is not in use...
+    if (_M_socket.bind(addr)) {
+      return true;
+    }
+  }
+
+  // Let the kernel choose the port.
+  return true;
+}
+
+bool net::dns::resolver::assign_txid(query* q)
+{
+  uint16_t txid;
+  if (!_M_random.next(txid)) {
+    return false;
+  }
+
+  // There are at most kMaxQueries queries, so there is a free id.
+  while (_M_txids[txid]) {
+    txid++;
+  }
+
+  q->txid = txid;
+  _M_txids[txid] = q;
+
+  return true;
+}
+
+void net::dns::resolver::send(query* q)
+{
+  uint8_t msg[kMaxMessageLen];
+  uint16_t txid = q->txid;
+
+  // Header.
+  msg[0] = static_cast<uint8_t>(txid >> 8);
+  msg[1] = static_cast<uint8_t>(txid);
+  msg[2] = static_cast<uint8_t>(kFlagRecursionDesired >> 8);
+  msg[3] = static_cast<uint8_t>(kFlagRecursionDesired);
+  msg[4] = 0; // QDCOUNT.
+  msg[5] = 1;
+  memset(msg + 6, 0, 6); // ANCOUNT, NSCOUNT, ARCOUNT.
+
+  // Question.
+  memcpy(msg + kHeaderLen, q->qname, q->qnamelen);
+
+  uint8_t* ptr = msg + kHeaderLen + q->qnamelen;
+  ptr[0] = 0;
+  ptr[1] = kTypeA;
+  ptr[2] = 0;
+  ptr[3] = kClassIN;
+
+  // If the datagram cannot be sent now, it will be retransmitted when the
+  // timer expires.
+  _M_socket.sendto(msg, (ptr + 4) - msg, _M_nameserver, 0);
+}
+
+void net::dns::resolver::process(const uint8_t* msg, size_t len)
+{
+  if (len < kHeaderLen) {
+    return;
+  }
+
+  uint16_t txid = (static_cast<uint16_t>(msg[0]) << 8) | msg[1];
+
+  query* q;
+  if ((q = _M_txids[txid]) == NULL) {
+    return;
+  }
+
+  uint16_t flags = (static_cast<uint16_t>(msg[2]) << 8) | msg[3];
+  uint16_t qdcount = (static_cast<uint16_t>(msg[4]) << 8) | msg[5];
+  uint16_t ancount = (static_cast<uint16_t>(msg[6]) << 8) | msg[7];
+
+  if ((!(flags & kFlagResponse)) || (qdcount != 1)) {
+    return;
+  }
+
+  const uint8_t* end = msg + len;
+  const uint8_t* ptr = msg + kHeaderLen;
+
+  // Check that the question is the one of the query (name, type and
+  // class).
+  if ((static_cast<size_t>(end - ptr) < q->qnamelen + 4) ||
+      (strncasecmp(reinterpret_cast<const char*>(ptr),
+                   reinterpret_cast<const char*>(q->qname),
+                   q->qnamelen) != 0) ||
+      (ptr[q->qnamelen] != 0) ||
+      (ptr[q->qnamelen + 1] != kTypeA) ||
+      (ptr[q->qnamelen + 2] != 0) ||
+      (ptr[q->qnamelen + 3] != kClassIN)) {
+    return;
+  }
+
+  ptr += (q->qnamelen + 4);
+
+  const uint8_t* addr = NULL;
+  uint32_t ttl = 0;
+
+  if (((flags & (kFlagTruncated | kRcodeMask)) == 0)) {
+    // Search the first A record (CNAMEs are followed by the name server).
+    for (unsigned i = 0; i < ancount; i++) {
+      if (((ptr = skip_name(ptr, end)) == NULL) || (end - ptr < 10)) {
+        break;
+      }
+
+      uint16_t type = (static_cast<uint16_t>(ptr[0]) << 8) | ptr[1];
+      uint16_t cls = (static_cast<uint16_t>(ptr[2]) << 8) | ptr[3];
+      uint32_t rrttl = (static_cast<uint32_t>(ptr[4]) << 24) |
+                       (static_cast<uint32_t>(ptr[5]) << 16) |
+                       (static_cast<uint32_t>(ptr[6]) << 8) |
+                       ptr[7];
+      uint16_t rdlength = (static_cast<uint16_t>(ptr[8]) << 8) | ptr[9];
+
+      ptr += 10;
+
+      if (end - ptr < rdlength) {
+        break;
+      }
+
+      if ((type == kTypeA) && (cls == kClassIN) && (rdlength == 4)) {
+        addr = ptr;
+        ttl = rrttl;
+
+        break;
+      }
+
+      ptr += rdlength;
+    }
+  }
+
+  if (addr) {
+    struct in_addr in;
+    memcpy(&in, addr, 4);
+
+    _M_cache.add(q->qname, q->qnamelen, in, ttl, _M_current_msec);
+  } else if (((flags & kRcodeMask) == kRcodeNameError) ||
+             ((flags & (kFlagTruncated | kRcodeMask)) == 0)) {
+    // NXDOMAIN or no A records.
+    _M_cache.add_negative(q->qname, q->qnamelen, _M_current_msec);
+  }
+
+  unsigned id = q->id;
+
+  _M_scheduler.erase(&q->timeout);
+  release(q);
+
+  if (_M_observer) {
+    if (addr) {
+      socket_address sa;
+      ipv4_address* ipv4_addr = reinterpret_cast<ipv4_address*>(&sa);
+
+      ipv4_addr->sin_family = AF_INET;
+      ipv4_addr->sin_port = 0;
+      memcpy(&ipv4_addr->sin_addr, addr, 4);
+
+#ifndef __minix
+      memset(ipv4_addr->sin_zero, 0, sizeof(ipv4_addr->sin_zero));
+#endif // !__minix
+
+      _M_observer->on_resolved(id, sa);
+    } else {
+      _M_observer->on_resolve_error(id);
+    }
+  }
+}
+
+const uint8_t* net::dns::resolver::skip_name(const uint8_t* ptr,
+                                             const uint8_t* end)
+{
+  while (ptr < end) {
+    uint8_t len = *ptr;
+
+    if (len == 0) {
+      return ptr + 1;
+    } else if ((len & 0xc0) == 0xc0) {
+      // Compression pointer.
+      return (end - ptr >= 2) ? ptr + 2 : NULL;
+    } else if (len & 0xc0) {
+      return NULL;
+    }
+
+    ptr += (1 + len);
+  }
+
+  return NULL;
+}
+
+void net::dns::resolver::release(query* q)
+{
+  q->used = false;
+
+  _M_txids[q->txid] = NULL;
+
+  // Remove the query from the bucket of its id.
+  if (q->prev_id) {
+    q->prev_id->next_id = q->next_id;
+  } else {
+    _M_ids[q->id & _M_ids_mask] = q->next_id;
+  }
+
+  if (q->next_id) {
+    q->next_id->prev_id = q->prev_id;
+  }
+
+  q->next = _M_free;
+  _M_free = q;
+}
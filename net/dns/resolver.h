@@ -0,0 +1,255 @@
+#ifndef NET_DNS_RESOLVER_H
+#define NET_DNS_RESOLVER_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "net/selector.h"
+#include "net/socket.h"
+#include "net/socket_address.h"
+#include "net/dns/observer.h"
+#include "net/dns/cache.h"
+#include "io/event_handler.h"
+#include "timer/scheduler.h"
+#include "timer/observer.h"
+#include "util/random.h"
+
+namespace net {
+  namespace dns {
+    class resolver : public io::event_handler, public timer::observer {
+      public:
+        static const size_t kMaxHostLen = 253;
+        static const size_t kMaxQueries = 64 * 1024; // 16-bit query ids.
+        static const unsigned kQueryTimeout = 2000; // Milliseconds.
+        static const unsigned kMaxAttempts = 3;
+        static const in_port_t kDefaultPort = 53;
+
+        static const char* kResolvConf;
+
+        // Constructor.
+        resolver();
+
+        // Destructor.
+        ~resolver();
+
+        // Set observer.
+        void set_observer(dns::observer* obs);
+
+        // Set name server.
+        void nameserver(const socket_address& addr);
+
+        // Create.
+        bool create(selector& sel, size_t max_queries);
+
+        // Look up host in the cache.
+        cache::result lookup(const char* host,
+                             size_t len,
+                             uint64_t current_msec,
+                             socket_address& addr);
+
+        // Resolve host (asynchronously).
+        bool resolve(const char* host,
+                     size_t len,
+                     unsigned id,
+                     uint64_t current_msec);
+
+        // Cancel query.
+        void cancel(unsigned id);
+
+        // Check expired queries.
+        void check_expired(uint64_t current_msec);
+
+        // On I/O.
+        io::event_handler::result on_io(io::event events);
+
+        // On timer.
+        void on_timer(timer::event_handler* handler);
+
+        // Get host cache.
+        const cache& host_cache() const;
+
+        // Reset cache statistics.
+        void reset_cache_statistics();
+
+      private:
+        static const size_t kMaxNameLen = 255;
+        static const size_t kHeaderLen = 12;
+        static const size_t kMaxMessageLen = 512;
+
+        // Number of transaction ids.
+        static const size_t kMaxTransactionIds = 64 * 1024;
+
+        // Attempts to bind the socket to a random port (the kernel chooses
+        // the port if they fail).
+        static const unsigned kMaxBindAttempts = 16;
+        static const in_port_t kMinSourcePort = 1024;
+
+        // DNS constants.
+        static const uint16_t kFlagResponse = 0x8000;
+        static const uint16_t kFlagTruncated = 0x0200;
+        static const uint16_t kFlagRecursionDesired = 0x0100;
+        static const uint16_t kRcodeMask = 0x000f;
+        static const uint16_t kRcodeNameError = 3;
+        static const uint16_t kTypeA = 1;
+        static const uint16_t kClassIN = 1;
+
+        struct query : public timer::event_handler {
+          unsigned id;
+          unsigned attempts;
+
+          // Random transaction id (so that the responses cannot be
+          // guessed).
+          uint16_t txid;
+
+          uint8_t qname[kMaxNameLen];
+          size_t qnamelen;
+
+          timer::timer timeout;
+
+          query* next;
+
+          // Queries whose ids have the same hash.
+          query* prev_id;
+          query* next_id;
+
+          bool used;
+
+          // Constructor.
+          query();
+
+          // On timer.
+          bool on_timer();
+        };
+
+        socket _M_socket;
+        socket_address _M_nameserver;
+        bool _M_have_nameserver;
+
+        timer::scheduler<1> _M_scheduler;
+
+        cache _M_cache;
+
+        query* _M_queries;
+        size_t _M_size;
+
+        query* _M_free;
+
+        // Queries by transaction id (NULL: transaction id not in use).
+        query** _M_txids;
+
+        // Queries by id (hash table, the ids are the file descriptors of
+        // the clients).
+        query** _M_ids;
+        size_t _M_ids_mask; // Number of buckets - 1.
+
+        util::random _M_random;
+
+        uint64_t _M_current_msec;
+
+        dns::observer* _M_observer;
+
+        // Load name server from resolv.conf.
+        bool load_nameserver();
+
+        // Bind the socket to a random port.
+        bool bind();
+
+        // Assign a random transaction id which is not in use to the query.
+        bool assign_txid(query* q);
+
+        // Encode host name.
+        static bool encode(const char* host,
+                           size_t len,
+                           uint8_t* qname,
+                           size_t& qnamelen);
+
+        // Send query.
+        void send(query* q);
+
+        // Process response.
+        void process(const uint8_t* msg, size_t len);
+
+        // Skip name.
+        static const uint8_t* skip_name(const uint8_t* ptr,
+                                        const uint8_t* end);
+
+        // Release query.
+        void release(query* q);
+
+        // Disable copy constructor and assignment operator.
+        resolver(const resolver&) = delete;
+        resolver& operator=(const resolver&) = delete;
+    };
+
+    inline resolver::resolver()
+      : _M_have_nameserver(false),
+        _M_queries(NULL),
+        _M_size(0),
+        _M_free(NULL),
+        _M_txids(NULL),
+        _M_ids(NULL),
+        _M_ids_mask(0),
+        _M_current_msec(0),
+        _M_observer(NULL)
+    {
+      _M_socket.fd(-1);
+      _M_scheduler.set_observer(this);
+    }
+
+    inline resolver::~resolver()
+    {
+      // The socket is closed by the selector.
+
+      if (_M_queries) {
+        delete [] _M_queries;
+      }
+
+      if (_M_txids) {
+        delete [] _M_txids;
+      }
+
+      if (_M_ids) {
+        delete [] _M_ids;
+      }
+    }
+
+    inline void resolver::set_observer(dns::observer* obs)
+    {
+      _M_observer = obs;
+    }
+
+    inline void resolver::nameserver(const socket_address& addr)
+    {
+      _M_nameserver = addr;
+      _M_have_nameserver = true;
+    }
+
+    inline const cache& resolver::host_cache() const
+    {
+      return _M_cache;
+    }
+
+    inline void resolver::reset_cache_statistics()
+    {
+      _M_cache.reset_statistics();
+    }
+
+    inline void resolver::check_expired(uint64_t current_msec)
+    {
+      _M_current_msec = current_msec;
+      _M_scheduler.check_expired(current_msec);
+    }
+
+    inline resolver::query::query()
+      : timeout(this),
+        used(false)
+    {
+    }
+
+    inline bool resolver::query::on_timer()
+    {
+      return true;
+    }
+  }
+}
+
+#endif // NET_DNS_RESOLVER_H
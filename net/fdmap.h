@@ -9,7 +9,10 @@ namespace net {
   enum class fdtype : uint8_t {
     kFdNone,
     kFdSocket,
-    kFdListener
+    kFdListener,
+    kFdDatagram,
+    kFdInotify,
+    kFdIoUring
   };
 
   class fdmap {
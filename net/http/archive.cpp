@@ -0,0 +1,67 @@
+#include <stdio.h>
+#include <limits.h>
+#include <errno.h>
+#include <sys/uio.h>
+#include "net/http/archive.h"
+
+bool net::http::archive::append(const void* data,
+                                size_t len,
+                                unsigned long& segment,
+                                off_t& offset)
+{
+  off_t size = kHeaderSize + len;
+
+  // If a new segment has to be started...
+  if ((!_M_file.is_open()) ||
+      ((_M_size > 0) && (_M_size + size > _M_max_segment_size))) {
+    if (!open_segment()) {
+      return false;
+    }
+  }
+
+  uint8_t header[kHeaderSize];
+  build_header(len, header);
+
+  struct iovec iov[2];
+  iov[0].iov_base = header;
+  iov[0].iov_len = kHeaderSize;
+  iov[1].iov_base = const_cast<void*>(data);
+  iov[1].iov_len = len;
+
+  if (_M_file.writev(iov, 2) != size) {
+    // Remove the incomplete record.
+    _M_file.truncate(_M_size);
+    return false;
+  }
+
+  segment = _M_segment;
+  offset = _M_size;
+
+  _M_size += size;
+
+  return true;
+}
+
+bool net::http::archive::open_segment()
+{
+  _M_file.close();
+
+  char path[PATH_MAX];
+
+  do {
+    snprintf(path,
+             sizeof(path),
+             "%s/segment_%02u_%06lu",
+             _M_dir,
+             _M_id,
+             _M_next++);
+
+    if (_M_file.open(path, O_CREAT | O_EXCL | O_WRONLY | O_APPEND, 0644)) {
+      _M_segment = _M_next - 1;
+      _M_size = 0;
+      return true;
+    }
+  } while (errno == EEXIST);
+
+  return false;
+}
@@ -0,0 +1,117 @@
+#ifndef NET_HTTP_ARCHIVE_H
+#define NET_HTTP_ARCHIVE_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+#include "fs/file.h"
+
+namespace net {
+  namespace http {
+    // Append-only archive: the responses are appended as records to
+    // segment files (<dir>/segment_<id>_<number>), a new segment is started
+    // when the current one reaches the maximum size.
+    // A record is a header (magic "DREC", 4 reserved bytes and the length
+    // of the record as a 64-bit big-endian number) followed by the URL, the
+    // Status-Line, the headers and the body, in the same format as the
+    // files with one URL.
+    class archive {
+      public:
+        static const size_t kHeaderSize = 16;
+
+        static const off_t kDefaultMaxSegmentSize = 1024L * 1024L * 1024L;
+
+        // Constructor.
+        archive();
+
+        // Create.
+        bool create(const char* dir, unsigned id, off_t max_segment_size);
+
+        // Append record (the number of the segment and the offset of the
+        // record are saved in 'segment' and 'offset').
+        bool append(const void* data,
+                    size_t len,
+                    unsigned long& segment,
+                    off_t& offset);
+
+        // Build record header.
+        static void build_header(uint64_t len, uint8_t* header);
+
+        // Parse record header.
+        static bool parse_header(const void* header, uint64_t& len);
+
+      private:
+        const char* _M_dir;
+        unsigned _M_id;
+
+        // Number of the current segment.
+        unsigned long _M_segment;
+
+        // Number of the next segment.
+        unsigned long _M_next;
+
+        fs::file _M_file;
+        off_t _M_size;
+
+        off_t _M_max_segment_size;
+
+        // Open next segment.
+        bool open_segment();
+
+        // Disable copy constructor and assignment operator.
+        archive(const archive&) = delete;
+        archive& operator=(const archive&) = delete;
+    };
+
+    inline archive::archive()
+      : _M_dir(NULL),
+        _M_id(0),
+        _M_segment(0),
+        _M_next(0),
+        _M_size(0),
+        _M_max_segment_size(kDefaultMaxSegmentSize)
+    {
+    }
+
+    inline bool archive::create(const char* dir,
+                                unsigned id,
+                                off_t max_segment_size)
+    {
+      _M_dir = dir;
+      _M_id = id;
+      _M_max_segment_size = max_segment_size;
+
+      return true;
+    }
+
+    inline void archive::build_header(uint64_t len, uint8_t* header)
+    {
+      memcpy(header, "DREC", 4);
+      memset(header + 4, 0, 4);
+
+      for (size_t i = 15; i >= 8; i--) {
+        header[i] = static_cast<uint8_t>(len);
+        len >>= 8;
+      }
+    }
+
+    inline bool archive::parse_header(const void* header, uint64_t& len)
+    {
+      const uint8_t* h = reinterpret_cast<const uint8_t*>(header);
+
+      if (memcmp(h, "DREC", 4) != 0) {
+        return false;
+      }
+
+      len = 0;
+      for (size_t i = 8; i < kHeaderSize; i++) {
+        len = (len << 8) | h[i];
+      }
+
+      return true;
+    }
+  }
+}
+
+#endif // NET_HTTP_ARCHIVE_H
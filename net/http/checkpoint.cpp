@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "net/http/checkpoint.h"
+#include "fs/file.h"
+
+namespace {
+  // Format of <dir>/checkpoint (host byte order).
+  struct record {
+    char magic[4]; // "DCKP".
+    uint32_t reserved;
+    uint64_t dev;
+    uint64_t ino;
+    int64_t mtime;
+    uint64_t offset;
+  };
+}
+
+net::http::checkpoint* net::http::checkpoint::create(const char* dir,
+                                                     const position& pos,
+                                                     unsigned nworkers,
+                                                     unsigned pending)
+{
+  checkpoint* cp;
+  if ((cp = reinterpret_cast<checkpoint*>(
+              malloc(sizeof(checkpoint))
+            )) == NULL) {
+    return NULL;
+  }
+
+  snprintf(cp->dir, sizeof(cp->dir), "%s", dir);
+
+  cp->pos = pos;
+  cp->nworkers = nworkers;
+  cp->pending = pending;
+  cp->failed = false;
+
+  return cp;
+}
+
+void net::http::checkpoint::release(unsigned count, bool saved)
+{
+  if (!saved) {
+    __atomic_store_n(&failed, true, __ATOMIC_RELEASE);
+  }
+
+  // If there are other references...
+  if (__atomic_sub_fetch(&pending, count, __ATOMIC_ACQ_REL) != 0) {
+    return;
+  }
+
+  // The position is only saved if all the workers have saved their URLs
+  // (otherwise, the URLs sent to the worker after the previous checkpoint
+  // would be lost).
+  if (__atomic_load_n(&failed, __ATOMIC_ACQUIRE)) {
+    ::free(this);
+    return;
+  }
+
+  char filename[PATH_MAX];
+  snprintf(filename, sizeof(filename), "%s/checkpoint", dir);
+
+  record r;
+  memcpy(r.magic, "DCKP", 4);
+  r.reserved = 0;
+  r.dev = pos.dev;
+  r.ino = pos.ino;
+  r.mtime = pos.mtime;
+  r.offset = pos.offset;
+
+  // If the position has been saved, remove the files of the workers of a
+  // previous run with more threads.
+  if (save(filename, &r, sizeof(record))) {
+    for (unsigned id = nworkers;
+         (path(dir, id, filename, sizeof(filename))) &&
+         (unlink(filename) == 0);
+         id++);
+  }
+
+  ::free(this);
+}
+
+bool net::http::checkpoint::load(const char* dir, position& pos)
+{
+  char filename[PATH_MAX];
+  snprintf(filename, sizeof(filename), "%s/checkpoint", dir);
+
+  fs::file file;
+  if (!file.open(filename, O_RDONLY)) {
+    return false;
+  }
+
+  record r;
+  if ((file.read(&r, sizeof(record)) != sizeof(record)) ||
+      (memcmp(r.magic, "DCKP", 4) != 0)) {
+    return false;
+  }
+
+  pos.dev = r.dev;
+  pos.ino = r.ino;
+  pos.mtime = r.mtime;
+  pos.offset = r.offset;
+
+  return true;
+}
+
+bool net::http::checkpoint::path(const char* dir,
+                                 unsigned id,
+                                 char* buf,
+                                 size_t size)
+{
+  int ret = snprintf(buf, size, "%s/checkpoint_%02u", dir, id);
+  return ((ret > 0) && (static_cast<size_t>(ret) < size));
+}
+
+bool net::http::checkpoint::save(const char* filename,
+                                 const void* data,
+                                 size_t len)
+{
+  char tmpfilename[PATH_MAX];
+  int ret = snprintf(tmpfilename, sizeof(tmpfilename), "%s.tmp", filename);
+  if ((ret <= 0) || (static_cast<size_t>(ret) >= sizeof(tmpfilename))) {
+    return false;
+  }
+
+  fs::file file;
+  if (!file.open(tmpfilename, O_CREAT | O_TRUNC | O_WRONLY, 0644)) {
+    return false;
+  }
+
+  // The file is flushed before replacing the old one, so that a crash
+  // leaves either the old file or the new one.
+  if (((len > 0) && (file.write(data, len) != static_cast<ssize_t>(len))) ||
+      (!file.sync()) ||
+      (!file.close()) ||
+      (rename(tmpfilename, filename) < 0)) {
+    unlink(tmpfilename);
+    return false;
+  }
+
+  return true;
+}
@@ -0,0 +1,118 @@
+#ifndef NET_HTTP_CHECKPOINT_H
+#define NET_HTTP_CHECKPOINT_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+namespace net {
+  namespace http {
+    // Progress through a file with URLs. The downloader sends a checkpoint
+    // to the workers after the URLs read up to an offset of the file: each
+    // worker saves the URLs it has not finished yet (<dir>/checkpoint_<id>,
+    // one URL per line) and the last one saves the offset
+    // (<dir>/checkpoint). A restarted downloader downloads those URLs again
+    // (skipping the ones which are in the index) and continues reading the
+    // file at the offset. The files are replaced atomically.
+    struct checkpoint {
+      // Position in a file with URLs.
+      struct position {
+        // Device, inode and modification time of the file (0: no file).
+        uint64_t dev;
+        uint64_t ino;
+        int64_t mtime;
+
+        // Offset of the first URL which has not been sent to the workers.
+        uint64_t offset;
+
+        // Constructor.
+        position();
+
+        // Set file (the offset is set to 0).
+        void file(const struct stat& buf);
+
+        // Is it a position of the file?
+        bool of(const struct stat& buf) const;
+
+        // Clear.
+        void clear();
+      };
+
+      char dir[PATH_MAX];
+
+      position pos;
+
+      unsigned nworkers;
+
+      // Number of references (the workers which haven't saved their URLs
+      // yet and the downloader).
+      unsigned pending;
+
+      // Couldn't a worker save its URLs?
+      bool failed;
+
+      // Create.
+      static checkpoint* create(const char* dir,
+                                const position& pos,
+                                unsigned nworkers,
+                                unsigned pending);
+
+      // Release references (the last one saves the position and removes
+      // the files of the workers which don't exist anymore, unless a
+      // worker couldn't save its URLs).
+      void release(unsigned count, bool saved = true);
+
+      // Get number of references.
+      unsigned references() const;
+
+      // Load position (returns false if there is no checkpoint).
+      static bool load(const char* dir, position& pos);
+
+      // Build path of the file with the URLs of a worker.
+      static bool path(const char* dir, unsigned id, char* buf, size_t size);
+
+      // Replace file atomically.
+      static bool save(const char* filename, const void* data, size_t len);
+    };
+
+    inline unsigned checkpoint::references() const
+    {
+      return __atomic_load_n(&pending, __ATOMIC_ACQUIRE);
+    }
+
+    inline checkpoint::position::position()
+      : dev(0),
+        ino(0),
+        mtime(0),
+        offset(0)
+    {
+    }
+
+    inline void checkpoint::position::file(const struct stat& buf)
+    {
+      dev = buf.st_dev;
+      ino = buf.st_ino;
+      mtime = buf.st_mtime;
+      offset = 0;
+    }
+
+    inline bool checkpoint::position::of(const struct stat& buf) const
+    {
+      return ((dev == static_cast<uint64_t>(buf.st_dev)) &&
+              (ino == static_cast<uint64_t>(buf.st_ino)) &&
+              (mtime == static_cast<int64_t>(buf.st_mtime)));
+    }
+
+    inline void checkpoint::position::clear()
+    {
+      dev = 0;
+      ino = 0;
+      mtime = 0;
+      offset = 0;
+    }
+  }
+}
+
+#endif // NET_HTTP_CHECKPOINT_H
@@ -1,8 +1,22 @@
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <new>
 #include "net/http/client.h"
 #include "util/ctype.h"
+#include "util/number.h"
 #include "macros/macros.h"
 
 const string::buffer* net::http::client::_M_user_agent = NULL;
+bool net::http::client::_M_persistent_connections = true;
+size_t net::http::client::_M_flush_threshold = kDefaultFlushThreshold;
+net::http::client::content_encoding net::http::client::_M_content_encoding =
+  kDefaultContentEncoding;
+uint64_t net::http::client::_M_max_body_size = kDefaultMaxBodySize;
+net::http::client::body_limit_action
+  net::http::client::_M_body_limit_action = body_limit_action::kDiscard;
+const net::http::response_filter* net::http::client::_M_filter = NULL;
+uint64_t net::http::client::_M_resume_min_size = kDefaultResumeMinSize;
 
 bool net::http::client::init(request* req,
                              const char* filename,
@@ -75,10 +89,149 @@ bool net::http::client::init(request* req,
   return true;
 }
 
+bool net::http::client::resume(request* req,
+                               const char* filename,
+                               uint64_t received)
+{
+  if (!_M_file.open(filename, O_RDWR)) {
+    return false;
+  }
+
+  // Read the URI, the status line and the headers of the partial file.
+  string::buffer buf;
+  ssize_t ret;
+  if ((!buf.allocate(kMaxResumeHeaderSize)) ||
+      ((ret = _M_file.pread(buf.data(), kMaxResumeHeaderSize, 0)) <= 0)) {
+    _M_file.close();
+    return false;
+  }
+
+  const char* begin = buf.data();
+  const char* end = begin + ret;
+
+  // Skip URI.
+  const char* status_line;
+  if ((status_line = static_cast<const char*>(memchr(begin,
+                                                     '\n',
+                                                     end - begin))) == NULL) {
+    _M_file.close();
+    return false;
+  }
+
+  status_line++;
+
+  // Only the downloads of 200 responses are resumed.
+  const char* ptr;
+  if ((end - status_line < 12) ||
+      (strncmp(status_line, "HTTP/1.", 7) != 0) ||
+      (strncmp(status_line + 8, " 200", 4) != 0) ||
+      ((ptr = static_cast<const char*>(memchr(status_line,
+                                               '\n',
+                                               end - status_line))) == NULL)) {
+    _M_file.close();
+    return false;
+  }
+
+  ptr++;
+
+  header::headers headers;
+  if (headers.parse(ptr, end - ptr) !=
+      header::headers::parse_result::kEndOfHeader) {
+    _M_file.close();
+    return false;
+  }
+
+  uint64_t header_size = (ptr - begin) + headers.size();
+
+  // The file must contain the body which has been received.
+  struct stat sbuf;
+  string::slice value;
+  if ((!_M_file.stat(sbuf)) ||
+      (static_cast<uint64_t>(sbuf.st_size) < header_size + received) ||
+      (!validator(headers, value)) ||
+      (!_M_file.truncate(header_size + received)) ||
+      (_M_file.seek(header_size + received, fs::file::whence::kSeekSet) < 0)) {
+    _M_file.close();
+    return false;
+  }
+
+  _M_validator.clear();
+
+  if ((!_M_validator.append(value.data(), value.length())) ||
+      ((_M_filename = strdup(filename)) == NULL)) {
+    _M_file.close();
+    return false;
+  }
+
+#if HAVE_IO_URING
+  _M_write_offset = header_size + received;
+#endif
+
+  _M_request = req;
+
+  _M_resume_offset = received;
+  _M_resume_header_size = header_size;
+
+  // The first response might have been chunked.
+  if (!headers.header(header::permanent_field_name::kContentLength,
+                      _M_resume_length)) {
+    _M_resume_length = kUnknownLength;
+  }
+
+  return true;
+}
+
+bool net::http::client::receive(request* req,
+                                unsigned download,
+                                unsigned range)
+{
+  const range_coordinator::download* d = _M_coordinator->get(download);
+
+  if (!_M_file.open(d->filename, O_WRONLY)) {
+    return false;
+  }
+
+  uint64_t offset = d->header_size + d->ranges[range].first;
+
+  _M_validator.clear();
+
+  if ((_M_file.seek(offset, fs::file::whence::kSeekSet) < 0) ||
+      (!_M_validator.append(d->validator.data(), d->validator.length())) ||
+      ((_M_filename = strdup(d->filename)) == NULL)) {
+    _M_file.close();
+    return false;
+  }
+
+#if HAVE_IO_URING
+  _M_write_offset = offset;
+#endif
+
+  _M_request = req;
+
+  _M_resume_offset = d->ranges[range].first;
+  _M_resume_header_size = d->header_size;
+
+  _M_download = download;
+  _M_range = range;
+
+  return true;
+}
+
 void net::http::client::clear()
 {
   tcp_connection::free();
 
+  _M_staging.free();
+
+  reset();
+
+  _M_reused = false;
+
+  _M_state = state::kConnecting;
+}
+
+void net::http::client::reset()
+{
   _M_request = NULL;
 
   _M_headers.clear();
@@ -91,12 +244,92 @@ void net::http::client::clear()
     _M_filename = NULL;
   }
 
+#if HAVE_IO_URING
+  if (_M_writer) {
+    cancel_writes();
+  }
+#endif
+
+  _M_staging.clear();
+
+#if HAVE_ZLIB
+  _M_decoder.clear();
+#endif
+
   _M_file.close();
   _M_max_file_size = kDefaultMaxFileSize;
 
+  _M_archive = NULL;
+  clear_record();
+  _M_max_record_size = 0;
+
   _M_reason_phrase_len = 0;
 
-  _M_state = state::kConnecting;
+  _M_response_size = 0;
+
+  _M_response_limit = kNoLimit;
+  _M_truncated = false;
+  _M_index_flags = 0;
+
+  _M_resume_offset = 0;
+  _M_resume_header_size = 0;
+  _M_resume_length = kUnknownLength;
+  _M_validator.clear();
+  _M_partial = false;
+
+  _M_if_none_match.clear();
+  _M_if_modified_since = static_cast<time_t>(-1);
+
+  _M_download = range_coordinator::kNoDownload;
+
+  _M_keep_alive = false;
+
+  // Discard pipelined requests.
+  for (; _M_npipelined > 0; _M_npipelined--) {
+    pipelined_request* r = &_M_pipeline[_M_pipeline_head];
+
+    r->uri.clear();
+
+    ::free(r->filename);
+    r->filename = NULL;
+
+    _M_pipeline_head = (_M_pipeline_head + 1) % kMaxPipeliningDepth;
+  }
+
+  _M_pipeline_head = 0;
+}
+
+bool net::http::client::pipeline(uri::uri&& uri, const char* filename)
+{
+  if ((_M_state != state::kReusingConnection) ||
+      (_M_request->method() != method::kGet) ||
+      (_M_npipelined + 1 == kMaxPipeliningDepth)) {
+    return false;
+  }
+
+  if (!_M_pipeline) {
+    if ((_M_pipeline = new (std::nothrow)
+                       pipelined_request[kMaxPipeliningDepth]) == NULL) {
+      return false;
+    }
+
+    for (unsigned i = 0; i < kMaxPipeliningDepth; i++) {
+      _M_pipeline[i].filename = NULL;
+    }
+  }
+
+  pipelined_request* r = &_M_pipeline[(_M_pipeline_head + _M_npipelined) %
+                                      kMaxPipeliningDepth];
+
+  if ((filename) && ((r->filename = strdup(filename)) == NULL)) {
+    return false;
+  }
+
+  r->uri = util::move(uri);
+
+  _M_npipelined++;
+
+  return true;
 }
 
 io::event_handler::result net::http::client::run()
@@ -105,10 +338,21 @@ io::event_handler::result net::http::client::run()
   const string::buffer* bufs[2];
   size_t count;
   size_t to_send;
+  bool filtered;
   int err;
 
   do {
     switch (_M_state) {
+      case state::kResolving: // Not registered in the selector yet.
+        return io::event_handler::result::kSuccess;
+      case state::kReusingConnection:
+        // Build headers.
+        if (!build_headers()) {
+          return error();
+        }
+
+        _M_state = state::kSendingRequest;
+        break;
       case state::kConnecting:
         if (!_M_writable) {
           return io::event_handler::result::kSuccess;
@@ -272,8 +516,9 @@ io::event_handler::result net::http::client::run()
 
         break;
       case state::kReadingHeaders:
-        // If the input buffer is empty...
-        if ((count = _M_in.length() - _M_inp) == 0) {
+        // If the whole input buffer has been parsed (the headers might
+        // have been received partially with the status line)...
+        if ((count = _M_in.length() - _M_inp - _M_headers.size()) == 0) {
           if (!_M_readable) {
             return io::event_handler::result::kSuccess;
           }
@@ -310,18 +555,66 @@ io::event_handler::result net::http::client::run()
         // Skip headers.
         _M_inp += _M_headers.size();
 
-        {
+        // If the download is being resumed or only a range is received...
+        if ((_M_resume_offset > 0) ||
+            (_M_download != range_coordinator::kNoDownload)) {
+          if (!resume_response()) {
+            return error();
+          }
+        }
+
+        // Is the body wanted?
+        filtered = ((_M_filter) &&
+                    (has_body()) &&
+                    (!_M_filter->match(_M_status_code, _M_headers)));
+
+#if HAVE_ZLIB
+        if ((has_body()) && (!filtered) && (!start_decoding())) {
+          return error();
+        }
+#endif
+
+        // If the response is neither the rest of the partial file nor a
+        // range...
+        if ((_M_resume_offset == 0) &&
+            (_M_download == range_coordinator::kNoDownload)) {
           string::slice uri(_M_request->uri().string());
 
           // Save URI and headers.
           if ((!add_data(uri.data(), uri.length())) ||
               (!add_data("\r\n", 2)) ||
-              (!add_data(_M_in.data(), _M_inp))) {
+              (!save_headers())) {
             return error();
           }
+
+          _M_header_size = _M_response_size;
+        }
+
+        if (_M_max_body_size > 0) {
+          _M_response_limit = _M_header_size + _M_max_body_size;
+        }
+
+        _M_keep_alive = persistent();
+
+        // If the response saved by the previous run is still valid...
+        if ((_M_status_code == 304) &&
+            ((_M_if_none_match.length() > 0) ||
+             (_M_if_modified_since != static_cast<time_t>(-1)))) {
+          _M_index_flags |= url_index::kUnchanged;
+        }
+
+        // If the body is not wanted...
+        if (filtered) {
+          skip_body();
+
+          if ((res = finished()) != io::event_handler::result::kSuccess) {
+            return res;
+          }
+
+          break;
         }
 
-        if (_M_request->method() != method::kHead) {
+        if (has_body()) {
           // RFC 2616: 4.4 Message length.
 
           // Get Transfer-Encoding header (if available).
@@ -334,12 +627,30 @@ io::event_handler::result net::http::client::run()
             // Get Content-Length header (if available).
             if (_M_headers.header(header::permanent_field_name::kContentLength,
                                   _M_content_length)) {
+              // If the body is too big and has to be discarded, don't
+              // receive it.
+              if ((_M_content_length > _M_max_body_size) &&
+                  (_M_max_body_size > 0) &&
+                  (_M_body_limit_action == body_limit_action::kDiscard)) {
+                return error();
+              }
+
               if (_M_content_length == 0) {
-                return finished();
+                res = finished();
+                if (res != io::event_handler::result::kSuccess) {
+                  return res;
+                }
+
+                break;
               }
 
               _M_received = 0;
 
+              // If the body is big, receive it over several connections.
+              if (splittable()) {
+                split();
+              }
+
               _M_state = state::kHaveContentLength;
             } else {
               // Get Connection header (if available).
@@ -356,6 +667,10 @@ io::event_handler::result net::http::client::run()
                           (strncasecmp(connection.data(), "close", 5) == 0))) {
                 _M_content_length = 0;
 
+                // The end of the body is signaled by closing the
+                // connection.
+                _M_keep_alive = false;
+
                 _M_state = state::kDontHaveContentLength;
               } else {
                 // Content-Length is needed.
@@ -371,8 +686,10 @@ io::event_handler::result net::http::client::run()
             _M_state = state::kChunkedTransferEncoding;
           }
         } else {
-          // HEAD method.
-          return finished();
+          // No message body.
+          if ((res = finished()) != io::event_handler::result::kSuccess) {
+            return res;
+          }
         }
 
         break;
@@ -383,6 +700,24 @@ io::event_handler::result net::http::client::run()
             return io::event_handler::result::kSuccess;
           }
 
+#if HAVE_SPLICE
+          if (can_splice()) {
+            // Move message body to the file.
+            if (splice(_M_content_length - _M_received, count) ==
+                io::event_handler::result::kError) {
+              return error();
+            }
+
+            if ((_M_received += count) == _M_content_length) {
+              if ((res = finished()) != io::event_handler::result::kSuccess) {
+                return res;
+              }
+            }
+
+            break;
+          }
+#endif
+
           // Read message body.
           res = read(count);
         }
@@ -391,13 +726,19 @@ io::event_handler::result net::http::client::run()
           size_t left = _M_content_length - _M_received;
 
           if (count >= left) {
-            if (!add_data(_M_in.data() + _M_inp, left)) {
+            if (!add_body(_M_in.data() + _M_inp, left)) {
               return error();
             }
 
-            return finished();
+            _M_inp += left;
+
+            if ((res = finished()) != io::event_handler::result::kSuccess) {
+              return res;
+            }
+
+            break;
           } else {
-            if (!add_data(_M_in.data() + _M_inp, count)) {
+            if (!add_body(_M_in.data() + _M_inp, count)) {
               return error();
             }
 
@@ -425,12 +766,30 @@ io::event_handler::result net::http::client::run()
             return io::event_handler::result::kSuccess;
           }
 
+#if HAVE_SPLICE
+          // Once the body has reached the maximum size, it is read: it is
+          // complete if the peer closes the connection, too big if more
+          // data is received.
+          if ((can_splice()) && (_M_response_size < _M_response_limit)) {
+            // Move message body to the file (until the peer closes the
+            // connection).
+            if (splice(net::splicer::kPipeSize, count) ==
+                io::event_handler::result::kError) {
+              return finished();
+            }
+
+            _M_content_length += count;
+
+            break;
+          }
+#endif
+
           // Read message body.
           res = read(count);
         }
 
         if (count > 0) {
-          if (!add_data(_M_in.data() + _M_inp, count)) {
+          if (!add_body(_M_in.data() + _M_inp, count)) {
             return error();
           }
 
@@ -465,7 +824,11 @@ io::event_handler::result net::http::client::run()
           // Parse chunked body.
           switch (parse_chunked_body()) {
             case parse_result::kEndOfData:
-              return finished();
+              if ((res = finished()) != io::event_handler::result::kSuccess) {
+                return res;
+              }
+
+              break;
             case parse_result::kInvalidData:
               return error();
             case parse_result::kNotEndOfData:
@@ -483,6 +846,29 @@ io::event_handler::result net::http::client::run()
         }
 
         break;
+#if HAVE_IO_URING
+      case state::kWritingFile:
+        if (_M_nwrites > 0) {
+          return io::event_handler::result::kSuccess;
+        }
+
+        if ((res = finished()) != io::event_handler::result::kSuccess) {
+          return res;
+        }
+
+        break;
+#endif
+      case state::kIdle:
+        if (_M_readable) {
+          // If the server has closed the connection (or has sent
+          // unexpected data)...
+          if (((res = read(count)) != io::event_handler::result::kSuccess) ||
+              (count > 0)) {
+            return io::event_handler::result::kError;
+          }
+        }
+
+        return io::event_handler::result::kChangeToReadMode;
       case state::kFinished: // Never reached.
         break;
     }
@@ -491,40 +877,52 @@ io::event_handler::result net::http::client::run()
 
 bool net::http::client::build_headers()
 {
-  string::slice m(methods::name(_M_request->method()));
-  const string::slice& path(_M_request->uri().path());
-  const string::slice& query(_M_request->uri().query());
+  if (!begin_request(_M_request->method(), _M_request->uri())) {
+    return false;
+  }
 
-  if (query.length() == 0) {
-    if (!_M_out.format("%.*s %.*s HTTP/1.1\r\n",
-        m.length(),
-        m.data(),
-        path.length(),
-        path.data())) {
-      return false;
+  // If the download is being resumed, request the rest of the body (if
+  // the resource has not changed).
+  if ((_M_resume_offset > 0) ||
+      (_M_download != range_coordinator::kNoDownload)) {
+    char range[64];
+    int len;
+
+    if (_M_download == range_coordinator::kNoDownload) {
+      len = snprintf(range,
+                     sizeof(range),
+                     "bytes=%" PRIu64 "-",
+                     _M_resume_offset);
+    } else {
+      const range_coordinator::range* r =
+        &_M_coordinator->get(_M_download)->ranges[_M_range];
+
+      len = snprintf(range,
+                     sizeof(range),
+                     "bytes=%" PRIu64 "-%" PRIu64,
+                     r->first,
+                     r->last);
     }
-  } else {
-    if (!_M_out.format("%.*s %.*s?%.*s HTTP/1.1\r\n",
-        m.length(),
-        m.data(),
-        path.length(),
-        path.data(),
-        query.length(),
-        query.data())) {
+
+    if ((!_M_headers.add(header::permanent_field_name::kRange, range, len)) ||
+        (!_M_headers.add(header::permanent_field_name::kIfRange,
+                         _M_validator.data(),
+                         _M_validator.length()))) {
       return false;
     }
   }
 
-  if (!_M_headers.add(header::permanent_field_name::kConnection,
-                      "close",
-                      5)) {
+  // If the request is conditional...
+  if ((_M_if_none_match.length() > 0) &&
+      (!_M_headers.add(header::permanent_field_name::kIfNoneMatch,
+                       _M_if_none_match.data(),
+                       _M_if_none_match.length()))) {
     return false;
   }
 
-  const string::slice& host(_M_request->uri().host());
-  if (!_M_headers.add(header::permanent_field_name::kHost,
-                      host.data(),
-                      host.length())) {
+  if ((_M_if_modified_since != static_cast<time_t>(-1)) &&
+      (!_M_headers.add_timestamp(header::permanent_field_name::kIfModifiedSince,
+                                 _M_if_modified_since))) {
     return false;
   }
 
@@ -559,6 +957,84 @@ bool net::http::client::build_headers()
       _M_next_state = state::kReadingStatusLine;
   }
 
+  if (!end_request()) {
+    return false;
+  }
+
+  // Pipelined requests (always GET requests, sent back-to-back after the
+  // first one).
+  for (unsigned i = 0; i < _M_npipelined; i++) {
+    _M_headers.clear();
+
+    if ((!begin_request(method::kGet, pipelined_uri(i))) || (!end_request())) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool net::http::client::begin_request(http::method method,
+                                      const uri::uri& uri)
+{
+  string::slice m(methods::name(method));
+  const string::slice& path(uri.path());
+  const string::slice& query(uri.query());
+
+  if (query.length() == 0) {
+    if (!_M_out.format("%.*s %.*s HTTP/1.1\r\n",
+        m.length(),
+        m.data(),
+        path.length(),
+        path.data())) {
+      return false;
+    }
+  } else {
+    if (!_M_out.format("%.*s %.*s?%.*s HTTP/1.1\r\n",
+        m.length(),
+        m.data(),
+        path.length(),
+        path.data(),
+        query.length(),
+        query.data())) {
+      return false;
+    }
+  }
+
+  if (_M_persistent_connections) {
+    if (!_M_headers.add(header::permanent_field_name::kConnection,
+                        "keep-alive",
+                        10)) {
+      return false;
+    }
+  } else {
+    if (!_M_headers.add(header::permanent_field_name::kConnection,
+                        "close",
+                        5)) {
+      return false;
+    }
+  }
+
+  const string::slice& host(uri.host());
+  return _M_headers.add(header::permanent_field_name::kHost,
+                        host.data(),
+                        host.length());
+}
+
+bool net::http::client::end_request()
+{
+  // The ranges refer to the body as it is sent, don't ask for compressed
+  // bodies when the rest of a partial file is requested.
+  if ((_M_content_encoding != content_encoding::kIdentity) &&
+      (_M_headers.header(header::permanent_field_name::kRange).length() ==
+       0)) {
+    if (!_M_headers.add(header::permanent_field_name::kAcceptEncoding,
+                        "gzip, deflate",
+                        13)) {
+      return false;
+    }
+  }
+
   if (_M_user_agent) {
     if (!_M_headers.add(header::permanent_field_name::kUserAgent,
                         _M_user_agent->data(),
@@ -570,6 +1046,776 @@ bool net::http::client::build_headers()
   return _M_headers.serialize(_M_out);
 }
 
+void net::http::client::skip_body()
+{
+  _M_index_flags |= url_index::kFiltered;
+
+  // Get Transfer-Encoding header (if available).
+  string::slice encoding =
+    _M_headers.header(header::permanent_field_name::kTransferEncoding);
+
+  // If the whole body has been received with the headers...
+  uint64_t content_length;
+  if ((encoding.length() == 0) &&
+      (_M_headers.header(header::permanent_field_name::kContentLength,
+                         content_length)) &&
+      (content_length <= _M_in.length() - _M_inp)) {
+    // Skip it (the connection can be reused).
+    _M_inp += content_length;
+  } else {
+    // The body is not received.
+    _M_keep_alive = false;
+  }
+}
+
+bool net::http::client::resume_response()
+{
+  // If the server sends the rest of the body...
+  if (_M_status_code == 206) {
+    uint64_t first, last, length;
+    if ((!content_range(
+            _M_headers.header(header::permanent_field_name::kContentRange),
+            first,
+            last,
+            length
+          )) ||
+        (first != _M_resume_offset)) {
+      return false;
+    }
+
+    if (_M_download != range_coordinator::kNoDownload) {
+      const range_coordinator::download* d =
+        _M_coordinator->get(_M_download);
+
+      const range_coordinator::range* r = &d->ranges[_M_range];
+
+      // The whole range has to be sent, as it is.
+      uint64_t content_length;
+      if ((last != r->last) ||
+          (length != d->content_length) ||
+          (!_M_headers.header(header::permanent_field_name::kContentLength,
+                              content_length)) ||
+          (content_length != r->last - r->first + 1) ||
+          (_M_headers.header(header::permanent_field_name::kContentEncoding).
+           length() > 0)) {
+        return false;
+      }
+    } else if ((length == kUnknownLength) ||
+               (last + 1 != length) ||
+               ((_M_resume_length != kUnknownLength) &&
+                (length != _M_resume_length))) {
+      // Not the rest of the body of the partial file.
+      return false;
+    }
+
+    // The body is appended to the partial file (the status line and the
+    // headers of the first response are kept).
+    _M_status_code = 200;
+
+    _M_header_size = _M_resume_header_size;
+    _M_response_size = _M_header_size + _M_resume_offset;
+
+    return true;
+  }
+
+  // Any other response (a temporary error, for example) fails the request:
+  // the partial file is kept as it was (and resumed by the next run). If a
+  // range was requested, the file cannot be started again.
+  if ((_M_status_code != 200) ||
+      (_M_download != range_coordinator::kNoDownload)) {
+    return false;
+  }
+
+  // The resource has changed (or the server doesn't support ranges),
+  // start again.
+  _M_resume_offset = 0;
+  _M_resume_length = kUnknownLength;
+
+#if HAVE_IO_URING
+  _M_write_offset = 0;
+#endif
+
+  return ((_M_file.truncate(0)) &&
+          (_M_file.seek(0, fs::file::whence::kSeekSet) == 0));
+}
+
+bool net::http::client::resumable() const
+{
+  if ((_M_resume_min_size == 0) ||
+      (!_M_index) ||
+      (_M_buf) ||
+      (_M_download != range_coordinator::kNoDownload)) {
+    return false;
+  }
+
+  // Only responses with a known end (and whose body is saved as it is
+  // sent) can be resumed.
+  if (((_M_state != state::kHaveContentLength) &&
+       (_M_state != state::kChunkedTransferEncoding)) ||
+      (_M_index_flags != 0)) {
+    return false;
+  }
+
+#if HAVE_ZLIB
+  if (_M_decoder.active()) {
+    return false;
+  }
+#endif
+
+  if (_M_headers.header(header::permanent_field_name::kContentEncoding).
+      length() > 0) {
+    return false;
+  }
+
+  // Has enough of the body been received by this attempt (so that
+  // retrying the download always makes progress)?
+  if (_M_response_size - _M_header_size - _M_resume_offset <
+      _M_resume_min_size) {
+    return false;
+  }
+
+  // If the server ignored the range of a resumed download, don't try
+  // again.
+  if (_M_resume_offset > 0) {
+    return true;
+  }
+
+  string::slice value;
+  return ((_M_resume_header_size == 0) &&
+          (_M_status_code == 200) &&
+          (validator(_M_headers, value)));
+}
+
+bool net::http::client::keep_partial()
+{
+  off_t size;
+
+#if HAVE_IO_URING
+  if (_M_writer) {
+    if (_M_write_error) {
+      return false;
+    }
+
+    // The completions of the writes in flight are ignored after the error
+    // (a failed write would go unnoticed), so their blocks are written
+    // again synchronously (the data is the same).
+    for (unsigned i = 0; i < kWriteBuffers; i++) {
+      const write_buffer* buf = &_M_write_buffers[i];
+
+      if ((buf->busy) &&
+          (buf->generation == _M_write_generation) &&
+          (_M_file.pwrite(buf->data.data(), buf->data.length(), buf->offset) !=
+           static_cast<ssize_t>(buf->data.length()))) {
+        return false;
+      }
+    }
+
+    size = _M_write_offset;
+
+    // Write the block which is being filled.
+    if (_M_write_buffer != kNoWriteBuffer) {
+      const string::buffer& data = _M_write_buffers[_M_write_buffer].data;
+
+      if ((data.length() > 0) &&
+          (_M_file.pwrite(data.data(), data.length(), _M_write_offset) !=
+           static_cast<ssize_t>(data.length()))) {
+        return false;
+      }
+
+      size += data.length();
+    }
+  } else {
+#endif
+    // Write the staged data.
+    if (((_M_staging.length() > 0) && (!flush())) ||
+        ((size = _M_file.offset()) < 0)) {
+      return false;
+    }
+#if HAVE_IO_URING
+  }
+#endif
+
+  // The download is resumed after the bytes which are in the file.
+  struct stat sbuf;
+  if ((!_M_file.stat(sbuf)) ||
+      (sbuf.st_size < size) ||
+      (static_cast<uint64_t>(size) < _M_header_size)) {
+    return false;
+  }
+
+  _M_response_size = size;
+
+  return true;
+}
+
+bool net::http::client::splittable() const
+{
+  if ((!_M_coordinator) ||
+      (!_M_coordinator->split(_M_content_length)) ||
+      (!_M_filename) ||
+      (_M_buf) ||
+      (_M_resume_offset > 0) ||
+      (_M_download != range_coordinator::kNoDownload) ||
+      (_M_npipelined > 0) ||
+      (_M_status_code != 200) ||
+      (_M_request->method() != method::kGet)) {
+    return false;
+  }
+
+  // If the body would be truncated...
+  if ((_M_max_body_size > 0) && (_M_content_length > _M_max_body_size)) {
+    return false;
+  }
+
+#if HAVE_ZLIB
+  if (_M_decoder.active()) {
+    return false;
+  }
+#endif
+
+  if (_M_headers.header(header::permanent_field_name::kContentEncoding).
+      length() > 0) {
+    return false;
+  }
+
+  // The server has to accept ranges and the resource has to have a
+  // validator (the ranges are requested with If-Range).
+  string::slice value;
+  return ((contains_token(
+             _M_headers.header(header::permanent_field_name::kAcceptRanges),
+             "bytes",
+             5)) &&
+          (validator(_M_headers, value)));
+}
+
+void net::http::client::split()
+{
+  // Allocate the whole file.
+  if (!_M_file.allocate(_M_header_size, _M_content_length)) {
+    return;
+  }
+
+  string::slice value;
+  validator(_M_headers, value);
+
+  unsigned download = _M_coordinator->add(_M_request->uri(),
+                                          _M_request->address(),
+                                          _M_filename,
+                                          _M_header_size,
+                                          _M_content_length,
+                                          value);
+
+  if (download != range_coordinator::kNoDownload) {
+    _M_download = download;
+    _M_range = 0;
+
+    // Receive the first range and close the connection.
+    _M_content_length = _M_coordinator->get(download)->ranges[0].last + 1;
+    _M_keep_alive = false;
+  }
+}
+
+bool net::http::client::validator(const header::headers& headers,
+                                  string::slice& value)
+{
+  // Weak entity tags cannot be used with If-Range.
+  value = headers.header(header::permanent_field_name::kETag);
+  if ((value.length() > 0) &&
+      ((value.length() < 2) || (strncmp(value.data(), "W/", 2) != 0))) {
+    return true;
+  }
+
+  value = headers.header(header::permanent_field_name::kLastModified);
+  return (value.length() > 0);
+}
+
+bool net::http::client::content_range(const string::slice& value,
+                                      uint64_t& first,
+                                      uint64_t& last,
+                                      uint64_t& length)
+{
+  // Content-Range: bytes <first>-<last>/<length> (<length> can be '*').
+  if ((value.length() <= 6) ||
+      (strncasecmp(value.data(), "bytes ", 6) != 0)) {
+    return false;
+  }
+
+  const char* begin = value.data() + 6;
+  const char* end = value.data() + value.length();
+
+  const char* dash;
+  const char* slash;
+  if (((dash = static_cast<const char*>(memchr(begin, '-', end - begin))) ==
+       NULL) ||
+      ((slash = static_cast<const char*>(memchr(dash, '/', end - dash))) ==
+       NULL) ||
+      (util::number::parse(begin, dash - begin, first) !=
+       util::number::parse_result::kSucceeded) ||
+      (util::number::parse(dash + 1, slash - (dash + 1), last) !=
+       util::number::parse_result::kSucceeded) ||
+      (last < first)) {
+    return false;
+  }
+
+  if ((end - slash == 2) && (slash[1] == '*')) {
+    length = kUnknownLength;
+    return true;
+  }
+
+  return ((util::number::parse(slash + 1, end - (slash + 1), length) ==
+           util::number::parse_result::kSucceeded) &&
+          (last < length));
+}
+
+bool net::http::client::next_response()
+{
+  pipelined_request* r = &_M_pipeline[_M_pipeline_head];
+
+  // If the response is not appended to the archive...
+  if (r->filename) {
+    if (!_M_file.open(r->filename, O_CREAT | O_TRUNC | O_WRONLY, 0644)) {
+      return false;
+    }
+
+    _M_filename = r->filename;
+    r->filename = NULL;
+
+#if HAVE_IO_URING
+    _M_write_offset = 0;
+    _M_write_error = false;
+#endif
+  }
+
+  socket_address addr(_M_request->address());
+
+  _M_request->clear();
+  _M_request->init(addr, method::kGet, util::move(r->uri));
+
+  _M_pipeline_head = (_M_pipeline_head + 1) % kMaxPipeliningDepth;
+  _M_npipelined--;
+
+  // Move the data received after the response to the beginning of the
+  // input buffer.
+  size_t left = _M_in.length() - _M_inp;
+  if (left > 0) {
+    memmove(_M_in.data(), _M_in.data() + _M_inp, left);
+  }
+
+  _M_in.length(left);
+  _M_inp = 0;
+
+  _M_reason_phrase_len = 0;
+  _M_response_size = 0;
+  _M_response_limit = kNoLimit;
+  _M_index_flags = 0;
+  _M_resume_offset = 0;
+  _M_if_none_match.clear();
+  _M_if_modified_since = static_cast<time_t>(-1);
+  _M_keep_alive = false;
+
+  _M_substate = 0;
+
+  _M_state = state::kReadingStatusLine;
+
+  return true;
+}
+
+#if HAVE_IO_URING
+void net::http::client::on_write(uint64_t user_data, int res)
+{
+  unsigned idx = static_cast<unsigned>((user_data >> 24) & 0xff);
+  write_buffer* buf = &_M_write_buffers[idx];
+
+  // If the write belongs to the current response...
+  if (static_cast<uint32_t>(user_data >> 32) == _M_write_generation) {
+    _M_nwrites--;
+
+    if (res < 0) {
+      _M_write_error = true;
+    } else if (static_cast<size_t>(res) < buf->data.length()) {
+      // Write the rest synchronously.
+      size_t left = buf->data.length() - res;
+      if (_M_file.pwrite(buf->data.data() + res, left, buf->offset + res) !=
+          static_cast<ssize_t>(left)) {
+        _M_write_error = true;
+      }
+    }
+  }
+
+  buf->data.clear();
+  buf->busy = false;
+
+  if (_M_write_buffer == kNoWriteBuffer) {
+    _M_write_buffer = idx;
+  }
+}
+
+bool net::http::client::write_async(const void* data, size_t len)
+{
+  // If all the buffers are being written...
+  if (_M_write_buffer == kNoWriteBuffer) {
+    if (_M_file.pwrite(data, len, _M_write_offset) !=
+        static_cast<ssize_t>(len)) {
+      return false;
+    }
+
+    _M_write_offset += len;
+
+    return true;
+  }
+
+  write_buffer* buf = &_M_write_buffers[_M_write_buffer];
+  if (!buf->data.append(reinterpret_cast<const char*>(data), len)) {
+    return false;
+  }
+
+  return ((buf->data.length() < _M_flush_threshold) || (submit_write()));
+}
+
+bool net::http::client::submit_write()
+{
+  write_buffer* buf = &_M_write_buffers[_M_write_buffer];
+  size_t len = buf->data.length();
+
+  buf->offset = _M_write_offset;
+  _M_write_offset += len;
+
+  if (_M_writer->write(_M_file.fd(),
+                       buf->data.data(),
+                       len,
+                       buf->offset,
+                       (static_cast<uint64_t>(_M_write_generation) << 32) |
+                       (_M_write_buffer << 24) |
+                       fd())) {
+    buf->busy = true;
+    buf->generation = _M_write_generation;
+    _M_nwrites++;
+
+    // Fill the next buffer which is not being written.
+    _M_write_buffer = kNoWriteBuffer;
+    for (unsigned i = 0; i < kWriteBuffers; i++) {
+      if (!_M_write_buffers[i].busy) {
+        _M_write_buffer = i;
+        break;
+      }
+    }
+  } else {
+    // There is no room in the ring.
+    if (_M_file.pwrite(buf->data.data(), len, buf->offset) !=
+        static_cast<ssize_t>(len)) {
+      return false;
+    }
+
+    buf->data.clear();
+  }
+
+  return true;
+}
+
+void net::http::client::cancel_writes()
+{
+  if (_M_nwrites > 0) {
+    // The descriptor of the file might be reused as soon as it is closed.
+    _M_writer->submit();
+
+    _M_nwrites = 0;
+    _M_write_generation++;
+  }
+
+  _M_write_buffer = kNoWriteBuffer;
+
+  for (unsigned i = 0; i < kWriteBuffers; i++) {
+    if (!_M_write_buffers[i].busy) {
+      _M_write_buffers[i].data.clear();
+
+      if (_M_write_buffer == kNoWriteBuffer) {
+        _M_write_buffer = i;
+      }
+    }
+  }
+
+  _M_write_offset = 0;
+  _M_write_error = false;
+}
+#endif
+
+bool net::http::client::flush(const void* data, size_t len)
+{
+  // Write both buffers with a single system call.
+  struct iovec iov[2];
+  iov[0].iov_base = _M_staging.data();
+  iov[0].iov_len = _M_staging.length();
+  iov[1].iov_base = const_cast<void*>(data);
+  iov[1].iov_len = len;
+
+  unsigned iovcnt = (len > 0) ? 2 : 1;
+  size_t total = iov[0].iov_len + len;
+
+  bool ret = (_M_file.writev(iov, iovcnt) == static_cast<ssize_t>(total));
+
+  _M_staging.clear();
+
+  return ret;
+}
+
+#if HAVE_SPLICE
+io::event_handler::result net::http::client::splice(size_t len, size_t& count)
+{
+  off_t* offset = NULL;
+
+#if HAVE_IO_URING
+  if (_M_writer) {
+    // Submit the data received so far, the body is written after it.
+    if ((_M_write_buffer != kNoWriteBuffer) &&
+        (_M_write_buffers[_M_write_buffer].data.length() > 0) &&
+        (!submit_write())) {
+      return io::event_handler::result::kError;
+    }
+
+    offset = &_M_write_offset;
+  }
+#endif
+
+  // If the body has reached the maximum size...
+  uint64_t left = _M_response_limit - _M_response_size;
+  if (left == 0) {
+    _M_truncated = (_M_body_limit_action == body_limit_action::kTruncate);
+    return io::event_handler::result::kError;
+  } else if (len > left) {
+    len = left;
+  }
+
+  // Write the staged data.
+  if ((_M_staging.length() > 0) && (!flush())) {
+    return io::event_handler::result::kError;
+  }
+
+  ssize_t ret;
+  switch (ret = _M_splicer->splice(fd(), _M_file.fd(), offset, len)) {
+    case -1:
+      if (errno == EAGAIN) {
+        count = 0;
+        _M_readable = 0;
+
+        return io::event_handler::result::kSuccess;
+      }
+
+      return io::event_handler::result::kError;
+    case 0:
+      // The peer has performed an orderly shutdown.
+      return io::event_handler::result::kError;
+    default:
+      count = ret;
+      _M_response_size += ret;
+
+      return io::event_handler::result::kSuccess;
+  }
+}
+#endif
+
+bool net::http::client::save_headers()
+{
+#if HAVE_ZLIB
+  if (_M_decoder.active()) {
+    // The saved headers have to describe the saved body: remove
+    // Content-Encoding and Content-Length (the decompressed body is
+    // delimited by the end of the record).
+    const char* ptr = _M_in.data();
+    const char* end = ptr + _M_inp;
+    bool skip = false;
+
+    while (ptr < end) {
+      const char* eol;
+      if ((eol = static_cast<const char*>(memchr(ptr, '\n', end - ptr))) ==
+          NULL) {
+        eol = end;
+      } else {
+        eol++;
+      }
+
+      // If not a continuation line...
+      if ((*ptr != ' ') && (*ptr != '\t')) {
+        size_t len = eol - ptr;
+
+        skip = (((len > 16) &&
+                 (strncasecmp(ptr, "Content-Encoding", 16) == 0) &&
+                 ((ptr[16] == ':') || (util::is_white_space(ptr[16])))) ||
+                ((len > 14) &&
+                 (strncasecmp(ptr, "Content-Length", 14) == 0) &&
+                 ((ptr[14] == ':') || (util::is_white_space(ptr[14])))));
+      }
+
+      if ((!skip) && (!add_data(ptr, eol - ptr))) {
+        return false;
+      }
+
+      ptr = eol;
+    }
+
+    return true;
+  }
+#endif
+
+  return add_data(_M_in.data(), _M_inp);
+}
+
+#if HAVE_ZLIB
+bool net::http::client::start_decoding()
+{
+  if (_M_content_encoding != content_encoding::kDecoded) {
+    return true;
+  }
+
+  // Get Content-Encoding header (if available).
+  string::slice encoding =
+    _M_headers.header(header::permanent_field_name::kContentEncoding);
+
+  decoder::encoding e;
+
+  switch (encoding.length()) {
+    case 4:
+      if (strncasecmp(encoding.data(), "gzip", 4) != 0) {
+        // Other encodings are saved as received.
+        return true;
+      }
+
+      e = decoder::encoding::kGzip;
+      break;
+    case 6:
+      if (strncasecmp(encoding.data(), "x-gzip", 6) != 0) {
+        return true;
+      }
+
+      e = decoder::encoding::kGzip;
+      break;
+    case 7:
+      if (strncasecmp(encoding.data(), "deflate", 7) != 0) {
+        return true;
+      }
+
+      e = decoder::encoding::kDeflate;
+      break;
+    default:
+      return true;
+  }
+
+  if (!_M_decoder.init(e)) {
+    return false;
+  }
+
+  _M_index_flags |= url_index::kDecoded;
+
+  return true;
+}
+
+bool net::http::client::decode(const void* data, size_t len)
+{
+  const uint8_t* in = static_cast<const uint8_t*>(data);
+  uint8_t out[kDecodeBufferSize];
+  size_t inlen, outlen;
+
+  do {
+    inlen = len;
+    outlen = sizeof(out);
+
+    if (!_M_decoder.decode(in, inlen, out, outlen)) {
+      return false;
+    }
+
+    if ((outlen > 0) && (!add_data(out, outlen))) {
+      return false;
+    }
+
+    in += inlen;
+    len -= inlen;
+
+    // While the output buffer gets filled or the input is consumed...
+  } while ((outlen == sizeof(out)) || ((len > 0) && (inlen > 0)));
+
+  return true;
+}
+#endif
+
+io::event_handler::result net::http::client::truncated()
+{
+#if HAVE_ZLIB
+  // The compressed body is incomplete.
+  _M_decoder.clear();
+#endif
+
+  _M_index_flags |= url_index::kTruncated;
+
+  // The rest of the body is not received.
+  _M_keep_alive = false;
+
+  return finished();
+}
+
+void net::http::client::add_to_index(uint64_t file,
+                                     off_t offset,
+                                     uint16_t flags)
+{
+  url_index::entry e;
+  e.file = file;
+  e.offset = offset;
+  e.content_length = _M_response_size - _M_header_size;
+  e.status_code = _M_status_code;
+  e.flags = flags | _M_index_flags;
+
+  // If the entry cannot be added, the response is still saved.
+  _M_index->add(_M_request->uri().string(), e);
+}
+
+bool net::http::client::persistent() const
+{
+  if (!_M_persistent_connections) {
+    return false;
+  }
+
+  // Get Connection header (if available).
+  string::slice connection =
+    _M_headers.header(header::permanent_field_name::kConnection);
+
+  if (contains_token(connection, "close", 5)) {
+    return false;
+  }
+
+  // HTTP/1.0 connections are only persistent if the server says so.
+  if ((_M_major_number == 1) && (_M_minor_number == 0)) {
+    return contains_token(connection, "keep-alive", 10);
+  }
+
+  return true;
+}
+
+bool net::http::client::contains_token(const string::slice& value,
+                                       const char* token,
+                                       size_t len)
+{
+  const char* ptr = value.data();
+  const char* end = ptr + value.length();
+
+  // Format: token *( "," token )
+  while (ptr < end) {
+    // Skip separators.
+    while ((ptr < end) && ((*ptr == ',') || (util::is_white_space(*ptr)))) {
+      ptr++;
+    }
+
+    const char* begin = ptr;
+    while ((ptr < end) && (*ptr != ',') && (!util::is_white_space(*ptr))) {
+      ptr++;
+    }
+
+    if ((static_cast<size_t>(ptr - begin) == len) &&
+        (strncasecmp(begin, token, len) == 0)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
 net::http::client::parse_result net::http::client::parse_status_line()
 {
   const uint8_t* data = reinterpret_cast<const uint8_t*>(_M_in.data());
@@ -868,7 +2114,7 @@ net::http::client::parse_result net::http::client::parse_chunked_body()
         _M_received = len - _M_inp;
 
         if (_M_received < _M_chunk_size) {
-          if (!add_data(data + _M_inp, _M_received)) {
+          if (!add_body(data + _M_inp, _M_received)) {
             return parse_result::kInvalidData;
           }
 
@@ -879,7 +2125,7 @@ net::http::client::parse_result net::http::client::parse_chunked_body()
 
           return parse_result::kNotEndOfData;
         } else {
-          if (!add_data(data + _M_inp, _M_chunk_size)) {
+          if (!add_body(data + _M_inp, _M_chunk_size)) {
             return parse_result::kInvalidData;
           }
 
@@ -894,7 +2140,7 @@ net::http::client::parse_result net::http::client::parse_chunked_body()
           size_t left = _M_chunk_size - _M_received;
 
           if (len < left) {
-            if (!add_data(data, len)) {
+            if (!add_body(data, len)) {
               return parse_result::kInvalidData;
             }
 
@@ -904,7 +2150,7 @@ net::http::client::parse_result net::http::client::parse_chunked_body()
 
             return parse_result::kNotEndOfData;
           } else {
-            if (!add_data(data, left)) {
+            if (!add_body(data, left)) {
               return parse_result::kInvalidData;
             }
 
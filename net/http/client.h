@@ -3,17 +3,74 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <unistd.h>
 #include "net/tcp_connection.h"
 #include "net/http/request.h"
+#include "net/http/archive.h"
+#include "net/http/url_index.h"
+#include "net/http/response_filter.h"
+#include "net/http/range_coordinator.h"
 #include "net/http/header/headers.h"
 
+#if HAVE_IO_URING
+  #include "fs/uring_writer.h"
+#endif
+
+#if HAVE_SPLICE
+  #include "net/splicer.h"
+#endif
+
+#if HAVE_ZLIB
+  #include "net/http/decoder.h"
+#endif
+
 namespace net {
   namespace http {
     class client : public tcp_connection {
       public:
         static const size_t kDefaultMaxBufferSize = 32 * 1024;
         static const off_t kDefaultMaxFileSize = 0; // No limit.
+        static const size_t kDefaultFlushThreshold = 256 * 1024;
+        static const uint64_t kDefaultMaxBodySize = 0; // No limit.
+        static const uint64_t kDefaultResumeMinSize = 1024 * 1024;
+        static const unsigned kMaxPipeliningDepth = 16;
+
+        // Compressed responses (Content-Encoding).
+        enum class content_encoding : uint8_t {
+          kIdentity, // Don't ask for compressed responses.
+          kRaw,      // Save the body as received.
+          kDecoded   // Save the decompressed body.
+        };
+
+#if HAVE_ZLIB
+        static const content_encoding kDefaultContentEncoding =
+                                        content_encoding::kDecoded;
+#else
+        static const content_encoding kDefaultContentEncoding =
+                                        content_encoding::kIdentity;
+#endif
+
+        // What is done with the responses whose body is bigger than the
+        // maximum (the connection is closed in both cases).
+        enum class body_limit_action : uint8_t {
+          kDiscard,
+          kTruncate // Save the beginning of the body (marked as truncated).
+        };
+
+        // Phase of the request (each one has its own timeout).
+        enum class phase : uint8_t {
+          kConnecting,
+          kPerformingHandshake,
+          kWaitingForResponse, // Nothing of the response received yet.
+          kReceivingHeaders,
+          kReceivingBody,
+          kWritingFile, // Waiting for the writes of the response.
+          kIdle
+        };
+
+        static const size_t kNumberPhases =
+                              static_cast<size_t>(phase::kIdle) + 1;
 
         // Constructor.
         client();
@@ -38,12 +95,131 @@ namespace net {
                   const char* filename,
                   off_t max_file_size);
 
+        // Initialize (the response is appended to the archive when it has
+        // been received, responses bigger than max_record_size are
+        // discarded).
+        void init(request* req, archive* arc, size_t max_record_size);
+
+        // Initialize to resume the download of a partial file ('received'
+        // is the length of the body which has been saved), the rest of
+        // the body is requested with Range and If-Range.
+        bool resume(request* req, const char* filename, uint64_t received);
+
+        // Initialize to receive a range of a download which has been split
+        // by the coordinator.
+        bool receive(request* req, unsigned download, unsigned range);
+
+        // Make the request conditional (call after init()): the ETag is
+        // sent in If-None-Match and the date in If-Modified-Since (-1: not
+        // sent). A 304 response is saved without body and flagged as
+        // unchanged in the index.
+        bool conditional(const string::slice& etag, time_t last_modified);
+
         // Clear.
         void clear();
 
+        // Resolving host?
+        bool resolving() const;
+
+        // Set whether the host is being resolved.
+        void resolving(bool value);
+
+        // Abort (the connection has not been established).
+        void abort();
+
+        // Idle (the response has been received and the connection can be
+        // reused)?
+        bool idle() const;
+
+        // Get phase.
+        phase current_phase() const;
+
+        // Get number of bytes of the response saved so far.
+        uint64_t response_size() const;
+
+        // Reuse the connection for a new request (call init() afterwards).
+        void reuse();
+
+        // Can the request be retried on a new connection (the reused
+        // connection has been closed before receiving the response)?
+        bool retryable() const;
+
+        // Has the partial file been kept after an error (the download can
+        // be resumed)?
+        bool partial() const;
+
+        // Is the client receiving a range of a split download?
+        bool receiving_range() const;
+
+        // Pipeline request (it will be sent after the current one, only
+        // possible for connections being reused whose request has not been
+        // sent yet). The filename is NULL if the responses are appended to
+        // the archive.
+        bool pipeline(uri::uri&& uri, const char* filename);
+
+        // Get number of pipelined requests whose response has not been
+        // received yet.
+        unsigned pipelined() const;
+
+        // Get URI of pipelined request.
+        const uri::uri& pipelined_uri(unsigned idx) const;
+
+        // Set index of the saved responses.
+        void index(url_index* idx);
+
+        // Set coordinator of the downloads split in ranges (the big
+        // responses are received over several connections).
+        void coordinator(range_coordinator* c);
+
+#if HAVE_IO_URING
+        // Set asynchronous writer of the files (the response is finished
+        // when all its writes have completed).
+        void writer(fs::uring_writer* w);
+
+        // Get file descriptor of the client of a write.
+        static unsigned write_owner(uint64_t user_data);
+
+        // On write completed.
+        void on_write(uint64_t user_data, int res);
+
+        // Has the response been received and written (the client has to
+        // be run again)?
+        bool written() const;
+#endif
+
+#if HAVE_SPLICE
+        // Set splicer (the body of plain HTTP responses which are saved to
+        // files is moved from the socket to the file without copying it).
+        void splicer(net::splicer* s);
+#endif
+
         // Set User-Agent.
         static void user_agent(const string::buffer* user_agent);
 
+        // Enable/disable persistent connections.
+        static void persistent_connections(bool enabled);
+
+        // Set how much of the response is buffered before writing it to
+        // the file.
+        static void flush_threshold(size_t size);
+
+        // Set whether compressed responses are accepted and how they are
+        // saved.
+        static void accept_encoding(content_encoding encoding);
+
+        // Set maximum size of the body of the responses (0: no limit).
+        static void max_body_size(uint64_t size, body_limit_action action);
+
+        // Set filter of the responses (only the status line and the headers
+        // of the responses which don't match are saved).
+        static void filter(const response_filter* f);
+
+        // Set / get how much of the body has to be received by an attempt
+        // for its partial file to be kept when the download fails (0: the
+        // partial files are removed).
+        static void resume_min_size(uint64_t size);
+        static uint64_t resume_min_size();
+
         // Run.
         io::event_handler::result run();
 
@@ -56,12 +232,37 @@ namespace net {
         static const size_t kChunkExtensionMaxLen = 1024;
         static const size_t kChunkTrailerMaxLen = 1024;
 
+        // Bigger record buffers are freed after each response.
+        static const size_t kMaxKeptRecordBuffer = 256 * 1024;
+
+        static const uint64_t kNoLimit = ~static_cast<uint64_t>(0);
+
+        // Unknown length of the body.
+        static const uint64_t kUnknownLength = ~static_cast<uint64_t>(0);
+
+        // Maximum size of the URI, the status line and the headers of a
+        // partial file.
+        static const size_t kMaxResumeHeaderSize = 96 * 1024;
+
         request* _M_request;
 
         header::headers _M_headers;
 
         static const string::buffer* _M_user_agent;
 
+        static bool _M_persistent_connections;
+
+        static size_t _M_flush_threshold;
+
+        static content_encoding _M_content_encoding;
+
+        static uint64_t _M_max_body_size;
+        static body_limit_action _M_body_limit_action;
+
+        static const response_filter* _M_filter;
+
+        static uint64_t _M_resume_min_size;
+
         string::buffer* _M_buf;
         size_t _M_max_buffer_size;
 
@@ -69,6 +270,15 @@ namespace net {
         fs::file _M_file;
         off_t _M_max_file_size;
 
+        // Data which has not been written to the file yet.
+        string::buffer _M_staging;
+
+        // Archive (the response is kept in _M_record until it has been
+        // received).
+        archive* _M_archive;
+        string::buffer _M_record;
+        size_t _M_max_record_size;
+
         unsigned _M_iovcnt;
 
         unsigned _M_major_number;
@@ -82,11 +292,124 @@ namespace net {
         uint64_t _M_content_length;
         uint64_t _M_received;
 
+        uint64_t _M_response_size;
+
+        // Number of bytes of the response before the body.
+        uint64_t _M_header_size;
+
+        // Maximum size of the response (headers + body).
+        uint64_t _M_response_limit;
+
+        // Has the body reached the maximum size (the response is saved
+        // truncated by error())?
+        bool _M_truncated;
+
+        // Flags of the index entry of the response (kTruncated,
+        // kFiltered, kUnchanged, kDecoded).
+        uint16_t _M_index_flags;
+
+        // Length of the body saved by the previous attempts (0: the
+        // download is not being resumed).
+        uint64_t _M_resume_offset;
+
+        // Number of bytes of the partial file before the body.
+        uint64_t _M_resume_header_size;
+
+        // Length of the whole body of the partial file (kUnknownLength: the
+        // first response was chunked).
+        uint64_t _M_resume_length;
+
+        // ETag or Last-Modified of the partial file (If-Range).
+        string::buffer _M_validator;
+
+        bool _M_partial;
+
+        // Validators of the conditional request (If-None-Match,
+        // If-Modified-Since: -1 if not sent).
+        string::buffer _M_if_none_match;
+        time_t _M_if_modified_since;
+
+        url_index* _M_index;
+
+        range_coordinator* _M_coordinator;
+
+        // Download and range being received (kNoDownload: the response is
+        // not split).
+        unsigned _M_download;
+        unsigned _M_range;
+
+#if HAVE_IO_URING
+        // The file is written in blocks of _M_flush_threshold bytes.
+        static const unsigned kWriteBuffers = 2;
+
+        // All the buffers are being written.
+        static const unsigned kNoWriteBuffer = kWriteBuffers;
+
+        fs::uring_writer* _M_writer;
+
+        struct write_buffer {
+          string::buffer data;
+          off_t offset;
+
+          // Submitted and not completed yet?
+          bool busy;
+
+          // Generation of the response of the write.
+          uint32_t generation;
+        };
+
+        write_buffer _M_write_buffers[kWriteBuffers];
+
+        // Buffer being filled.
+        unsigned _M_write_buffer;
+
+        // Offset of the next block.
+        off_t _M_write_offset;
+
+        // Number of writes of the response which have not completed.
+        unsigned _M_nwrites;
+
+        bool _M_write_error;
+
+        // The completions of previous responses are ignored.
+        uint32_t _M_write_generation;
+#endif
+
+#if HAVE_SPLICE
+        net::splicer* _M_splicer;
+#endif
+
+#if HAVE_ZLIB
+        // The body is decompressed in blocks of kDecodeBufferSize bytes.
+        static const size_t kDecodeBufferSize = 16 * 1024;
+
+        decoder _M_decoder;
+#endif
+
         size_t _M_chunk_size;
         size_t _M_chunk_extension_len;
         size_t _M_chunk_trailer_len;
 
+        // Can the connection be reused after the response?
+        bool _M_keep_alive;
+
+        // Has the connection been reused?
+        bool _M_reused;
+
+        struct pipelined_request {
+          uri::uri uri;
+          char* filename;
+        };
+
+        // Pipelined requests (circular buffer of kMaxPipeliningDepth
+        // entries, allocated the first time a request is pipelined).
+        pipelined_request* _M_pipeline;
+        unsigned _M_pipeline_head;
+        unsigned _M_npipelined;
+
         enum class state : uint8_t {
+          kResolving,
+          kReusingConnection,
           kConnecting,
           kConnected,
 
@@ -102,6 +425,12 @@ namespace net {
           kHaveContentLength,
           kDontHaveContentLength,
           kChunkedTransferEncoding,
+
+#if HAVE_IO_URING
+          kWritingFile,
+#endif
+
+          kIdle,
           kFinished
         };
 
@@ -110,9 +439,66 @@ namespace net {
 
         uint8_t _M_substate;
 
+        // Reset (keeping the connection).
+        void reset();
+
         // Build headers.
         bool build_headers();
 
+        // Build request line and common headers.
+        bool begin_request(http::method method, const uri::uri& uri);
+
+        // Add last headers and serialize them.
+        bool end_request();
+
+        // Don't save the body of the response (it is skipped if it has been
+        // received with the headers, otherwise the connection is closed).
+        void skip_body();
+
+        // Continue the partial file if the response is the rest of the
+        // body, start it again if it is a 200 response, otherwise fail (the
+        // partial file is kept).
+        bool resume_response();
+
+        // Can the partial file be kept after an error?
+        bool resumable() const;
+
+        // Write the data of the partial file which has not been written
+        // yet (the size of the response is set to the size of the file).
+        bool keep_partial();
+
+        // Can the body be split in ranges?
+        bool splittable() const;
+
+        // Split the body in ranges (the first one is received by this
+        // client, the rest over new connections).
+        void split();
+
+        // Get the validator of the response for If-Range (a strong ETag or
+        // Last-Modified).
+        static bool validator(const header::headers& headers,
+                              string::slice& value);
+
+        // Has the response a body (RFC 2616: 4.4 Message length)?
+        bool has_body() const;
+
+        // Parse Content-Range (length: kUnknownLength if it is '*').
+        static bool content_range(const string::slice& value,
+                                  uint64_t& first,
+                                  uint64_t& last,
+                                  uint64_t& length);
+
+        // Prepare for the response of the next pipelined request.
+        bool next_response();
+
+        // Is the connection persistent (according to the response)?
+        bool persistent() const;
+
+        // Does the header value contain the token?
+        static bool contains_token(const string::slice& value,
+                                   const char* token,
+                                   size_t len);
+
         enum class parse_result {
           kInvalidData,
           kNotEndOfData,
@@ -128,12 +514,64 @@ namespace net {
         // Add data.
         bool add_data(const void* data, size_t len);
 
+        // Add data of the message body (decompressed if needed).
+        bool add_body(const void* data, size_t len);
+
+        // Save the Status-Line and the headers (without Content-Encoding and
+        // Content-Length if the body is decompressed).
+        bool save_headers();
+
+#if HAVE_ZLIB
+        // Start decompressing the body (if the response is compressed).
+        bool start_decoding();
+
+        // Decompress data of the message body and add it.
+        bool decode(const void* data, size_t len);
+#endif
+
+        // Write to the file.
+        bool write_file(const void* data, size_t len);
+
+        // Write the staged data followed by 'data' to the file.
+        bool flush(const void* data = NULL, size_t len = 0);
+
+#if HAVE_SPLICE
+        // Can the body be moved from the socket to the file?
+        bool can_splice() const;
+
+        // Move up to 'len' bytes of the body from the socket to the file
+        // (same results as read()).
+        io::event_handler::result splice(size_t len, size_t& count);
+#endif
+
+#if HAVE_IO_URING
+        // Add data to the buffer being filled (or write it synchronously if
+        // all the buffers are being written).
+        bool write_async(const void* data, size_t len);
+
+        // Submit the buffer being filled.
+        bool submit_write();
+
+        // Forget the writes of the response (the queued writes are
+        // submitted, the buffers are freed when they complete).
+        void cancel_writes();
+#endif
+
+        // Empty the record buffer.
+        void clear_record();
+
+        // Add the saved response to the index.
+        void add_to_index(uint64_t file, off_t offset, uint16_t flags);
+
         // On error.
         void on_error();
 
         io::event_handler::result finished();
         io::event_handler::result error();
 
+        // Save the truncated response and close the connection.
+        io::event_handler::result truncated();
+
         // Disable copy constructor and assignment operator.
         client(const client&) = delete;
         client& operator=(const client&) = delete;
@@ -145,9 +583,47 @@ namespace net {
         _M_max_buffer_size(kDefaultMaxBufferSize),
         _M_filename(NULL),
         _M_max_file_size(kDefaultMaxFileSize),
+        _M_archive(NULL),
+        _M_max_record_size(0),
         _M_reason_phrase_len(0),
+        _M_response_size(0),
+        _M_header_size(0),
+        _M_response_limit(kNoLimit),
+        _M_truncated(false),
+        _M_index_flags(0),
+        _M_resume_offset(0),
+        _M_resume_header_size(0),
+        _M_resume_length(kUnknownLength),
+        _M_partial(false),
+        _M_if_modified_since(static_cast<time_t>(-1)),
+        _M_index(NULL),
+        _M_coordinator(NULL),
+        _M_download(range_coordinator::kNoDownload),
+        _M_range(0),
+#if HAVE_IO_URING
+        _M_writer(NULL),
+        _M_write_buffer(0),
+        _M_write_offset(0),
+        _M_nwrites(0),
+        _M_write_error(false),
+        _M_write_generation(0),
+#endif
+#if HAVE_SPLICE
+        _M_splicer(NULL),
+#endif
+        _M_keep_alive(false),
+        _M_reused(false),
+        _M_pipeline(NULL),
+        _M_pipeline_head(0),
+        _M_npipelined(0),
         _M_state(state::kConnecting)
     {
+#if HAVE_IO_URING
+      for (unsigned i = 0; i < kWriteBuffers; i++) {
+        _M_write_buffers[i].offset = 0;
+        _M_write_buffers[i].busy = false;
+      }
+#endif
     }
 
     inline client::~client()
@@ -155,6 +631,16 @@ namespace net {
       if (_M_filename) {
         ::free(_M_filename);
       }
+
+      if (_M_pipeline) {
+        for (unsigned i = 0; i < kMaxPipeliningDepth; i++) {
+          if (_M_pipeline[i].filename) {
+            ::free(_M_pipeline[i].filename);
+          }
+        }
+
+        delete [] _M_pipeline;
+      }
     }
 
     inline void client::init(request* req,
@@ -166,47 +652,450 @@ namespace net {
       _M_max_buffer_size = max_buffer_size;
     }
 
+    inline void client::init(request* req,
+                             archive* arc,
+                             size_t max_record_size)
+    {
+      _M_request = req;
+
+      _M_archive = arc;
+      _M_max_record_size = max_record_size;
+    }
+
+    inline bool client::resolving() const
+    {
+      return (_M_state == state::kResolving);
+    }
+
+    inline void client::resolving(bool value)
+    {
+      _M_state = value ? state::kResolving : state::kConnecting;
+    }
+
+    inline void client::abort()
+    {
+      on_error();
+    }
+
+    inline bool client::idle() const
+    {
+      return (_M_state == state::kIdle);
+    }
+
+    inline client::phase client::current_phase() const
+    {
+      switch (_M_state) {
+        case state::kResolving:
+        case state::kConnecting:
+        case state::kConnected:
+          return phase::kConnecting;
+#if HAVE_SSL
+        case state::kPerformingHandshake:
+          return phase::kPerformingHandshake;
+#endif
+        case state::kReusingConnection:
+        case state::kSendingRequest:
+        case state::kSendingMessageBody:
+          return phase::kWaitingForResponse;
+        case state::kReadingStatusLine:
+          return (_M_in.length() == 0) ? phase::kWaitingForResponse :
+                                         phase::kReceivingHeaders;
+        case state::kReadingHeaders:
+        case state::kProcessingHeaders:
+          return phase::kReceivingHeaders;
+#if HAVE_IO_URING
+        case state::kWritingFile:
+          return phase::kWritingFile;
+#endif
+        case state::kIdle:
+          return phase::kIdle;
+        default:
+          return phase::kReceivingBody;
+      }
+    }
+
+    inline uint64_t client::response_size() const
+    {
+      return _M_response_size;
+    }
+
+    inline void client::reuse()
+    {
+      tcp_connection::clear();
+
+      release_input();
+
+      reset();
+
+      _M_reused = true;
+
+      _M_state = state::kReusingConnection;
+    }
+
+    inline bool client::retryable() const
+    {
+      // Nothing has been received yet.
+      return ((_M_reused) &&
+              ((_M_state == state::kSendingRequest) ||
+               (_M_state == state::kSendingMessageBody) ||
+               (_M_state == state::kReadingStatusLine)) &&
+              (_M_in.length() == 0));
+    }
+
+    inline bool client::partial() const
+    {
+      return _M_partial;
+    }
+
+    inline bool client::receiving_range() const
+    {
+      return (_M_download != range_coordinator::kNoDownload);
+    }
+
+    inline bool client::conditional(const string::slice& etag,
+                                    time_t last_modified)
+    {
+      _M_if_modified_since = last_modified;
+      return _M_if_none_match.append(etag.data(), etag.length());
+    }
+
+    inline unsigned client::pipelined() const
+    {
+      return _M_npipelined;
+    }
+
+    inline const uri::uri& client::pipelined_uri(unsigned idx) const
+    {
+      return _M_pipeline[(_M_pipeline_head + idx) % kMaxPipeliningDepth].uri;
+    }
+
+    inline void client::index(url_index* idx)
+    {
+      _M_index = idx;
+    }
+
+    inline void client::coordinator(range_coordinator* c)
+    {
+      _M_coordinator = c;
+    }
+
+#if HAVE_IO_URING
+    inline void client::writer(fs::uring_writer* w)
+    {
+      _M_writer = w;
+    }
+
+    inline unsigned client::write_owner(uint64_t user_data)
+    {
+      // <generation (32 bits)> <buffer (8 bits)> <file descriptor (24 bits)>
+      return static_cast<unsigned>(user_data & 0xffffff);
+    }
+
+    inline bool client::written() const
+    {
+      return ((_M_state == state::kWritingFile) && (_M_nwrites == 0));
+    }
+#endif
+
+#if HAVE_SPLICE
+    inline void client::splicer(net::splicer* s)
+    {
+      _M_splicer = s;
+    }
+
+    inline bool client::can_splice() const
+    {
+#if HAVE_ZLIB
+      if (_M_decoder.active()) {
+        return false;
+      }
+#endif
+
+      return ((_M_splicer) && (_M_filename) && (!_M_buf) && (!ssl()));
+    }
+#endif
+
     inline void client::user_agent(const string::buffer* user_agent)
     {
       _M_user_agent = user_agent;
     }
 
+    inline void client::persistent_connections(bool enabled)
+    {
+      _M_persistent_connections = enabled;
+    }
+
+    inline void client::flush_threshold(size_t size)
+    {
+      _M_flush_threshold = size;
+    }
+
+    inline void client::accept_encoding(content_encoding encoding)
+    {
+      _M_content_encoding = encoding;
+    }
+
+    inline void client::max_body_size(uint64_t size, body_limit_action action)
+    {
+      _M_max_body_size = size;
+      _M_body_limit_action = action;
+    }
+
+    inline void client::filter(const response_filter* f)
+    {
+      _M_filter = f;
+    }
+
+    inline void client::resume_min_size(uint64_t size)
+    {
+      _M_resume_min_size = size;
+    }
+
+    inline uint64_t client::resume_min_size()
+    {
+      return _M_resume_min_size;
+    }
+
     inline bool client::on_timer()
     {
       on_error();
       return false;
     }
 
+    inline bool client::has_body() const
+    {
+      // The responses to HEAD requests and the 204 and 304 responses don't
+      // have body.
+      return ((_M_request->method() != method::kHead) &&
+              (_M_status_code != 204) &&
+              (_M_status_code != 304));
+    }
+
     inline bool client::add_data(const void* data, size_t len)
     {
+      bool truncate = false;
+
+      // If the body would exceed the maximum size...
+      if (_M_response_size + len > _M_response_limit) {
+        if (_M_body_limit_action == body_limit_action::kDiscard) {
+          return false;
+        }
+
+        // Add the part which fits.
+        len = _M_response_limit - _M_response_size;
+        truncate = true;
+      }
+
       if ((_M_buf) &&
-          (!_M_buf->append(reinterpret_cast<const char*>(data), len))) {
+          ((_M_buf->length() + len > _M_max_buffer_size) ||
+           (!_M_buf->append(reinterpret_cast<const char*>(data), len)))) {
         return false;
       }
 
       if ((_M_filename) &&
-          (_M_file.write(data, len) != static_cast<ssize_t>(len))) {
+          (((_M_max_file_size > 0) &&
+            (_M_response_size + len >
+             static_cast<uint64_t>(_M_max_file_size))) ||
+           (!write_file(data, len)))) {
+        return false;
+      }
+
+      if ((_M_archive) &&
+          ((_M_record.length() + len > _M_max_record_size) ||
+           (!_M_record.append(reinterpret_cast<const char*>(data), len)))) {
+        return false;
+      }
+
+      _M_response_size += len;
+
+      if (truncate) {
+        _M_truncated = true;
         return false;
       }
 
       return true;
     }
 
+    inline bool client::add_body(const void* data, size_t len)
+    {
+#if HAVE_ZLIB
+      if (_M_decoder.active()) {
+        return decode(data, len);
+      }
+#endif
+
+      return add_data(data, len);
+    }
+
+    inline bool client::write_file(const void* data, size_t len)
+    {
+#if HAVE_IO_URING
+      if (_M_writer) {
+        return write_async(data, len);
+      }
+#endif
+
+      // If the threshold has not been reached yet...
+      if (_M_staging.length() + len < _M_flush_threshold) {
+        return _M_staging.append(reinterpret_cast<const char*>(data), len);
+      }
+
+      return flush(data, len);
+    }
+
+    inline void client::clear_record()
+    {
+      if (_M_record.capacity() > kMaxKeptRecordBuffer) {
+        _M_record.free();
+      } else {
+        _M_record.clear();
+      }
+    }
+
     inline void client::on_error()
     {
+      // If enough of the body has been received, keep the partial file.
+      _M_partial = (_M_filename) && (resumable()) && (keep_partial());
+
+#if HAVE_IO_URING
+      if (_M_writer) {
+        cancel_writes();
+      }
+#endif
+
+#if HAVE_ZLIB
+      _M_decoder.clear();
+#endif
+
       if (_M_filename) {
+        _M_staging.clear();
+
         _M_file.close();
-        unlink(_M_filename);
+
+        if (_M_download != range_coordinator::kNoDownload) {
+          // The range is requested again (or the file is removed).
+          _M_coordinator->failed(_M_download, _M_range);
+          _M_download = range_coordinator::kNoDownload;
+        } else if (_M_partial) {
+          // The files are named after their number.
+          const char* name = strrchr(_M_filename, '/');
+
+          add_to_index(strtoull(name ? name + 1 : _M_filename, NULL, 10),
+                       0,
+                       url_index::kPartial);
+        } else if (_M_resume_offset == 0) {
+          unlink(_M_filename);
+        }
+
+        // Otherwise, the partial file is kept as it was.
 
         ::free(_M_filename);
         _M_filename = NULL;
       }
+
+      clear_record();
     }
 
     inline io::event_handler::result client::finished()
     {
+#if HAVE_ZLIB
+      if (_M_decoder.active()) {
+        bool complete = _M_decoder.complete();
+
+        _M_decoder.clear();
+
+        // If the compressed body is truncated...
+        if (!complete) {
+          return error();
+        }
+      }
+#endif
+
       if (_M_filename) {
+#if HAVE_IO_URING
+        if (_M_writer) {
+          // Submit the last block.
+          if ((_M_write_buffer != kNoWriteBuffer) &&
+              (_M_write_buffers[_M_write_buffer].data.length() > 0) &&
+              (!submit_write())) {
+            return error();
+          }
+
+          // Wait for the writes of the response to complete.
+          if (_M_nwrites > 0) {
+            _M_state = state::kWritingFile;
+            return io::event_handler::result::kSuccess;
+          }
+
+          if (_M_write_error) {
+            return error();
+          }
+        }
+#endif
+
+        // Write the staged data.
+        if ((_M_staging.length() > 0) && (!flush())) {
+          return error();
+        }
+
         _M_file.close();
+
+        if (_M_download != range_coordinator::kNoDownload) {
+          // The file is added to the index when all the ranges have been
+          // received.
+          _M_coordinator->received(_M_download, _M_range);
+          _M_download = range_coordinator::kNoDownload;
+        } else if (_M_index) {
+          // The files are named after their number.
+          const char* name = strrchr(_M_filename, '/');
+
+          add_to_index(strtoull(name ? name + 1 : _M_filename, NULL, 10),
+                       0,
+                       0);
+        }
+
+        ::free(_M_filename);
+        _M_filename = NULL;
+      }
+
+      if (_M_archive) {
+        unsigned long segment;
+        off_t offset;
+        bool appended = _M_archive->append(_M_record.data(),
+                                           _M_record.length(),
+                                           segment,
+                                           offset);
+
+        clear_record();
+
+        if (!appended) {
+          _M_state = state::kFinished;
+          return io::event_handler::result::kError;
+        }
+
+        if (_M_index) {
+          add_to_index(segment, offset, url_index::kArchived);
+        }
+      }
+
+      // If the connection can be reused...
+      if (_M_keep_alive) {
+        // If there are pipelined requests...
+        if (_M_npipelined > 0) {
+          // Parse the next response.
+          return next_response() ? io::event_handler::result::kSuccess :
+                                   io::event_handler::result::kError;
+        }
+
+        // If there is no unexpected data after the response...
+        if (static_cast<size_t>(_M_inp) == _M_in.length()) {
+          // Idle connections don't keep the input buffer.
+          release_input();
+
+          _M_state = state::kIdle;
+
+          return io::event_handler::result::kChangeToReadMode;
+        }
       }
 
       _M_state = state::kFinished;
@@ -216,6 +1105,11 @@ namespace net {
 
     inline io::event_handler::result client::error()
     {
+      if (_M_truncated) {
+        _M_truncated = false;
+        return truncated();
+      }
+
       on_error();
       return io::event_handler::result::kError;
     }
@@ -0,0 +1,298 @@
+#include <string.h>
+#include <stdio.h>
+#include "net/http/connection_pool.h"
+#include "util/ctype.h"
+
+net::http::connection_pool::~connection_pool()
+{
+  for (size_t i = 0; i < kNumberBuckets; i++) {
+    origin* o = _M_buckets[i];
+
+    while (o) {
+      origin* next = o->next;
+      ::free(o);
+      o = next;
+    }
+  }
+
+  if (_M_nodes) {
+    ::free(_M_nodes);
+  }
+}
+
+bool net::http::connection_pool::create(size_t size)
+{
+  if ((_M_nodes = reinterpret_cast<node*>(
+                    calloc(size, sizeof(node))
+                  )) == NULL) {
+    return false;
+  }
+
+  _M_size = size;
+
+  return true;
+}
+
+int net::http::connection_pool::get(const uri::uri& uri, in_port_t port)
+{
+  if (_M_count == 0) {
+    return -1;
+  }
+
+  char key[kMaxKeyLen];
+  size_t keylen;
+  if (!build_key(uri, port, key, keylen)) {
+    return -1;
+  }
+
+  origin* o;
+  if (((o = search(key, keylen, hash(key, keylen))) == NULL) ||
+      (o->head == -1)) {
+    return -1;
+  }
+
+  // Take the most recently added connection (the least likely to have been
+  // closed by the server).
+  int fd = o->head;
+
+  remove(fd);
+
+  return fd;
+}
+
+int net::http::connection_pool::get_pipelining(const uri::uri& uri,
+                                               in_port_t port) const
+{
+  if (_M_pipelining == -1) {
+    return -1;
+  }
+
+  char key[kMaxKeyLen];
+  size_t keylen;
+  if (!build_key(uri, port, key, keylen)) {
+    return -1;
+  }
+
+  const origin* o;
+  if ((o = search(key, keylen, hash(key, keylen))) == NULL) {
+    return -1;
+  }
+
+  return o->pipelining;
+}
+
+void net::http::connection_pool::remove(unsigned fd)
+{
+  if ((fd >= _M_size) || (!_M_nodes[fd].o)) {
+    return;
+  }
+
+  node* n = &_M_nodes[fd];
+  origin* o = n->o;
+
+  // Unlink from the origin's list.
+  if (n->prev != -1) {
+    _M_nodes[n->prev].next = n->next;
+  } else if (n->idle) {
+    o->head = n->next;
+  } else {
+    o->pipelining = n->next;
+  }
+
+  if (n->next != -1) {
+    _M_nodes[n->next].prev = n->prev;
+  }
+
+  // Unlink from the global list.
+  if (n->lru_prev != -1) {
+    _M_nodes[n->lru_prev].lru_next = n->lru_next;
+  } else if (n->idle) {
+    _M_lru_head = n->lru_next;
+  } else {
+    _M_pipelining = n->lru_next;
+  }
+
+  if (n->lru_next != -1) {
+    _M_nodes[n->lru_next].lru_prev = n->lru_prev;
+  } else if (n->idle) {
+    _M_lru_tail = n->lru_prev;
+  }
+
+  if (n->idle) {
+    _M_count--;
+  }
+
+  n->o = NULL;
+
+  // If the origin has no more connections...
+  if ((o->head == -1) && (o->pipelining == -1)) {
+    origin** ptr = &_M_buckets[o->hash & (kNumberBuckets - 1)];
+    while (*ptr != o) {
+      ptr = &(*ptr)->next;
+    }
+
+    *ptr = o->next;
+
+    ::free(o);
+  }
+}
+
+void net::http::connection_pool::disable_pipelining(const uri::uri& uri,
+                                                    in_port_t port)
+{
+  char key[kMaxKeyLen];
+  size_t keylen;
+  if (build_key(uri, port, key, keylen)) {
+    uint32_t h = hash(key, keylen) | 1;
+
+    _M_no_pipelining[h & (kNoPipeliningSize - 1)] = h;
+  }
+}
+
+bool net::http::connection_pool::pipelining(const uri::uri& uri,
+                                            in_port_t port) const
+{
+  char key[kMaxKeyLen];
+  size_t keylen;
+  if (!build_key(uri, port, key, keylen)) {
+    return false;
+  }
+
+  uint32_t h = hash(key, keylen) | 1;
+
+  return (_M_no_pipelining[h & (kNoPipeliningSize - 1)] != h);
+}
+
+bool net::http::connection_pool::insert(unsigned fd,
+                                        const uri::uri& uri,
+                                        in_port_t port,
+                                        bool idle)
+{
+  if ((fd >= _M_size) || (_M_nodes[fd].o)) {
+    return false;
+  }
+
+  char key[kMaxKeyLen];
+  size_t keylen;
+  if (!build_key(uri, port, key, keylen)) {
+    return false;
+  }
+
+  uint32_t h = hash(key, keylen);
+
+  origin* o;
+  if ((o = search(key, keylen, h)) == NULL) {
+    if ((o = reinterpret_cast<origin*>(
+               malloc(sizeof(origin) + keylen)
+             )) == NULL) {
+      return false;
+    }
+
+    memcpy(o->key, key, keylen);
+    o->keylen = keylen;
+    o->hash = h;
+    o->head = -1;
+    o->pipelining = -1;
+
+    origin** bucket = &_M_buckets[h & (kNumberBuckets - 1)];
+    o->next = *bucket;
+    *bucket = o;
+  }
+
+  node* n = &_M_nodes[fd];
+
+  n->o = o;
+  n->idle = idle;
+
+  int& head = idle ? o->head : o->pipelining;
+  int& global_head = idle ? _M_lru_head : _M_pipelining;
+
+  // Link at the front of the origin's list.
+  n->prev = -1;
+  n->next = head;
+
+  if (head != -1) {
+    _M_nodes[head].prev = fd;
+  }
+
+  head = fd;
+
+  // Link at the front of the global list.
+  n->lru_prev = -1;
+  n->lru_next = global_head;
+
+  if (global_head != -1) {
+    _M_nodes[global_head].lru_prev = fd;
+  } else if (idle) {
+    _M_lru_tail = fd;
+  }
+
+  global_head = fd;
+
+  if (idle) {
+    _M_count++;
+  }
+
+  return true;
+}
+
+bool net::http::connection_pool::build_key(const uri::uri& uri,
+                                           in_port_t port,
+                                           char* key,
+                                           size_t& keylen)
+{
+  const string::slice& scheme(uri.scheme());
+  const string::slice& host(uri.host());
+
+  // Format: <scheme>://<host>:<port>
+  int ret = snprintf(key,
+                     kMaxKeyLen,
+                     "%.*s://%.*s:%u",
+                     static_cast<int>(scheme.length()),
+                     scheme.data(),
+                     static_cast<int>(host.length()),
+                     host.data(),
+                     port);
+
+  if ((ret <= 0) || (static_cast<size_t>(ret) >= kMaxKeyLen)) {
+    return false;
+  }
+
+  keylen = ret;
+
+  // Scheme and host are case-insensitive.
+  for (size_t i = 0; i < keylen; i++) {
+    key[i] = util::to_lower(key[i]);
+  }
+
+  return true;
+}
+
+uint32_t net::http::connection_pool::hash(const char* key, size_t keylen)
+{
+  // FNV-1a.
+  uint32_t h = 2166136261u;
+
+  for (size_t i = 0; i < keylen; i++) {
+    h ^= static_cast<uint8_t>(key[i]);
+    h *= 16777619u;
+  }
+
+  return h;
+}
+
+net::http::connection_pool::origin*
+net::http::connection_pool::search(const char* key,
+                                   size_t keylen,
+                                   uint32_t h) const
+{
+  for (origin* o = _M_buckets[h & (kNumberBuckets - 1)]; o; o = o->next) {
+    if ((o->hash == h) &&
+        (o->keylen == keylen) &&
+        (memcmp(o->key, key, keylen) == 0)) {
+      return o;
+    }
+  }
+
+  return NULL;
+}
@@ -0,0 +1,194 @@
+#ifndef NET_HTTP_CONNECTION_POOL_H
+#define NET_HTTP_CONNECTION_POOL_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <netinet/in.h>
+#include "net/uri/uri.h"
+
+namespace net {
+  namespace http {
+    // Pool of idle (keep-alive) connections per (scheme, host, port).
+    // Connections which accept pipelined requests are also kept here until
+    // their requests are sent.
+    class connection_pool {
+      public:
+        static const size_t kMaxKeyLen = 512;
+
+        // Constructor.
+        connection_pool();
+
+        // Destructor.
+        ~connection_pool();
+
+        // Create.
+        bool create(size_t size);
+
+        // Get idle connection (returns -1 if there is none).
+        int get(const uri::uri& uri, in_port_t port);
+
+        // Add idle connection.
+        bool add(unsigned fd, const uri::uri& uri, in_port_t port);
+
+        // Add connection which accepts pipelined requests.
+        bool add_pipelining(unsigned fd, const uri::uri& uri, in_port_t port);
+
+        // Get connection which accepts pipelined requests (returns -1 if
+        // there is none). The connection is not removed.
+        int get_pipelining(const uri::uri& uri, in_port_t port) const;
+
+        // Remove any connection which accepts pipelined requests (returns
+        // -1 if there is none).
+        int pop_pipelining();
+
+        // Remove connection (idle or accepting pipelined requests).
+        void remove(unsigned fd);
+
+        // Contains idle connection?
+        bool contains(unsigned fd) const;
+
+        // Disable pipelining for the origin.
+        void disable_pipelining(const uri::uri& uri, in_port_t port);
+
+        // Is pipelining enabled for the origin?
+        bool pipelining(const uri::uri& uri, in_port_t port) const;
+
+        // Get the connection which has been idle for longest
+        // (returns -1 if there is none).
+        int oldest() const;
+
+        // Get number of idle connections.
+        size_t count() const;
+
+      private:
+        static const size_t kNumberBuckets = 4 * 1024;
+
+        // Origins for which pipelining has been disabled (hashes of their
+        // keys, an origin might be forgotten when another one uses the same
+        // slot).
+        static const size_t kNoPipeliningSize = 4 * 1024;
+
+        struct origin {
+          origin* next;
+          uint32_t hash;
+
+          // Most recently added idle connection.
+          int head;
+
+          // Connections which accept pipelined requests.
+          int pipelining;
+
+          size_t keylen;
+          char key[1];
+        };
+
+        struct node {
+          origin* o;
+
+          bool idle;
+
+          // List of connections of the origin.
+          int prev;
+          int next;
+
+          // List of all idle connections (most recent first) or list of all
+          // the connections which accept pipelined requests.
+          int lru_prev;
+          int lru_next;
+        };
+
+        origin* _M_buckets[kNumberBuckets];
+
+        uint32_t _M_no_pipelining[kNoPipeliningSize];
+
+        node* _M_nodes;
+        size_t _M_size;
+        size_t _M_count;
+
+        int _M_lru_head;
+        int _M_lru_tail;
+
+        int _M_pipelining;
+
+        // Insert connection.
+        bool insert(unsigned fd,
+                    const uri::uri& uri,
+                    in_port_t port,
+                    bool idle);
+
+        // Build key.
+        static bool build_key(const uri::uri& uri,
+                              in_port_t port,
+                              char* key,
+                              size_t& keylen);
+
+        // Hash function.
+        static uint32_t hash(const char* key, size_t keylen);
+
+        // Search origin.
+        origin* search(const char* key, size_t keylen, uint32_t h) const;
+
+        // Disable copy constructor and assignment operator.
+        connection_pool(const connection_pool&) = delete;
+        connection_pool& operator=(const connection_pool&) = delete;
+    };
+
+    inline connection_pool::connection_pool()
+      : _M_nodes(NULL),
+        _M_size(0),
+        _M_count(0),
+        _M_lru_head(-1),
+        _M_lru_tail(-1),
+        _M_pipelining(-1)
+    {
+      for (size_t i = 0; i < kNumberBuckets; i++) {
+        _M_buckets[i] = NULL;
+      }
+
+      for (size_t i = 0; i < kNoPipeliningSize; i++) {
+        _M_no_pipelining[i] = 0;
+      }
+    }
+
+    inline bool connection_pool::add(unsigned fd,
+                                     const uri::uri& uri,
+                                     in_port_t port)
+    {
+      return insert(fd, uri, port, true);
+    }
+
+    inline bool connection_pool::add_pipelining(unsigned fd,
+                                                const uri::uri& uri,
+                                                in_port_t port)
+    {
+      return insert(fd, uri, port, false);
+    }
+
+    inline int connection_pool::pop_pipelining()
+    {
+      int fd;
+      if ((fd = _M_pipelining) != -1) {
+        remove(fd);
+      }
+
+      return fd;
+    }
+
+    inline bool connection_pool::contains(unsigned fd) const
+    {
+      return ((fd < _M_size) && (_M_nodes[fd].o) && (_M_nodes[fd].idle));
+    }
+
+    inline int connection_pool::oldest() const
+    {
+      return _M_lru_tail;
+    }
+
+    inline size_t connection_pool::count() const
+    {
+      return _M_count;
+    }
+  }
+}
+
+#endif // NET_HTTP_CONNECTION_POOL_H
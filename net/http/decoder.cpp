@@ -0,0 +1,93 @@
+#include <string.h>
+#include "net/http/decoder.h"
+
+bool net::http::decoder::init(encoding enc)
+{
+  memset(&_M_stream, 0, sizeof(z_stream));
+
+  // Window bits: 15 + 16 for the gzip format, 15 for the zlib format.
+  if (inflateInit2(&_M_stream,
+                   (enc == encoding::kGzip) ? 15 + 16 : 15) != Z_OK) {
+    return false;
+  }
+
+  _M_active = true;
+  _M_end = false;
+  _M_deflate_header = (enc == encoding::kDeflate);
+  _M_first_byte_received = false;
+
+  return true;
+}
+
+bool net::http::decoder::decode(const void* data,
+                                size_t& len,
+                                void* out,
+                                size_t& outlen)
+{
+  // Data after the end of the stream is ignored.
+  if (_M_end) {
+    outlen = 0;
+    return true;
+  }
+
+  const Bytef* in = static_cast<const Bytef*>(data);
+  size_t inlen = len;
+
+  _M_stream.next_out = static_cast<Bytef*>(out);
+  _M_stream.avail_out = static_cast<uInt>(outlen);
+
+  if (_M_deflate_header) {
+    // The data is always consumed (the first byte is kept until the second
+    // one has been received).
+    if (!_M_first_byte_received) {
+      if (inlen == 0) {
+        outlen = 0;
+        return true;
+      }
+
+      _M_first_byte = *in++;
+      inlen--;
+
+      _M_first_byte_received = true;
+    }
+
+    if (inlen == 0) {
+      outlen = 0;
+      return true;
+    }
+
+    // If the data doesn't start with a zlib header...
+    if ((!zlib_header(_M_first_byte, *in)) &&
+        (inflateReset2(&_M_stream, -15) != Z_OK)) {
+      return false;
+    }
+
+    _M_deflate_header = false;
+
+    // Decode the first byte (a single byte doesn't produce output).
+    _M_stream.next_in = &_M_first_byte;
+    _M_stream.avail_in = 1;
+
+    if (inflate(&_M_stream, Z_NO_FLUSH) != Z_OK) {
+      return false;
+    }
+  }
+
+  _M_stream.next_in = const_cast<Bytef*>(in);
+  _M_stream.avail_in = static_cast<uInt>(inlen);
+
+  switch (inflate(&_M_stream, Z_NO_FLUSH)) {
+    case Z_STREAM_END:
+      _M_end = true;
+
+      // Fall through.
+    case Z_OK:
+    case Z_BUF_ERROR: // No progress possible (more data needed).
+      len -= _M_stream.avail_in;
+      outlen -= _M_stream.avail_out;
+
+      return true;
+    default:
+      return false;
+  }
+}
@@ -0,0 +1,110 @@
+#ifndef NET_HTTP_DECODER_H
+#define NET_HTTP_DECODER_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <zlib.h>
+
+namespace net {
+  namespace http {
+    // Streaming decoder of gzip / deflate bodies (Content-Encoding).
+    class decoder {
+      public:
+        enum class encoding : uint8_t {
+          kGzip,
+          kDeflate
+        };
+
+        // Constructor.
+        decoder();
+
+        // Destructor.
+        ~decoder();
+
+        // Initialize.
+        bool init(encoding enc);
+
+        // Free the state of the decoder.
+        void clear();
+
+        // Is a body being decoded?
+        bool active() const;
+
+        // Has the whole body been decoded (or nothing received at all)?
+        bool complete() const;
+
+        // Decode data ('len' is updated with the number of bytes consumed
+        // and 'outlen' with the number of bytes produced; while 'out' gets
+        // filled, there might be data pending).
+        bool decode(const void* data, size_t& len, void* out, size_t& outlen);
+
+      private:
+        z_stream _M_stream;
+
+        bool _M_active;
+
+        // Has the end of the stream been reached?
+        bool _M_end;
+
+        // Is the first data of a deflate body being decoded (some servers
+        // send raw deflate data without the zlib header)?
+        bool _M_deflate_header;
+
+        // First byte of a deflate body (kept until the second one has been
+        // received, so that the header can be checked).
+        Bytef _M_first_byte;
+        bool _M_first_byte_received;
+
+        // Is it a zlib header?
+        static bool zlib_header(uint8_t cmf, uint8_t flg);
+
+        // Disable copy constructor and assignment operator.
+        decoder(const decoder&) = delete;
+        decoder& operator=(const decoder&) = delete;
+    };
+
+    inline decoder::decoder()
+      : _M_active(false),
+        _M_end(false),
+        _M_deflate_header(false),
+        _M_first_byte(0),
+        _M_first_byte_received(false)
+    {
+    }
+
+    inline decoder::~decoder()
+    {
+      clear();
+    }
+
+    inline void decoder::clear()
+    {
+      if (_M_active) {
+        inflateEnd(&_M_stream);
+        _M_active = false;
+      }
+    }
+
+    inline bool decoder::active() const
+    {
+      return _M_active;
+    }
+
+    inline bool decoder::complete() const
+    {
+      return ((_M_end) ||
+              ((_M_stream.total_in == 0) && (!_M_first_byte_received)));
+    }
+
+    inline bool decoder::zlib_header(uint8_t cmf, uint8_t flg)
+    {
+      // Compression method 8 (deflate), window size up to 32K and check
+      // bits.
+      return (((cmf & 0x0f) == 8) &&
+              ((cmf >> 4) <= 7) &&
+              ((((static_cast<unsigned>(cmf) << 8) | flg) % 31) == 0));
+    }
+  }
+}
+
+#endif // NET_HTTP_DECODER_H
@@ -2,6 +2,8 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include "net/http/downloaded_file_processor.h"
+#include "net/http/archive.h"
+#include "net/http/url_index.h"
 #include "string/memcasemem.h"
 #include "util/number.h"
 #include "util/ctype.h"
@@ -14,26 +16,91 @@ bool net::http::downloaded_file_processor::open(const char* filename)
     return false;
   }
 
+  return map(filename, 0, sbuf.st_size);
+}
+
+bool net::http::downloaded_file_processor::open(const char* filename,
+                                                off_t offset)
+{
+  struct stat sbuf;
+  if ((stat(filename, &sbuf) < 0) ||
+      (!S_ISREG(sbuf.st_mode)) ||
+      (offset < 0) ||
+      (static_cast<uint64_t>(offset) + archive::kHeaderSize >
+       static_cast<uint64_t>(sbuf.st_size))) {
+    return false;
+  }
+
   if ((_M_fd = ::open(filename, O_RDONLY)) < 0) {
     return false;
   }
 
+  uint8_t header[archive::kHeaderSize];
+  uint64_t len;
+  if ((pread(_M_fd, header, sizeof(header), offset) !=
+       static_cast<ssize_t>(sizeof(header))) ||
+      (!archive::parse_header(header, len))) {
+    return false;
+  }
+
+  offset += archive::kHeaderSize;
+
+  // If the record is truncated...
+  if (len > static_cast<uint64_t>(sbuf.st_size - offset)) {
+    return false;
+  }
+
+  return map(filename, offset, len);
+}
+
+bool net::http::downloaded_file_processor::open_url(const char* dir,
+                                                    const char* url)
+{
+  string::slice u(url, strlen(url));
+
+  url_index::entry e;
+  char path[PATH_MAX];
+  if (!url_index::find(dir, u, e, path, sizeof(path))) {
+    return false;
+  }
+
+  bool ret = (e.flags & url_index::kArchived) ? open(path, e.offset) :
+                                                open(path);
+
+  // The URL has to match (not only its hash).
+  return ((ret) &&
+          (_M_uri.length() == u.length()) &&
+          (memcmp(_M_uri.data(), u.data(), u.length()) == 0));
+}
+
+bool net::http::downloaded_file_processor::map(const char* filename,
+                                               off_t offset,
+                                               uint64_t len)
+{
+  if ((_M_fd == -1) && ((_M_fd = ::open(filename, O_RDONLY)) < 0)) {
+    return false;
+  }
+
+  // The offset of the mapping has to be a multiple of the page size.
+  off_t page_offset = offset % sysconf(_SC_PAGESIZE);
+
   void* data;
   if ((data = mmap(NULL,
-                   sbuf.st_size,
+                   page_offset + len,
                    PROT_READ,
                    MAP_SHARED,
                    _M_fd,
-                   0)) == MAP_FAILED) {
+                   offset - page_offset)) == MAP_FAILED) {
     return false;
   }
 
-  _M_len = sbuf.st_size;
+  _M_len = page_offset + len;
 
   _M_data = reinterpret_cast<uint8_t*>(data);
   _M_end = _M_data + _M_len;
 
-  _M_ptr = _M_data;
+  _M_begin = _M_data + page_offset;
+  _M_ptr = _M_begin;
 
   _M_content_type = content_type::kOther;
 
@@ -358,13 +425,13 @@ bool net::http::downloaded_file_processor::read_status_code()
 {
   // Skip first line (URI).
   if ((_M_ptr = reinterpret_cast<const uint8_t*>(
-                  memmem(_M_data, _M_len, "\r\n", 2)
+                  memmem(_M_begin, _M_end - _M_begin, "\r\n", 2)
                 )) == NULL) {
     return false;
   }
 
   // Save URI.
-  _M_uri.set(reinterpret_cast<const char*>(_M_data), _M_ptr - _M_data);
+  _M_uri.set(reinterpret_cast<const char*>(_M_begin), _M_ptr - _M_begin);
 
   _M_ptr += 2;
 
@@ -398,10 +465,7 @@ bool net::http::downloaded_file_processor::read_status_code()
 
   // Point '_M_ptr' to the headers.
   if ((_M_ptr = reinterpret_cast<const uint8_t*>(
-                  memmem(_M_ptr,
-                         _M_len - (_M_ptr - _M_data),
-                         "\r\n",
-                         2)
+                  memmem(_M_ptr, _M_end - _M_ptr, "\r\n", 2)
                 )) == NULL) {
     return false;
   }
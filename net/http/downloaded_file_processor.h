@@ -23,6 +23,13 @@ namespace net {
         // Open file.
         bool open(const char* filename);
 
+        // Open record of a segment of the archive.
+        bool open(const char* filename, off_t offset);
+
+        // Open the response of the URL (looked up in the indexes of the
+        // directory).
+        bool open_url(const char* dir, const char* url);
+
         // Get URI.
         const string::slice& uri() const;
 
@@ -66,6 +73,8 @@ namespace net {
         uint8_t* _M_data;
         uint64_t _M_len;
 
+        // Beginning and end of the record.
+        const uint8_t* _M_begin;
         const uint8_t* _M_end;
         const uint8_t* _M_body;
         const uint8_t* _M_ptr;
@@ -82,6 +91,9 @@ namespace net {
 
         string::buffer _M_buf;
 
+        // Map file.
+        bool map(const char* filename, off_t offset, uint64_t len);
+
         // Read status code.
         bool read_status_code();
 
@@ -1,18 +1,16 @@
 #include <string.h>
 #include <stdio.h>
+#include <signal.h>
+#include <pthread.h>
 #include <sys/stat.h>
 #include <unistd.h>
-#include <netdb.h>
+#include <fcntl.h>
 #include <errno.h>
+#include <time.h>
+#include <inttypes.h>
 #include <new>
 #include "net/http/downloader.h"
-#include "net/http/methods.h"
-#include "net/uri/uri.h"
-#include "net/ipv4_address.h"
-#include "net/ipv6_address.h"
-#include "net/ports.h"
-#include "string/slice.h"
-#include "util/move.h"
+#include "util/ctype.h"
 
 const char* net::http::downloader::kDefaultUrlsFile = "urls.txt";
 const char* net::http::downloader::kDefaultDirectory = "data";
@@ -69,235 +67,503 @@ bool net::http::downloader::create(const char* url_file, const char* dir)
     }
   }
 
-  if (!_M_selector.create()) {
-    return false;
+  if (dir[len - 1] == '/') {
+    memcpy(_M_dir, dir, len - 1);
+    _M_dir[len] = 0;
+  } else {
+    memcpy(_M_dir, dir, len + 1);
+  }
+
+  // Continue where the previous run stopped.
+  bool resume = ((_M_checkpoint_interval > 0) &&
+                 (checkpoint::load(_M_dir, _M_position)));
+
+  // Skip the URLs which have already been read.
+  if (_M_dedup != seen_set::mode::kNone) {
+    char filename[PATH_MAX];
+    if (_M_dedup == seen_set::mode::kExact) {
+      snprintf(filename, sizeof(filename), "%s/seen", _M_dir);
+    }
+
+    size_t size = (_M_dedup_memory < SIZE_MAX / (1024 * 1024)) ?
+                    static_cast<size_t>(_M_dedup_memory) * 1024 * 1024 :
+                    SIZE_MAX;
+
+    // The URLs read by the previous run are skipped if it is resumed.
+    if (!_M_seen.create(size,
+                        (_M_dedup == seen_set::mode::kExact) ?
+                          filename :
+                          NULL,
+                        resume)) {
+      return false;
+    }
+  }
+
+  // Each worker needs at least one connection.
+  _M_nworkers = (_M_threads < _M_max_connections) ?
+                _M_threads :
+                static_cast<unsigned>(_M_max_connections);
+
+#if HAVE_INOTIFY
+  if (_M_selector.create()) {
+    _M_watching = _M_watcher.create(_M_selector, _M_url_file);
   }
+#endif
 
-  if ((_M_clients = new (std::nothrow) client[_M_selector.size()]) == NULL) {
+  if ((_M_buf = reinterpret_cast<char*>(malloc(kReadBufferSize))) == NULL) {
     return false;
   }
 
-  if ((_M_requests = new (std::nothrow) request[_M_selector.size()]) == NULL) {
+  if ((_M_workers = new (std::nothrow) worker[_M_nworkers]) == NULL) {
     return false;
   }
 
-  if (dir[len - 1] == '/') {
-    memcpy(_M_dir, dir, len - 1);
-    _M_dir[len] = 0;
-  } else {
-    memcpy(_M_dir, dir, len + 1);
+  for (unsigned i = 0; i < _M_nworkers; i++) {
+    worker* w = &_M_workers[i];
+
+    // Share the connections among the workers.
+    w->max_connections((_M_max_connections / _M_nworkers) +
+                       ((i < _M_max_connections % _M_nworkers) ? 1 : 0));
+
+    for (size_t j = 0; j < client::kNumberPhases; j++) {
+      w->timeout(static_cast<client::phase>(j), _M_timeouts[j]);
+    }
+
+    w->total_timeout(_M_total_timeout);
+    w->min_speed(_M_min_speed);
+    w->pipelining_depth(_M_pipelining_depth);
+    w->max_host_connections(_M_max_host_connections);
+    w->host_delay(_M_host_delay);
+    w->ranges(_M_ranges, static_cast<uint64_t>(_M_ranges_min_size) * 1024);
+    w->output(_M_output);
+    w->segment_size(static_cast<off_t>(_M_segment_size) * 1024 * 1024);
+
+    if (_M_revisit.opened()) {
+      w->revisit(&_M_revisit);
+    }
+
+    if (_M_have_nameserver) {
+      w->nameserver(_M_nameserver);
+    }
+
+    if (!w->create(_M_dir, i, _M_nworkers)) {
+      return false;
+    }
   }
 
   return true;
 }
 
-void net::http::downloader::start()
+bool net::http::downloader::start()
 {
-  _M_running = true;
+  // Block the signals in the workers' threads (they are handled by this
+  // thread).
+  sigset_t set, oldset;
+  sigemptyset(&set);
+  sigaddset(&set, SIGINT);
+  sigaddset(&set, SIGTERM);
+
+  pthread_sigmask(SIG_BLOCK, &set, &oldset);
+
+  unsigned nstarted = 0;
+  while ((nstarted < _M_nworkers) && (_M_workers[nstarted].start())) {
+    nstarted++;
+  }
 
-  do {
-    if (_M_selector.count() > 0) {
-      if (!_M_selector.wait_for_events(1000)) {
-        update_time();
-      } else {
-        update_time();
+  pthread_sigmask(SIG_SETMASK, &oldset, NULL);
 
-        _M_selector.process_events();
-      }
-    } else {
-      sleep(1);
-      update_time();
-    }
+  if (nstarted == _M_nworkers) {
+    _M_running = true;
 
-    _M_scheduler.check_expired(_M_current_msec);
+    // Download the URLs which had not been finished by the previous run.
+    if (_M_checkpoint_interval > 0) {
+      recover();
+    }
 
-    // Check whether there is a new file with URLs.
-    if (_M_selector.count() < _M_max_connections) {
-      struct stat buf;
-      if ((stat(_M_url_file, &buf) == 0) && (S_ISREG(buf.st_mode))) {
-        load_urls();
+    do {
+      // If there is no new file with URLs...
+      if ((!_M_check) || (!load_urls())) {
+        wait();
       }
-    }
-  } while (_M_running);
+    } while (_M_running);
+  }
+
+  for (unsigned i = 0; i < nstarted; i++) {
+    _M_workers[i].stop();
+  }
+
+  for (unsigned i = 0; i < nstarted; i++) {
+    _M_workers[i].join();
+  }
+
+  if (nstarted < _M_nworkers) {
+    return false;
+  }
+
+  print_statistics();
+
+  return true;
 }
 
 bool net::http::downloader::load_urls()
 {
-  if (!_M_file) {
-    if ((_M_file = fopen(_M_url_file, "r")) == NULL) {
-      return false;
-    }
+  struct stat buf;
+  if ((stat(_M_url_file, &buf) < 0) || (!S_ISREG(buf.st_mode))) {
+    return false;
   }
 
-  char line[4 * 1024];
-  while ((_M_selector.count() < _M_max_connections) &&
-         (fgets(line, sizeof(line), _M_file))) {
-    const char* begin = line;
-    while ((*begin) && (*begin <= ' ')) {
-      begin++;
-    }
+  if (!_M_file.open(_M_url_file, O_RDONLY)) {
+    return false;
+  }
 
-    if (!*begin) {
-      continue;
+  if (_M_checkpoint_interval > 0) {
+    if (!_M_file.stat(buf)) {
+      _M_position.clear();
+    } else if (!_M_position.of(buf)) {
+      _M_position.file(buf);
+    } else if (_M_file.seek(_M_position.offset,
+                            fs::file::whence::kSeekSet) < 0) {
+      // The previous run was reading the same file but the offset is not
+      // valid, start from the beginning.
+      _M_position.file(buf);
     }
+  }
 
-    const char* end = begin + 1;
-    while (*end > ' ') {
-      end++;
-    }
+  _M_file_duplicates = 0;
 
-    uri::uri uri;
-    if (!uri.init(begin, end - begin)) {
-      continue;
-    }
+  if (!read_urls(false)) {
+    // Stopped.
+    return true;
+  }
 
-    // If not HTTP or HTTPS...
-    const string::slice& scheme(uri.scheme());
-    if (((scheme.length() != 4) ||
-         (strncasecmp(scheme.data(), "http", 4) != 0))
-#if HAVE_SSL
-        &&
-        ((scheme.length() != 5) ||
-         (strncasecmp(scheme.data(), "https", 5) != 0))) {
-#else
-       ) {
-#endif
-      continue;
+  if (_M_checkpoint_interval > 0) {
+    _M_position.offset = _M_file.offset();
+
+    // Wait for the workers to save the URLs being downloaded before
+    // renaming the file (after renaming it, the URLs after the previous
+    // checkpoint couldn't be read again).
+    if (!send_checkpoint(true)) {
+      // Stopped.
+      return true;
     }
 
-    const string::slice& host(uri.host());
-    char hoststr[512];
+    // A file with the same inode is read from the beginning.
+    _M_position.clear();
+  }
 
-    if (host.length() >= sizeof(hoststr)) {
-      continue;
-    }
+  _M_file.close();
 
-    memcpy(hoststr, host.data(), host.length());
-    hoststr[host.length()] = 0;
+  char newpath[PATH_MAX];
 
-    socket_address addr;
-    if (!resolve(hoststr, addr)) {
-      continue;
+  do {
+    snprintf(newpath, sizeof(newpath), "%s_%06lu", _M_url_file, _M_nfiles++);
+  } while (stat(newpath, &buf) == 0);
+
+  rename(_M_url_file, newpath);
+
+  // The statistics are printed when all the workers have added their
+  // counters (this thread holds one reference until all the workers have
+  // been notified).
+  worker::file_statistics* stats;
+  if ((stats = worker::file_statistics::create(newpath,
+                                               _M_nworkers + 1)) != NULL) {
+    stats->duplicates = _M_file_duplicates;
+
+    unsigned i = 0;
+    while ((i < _M_nworkers) && (push(_M_workers[i], stats))) {
+      i++;
     }
 
-    in_port_t port = (uri.port() == 0) ?
-                                         standard_port(scheme.data(),
-                                                       scheme.length()) :
-                                         uri.port();
+    stats->release(_M_nworkers - i + 1);
+  }
 
-    if (addr.ss_family == AF_INET) {
-      reinterpret_cast<ipv4_address*>(&addr)->port(port);
+  return true;
+}
+
+bool net::http::downloader::read_urls(bool recovered)
+{
+  worker::task t;
+
+  // Number of bytes in the buffer.
+  size_t len = 0;
+
+  // Skipping a line which doesn't fit in the buffer?
+  bool skip = false;
+
+  // Offset of the end of the data read and time of the last checkpoint.
+  off_t offset = _M_file.offset();
+  time_t last = time(NULL);
+
+  ssize_t ret;
+  while ((ret = _M_file.read(_M_buf + len, kReadBufferSize - len)) > 0) {
+    const char* ptr = _M_buf;
+    const char* end = _M_buf + len + ret;
+
+    const char* eol;
+    while ((eol = static_cast<const char*>(
+                    memchr(ptr, '\n', end - ptr)
+                  )) != NULL) {
+      if (!skip) {
+        if (!add_url(t, ptr, eol - ptr, recovered)) {
+          // Stopped.
+          return false;
+        }
+      } else {
+        skip = false;
+      }
+
+      ptr = eol + 1;
+    }
+
+    // If the line doesn't fit in the buffer...
+    if ((len = end - ptr) == kReadBufferSize) {
+      skip = true;
+      len = 0;
     } else {
-      reinterpret_cast<ipv6_address*>(&addr)->port(port);
+      // Move the beginning of the line to the beginning of the buffer.
+      memmove(_M_buf, ptr, len);
     }
 
-    socket sock;
-    if (!sock.connect(socket::type::kStream, addr, 0)) {
-      continue;
+    offset += ret;
+
+    // If it is time for a checkpoint (the URLs before the line in the
+    // buffer have been sent to the workers)...
+    if ((!recovered) && (!skip) && (_M_checkpoint_interval > 0)) {
+      time_t now = time(NULL);
+      if (now - last >= static_cast<time_t>(_M_checkpoint_interval)) {
+        _M_position.offset = offset - len;
+
+        if (!send_checkpoint(false)) {
+          // Stopped.
+          return false;
+        }
+
+        last = now;
+      }
     }
+  }
+
+  // Last line.
+  return ((len == 0) || (skip) || (add_url(t, _M_buf, len, recovered)));
+}
 
-    if (!_M_selector.add(sock.fd(),
-                         fdtype::kFdSocket,
-                         &_M_clients[sock.fd()],
-                         io::event::kWrite)) {
-      sock.close();
-      continue;
+bool net::http::downloader::recover()
+{
+  // The workers of the previous run saved their URLs in
+  // <dir>/checkpoint_<id> (the ids are consecutive).
+  unsigned id = 0;
+  char filename[PATH_MAX];
+  while ((checkpoint::path(_M_dir, id, filename, sizeof(filename))) &&
+         (_M_file.open(filename, O_RDONLY))) {
+    bool running = read_urls(true);
+
+    _M_file.close();
+
+    if (!running) {
+      return false;
     }
 
-    request* req = &_M_requests[sock.fd()];
-    req->clear();
+    id++;
+  }
 
-    req->init(addr, method::kGet, util::move(uri));
+  // If there was a checkpoint, save the URLs again (now they are in the
+  // queues of the new workers).
+  return ((id == 0) || (send_checkpoint(false)));
+}
 
-    char path[PATH_MAX];
-    struct stat buf;
+bool net::http::downloader::send_checkpoint(bool wait)
+{
+  // This thread holds one reference until all the workers have been
+  // notified (and, if 'wait', until they have saved their URLs).
+  checkpoint* cp;
+  if ((cp = checkpoint::create(_M_dir,
+                               _M_position,
+                               _M_nworkers,
+                               _M_nworkers + 1)) == NULL) {
+    // Skip checkpoint.
+    return true;
+  }
 
-    do {
-      snprintf(path, sizeof(path), "%s/%012lu", _M_dir, _M_count++);
-    } while (stat(path, &buf) == 0);
+  unsigned i = 0;
+  while ((i < _M_nworkers) && (push(_M_workers[i], cp))) {
+    i++;
+  }
 
-    client* client = &_M_clients[sock.fd()];
+  if (i == _M_nworkers) {
+    if (wait) {
+      while ((cp->references() > 1) && (_M_running)) {
+        usleep(kQueueFullWait * 1000);
+      }
+    }
 
-    client->clear();
+    cp->release(1);
+
+    return _M_running;
+  }
 
-    // Set socket descriptor.
-    client->fd(sock.fd());
+  // Stopped (the position is not saved).
+  cp->release(_M_nworkers - i + 1, false);
 
-    if (!client->init(req, path)) {
-      // The selector closes the socket.
-      _M_selector.remove(sock.fd());
+  return false;
+}
 
-      continue;
+void net::http::downloader::wait()
+{
+#if HAVE_INOTIFY
+  if (_M_watching) {
+    if (_M_selector.wait_for_events(1000)) {
+      _M_selector.process_events();
     }
 
-    // Schedule client.
-    _M_scheduler.schedule(kNormalPriority,
-                          client->timer(),
-                          _M_current_msec + (kClientTimeout * 1000));
+    _M_check = _M_watcher.changed();
+
+    return;
   }
+#endif
 
-  // If the end of the file has been reached...
-  if (_M_selector.count() < _M_max_connections) {
-    fclose(_M_file);
-    _M_file = NULL;
+  sleep(1);
+}
 
-    char newpath[PATH_MAX];
-    struct stat buf;
+bool net::http::downloader::add_url(worker::task& t,
+                                    const char* line,
+                                    size_t len,
+                                    bool recovered)
+{
+  const char* end = line + len;
 
-    do {
-      snprintf(newpath, sizeof(newpath), "%s_%06lu", _M_url_file, _M_nfiles++);
-    } while (stat(newpath, &buf) == 0);
+  const char* begin = line;
+  while ((begin < end) && (static_cast<uint8_t>(*begin) <= ' ')) {
+    begin++;
+  }
 
-    rename(_M_url_file, newpath);
+  if (begin == end) {
+    return true;
   }
 
-  return true;
+  const char* ptr = begin + 1;
+  while ((ptr < end) && (static_cast<uint8_t>(*ptr) > ' ')) {
+    ptr++;
+  }
+
+  // Parse the URL here, so that the workers only have to connect.
+  if (!t.init(begin, ptr - begin)) {
+    // Skip invalid URL.
+    return true;
+  }
+
+  t.recovered = recovered;
+
+  // The URLs which had not been finished by the previous run are not
+  // skipped (the URLs read from the files were already deduplicated).
+  if ((_M_seen.created()) &&
+      (t.uri.normalize(_M_normalized)) &&
+      (!_M_seen.add(_M_normalized.string())) &&
+      (!recovered)) {
+    _M_file_duplicates++;
+    _M_duplicates++;
+
+    return true;
+  }
+
+  // The URLs of the same server are downloaded by the same worker (so
+  // that its connections can be reused).
+  return push(_M_workers[hash(t.uri.host(), t.port) % _M_nworkers], t);
 }
 
-bool net::http::downloader::resolve(const char* host, socket_address& addr)
+bool net::http::downloader::push(worker& w, worker::task& t)
 {
-#if defined(__linux__) || defined(__sun__)
-  char buf[2048];
-  struct hostent ret;
-#endif // defined(__linux__) || defined(__sun__)
-
-  struct hostent* result;
-
-#if defined(__linux__)
-  int error;
-  if (gethostbyname_r(host, &ret, buf, sizeof(buf), &result, &error) != 0) {
-#elif defined(__FreeBSD__) || \
-      defined(__OpenBSD__) || \
-      defined(__NetBSD__) || \
-      defined(__DragonFly__) || \
-      defined(__minix)
-  if ((result = gethostbyname(host)) == NULL) {
-#elif defined(__sun__)
-  int error;
-  if ((result = gethostbyname_r(host,
-                                &ret,
-                                buf,
-                                sizeof(buf),
-                                &error)) == NULL) {
-#endif
-    return false;
+  do {
+    if (w.push(t)) {
+      return true;
+    }
+
+    // The worker's queue is full.
+    usleep(kQueueFullWait * 1000);
+  } while (_M_running);
+
+  return false;
+}
+
+bool net::http::downloader::push(worker& w, worker::file_statistics* stats)
+{
+  do {
+    if (w.push(stats)) {
+      return true;
+    }
+
+    // The worker's queue is full.
+    usleep(kQueueFullWait * 1000);
+  } while (_M_running);
+
+  return false;
+}
+
+bool net::http::downloader::push(worker& w, checkpoint* cp)
+{
+  do {
+    if (w.push(cp)) {
+      return true;
+    }
+
+    // The worker's queue is full.
+    usleep(kQueueFullWait * 1000);
+  } while (_M_running);
+
+  return false;
+}
+
+uint32_t net::http::downloader::hash(const string::slice& host,
+                                     in_port_t port)
+{
+  // FNV-1a (the host is case-insensitive).
+  uint32_t h = 2166136261u;
+
+  const char* ptr = host.data();
+  const char* end = ptr + host.length();
+
+  while (ptr < end) {
+    h ^= static_cast<uint8_t>(util::to_lower(*ptr++));
+    h *= 16777619u;
   }
 
-  // IPv4?
-  if (result->h_addrtype == AF_INET) {
-    ipv4_address* ipv4_addr = reinterpret_cast<ipv4_address*>(&addr);
+  h ^= port;
+  h *= 16777619u;
 
-    ipv4_addr->sin_family = AF_INET;
-    memcpy(&ipv4_addr->sin_addr, result->h_addr_list[0], result->h_length);
-    memset(ipv4_addr->sin_zero, 0, sizeof(ipv4_addr->sin_zero));
-  } else {
-    ipv6_address* ipv6_addr = reinterpret_cast<ipv6_address*>(&addr);
+  return h;
+}
 
-    memset(ipv6_addr, 0, sizeof(ipv6_address));
+void net::http::downloader::print_statistics() const
+{
+  uint64_t urls = 0;
+  uint64_t hits = 0;
+  uint64_t negative_hits = 0;
+  uint64_t misses = 0;
+
+  for (unsigned i = 0; i < _M_nworkers; i++) {
+    const worker* w = &_M_workers[i];
+
+    urls += w->urls();
+    hits += w->hits();
+    negative_hits += w->negative_hits();
+    misses += w->misses();
+  }
+
+  printf("Total: %" PRIu64 " URLs, ", urls);
 
-    ipv6_addr->sin6_family = AF_INET6;
-    memcpy(&ipv6_addr->sin6_addr, result->h_addr_list[0], result->h_length);
+  if (_M_dedup == seen_set::mode::kExact) {
+    printf("%" PRIu64 " duplicates skipped (%" PRIu64 " false positives "
+           "of the filter), ",
+           _M_duplicates,
+           _M_seen.false_positives());
+  } else if (_M_dedup == seen_set::mode::kFilter) {
+    printf("%" PRIu64 " duplicates skipped, ", _M_duplicates);
   }
 
-  return true;
+  printf("DNS cache: %" PRIu64 " hits (%" PRIu64 " negative), "
+         "%" PRIu64 " misses.\n",
+         hits,
+         negative_hits,
+         misses);
+
+  fflush(stdout);
 }
@@ -4,23 +4,113 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdio.h>
-#include <time.h>
-#include <sys/time.h>
-#include "net/selector.h"
+#include <limits.h>
+#include "net/socket_address.h"
 #include "net/http/client.h"
-#include "net/http/request.h"
-#include "timer/scheduler.h"
-#include "timer/observer.h"
-#include "io/observer.h"
+#include "net/http/worker.h"
+#include "net/http/revisit_index.h"
+#include "net/http/checkpoint.h"
+#include "net/http/seen_set.h"
+#include "net/uri/uri.h"
+#include "fs/file.h"
+
+#if HAVE_INOTIFY
+  #include "net/selector.h"
+  #include "fs/watcher.h"
+#endif
+#include "string/buffer.h"
 
 namespace net {
   namespace http {
-    class downloader : public io::observer, public timer::observer {
+    class downloader {
       public:
         static const size_t kMinConnections = 1;
         static const size_t kMaxConnections = 2048;
         static const size_t kDefaultConnections = 100;
 
+        static const unsigned kMaxIdleTimeout = 300; // Seconds.
+        static const unsigned kDefaultIdleTimeout = 4; // Seconds.
+
+        // Timeouts of the other phases of the requests (seconds).
+        static const unsigned kMinTimeout = 1;
+        static const unsigned kMaxTimeout = 300;
+        static const unsigned kDefaultConnectTimeout = 10;
+        static const unsigned kDefaultHandshakeTimeout = 10;
+        static const unsigned kDefaultFirstByteTimeout = 30;
+        static const unsigned kDefaultHeadersTimeout = 30;
+        static const unsigned kDefaultBodyTimeout = 30;
+        static const unsigned kDefaultWriteTimeout = 60;
+
+        static const unsigned kMaxTotalTimeout = 86400; // Seconds.
+        static const unsigned kDefaultTotalTimeout = 0; // No limit.
+
+        static const unsigned kMaxMinSpeed = 1024 * 1024; // Bytes/second.
+        static const unsigned kDefaultMinSpeed = 1024; // Bytes/second.
+
+        static const unsigned kMinPipeliningDepth = 1;
+        static const unsigned kMaxPipeliningDepth =
+                                client::kMaxPipeliningDepth;
+        static const unsigned kDefaultPipeliningDepth = 1; // No pipelining.
+
+        static const unsigned kMinHostConnections = 1;
+        static const unsigned kMaxHostConnections = kMaxConnections;
+        static const unsigned kDefaultHostConnections = 8;
+
+        static const unsigned kMaxHostDelay = 60 * 1000; // Milliseconds.
+        static const unsigned kDefaultHostDelay = 0; // Milliseconds.
+
+        // Number of ranges in which the big responses are split.
+        static const unsigned kMinRanges = 1; // The responses are not split.
+        static const unsigned kMaxRanges = range_coordinator::kMaxRanges;
+        static const unsigned kDefaultRanges =
+                                range_coordinator::kDefaultRanges;
+
+        // Minimum Content-Length of the responses which are split
+        // (kilobytes).
+        static const unsigned kMinRangesMinSize = 64;
+        static const unsigned kMaxRangesMinSize = 64 * 1024 * 1024;
+        static const unsigned kDefaultRangesMinSize =
+                                range_coordinator::kDefaultMinSize / 1024;
+
+        // Size of the segments of the archive (megabytes).
+        static const unsigned kMinSegmentSize = 1;
+        static const unsigned kMaxSegmentSize = 64 * 1024;
+        static const unsigned kDefaultSegmentSize = 1024;
+
+        // Data of a response buffered before writing it (kilobytes).
+        static const unsigned kMinFlushThreshold = 4;
+        static const unsigned kMaxFlushThreshold = 16 * 1024;
+        static const unsigned kDefaultFlushThreshold =
+                                client::kDefaultFlushThreshold / 1024;
+
+        // Maximum size of the body of the responses (kilobytes).
+        static const unsigned kMaxMaxBodySize = 64 * 1024 * 1024;
+        static const unsigned kDefaultMaxBodySize =
+                                client::kDefaultMaxBodySize / 1024;
+
+        // Maximum Content-Length of the responses whose body is saved
+        // (kilobytes).
+        static const unsigned kMaxFilterContentLength = 64 * 1024 * 1024;
+
+        // Body received by an attempt for its partial file to be kept
+        // (kilobytes).
+        static const unsigned kMaxResumeMinSize = 64 * 1024 * 1024;
+        static const unsigned kDefaultResumeMinSize =
+                                client::kDefaultResumeMinSize / 1024;
+
+        // Time between checkpoints (seconds).
+        static const unsigned kMaxCheckpointInterval = 3600;
+        static const unsigned kDefaultCheckpointInterval = 5;
+
+        // Size of the filter of the URLs which have been read (megabytes).
+        static const unsigned kMinDedupMemory = 1;
+        static const unsigned kMaxDedupMemory = 16 * 1024;
+        static const unsigned kDefaultDedupMemory = 64;
+
+        static const unsigned kMinThreads = 1;
+        static const unsigned kMaxThreads = 32;
+        static const unsigned kDefaultThreads = 1;
+
         static const char* kDefaultUrlsFile;
         static const char* kDefaultDirectory;
 
@@ -30,66 +120,216 @@ namespace net {
         // Destructor.
         ~downloader();
 
-        // Create.
+        // Create (call the setters before).
         bool create(const char* url_file, const char* dir);
 
         // Start.
-        void start();
+        bool start();
 
         // Stop.
         void stop();
 
-        // Set maximum number of simultaneous connections.
+        // Set maximum number of simultaneous connections (shared among
+        // the threads).
         void max_connections(size_t value);
 
         // Set User-Agent.
         bool user_agent(const char* user_agent);
 
-        // On I/O success.
-        void on_success(io::event_handler* handler);
+        // Set how long idle connections are kept open (0: don't reuse
+        // connections).
+        void idle_timeout(unsigned seconds);
+
+        // Set timeout of a phase of the requests.
+        void timeout(client::phase phase, unsigned seconds);
+
+        // Set maximum duration of a request (0: no limit).
+        void total_timeout(unsigned seconds);
+
+        // Set minimum transfer rate while receiving the body of a response
+        // (0: no minimum).
+        void min_speed(unsigned bytes_per_second);
+
+        // Set maximum number of requests in flight per connection (requests
+        // are only pipelined over reused connections).
+        void pipelining_depth(unsigned depth);
+
+        // Set maximum number of simultaneous connections per host.
+        void max_host_connections(unsigned n);
+
+        // Set minimum delay between requests to the same host.
+        void host_delay(unsigned msec);
+
+        // Set number of ranges in which the responses whose Content-Length
+        // is at least 'min_size' kilobytes are split (each range is
+        // received over its own connection).
+        void ranges(unsigned n, unsigned min_size);
+
+        // Set where the responses are saved.
+        void output(worker::output_mode mode);
+
+        // Set maximum size of the segments of the archive.
+        void segment_size(unsigned megabytes);
+
+        // Set how much of a response is buffered before writing it to the
+        // file.
+        void flush_threshold(unsigned kilobytes);
+
+        // Set whether compressed responses are accepted and how they are
+        // saved.
+        void accept_encoding(client::content_encoding encoding);
+
+        // Set maximum size of the body of the responses (0: no limit) and
+        // what is done with the bigger ones.
+        void max_body_size(unsigned kilobytes,
+                           client::body_limit_action action);
 
-        // On I/O error.
-        void on_error(io::event_handler* handler);
+        // Only save the body of the responses with these status codes
+        // ("200,300-399").
+        bool filter_status_codes(const char* s);
 
-        // On timer.
-        void on_timer(timer::event_handler* handler);
+        // Only save the body of the responses with these content types
+        // ("text/html,text/*").
+        bool filter_content_types(const char* s);
+
+        // Only save the body of the responses whose Content-Length is not
+        // bigger.
+        void filter_content_length(unsigned kilobytes);
+
+        // Set how much of the body has to be received for the partial file
+        // to be kept when the download fails (0: the downloads are not
+        // resumed).
+        void resume_min_size(unsigned kilobytes);
+
+        // Send conditional requests for the URLs saved in the directory of
+        // a previous run (the responses which have not changed are saved
+        // without body).
+        bool revisit(const char* dir);
+
+        // Set how often the progress through the file with URLs is saved
+        // (0: no checkpoints).
+        void checkpoint_interval(unsigned seconds);
+
+        // Set whether the URLs which have already been read (from any file
+        // with URLs) are skipped and the memory used for remembering them.
+        void dedup(seen_set::mode mode, unsigned megabytes);
+
+        // Set number of threads (each one runs its own event loop).
+        void threads(unsigned n);
+
+        // Set name server.
+        void nameserver(const socket_address& addr);
 
       private:
-        static const timer::priority_t kNormalPriority = 1;
-        static const unsigned kClientTimeout = 30; // Seconds.
+        // Time waiting when a worker's queue is full.
+        static const unsigned kQueueFullWait = 10; // Milliseconds.
 
-        selector _M_selector;
-        timer::scheduler<2> _M_scheduler;
+        // Size of the buffer for reading the file with URLs (longer lines
+        // are skipped).
+        static const size_t kReadBufferSize = 256 * 1024;
 
-        client* _M_clients;
-        request* _M_requests;
+        worker* _M_workers;
+        unsigned _M_nworkers;
 
         char _M_url_file[PATH_MAX];
         char _M_dir[PATH_MAX];
 
-        FILE* _M_file;
+        fs::file _M_file;
+        char* _M_buf;
         size_t _M_nfiles;
 
         size_t _M_max_connections;
+        unsigned _M_timeouts[client::kNumberPhases];
+        unsigned _M_total_timeout;
+        unsigned _M_min_speed;
+        unsigned _M_pipelining_depth;
+        unsigned _M_max_host_connections;
+        unsigned _M_host_delay;
+        unsigned _M_ranges;
+        unsigned _M_ranges_min_size;
+        worker::output_mode _M_output;
+        unsigned _M_segment_size;
+        unsigned _M_threads;
+
+        unsigned _M_checkpoint_interval;
+
+        // Position in the file with URLs (saved in the checkpoints).
+        checkpoint::position _M_position;
+
+        // URLs which have been read (normalized).
+        seen_set::mode _M_dedup;
+        unsigned _M_dedup_memory;
+        seen_set _M_seen;
+        uri::uri _M_normalized;
+
+        // Number of duplicate URLs skipped (in the current file and in
+        // total).
+        uint64_t _M_file_duplicates;
+        uint64_t _M_duplicates;
+
+        socket_address _M_nameserver;
+        bool _M_have_nameserver;
+
+#if HAVE_INOTIFY
+        // Detects the creation of the file with URLs (if it couldn't be
+        // created, the file is checked every second).
+        selector _M_selector;
+        fs::watcher _M_watcher;
+        bool _M_watching;
+#endif
+
+        // Check whether there is a file with URLs?
+        bool _M_check;
 
         string::buffer _M_user_agent;
 
-        size_t _M_count;
+        response_filter _M_filter;
 
-        time_t _M_current_time;
-        uint64_t _M_current_msec;
-        struct tm _M_localtime;
+        // Indexes of the previous run.
+        revisit_index _M_revisit;
 
         bool _M_running;
 
-        // Update time.
-        void update_time();
-
-        // Load URLs.
+        // Load URLs (returns false if there is no file with URLs).
         bool load_urls();
 
-        // Resolve.
-        static bool resolve(const char* host, socket_address& addr);
+        // Wait for a new file with URLs.
+        void wait();
+
+        // Read the URLs of the open file (returns false if the downloader
+        // has been stopped).
+        bool read_urls(bool recovered);
+
+        // Hand the URLs saved by the last checkpoint to the workers
+        // (returns false if the downloader has been stopped).
+        bool recover();
+
+        // Send checkpoint to the workers and, if 'wait', wait for them to
+        // save their URLs (returns false if the downloader has been
+        // stopped).
+        bool send_checkpoint(bool wait);
+
+        // Parse line and hand the URL to a worker (returns false if the
+        // downloader has been stopped).
+        bool add_url(worker::task& t,
+                     const char* line,
+                     size_t len,
+                     bool recovered);
+
+        // Send task to worker (waits while the worker's queue is full).
+        bool push(worker& w, worker::task& t);
+
+        // Send end of file marker to worker.
+        bool push(worker& w, worker::file_statistics* stats);
+
+        // Send checkpoint to worker.
+        bool push(worker& w, checkpoint* cp);
+
+        // Compute hash of the host and port.
+        static uint32_t hash(const string::slice& host, in_port_t port);
+
+        // Print counters of all the workers.
+        void print_statistics() const;
 
         // Disable copy constructor and assignment operator.
         downloader(const downloader&) = delete;
@@ -97,32 +337,50 @@ namespace net {
     };
 
     inline downloader::downloader()
-      : _M_clients(NULL),
-        _M_requests(NULL),
-        _M_file(NULL),
+      : _M_workers(NULL),
+        _M_nworkers(0),
+        _M_buf(NULL),
         _M_nfiles(0),
         _M_max_connections(kDefaultConnections),
-        _M_count(0),
+        _M_total_timeout(kDefaultTotalTimeout),
+        _M_min_speed(kDefaultMinSpeed),
+        _M_pipelining_depth(kDefaultPipeliningDepth),
+        _M_max_host_connections(kDefaultHostConnections),
+        _M_host_delay(kDefaultHostDelay),
+        _M_ranges(kDefaultRanges),
+        _M_ranges_min_size(kDefaultRangesMinSize),
+        _M_output(worker::output_mode::kFiles),
+        _M_segment_size(kDefaultSegmentSize),
+        _M_threads(kDefaultThreads),
+        _M_checkpoint_interval(kDefaultCheckpointInterval),
+        _M_dedup(seen_set::mode::kNone),
+        _M_dedup_memory(kDefaultDedupMemory),
+        _M_file_duplicates(0),
+        _M_duplicates(0),
+        _M_have_nameserver(false),
+#if HAVE_INOTIFY
+        _M_watching(false),
+#endif
+        _M_check(true),
         _M_running(false)
     {
-      _M_selector.set_io_observer(this);
-      _M_scheduler.set_observer(this);
-
-      update_time();
+      timeout(client::phase::kConnecting, kDefaultConnectTimeout);
+      timeout(client::phase::kPerformingHandshake, kDefaultHandshakeTimeout);
+      timeout(client::phase::kWaitingForResponse, kDefaultFirstByteTimeout);
+      timeout(client::phase::kReceivingHeaders, kDefaultHeadersTimeout);
+      timeout(client::phase::kReceivingBody, kDefaultBodyTimeout);
+      timeout(client::phase::kWritingFile, kDefaultWriteTimeout);
+      timeout(client::phase::kIdle, kDefaultIdleTimeout);
     }
 
     inline downloader::~downloader()
     {
-      if (_M_clients) {
-        delete [] _M_clients;
-      }
-
-      if (_M_requests) {
-        delete [] _M_requests;
+      if (_M_workers) {
+        delete [] _M_workers;
       }
 
-      if (_M_file) {
-        fclose(_M_file);
+      if (_M_buf) {
+        ::free(_M_buf);
       }
     }
 
@@ -149,33 +407,134 @@ namespace net {
       return true;
     }
 
-    inline void downloader::on_success(io::event_handler* handler)
+    inline void downloader::idle_timeout(unsigned seconds)
+    {
+      timeout(client::phase::kIdle, seconds);
+
+      client::persistent_connections(seconds > 0);
+    }
+
+    inline void downloader::timeout(client::phase phase, unsigned seconds)
+    {
+      _M_timeouts[static_cast<size_t>(phase)] = seconds;
+    }
+
+    inline void downloader::total_timeout(unsigned seconds)
+    {
+      _M_total_timeout = seconds;
+    }
+
+    inline void downloader::min_speed(unsigned bytes_per_second)
+    {
+      _M_min_speed = bytes_per_second;
+    }
+
+    inline void downloader::pipelining_depth(unsigned depth)
+    {
+      _M_pipelining_depth = depth;
+    }
+
+    inline void downloader::max_host_connections(unsigned n)
+    {
+      _M_max_host_connections = n;
+    }
+
+    inline void downloader::host_delay(unsigned msec)
+    {
+      _M_host_delay = msec;
+    }
+
+    inline void downloader::ranges(unsigned n, unsigned min_size)
+    {
+      _M_ranges = n;
+      _M_ranges_min_size = min_size;
+    }
+
+    inline void downloader::output(worker::output_mode mode)
+    {
+      _M_output = mode;
+    }
+
+    inline void downloader::segment_size(unsigned megabytes)
+    {
+      _M_segment_size = megabytes;
+    }
+
+    inline void downloader::flush_threshold(unsigned kilobytes)
+    {
+      client::flush_threshold(kilobytes * 1024);
+    }
+
+    inline void downloader::accept_encoding(client::content_encoding encoding)
+    {
+      client::accept_encoding(encoding);
+    }
+
+    inline void downloader::max_body_size(unsigned kilobytes,
+                                          client::body_limit_action action)
+    {
+      client::max_body_size(static_cast<uint64_t>(kilobytes) * 1024, action);
+    }
+
+    inline bool downloader::filter_status_codes(const char* s)
+    {
+      if (!_M_filter.status_codes(s)) {
+        return false;
+      }
+
+      client::filter(&_M_filter);
+
+      return true;
+    }
+
+    inline bool downloader::filter_content_types(const char* s)
     {
-      _M_scheduler.reschedule(kNormalPriority,
-                              static_cast<client*>(handler)->timer(),
-                              _M_current_msec + (kClientTimeout * 1000));
+      if (!_M_filter.content_types(s)) {
+        return false;
+      }
+
+      client::filter(&_M_filter);
+
+      return true;
+    }
+
+    inline void downloader::filter_content_length(unsigned kilobytes)
+    {
+      _M_filter.max_content_length(static_cast<uint64_t>(kilobytes) * 1024);
+
+      client::filter(&_M_filter);
+    }
+
+    inline void downloader::resume_min_size(unsigned kilobytes)
+    {
+      client::resume_min_size(static_cast<uint64_t>(kilobytes) * 1024);
     }
 
-    inline void downloader::on_error(io::event_handler* handler)
+    inline bool downloader::revisit(const char* dir)
     {
-      _M_scheduler.erase(static_cast<client*>(handler)->timer());
+      return _M_revisit.open(dir);
     }
 
-    inline void downloader::on_timer(timer::event_handler* handler)
+    inline void downloader::checkpoint_interval(unsigned seconds)
     {
-      _M_selector.remove(static_cast<client*>(handler)->fd());
+      _M_checkpoint_interval = seconds;
     }
 
-    inline void downloader::update_time()
+    inline void downloader::dedup(seen_set::mode mode, unsigned megabytes)
     {
-      struct timeval tv;
-      gettimeofday(&tv, NULL);
+      _M_dedup = mode;
+      _M_dedup_memory = megabytes;
+    }
 
-      _M_current_time = tv.tv_sec;
-      _M_current_msec = (static_cast<uint64_t>(_M_current_time) * 1000) +
-                        (tv.tv_usec / 1000);
+    inline void downloader::threads(unsigned n)
+    {
+      _M_threads = n;
+    }
 
-      localtime_r(&_M_current_time, &_M_localtime);
+    inline void downloader::nameserver(const socket_address& addr)
+    {
+      _M_nameserver = addr;
+      _M_have_nameserver = true;
     }
   }
 }
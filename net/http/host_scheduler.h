@@ -0,0 +1,1043 @@
+#ifndef NET_HTTP_HOST_SCHEDULER_H
+#define NET_HTTP_HOST_SCHEDULER_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <new>
+#include "fs/file.h"
+#include "string/buffer.h"
+#include "string/slice.h"
+#include "util/ctype.h"
+#include "util/move.h"
+
+namespace net {
+  namespace http {
+    // Queues of requests per (host, port): the hosts are served in
+    // round-robin order, each one with a maximum number of connections
+    // and a minimum delay between requests. Only the hosts which can be sent
+    // a request are in the round-robin list; the hosts waiting for their
+    // delay are sorted by time and the hosts which have reached the maximum
+    // number of connections wait for a connection to be released, so that
+    // popping an element doesn't go through the hosts which cannot be
+    // served.
+    // Only a limited number of elements are kept in memory (per host and in
+    // total): the rest are appended to a spill file and loaded again as the
+    // queue of their host drains, so that a host with many requests
+    // doesn't keep the requests of the other hosts from being queued. The
+    // elements are saved with 'bool save(string::buffer&) const' (a single
+    // line) and loaded with 'bool load(const char*, size_t)'.
+    template<typename _T>
+    class host_scheduler {
+      public:
+        static const size_t kMaxKeyLen = 512;
+
+        // Constructor.
+        host_scheduler();
+
+        // Destructor.
+        ~host_scheduler();
+
+        // Create (size: maximum number of file descriptors, 'filename':
+        // spill file or NULL; the file is removed as soon as it is opened).
+        bool create(size_t size, const char* filename);
+
+        // Set maximum number of connections per host.
+        void max_connections(unsigned n);
+
+        // Set minimum delay between requests to the same host.
+        void delay(unsigned msec);
+
+        // Set maximum number of elements in memory per host and in total
+        // (the rest are spilled).
+        void max_queued(size_t per_host, size_t total);
+
+        // Add element to the queue of the host.
+        bool push(const string::slice& host, in_port_t port, _T&& elem);
+
+        // Pop element of the next host which can be sent a request (returns
+        // false if there is none).
+        bool pop(uint64_t current_msec, _T& elem);
+
+        // The connection is going to send requests to the host.
+        bool acquire(unsigned fd,
+                     const string::slice& host,
+                     in_port_t port,
+                     uint64_t current_msec);
+
+        // The connection is not going to send more requests.
+        void release(unsigned fd, uint64_t current_msec);
+
+        // Is the connection sending requests to a host?
+        bool acquired(unsigned fd) const;
+
+        // Get number of queued elements (including the spilled ones).
+        size_t count() const;
+
+        // Get number of spilled elements.
+        size_t spilled() const;
+
+        // Call 'fn' for each queued element (stops when 'fn' returns
+        // false).
+        bool for_each(bool (*fn)(const _T& elem, void* arg), void* arg);
+
+      private:
+        static const size_t kNumberBuckets = 4 * 1024;
+
+        // The spilled elements are written in blocks of (at least)
+        // kSpillBufferSize bytes.
+        static const size_t kSpillBufferSize = 64 * 1024;
+
+        // Maximum length of a spilled element.
+        static const size_t kSpillReadSize = 256 * 1024;
+
+        struct element {
+          element* next;
+          _T value;
+        };
+
+        // Consecutive spilled elements of a host.
+        struct extent {
+          extent* next;
+          off_t offset;
+          off_t length;
+          size_t count;
+        };
+
+        enum class list : uint8_t {
+          kNone, // Waiting for a connection to be released.
+          kReady,
+          kDelayed,
+          kUnused
+        };
+
+        struct host {
+          host* next;
+          uint32_t hash;
+
+          // List of hosts which can be sent a request (circular), list of
+          // hosts waiting for their delay or list of unused hosts.
+          host* prev_host;
+          host* next_host;
+
+          // List the host is in.
+          list in;
+
+          // Queued elements.
+          element* head;
+          element* tail;
+          size_t queued;
+
+          // Spilled elements (after the queued ones).
+          extent* spilled_head;
+          extent* spilled_tail;
+
+          // Number of connections sending requests to the host.
+          unsigned connections;
+
+          // Earliest time for the next request.
+          uint64_t next_request;
+
+          size_t keylen;
+          char key[1];
+        };
+
+        host* _M_buckets[kNumberBuckets];
+
+        // Host of each connection.
+        host** _M_hosts;
+        size_t _M_size;
+
+        // Next host to be served.
+        host* _M_next;
+
+        // Hosts with elements waiting for their delay (sorted by the time
+        // of the next request).
+        host* _M_delayed_head;
+        host* _M_delayed_tail;
+
+        // Hosts without elements or connections which have been sent a
+        // request recently (oldest first).
+        host* _M_unused_head;
+        host* _M_unused_tail;
+
+        size_t _M_count;
+
+        unsigned _M_max_connections;
+        unsigned _M_delay;
+
+        size_t _M_max_host_queued;
+        size_t _M_max_queued;
+
+        // Spill file.
+        fs::file _M_spill;
+        off_t _M_spill_size; // Including the data which has not been written.
+        string::buffer _M_spill_buffer; // Data which has not been written.
+        char* _M_spill_read;
+        size_t _M_spilled;
+        bool _M_spill_error;
+
+        // Spill element (returns false if it has to be kept in memory).
+        bool spill(host* h, const _T& elem);
+
+        // Load spilled elements of the host.
+        void load(host* h);
+
+        // Remove first extent of the host (its elements which have not
+        // been loaded are lost).
+        void drop(host* h);
+
+        // Write the data of the spill buffer.
+        bool flush();
+
+        // Get host (it is created if it doesn't exist).
+        host* get(const string::slice& host, in_port_t port);
+
+        // Link host to the list of hosts which can be sent a request.
+        void link_ready(host* h);
+
+        // Unlink host from the list of hosts which can be sent a request.
+        void unlink_ready(host* h);
+
+        // Link host to the list of hosts waiting for their delay.
+        void link_delayed(host* h);
+
+        // Unlink host from the list of hosts waiting for their delay.
+        void unlink_delayed(host* h);
+
+        // Unlink host from the list of unused hosts.
+        void unlink_unused(host* h);
+
+        // Unlink host from its list.
+        void unlink(host* h);
+
+        // Move host to the list of its state (it might be freed).
+        void update(host* h, uint64_t current_msec);
+
+        // The host has neither elements nor connections.
+        void unused(host* h, uint64_t current_msec);
+
+        // Free unused hosts whose delay has expired.
+        void free_unused(uint64_t current_msec);
+
+        // Free host.
+        void free(host* h);
+
+        // Hash function.
+        static uint32_t hash(const char* key, size_t keylen);
+
+        // Disable copy constructor and assignment operator.
+        host_scheduler(const host_scheduler&) = delete;
+        host_scheduler& operator=(const host_scheduler&) = delete;
+    };
+
+    template<typename _T>
+    inline host_scheduler<_T>::host_scheduler()
+      : _M_hosts(NULL),
+        _M_size(0),
+        _M_next(NULL),
+        _M_delayed_head(NULL),
+        _M_delayed_tail(NULL),
+        _M_unused_head(NULL),
+        _M_unused_tail(NULL),
+        _M_count(0),
+        _M_max_connections(1),
+        _M_delay(0),
+        _M_max_host_queued(~static_cast<size_t>(0)),
+        _M_max_queued(~static_cast<size_t>(0)),
+        _M_spill_size(0),
+        _M_spill_read(NULL),
+        _M_spilled(0),
+        _M_spill_error(false)
+    {
+      for (size_t i = 0; i < kNumberBuckets; i++) {
+        _M_buckets[i] = NULL;
+      }
+    }
+
+    template<typename _T>
+    host_scheduler<_T>::~host_scheduler()
+    {
+      for (size_t i = 0; i < kNumberBuckets; i++) {
+        host* h = _M_buckets[i];
+
+        while (h) {
+          host* next = h->next;
+
+          while (h->head) {
+            element* e = h->head;
+            h->head = e->next;
+
+            delete e;
+          }
+
+          while (h->spilled_head) {
+            extent* x = h->spilled_head;
+            h->spilled_head = x->next;
+
+            delete x;
+          }
+
+          ::free(h);
+
+          h = next;
+        }
+      }
+
+      if (_M_hosts) {
+        ::free(_M_hosts);
+      }
+
+      if (_M_spill_read) {
+        ::free(_M_spill_read);
+      }
+    }
+
+    template<typename _T>
+    bool host_scheduler<_T>::create(size_t size, const char* filename)
+    {
+      if ((_M_hosts = reinterpret_cast<host**>(
+                        calloc(size, sizeof(host*))
+                      )) == NULL) {
+        return false;
+      }
+
+      _M_size = size;
+
+      if (filename) {
+        if ((_M_spill_read = reinterpret_cast<char*>(
+                               malloc(kSpillReadSize)
+                             )) == NULL) {
+          return false;
+        }
+
+        if (!_M_spill.open(filename, O_CREAT | O_TRUNC | O_RDWR, 0644)) {
+          return false;
+        }
+
+        ::unlink(filename);
+      }
+
+      return true;
+    }
+
+    template<typename _T>
+    inline void host_scheduler<_T>::max_connections(unsigned n)
+    {
+      _M_max_connections = n;
+    }
+
+    template<typename _T>
+    inline void host_scheduler<_T>::delay(unsigned msec)
+    {
+      _M_delay = msec;
+    }
+
+    template<typename _T>
+    inline void host_scheduler<_T>::max_queued(size_t per_host, size_t total)
+    {
+      _M_max_host_queued = per_host;
+      _M_max_queued = total;
+    }
+
+    template<typename _T>
+    bool host_scheduler<_T>::push(const string::slice& host,
+                                  in_port_t port,
+                                  _T&& elem)
+    {
+      element* e;
+      if ((e = new (std::nothrow) element) == NULL) {
+        return false;
+      }
+
+      struct host* h;
+      if ((h = get(host, port)) == NULL) {
+        delete e;
+        return false;
+      }
+
+      // If the host already has spilled elements or too many elements are
+      // in memory (the host keeps at least one element in memory)...
+      if ((h->head) &&
+          ((h->spilled_head) ||
+           (h->queued >= _M_max_host_queued) ||
+           (_M_count - _M_spilled >= _M_max_queued)) &&
+          (spill(h, elem))) {
+        delete e;
+        return true;
+      }
+
+      e->next = NULL;
+      e->value = util::move(elem);
+
+      if (h->tail) {
+        h->tail->next = e;
+      } else {
+        h->head = e;
+
+        if (h->in == list::kUnused) {
+          unlink_unused(h);
+        }
+
+        // The host is moved to the list of hosts which can be sent a
+        // request when its delay expires.
+        if (h->connections < _M_max_connections) {
+          link_delayed(h);
+        }
+      }
+
+      h->tail = e;
+      h->queued++;
+
+      _M_count++;
+
+      return true;
+    }
+
+    template<typename _T>
+    bool host_scheduler<_T>::pop(uint64_t current_msec, _T& elem)
+    {
+      free_unused(current_msec);
+
+      // The hosts whose delay has expired can be sent a request.
+      host* h;
+      while (((h = _M_delayed_head) != NULL) &&
+             (h->next_request <= current_msec)) {
+        unlink_delayed(h);
+        link_ready(h);
+      }
+
+      if ((h = _M_next) == NULL) {
+        return false;
+      }
+
+      element* e = h->head;
+
+      elem = util::move(e->value);
+
+      h->next_request = current_msec + _M_delay;
+
+      if ((h->head = e->next) == NULL) {
+        h->tail = NULL;
+      }
+
+      h->queued--;
+
+      _M_count--;
+
+      delete e;
+
+      // If half of the elements of the host which can be in memory have
+      // been popped, load spilled elements.
+      if ((h->spilled_head) && (h->queued <= _M_max_host_queued / 2)) {
+        load(h);
+      }
+
+      // Serve the next host the next time.
+      _M_next = h->next_host;
+
+      update(h, current_msec);
+
+      return true;
+    }
+
+    template<typename _T>
+    bool host_scheduler<_T>::acquire(unsigned fd,
+                                     const string::slice& host,
+                                     in_port_t port,
+                                     uint64_t current_msec)
+    {
+      if (fd >= _M_size) {
+        return false;
+      }
+
+      struct host* h;
+      if ((h = get(host, port)) == NULL) {
+        return false;
+      }
+
+      if (_M_hosts[fd]) {
+        if (_M_hosts[fd] == h) {
+          return true;
+        }
+
+        // The connection was sending requests to another host.
+        release(fd, current_msec);
+      }
+
+      h->connections++;
+
+      _M_hosts[fd] = h;
+
+      update(h, current_msec);
+
+      return true;
+    }
+
+    template<typename _T>
+    void host_scheduler<_T>::release(unsigned fd, uint64_t current_msec)
+    {
+      host* h;
+      if ((fd >= _M_size) || ((h = _M_hosts[fd]) == NULL)) {
+        return;
+      }
+
+      _M_hosts[fd] = NULL;
+
+      h->connections--;
+
+      update(h, current_msec);
+    }
+
+    template<typename _T>
+    inline bool host_scheduler<_T>::acquired(unsigned fd) const
+    {
+      return ((fd < _M_size) && (_M_hosts[fd]));
+    }
+
+    template<typename _T>
+    inline size_t host_scheduler<_T>::count() const
+    {
+      return _M_count;
+    }
+
+    template<typename _T>
+    inline size_t host_scheduler<_T>::spilled() const
+    {
+      return _M_spilled;
+    }
+
+    template<typename _T>
+    bool host_scheduler<_T>::for_each(bool (*fn)(const _T& elem, void* arg),
+                                      void* arg)
+    {
+      if ((_M_spilled > 0) && (!flush())) {
+        return false;
+      }
+
+      for (size_t i = 0; i < kNumberBuckets; i++) {
+        for (const host* h = _M_buckets[i]; h; h = h->next) {
+          for (const element* e = h->head; e; e = e->next) {
+            if (!fn(e->value, arg)) {
+              return false;
+            }
+          }
+
+          for (const extent* x = h->spilled_head; x; x = x->next) {
+            off_t offset = x->offset;
+            off_t end = x->offset + x->length;
+
+            while (offset < end) {
+              size_t len = (end - offset < static_cast<off_t>(kSpillReadSize)) ?
+                             end - offset :
+                             kSpillReadSize;
+
+              if (_M_spill.pread(_M_spill_read, len, offset) !=
+                  static_cast<ssize_t>(len)) {
+                return false;
+              }
+
+              const char* ptr = _M_spill_read;
+              const char* eol;
+              while ((eol = static_cast<const char*>(
+                              memchr(ptr, '\n', _M_spill_read + len - ptr)
+                            )) != NULL) {
+                _T elem;
+                if ((elem.load(ptr, eol - ptr)) && (!fn(elem, arg))) {
+                  return false;
+                }
+
+                ptr = eol + 1;
+              }
+
+              if (ptr == _M_spill_read) {
+                return false;
+              }
+
+              offset += ptr - _M_spill_read;
+            }
+          }
+        }
+      }
+
+      return true;
+    }
+
+    template<typename _T>
+    typename host_scheduler<_T>::host*
+    host_scheduler<_T>::get(const string::slice& host, in_port_t port)
+    {
+      // Format: <host>:<port>
+      char key[kMaxKeyLen];
+      int ret = snprintf(key,
+                         sizeof(key),
+                         "%.*s:%u",
+                         static_cast<int>(host.length()),
+                         host.data(),
+                         port);
+
+      if ((ret <= 0) || (static_cast<size_t>(ret) >= sizeof(key))) {
+        return NULL;
+      }
+
+      size_t keylen = ret;
+
+      // The host is case-insensitive.
+      for (size_t i = 0; i < keylen; i++) {
+        key[i] = util::to_lower(key[i]);
+      }
+
+      uint32_t h = hash(key, keylen);
+
+      struct host** bucket = &_M_buckets[h & (kNumberBuckets - 1)];
+
+      for (struct host* ptr = *bucket; ptr; ptr = ptr->next) {
+        if ((ptr->hash == h) &&
+            (ptr->keylen == keylen) &&
+            (memcmp(ptr->key, key, keylen) == 0)) {
+          return ptr;
+        }
+      }
+
+      struct host* ptr;
+      if ((ptr = reinterpret_cast<struct host*>(
+                   malloc(sizeof(struct host) + keylen)
+                 )) == NULL) {
+        return NULL;
+      }
+
+      memcpy(ptr->key, key, keylen);
+      ptr->keylen = keylen;
+      ptr->hash = h;
+      ptr->prev_host = NULL;
+      ptr->next_host = NULL;
+      ptr->in = list::kNone;
+      ptr->head = NULL;
+      ptr->tail = NULL;
+      ptr->queued = 0;
+      ptr->spilled_head = NULL;
+      ptr->spilled_tail = NULL;
+      ptr->connections = 0;
+      ptr->next_request = 0;
+
+      ptr->next = *bucket;
+      *bucket = ptr;
+
+      return ptr;
+    }
+
+    template<typename _T>
+    bool host_scheduler<_T>::spill(host* h, const _T& elem)
+    {
+      if ((!_M_spill.is_open()) || (_M_spill_error)) {
+        return false;
+      }
+
+      size_t len = _M_spill_buffer.length();
+      if ((!elem.save(_M_spill_buffer)) || (!_M_spill_buffer.append('\n'))) {
+        _M_spill_buffer.length(len);
+        return false;
+      }
+
+      len = _M_spill_buffer.length() - len;
+
+      // If the element follows the last spilled element of the host...
+      extent* x = h->spilled_tail;
+      if ((x) && (x->offset + x->length == _M_spill_size)) {
+        x->length += len;
+        x->count++;
+      } else {
+        if ((x = new (std::nothrow) extent) == NULL) {
+          _M_spill_buffer.length(_M_spill_buffer.length() - len);
+          return false;
+        }
+
+        x->next = NULL;
+        x->offset = _M_spill_size;
+        x->length = len;
+        x->count = 1;
+
+        if (h->spilled_tail) {
+          h->spilled_tail->next = x;
+        } else {
+          h->spilled_head = x;
+        }
+
+        h->spilled_tail = x;
+      }
+
+      _M_spill_size += len;
+
+      _M_spilled++;
+      _M_count++;
+
+      // If the buffer is full, write it (if it cannot be written, the
+      // elements are lost when they are loaded).
+      if ((_M_spill_buffer.length() >= kSpillBufferSize) && (!flush())) {
+        _M_spill_error = true;
+      }
+
+      return true;
+    }
+
+    template<typename _T>
+    void host_scheduler<_T>::load(host* h)
+    {
+      // Load the elements of the host which fit in memory (at least one).
+      size_t n = _M_max_host_queued - h->queued;
+
+      size_t queued = _M_count - _M_spilled;
+      if (queued + n > _M_max_queued) {
+        n = (queued < _M_max_queued) ? _M_max_queued - queued : 0;
+      }
+
+      if (n == 0) {
+        if (h->head) {
+          return;
+        }
+
+        n = 1;
+      }
+
+      if (!flush()) {
+        _M_spill_error = true;
+      }
+
+      extent* x;
+      while ((n > 0) && ((x = h->spilled_head) != NULL)) {
+        size_t len = (x->length < static_cast<off_t>(kSpillReadSize)) ?
+                       x->length :
+                       kSpillReadSize;
+
+        if (_M_spill.pread(_M_spill_read, len, x->offset) !=
+            static_cast<ssize_t>(len)) {
+          drop(h);
+          continue;
+        }
+
+        const char* ptr = _M_spill_read;
+        const char* eol;
+        while ((n > 0) &&
+               ((eol = static_cast<const char*>(
+                         memchr(ptr, '\n', _M_spill_read + len - ptr)
+                       )) != NULL)) {
+          element* e;
+          if ((e = new (std::nothrow) element) != NULL) {
+            if (e->value.load(ptr, eol - ptr)) {
+              e->next = NULL;
+
+              if (h->tail) {
+                h->tail->next = e;
+              } else {
+                h->head = e;
+              }
+
+              h->tail = e;
+              h->queued++;
+
+              n--;
+            } else {
+              delete e;
+              _M_count--;
+            }
+          } else {
+            _M_count--;
+          }
+
+          _M_spilled--;
+
+          x->count--;
+
+          ptr = eol + 1;
+        }
+
+        x->offset += ptr - _M_spill_read;
+        x->length -= ptr - _M_spill_read;
+
+        // If the extent has been loaded or its next element doesn't fit in
+        // the buffer...
+        if ((x->count == 0) || (ptr == _M_spill_read)) {
+          drop(h);
+        }
+      }
+
+      // If there are no more spilled elements, reuse the file.
+      if ((_M_spilled == 0) && (!_M_spill_error)) {
+        if (_M_spill.truncate(0)) {
+          _M_spill_size = 0;
+        }
+      }
+    }
+
+    template<typename _T>
+    void host_scheduler<_T>::drop(host* h)
+    {
+      extent* x = h->spilled_head;
+
+      _M_spilled -= x->count;
+      _M_count -= x->count;
+
+      if ((h->spilled_head = x->next) == NULL) {
+        h->spilled_tail = NULL;
+      }
+
+      delete x;
+    }
+
+    template<typename _T>
+    bool host_scheduler<_T>::flush()
+    {
+      const char* data = _M_spill_buffer.data();
+      size_t len = _M_spill_buffer.length();
+      off_t offset = _M_spill_size - len;
+
+      while (len > 0) {
+        ssize_t ret;
+        if ((ret = _M_spill.pwrite(data, len, offset)) <= 0) {
+          return false;
+        }
+
+        data += ret;
+        len -= ret;
+        offset += ret;
+      }
+
+      _M_spill_buffer.clear();
+
+      return true;
+    }
+
+    template<typename _T>
+    void host_scheduler<_T>::link_ready(host* h)
+    {
+      if (_M_next) {
+        // Insert before the next host to be served (it will be served
+        // last).
+        h->prev_host = _M_next->prev_host;
+        h->next_host = _M_next;
+
+        _M_next->prev_host->next_host = h;
+        _M_next->prev_host = h;
+      } else {
+        h->prev_host = h;
+        h->next_host = h;
+
+        _M_next = h;
+      }
+
+      h->in = list::kReady;
+    }
+
+    template<typename _T>
+    void host_scheduler<_T>::unlink_ready(host* h)
+    {
+      if (h->next_host != h) {
+        h->prev_host->next_host = h->next_host;
+        h->next_host->prev_host = h->prev_host;
+
+        if (_M_next == h) {
+          _M_next = h->next_host;
+        }
+      } else {
+        _M_next = NULL;
+      }
+
+      h->prev_host = NULL;
+      h->next_host = NULL;
+
+      h->in = list::kNone;
+    }
+
+    template<typename _T>
+    void host_scheduler<_T>::link_delayed(host* h)
+    {
+      // The hosts are usually delayed in the order of their next request
+      // (the delay is the same for all of them).
+      host* prev = _M_delayed_tail;
+      while ((prev) && (prev->next_request > h->next_request)) {
+        prev = prev->prev_host;
+      }
+
+      h->prev_host = prev;
+
+      if (prev) {
+        h->next_host = prev->next_host;
+        prev->next_host = h;
+      } else {
+        h->next_host = _M_delayed_head;
+        _M_delayed_head = h;
+      }
+
+      if (h->next_host) {
+        h->next_host->prev_host = h;
+      } else {
+        _M_delayed_tail = h;
+      }
+
+      h->in = list::kDelayed;
+    }
+
+    template<typename _T>
+    void host_scheduler<_T>::unlink_delayed(host* h)
+    {
+      if (h->prev_host) {
+        h->prev_host->next_host = h->next_host;
+      } else {
+        _M_delayed_head = h->next_host;
+      }
+
+      if (h->next_host) {
+        h->next_host->prev_host = h->prev_host;
+      } else {
+        _M_delayed_tail = h->prev_host;
+      }
+
+      h->prev_host = NULL;
+      h->next_host = NULL;
+
+      h->in = list::kNone;
+    }
+
+    template<typename _T>
+    void host_scheduler<_T>::unlink_unused(host* h)
+    {
+      if (h->prev_host) {
+        h->prev_host->next_host = h->next_host;
+      } else {
+        _M_unused_head = h->next_host;
+      }
+
+      if (h->next_host) {
+        h->next_host->prev_host = h->prev_host;
+      } else {
+        _M_unused_tail = h->prev_host;
+      }
+
+      h->prev_host = NULL;
+      h->next_host = NULL;
+
+      h->in = list::kNone;
+    }
+
+    template<typename _T>
+    void host_scheduler<_T>::unlink(host* h)
+    {
+      switch (h->in) {
+        case list::kNone:
+          break;
+        case list::kReady:
+          unlink_ready(h);
+          break;
+        case list::kDelayed:
+          unlink_delayed(h);
+          break;
+        case list::kUnused:
+          unlink_unused(h);
+          break;
+      }
+    }
+
+    template<typename _T>
+    void host_scheduler<_T>::update(host* h, uint64_t current_msec)
+    {
+      list in;
+      if (!h->head) {
+        in = (h->connections == 0) ? list::kUnused : list::kNone;
+      } else if (h->connections >= _M_max_connections) {
+        in = list::kNone;
+      } else if (h->next_request > current_msec) {
+        in = list::kDelayed;
+      } else {
+        in = list::kReady;
+      }
+
+      if (h->in == in) {
+        return;
+      }
+
+      unlink(h);
+
+      switch (in) {
+        case list::kNone:
+          break;
+        case list::kReady:
+          link_ready(h);
+          break;
+        case list::kDelayed:
+          link_delayed(h);
+          break;
+        case list::kUnused:
+          unused(h, current_msec);
+          break;
+      }
+    }
+
+    template<typename _T>
+    void host_scheduler<_T>::unused(host* h, uint64_t current_msec)
+    {
+      // If the delay has expired, the host can be forgotten.
+      if (h->next_request <= current_msec) {
+        free(h);
+        return;
+      }
+
+      // Append to the list of unused hosts.
+      h->prev_host = _M_unused_tail;
+      h->next_host = NULL;
+
+      if (_M_unused_tail) {
+        _M_unused_tail->next_host = h;
+      } else {
+        _M_unused_head = h;
+      }
+
+      _M_unused_tail = h;
+
+      h->in = list::kUnused;
+    }
+
+    template<typename _T>
+    void host_scheduler<_T>::free_unused(uint64_t current_msec)
+    {
+      host* h;
+      while (((h = _M_unused_head) != NULL) &&
+             (h->next_request <= current_msec)) {
+        unlink_unused(h);
+        free(h);
+      }
+    }
+
+    template<typename _T>
+    void host_scheduler<_T>::free(host* h)
+    {
+      host** ptr = &_M_buckets[h->hash & (kNumberBuckets - 1)];
+      while (*ptr != h) {
+        ptr = &(*ptr)->next;
+      }
+
+      *ptr = h->next;
+
+      ::free(h);
+    }
+
+    template<typename _T>
+    uint32_t host_scheduler<_T>::hash(const char* key, size_t keylen)
+    {
+      // FNV-1a.
+      uint32_t h = 2166136261u;
+
+      for (size_t i = 0; i < keylen; i++) {
+        h ^= static_cast<uint8_t>(key[i]);
+        h *= 16777619u;
+      }
+
+      return h;
+    }
+  }
+}
+
+#endif // NET_HTTP_HOST_SCHEDULER_H
@@ -0,0 +1,178 @@
+#include <string.h>
+#include <unistd.h>
+#include "net/http/range_coordinator.h"
+
+unsigned net::http::range_coordinator::add(const uri::uri& uri,
+                                           const socket_address& addr,
+                                           const char* filename,
+                                           uint64_t header_size,
+                                           uint64_t content_length,
+                                           const string::slice& validator)
+{
+  // Search a free slot.
+  unsigned id;
+  for (id = 0; id < kMaxDownloads; id++) {
+    if (!_M_downloads[id].used) {
+      break;
+    }
+  }
+
+  if (id == kMaxDownloads) {
+    return kNoDownload;
+  }
+
+  download* d = &_M_downloads[id];
+
+  size_t len = strlen(filename);
+  if (len >= sizeof(d->filename)) {
+    return kNoDownload;
+  }
+
+  d->uri.clear();
+  d->validator.clear();
+
+  if ((!d->uri.init(uri)) ||
+      (!d->validator.append(validator.data(), validator.length()))) {
+    return kNoDownload;
+  }
+
+  d->addr = addr;
+
+  memcpy(d->filename, filename, len + 1);
+
+  d->header_size = header_size;
+  d->content_length = content_length;
+
+  // Split the body in ranges of the same size (the last one gets the
+  // remainder).
+  uint64_t size = content_length / _M_nranges;
+
+  for (unsigned i = 0; i < _M_nranges; i++) {
+    range* r = &d->ranges[i];
+
+    r->first = i * size;
+    r->last = (i + 1 < _M_nranges) ? r->first + size - 1 : content_length - 1;
+    r->st = range::state::kPending;
+    r->attempts = 0;
+  }
+
+  // The first range is being received.
+  d->ranges[0].st = range::state::kReceiving;
+  d->ranges[0].attempts = 1;
+
+  d->nranges = _M_nranges;
+  d->receiving = 1;
+  d->received = 0;
+
+  d->used = true;
+  d->failed = false;
+
+  _M_pending += _M_nranges - 1;
+
+  return id;
+}
+
+bool net::http::range_coordinator::next(unsigned& id, unsigned& idx)
+{
+  if (_M_pending == 0) {
+    return false;
+  }
+
+  for (unsigned i = 0; i < kMaxDownloads; i++) {
+    download* d = &_M_downloads[i];
+
+    if ((d->used) && (!d->failed)) {
+      for (unsigned j = 0; j < d->nranges; j++) {
+        range* r = &d->ranges[j];
+
+        if (r->st == range::state::kPending) {
+          r->st = range::state::kReceiving;
+          r->attempts++;
+
+          d->receiving++;
+
+          _M_pending--;
+
+          id = i;
+          idx = j;
+
+          return true;
+        }
+      }
+    }
+  }
+
+  return false;
+}
+
+void net::http::range_coordinator::received(unsigned id, unsigned idx)
+{
+  download* d = &_M_downloads[id];
+
+  d->ranges[idx].st = range::state::kReceived;
+
+  d->receiving--;
+  d->received++;
+
+  finish(d);
+}
+
+void net::http::range_coordinator::failed(unsigned id, unsigned idx)
+{
+  download* d = &_M_downloads[id];
+  range* r = &d->ranges[idx];
+
+  d->receiving--;
+
+  if (!d->failed) {
+    if (r->attempts < kMaxAttempts) {
+      // Request the range again.
+      r->st = range::state::kPending;
+      _M_pending++;
+
+      return;
+    }
+
+    // Give up, the ranges which have not been requested yet won't be.
+    for (unsigned i = 0; i < d->nranges; i++) {
+      if (d->ranges[i].st == range::state::kPending) {
+        _M_pending--;
+      }
+    }
+
+    d->failed = true;
+  }
+
+  finish(d);
+}
+
+void net::http::range_coordinator::finish(download* d)
+{
+  if (d->failed) {
+    // Wait for the ranges which are still being received.
+    if (d->receiving == 0) {
+      unlink(d->filename);
+
+      d->uri.clear();
+      d->used = false;
+    }
+  } else if (d->received == d->nranges) {
+    if (_M_index) {
+      // The files are named after their number.
+      const char* name = strrchr(d->filename, '/');
+
+      url_index::entry e;
+      e.file = strtoull(name ? name + 1 : d->filename, NULL, 10);
+      e.offset = 0;
+      e.content_length = d->content_length;
+      e.status_code = 200;
+      e.flags = 0;
+
+      // If the entry cannot be added, the response is still saved.
+      _M_index->add(d->uri.string(), e);
+    }
+
+    d->uri.clear();
+    d->used = false;
+  }
+}
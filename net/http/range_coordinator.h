@@ -0,0 +1,183 @@
+#ifndef NET_HTTP_RANGE_COORDINATOR_H
+#define NET_HTTP_RANGE_COORDINATOR_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include "net/socket_address.h"
+#include "net/uri/uri.h"
+#include "net/http/url_index.h"
+#include "string/buffer.h"
+#include "string/slice.h"
+
+namespace net {
+  namespace http {
+    // Downloads of large responses split into byte ranges, each one
+    // received over its own connection and written at its offset of the
+    // preallocated file (the first range is received by the client which
+    // received the headers). The file is added to the index when all the
+    // ranges have been received; if a range fails too many times, the file
+    // is removed.
+    class range_coordinator {
+      public:
+        static const unsigned kMaxRanges = 16;
+        static const unsigned kDefaultRanges = 1; // The files are not split.
+        static const uint64_t kDefaultMinSize = 8 * 1024 * 1024;
+
+        // Maximum number of downloads being split at the same time.
+        static const unsigned kMaxDownloads = 32;
+
+        static const unsigned kNoDownload = ~0u;
+
+        // Number of times a range is requested before giving up.
+        static const unsigned kMaxAttempts = 3;
+
+        struct range {
+          // Offsets of the first and the last byte of the range (in the
+          // body).
+          uint64_t first;
+          uint64_t last;
+
+          enum class state : uint8_t {
+            kPending,
+            kReceiving,
+            kReceived
+          };
+
+          state st;
+
+          unsigned attempts;
+        };
+
+        struct download {
+          uri::uri uri;
+          socket_address addr;
+
+          char filename[PATH_MAX];
+
+          // Size of the URI, the status line and the headers.
+          uint64_t header_size;
+
+          uint64_t content_length;
+
+          // ETag or Last-Modified (If-Range).
+          string::buffer validator;
+
+          range ranges[kMaxRanges];
+          unsigned nranges;
+
+          // Number of ranges being received.
+          unsigned receiving;
+
+          // Number of ranges received.
+          unsigned received;
+
+          bool used;
+          bool failed;
+        };
+
+        // Constructor.
+        range_coordinator();
+
+        // Destructor.
+        ~range_coordinator();
+
+        // Set number of ranges per file and minimum Content-Length of the
+        // responses which are split.
+        void ranges(unsigned n, uint64_t min_size);
+
+        // Set index.
+        void index(url_index* idx);
+
+        // Should a response of this length be split?
+        bool split(uint64_t content_length) const;
+
+        // Add download (returns kNoDownload if there is no room); the first
+        // range is being received by the caller.
+        unsigned add(const uri::uri& uri,
+                     const socket_address& addr,
+                     const char* filename,
+                     uint64_t header_size,
+                     uint64_t content_length,
+                     const string::slice& validator);
+
+        // Get download.
+        const download* get(unsigned id) const;
+
+        // Get number of ranges waiting to be requested.
+        unsigned pending() const;
+
+        // Get next range to be requested (returns false if there is none).
+        bool next(unsigned& id, unsigned& idx);
+
+        // The range has been received.
+        void received(unsigned id, unsigned idx);
+
+        // The range couldn't be received (it is requested again).
+        void failed(unsigned id, unsigned idx);
+
+      private:
+        download _M_downloads[kMaxDownloads];
+
+        unsigned _M_nranges;
+        uint64_t _M_min_size;
+
+        unsigned _M_pending;
+
+        url_index* _M_index;
+
+        // Finish download.
+        void finish(download* d);
+
+        // Disable copy constructor and assignment operator.
+        range_coordinator(const range_coordinator&) = delete;
+        range_coordinator& operator=(const range_coordinator&) = delete;
+    };
+
+    inline range_coordinator::range_coordinator()
+      : _M_nranges(kDefaultRanges),
+        _M_min_size(kDefaultMinSize),
+        _M_pending(0),
+        _M_index(NULL)
+    {
+      for (unsigned i = 0; i < kMaxDownloads; i++) {
+        _M_downloads[i].used = false;
+      }
+    }
+
+    inline range_coordinator::~range_coordinator()
+    {
+    }
+
+    inline void range_coordinator::ranges(unsigned n, uint64_t min_size)
+    {
+      _M_nranges = n;
+      _M_min_size = min_size;
+    }
+
+    inline void range_coordinator::index(url_index* idx)
+    {
+      _M_index = idx;
+    }
+
+    inline bool range_coordinator::split(uint64_t content_length) const
+    {
+      return ((_M_nranges > 1) &&
+              (content_length >= _M_min_size) &&
+              (content_length >= _M_nranges));
+    }
+
+    inline const range_coordinator::download*
+    range_coordinator::get(unsigned id) const
+    {
+      return &_M_downloads[id];
+    }
+
+    inline unsigned range_coordinator::pending() const
+    {
+      return _M_pending;
+    }
+  }
+}
+
+#endif // NET_HTTP_RANGE_COORDINATOR_H
@@ -54,6 +54,9 @@ namespace net {
         // Get address.
         const socket_address& address() const;
 
+        // Set address.
+        void address(const socket_address& addr);
+
         // Get method.
         http::method method() const;
 
@@ -204,6 +207,11 @@ namespace net {
       return _M_addr;
     }
 
+    inline void request::address(const socket_address& addr)
+    {
+      _M_addr = addr;
+    }
+
     inline method request::method() const
     {
       return _M_method;
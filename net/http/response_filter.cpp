@@ -0,0 +1,164 @@
+#include <strings.h>
+#include "net/http/response_filter.h"
+#include "util/number.h"
+
+bool net::http::response_filter::status_codes(const char* s)
+{
+  memset(_M_status_codes, 0, sizeof(_M_status_codes));
+
+  do {
+    const char* end = strchr(s, ',');
+    if (!end) {
+      end = s + strlen(s);
+    }
+
+    // Range?
+    const char* dash = static_cast<const char*>(memchr(s, '-', end - s));
+
+    uint32_t from, to;
+    if (util::number::parse(s,
+                            (dash ? dash : end) - s,
+                            from,
+                            kMinStatusCode,
+                            kMaxStatusCode) !=
+        util::number::parse_result::kSucceeded) {
+      return false;
+    }
+
+    if (dash) {
+      if (util::number::parse(dash + 1,
+                              end - (dash + 1),
+                              to,
+                              from,
+                              kMaxStatusCode) !=
+          util::number::parse_result::kSucceeded) {
+        return false;
+      }
+    } else {
+      to = from;
+    }
+
+    for (; from <= to; from++) {
+      _M_status_codes[from / 8] |= (1 << (from % 8));
+    }
+
+    s = (*end == ',') ? end + 1 : end;
+  } while (*s);
+
+  _M_have_status_codes = true;
+
+  return true;
+}
+
+bool net::http::response_filter::content_types(const char* s)
+{
+  _M_types.clear();
+  _M_ntypes = 0;
+
+  do {
+    const char* end = strchr(s, ',');
+    if (!end) {
+      end = s + strlen(s);
+    }
+
+    // The media type must have a type and a subtype.
+    const char* slash = static_cast<const char*>(memchr(s, '/', end - s));
+    if ((!slash) || (slash == s) || (slash + 1 == end)) {
+      return false;
+    }
+
+    if (_M_ntypes == kMaxContentTypes) {
+      return false;
+    }
+
+    _M_type_offsets[_M_ntypes++] = _M_types.length();
+
+    if (!_M_types.append_nul_terminated_string(s, end - s)) {
+      return false;
+    }
+
+    s = (*end == ',') ? end + 1 : end;
+  } while (*s);
+
+  return true;
+}
+
+bool net::http::response_filter::match(unsigned status_code,
+                                       const header::headers& headers) const
+{
+  if (_M_have_status_codes) {
+    if ((status_code < kMinStatusCode) ||
+        (status_code > kMaxStatusCode) ||
+        ((_M_status_codes[status_code / 8] & (1 << (status_code % 8))) ==
+         0)) {
+      return false;
+    }
+  }
+
+  if (_M_ntypes > 0) {
+    // Get Content-Type header (if available).
+    string::slice value =
+      headers.header(header::permanent_field_name::kContentType);
+
+    unsigned i;
+    for (i = 0; i < _M_ntypes; i++) {
+      if (match(_M_types.data() + _M_type_offsets[i],
+                value.data(),
+                value.length())) {
+        break;
+      }
+    }
+
+    // If the content type doesn't match any media type...
+    if (i == _M_ntypes) {
+      return false;
+    }
+  }
+
+  if (_M_have_max_content_length) {
+    uint64_t content_length;
+    if ((headers.header(header::permanent_field_name::kContentLength,
+                        content_length)) &&
+        (content_length > _M_max_content_length)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool net::http::response_filter::match(const char* type,
+                                       const char* value,
+                                       size_t len)
+{
+  // Skip the parameters of the content type.
+  size_t medialen = 0;
+  while ((medialen < len) &&
+         (value[medialen] != ';') &&
+         (value[medialen] != ' ') &&
+         (value[medialen] != '\t')) {
+    medialen++;
+  }
+
+  if (medialen == 0) {
+    return false;
+  }
+
+  size_t typelen = strlen(type);
+
+  // Any subtype?
+  if (type[typelen - 1] == '*') {
+    // Any type?
+    if ((typelen == 3) && (*type == '*')) {
+      return true;
+    }
+
+    // Compare "<type>/".
+    typelen--;
+
+    return ((medialen > typelen) &&
+            (strncasecmp(type, value, typelen) == 0));
+  }
+
+  return ((medialen == typelen) && (strncasecmp(type, value, typelen) == 0));
+}
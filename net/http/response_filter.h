@@ -0,0 +1,98 @@
+#ifndef NET_HTTP_RESPONSE_FILTER_H
+#define NET_HTTP_RESPONSE_FILTER_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "net/http/header/headers.h"
+#include "string/buffer.h"
+
+namespace net {
+  namespace http {
+    // Decides, from the status code and the headers, whether the body of
+    // a response is wanted (only the criteria which have been set are
+    // checked).
+    class response_filter {
+      public:
+        static const unsigned kMinStatusCode = 100;
+        static const unsigned kMaxStatusCode = 599;
+
+        static const unsigned kMaxContentTypes = 32;
+
+        // Constructor.
+        response_filter();
+
+        // Destructor.
+        ~response_filter();
+
+        // Set status codes (comma-separated list of codes and ranges:
+        // "200,300-399").
+        bool status_codes(const char* s);
+
+        // Set content types (comma-separated list of media types, the
+        // subtype can be '*': "text/html,text/*").
+        bool content_types(const char* s);
+
+        // Set maximum Content-Length (responses without Content-Length
+        // are not checked).
+        void max_content_length(uint64_t n);
+
+        // Has any criterion been set?
+        bool empty() const;
+
+        // Is the body of the response wanted?
+        bool match(unsigned status_code,
+                   const header::headers& headers) const;
+
+      private:
+        // Bitmap of status codes.
+        uint8_t _M_status_codes[(kMaxStatusCode + 8) / 8];
+        bool _M_have_status_codes;
+
+        // Content types (NUL-terminated).
+        string::buffer _M_types;
+        size_t _M_type_offsets[kMaxContentTypes];
+        unsigned _M_ntypes;
+
+        uint64_t _M_max_content_length;
+        bool _M_have_max_content_length;
+
+        // Does the media type match the content type?
+        static bool match(const char* type,
+                          const char* value,
+                          size_t len);
+
+        // Disable copy constructor and assignment operator.
+        response_filter(const response_filter&) = delete;
+        response_filter& operator=(const response_filter&) = delete;
+    };
+
+    inline response_filter::response_filter()
+      : _M_have_status_codes(false),
+        _M_ntypes(0),
+        _M_max_content_length(0),
+        _M_have_max_content_length(false)
+    {
+      memset(_M_status_codes, 0, sizeof(_M_status_codes));
+    }
+
+    inline response_filter::~response_filter()
+    {
+    }
+
+    inline void response_filter::max_content_length(uint64_t n)
+    {
+      _M_max_content_length = n;
+      _M_have_max_content_length = true;
+    }
+
+    inline bool response_filter::empty() const
+    {
+      return ((!_M_have_status_codes) &&
+              (_M_ntypes == 0) &&
+              (!_M_have_max_content_length));
+    }
+  }
+}
+
+#endif // NET_HTTP_RESPONSE_FILTER_H
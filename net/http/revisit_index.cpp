@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include "net/http/revisit_index.h"
+#include "net/http/archive.h"
+#include "net/http/date.h"
+#include "net/http/header/headers.h"
+#include "fs/file.h"
+
+bool net::http::revisit_index::open(const char* dir)
+{
+  size_t len;
+  if ((len = strlen(dir)) >= sizeof(_M_dir)) {
+    return false;
+  }
+
+  for (unsigned i = 0; i < kMaxIndexes; i++) {
+    char filename[PATH_MAX];
+    int ret = snprintf(filename, sizeof(filename), "%s/index_%02u", dir, i);
+    if ((ret <= 0) || (static_cast<size_t>(ret) >= sizeof(filename))) {
+      return false;
+    }
+
+    // The indexes which cannot be opened are skipped.
+    if (_M_indexes[_M_nindexes].open(filename)) {
+      _M_nindexes++;
+    }
+  }
+
+  memcpy(_M_dir, dir, len + 1);
+
+  return (_M_nindexes > 0);
+}
+
+bool net::http::revisit_index::validators(const string::slice& url,
+                                          string::buffer& etag,
+                                          time_t& last_modified) const
+{
+  etag.clear();
+  last_modified = static_cast<time_t>(-1);
+
+  const url_index* index = NULL;
+  const url_index::entry* e = NULL;
+
+  for (unsigned i = 0; i < _M_nindexes; i++) {
+    if ((e = _M_indexes[i].find(url)) != NULL) {
+      index = &_M_indexes[i];
+      break;
+    }
+  }
+
+  // Only the responses which have been saved completely are revisited.
+  if ((!e) ||
+      (e->flags & ~(url_index::kArchived |
+                    url_index::kUnchanged |
+                    url_index::kDecoded))) {
+    return false;
+  }
+
+  char path[PATH_MAX];
+  if (!index->path(_M_dir, *e, path, sizeof(path))) {
+    return false;
+  }
+
+  fs::file file;
+  if (!file.open(path, O_RDONLY)) {
+    return false;
+  }
+
+  // Skip the header of the record of the archive.
+  off_t offset = (e->flags & url_index::kArchived) ?
+                   e->offset + archive::kHeaderSize :
+                   0;
+
+  char buf[kMaxHeaderSize];
+  ssize_t ret;
+  if ((ret = file.pread(buf, sizeof(buf), offset)) <= 0) {
+    return false;
+  }
+
+  const char* end = buf + ret;
+
+  // Skip URI and Status-Line.
+  const char* ptr = buf;
+  for (unsigned i = 0; i < 2; i++) {
+    if ((ptr = static_cast<const char*>(memchr(ptr, '\n', end - ptr))) ==
+        NULL) {
+      return false;
+    }
+
+    ptr++;
+  }
+
+  header::headers headers;
+  if (headers.parse(ptr, end - ptr) !=
+      header::headers::parse_result::kEndOfHeader) {
+    return false;
+  }
+
+  string::slice value = headers.header(header::permanent_field_name::kETag);
+  if ((value.length() > 0) && (!etag.append(value.data(), value.length()))) {
+    return false;
+  }
+
+  value = headers.header(header::permanent_field_name::kLastModified);
+
+  // A 304 response doesn't need to have Last-Modified, but the resource
+  // has not been modified since the date of the response.
+  if ((value.length() == 0) && (e->flags & url_index::kUnchanged)) {
+    value = headers.header(header::permanent_field_name::kDate);
+  }
+
+  if (value.length() > 0) {
+    last_modified = date::parse(value.data(), value.length());
+  }
+
+  return ((etag.length() > 0) || (last_modified != static_cast<time_t>(-1)));
+}
@@ -0,0 +1,73 @@
+#ifndef NET_HTTP_REVISIT_INDEX_H
+#define NET_HTTP_REVISIT_INDEX_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
+#include "net/http/url_index.h"
+#include "string/buffer.h"
+#include "string/slice.h"
+
+namespace net {
+  namespace http {
+    // Indexes of the directory of a previous run: the ETag and the
+    // Last-Modified date of the responses saved by that run are sent in
+    // conditional requests (If-None-Match, If-Modified-Since). The indexes
+    // are only read, so they are shared by the workers.
+    class revisit_index {
+      public:
+        // Maximum number of indexes (one per thread of the previous run).
+        static const unsigned kMaxIndexes = 32;
+
+        // Constructor.
+        revisit_index();
+
+        // Destructor.
+        ~revisit_index();
+
+        // Open the indexes of the directory.
+        bool open(const char* dir);
+
+        // Have the indexes been opened?
+        bool opened() const;
+
+        // Get the validators of the response saved for the URL ('etag' is
+        // left empty and 'last_modified' is set to -1 if they are not
+        // available).
+        bool validators(const string::slice& url,
+                        string::buffer& etag,
+                        time_t& last_modified) const;
+
+      private:
+        // Only the beginning of the saved response is read.
+        static const size_t kMaxHeaderSize = 16 * 1024;
+
+        char _M_dir[PATH_MAX];
+
+        url_index _M_indexes[kMaxIndexes];
+        unsigned _M_nindexes;
+
+        // Disable copy constructor and assignment operator.
+        revisit_index(const revisit_index&) = delete;
+        revisit_index& operator=(const revisit_index&) = delete;
+    };
+
+    inline revisit_index::revisit_index()
+      : _M_nindexes(0)
+    {
+      *_M_dir = 0;
+    }
+
+    inline revisit_index::~revisit_index()
+    {
+    }
+
+    inline bool revisit_index::opened() const
+    {
+      return (_M_nindexes > 0);
+    }
+  }
+}
+
+#endif // NET_HTTP_REVISIT_INDEX_H
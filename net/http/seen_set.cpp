@@ -0,0 +1,100 @@
+#include <string.h>
+#include "net/http/seen_set.h"
+
+bool net::http::seen_set::create(size_t size,
+                                 const char* filename,
+                                 bool resume)
+{
+  if (size == 0) {
+    return false;
+  }
+
+  // The number of bits is a power of two, so that the bit of a hash is
+  // computed with a mask.
+  size_t n = 1;
+  while (n <= size / 2) {
+    n *= 2;
+  }
+
+  // The pages are only allocated when they are written.
+  if ((_M_bits = reinterpret_cast<uint8_t*>(calloc(n, 1))) == NULL) {
+    return false;
+  }
+
+  _M_mask = static_cast<uint64_t>(n) * 8 - 1;
+
+  if (filename) {
+    if (!_M_index.create(filename, resume)) {
+      ::free(_M_bits);
+      _M_bits = NULL;
+
+      return false;
+    }
+
+    // Fill the filter with the URLs of the previous run.
+    for (uint64_t i = _M_index.capacity(); i > 0; i--) {
+      uint64_t h1 = _M_index.slot(i - 1).hash;
+      if (h1 != 0) {
+        set(h1);
+      }
+    }
+
+    _M_exact = true;
+  }
+
+  return true;
+}
+
+bool net::http::seen_set::add(const string::slice& url)
+{
+  // The bits are derived from the hash of the index, so that the filter
+  // can be filled from the index.
+  bool seen = set(url_index::hash(url));
+
+  if (!_M_exact) {
+    return !seen;
+  }
+
+  if (seen) {
+    if (_M_index.find(url)) {
+      return false;
+    }
+
+    _M_false_positives++;
+  }
+
+  // If the URL cannot be added to the index, it might be downloaded twice.
+  url_index::entry e;
+  memset(&e, 0, sizeof(url_index::entry));
+
+  _M_index.add(url, e);
+
+  return true;
+}
+
+bool net::http::seen_set::set(uint64_t h1)
+{
+  // Double hashing: the i-th bit is h1 + i * h2 (h2 is derived from h1
+  // with the finalizer of splitmix64 and it is odd, so that the bits are
+  // different).
+  uint64_t h2 = h1;
+  h2 = (h2 ^ (h2 >> 30)) * 0xbf58476d1ce4e5b9ull;
+  h2 = (h2 ^ (h2 >> 27)) * 0x94d049bb133111ebull;
+  h2 = (h2 ^ (h2 >> 31)) | 1;
+
+  bool seen = true;
+
+  for (unsigned i = 0; i < kHashes; i++) {
+    uint64_t bit = (h1 + i * h2) & _M_mask;
+
+    uint8_t* byte = &_M_bits[bit / 8];
+    uint8_t m = static_cast<uint8_t>(1 << (bit % 8));
+
+    if ((*byte & m) == 0) {
+      *byte |= m;
+      seen = false;
+    }
+  }
+
+  return seen;
+}
@@ -0,0 +1,97 @@
+#ifndef NET_HTTP_SEEN_SET_H
+#define NET_HTTP_SEEN_SET_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "net/http/url_index.h"
+#include "string/slice.h"
+
+namespace net {
+  namespace http {
+    // URLs read by the downloader (normalized), so that a URL which
+    // appears again in the same or in a later file with URLs is skipped.
+    // The URLs are added to a Bloom filter whose size is fixed, so the
+    // memory doesn't grow with the number of URLs; a false positive skips
+    // a URL which has not been downloaded. In exact mode, the URLs are also
+    // added to an index on disk (<dir>/seen), which is only looked up when
+    // the filter reports a URL as seen. When the downloader resumes from a
+    // checkpoint, the index is kept and the filter is filled from it.
+    class seen_set {
+      public:
+        enum class mode {
+          kNone, // The URLs are not deduplicated.
+          kFilter,
+          kExact
+        };
+
+        // Constructor.
+        seen_set();
+
+        // Destructor.
+        ~seen_set();
+
+        // Create (the size of the filter is rounded down to a power of two,
+        // 'filename': index of exact mode or NULL, 'resume': keep the URLs
+        // of the existing index).
+        bool create(size_t size, const char* filename, bool resume = false);
+
+        // Has the set been created?
+        bool created() const;
+
+        // Add URL (returns false if the URL had already been added).
+        bool add(const string::slice& url);
+
+        // Get number of URLs which the filter reported as seen but were not
+        // in the index.
+        uint64_t false_positives() const;
+
+      private:
+        // Number of bits set per URL (about 1% of false positives with 10
+        // bits per URL).
+        static const unsigned kHashes = 7;
+
+        uint8_t* _M_bits;
+        uint64_t _M_mask; // Number of bits - 1.
+
+        url_index _M_index;
+        bool _M_exact;
+
+        uint64_t _M_false_positives;
+
+        // Set the bits of the hash of a URL (returns true if all of them
+        // were already set).
+        bool set(uint64_t h1);
+
+        // Disable copy constructor and assignment operator.
+        seen_set(const seen_set&) = delete;
+        seen_set& operator=(const seen_set&) = delete;
+    };
+
+    inline seen_set::seen_set()
+      : _M_bits(NULL),
+        _M_mask(0),
+        _M_exact(false),
+        _M_false_positives(0)
+    {
+    }
+
+    inline seen_set::~seen_set()
+    {
+      if (_M_bits) {
+        ::free(_M_bits);
+      }
+    }
+
+    inline bool seen_set::created() const
+    {
+      return (_M_bits != NULL);
+    }
+
+    inline uint64_t seen_set::false_positives() const
+    {
+      return _M_false_positives;
+    }
+  }
+}
+
+#endif // NET_HTTP_SEEN_SET_H
@@ -0,0 +1,361 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "net/http/url_index.h"
+
+net::http::url_index::~url_index()
+{
+  unmap();
+
+  if (_M_fd != -1) {
+    close(_M_fd);
+  }
+}
+
+bool net::http::url_index::create(const char* dir, unsigned id)
+{
+  int ret = snprintf(_M_filename,
+                     sizeof(_M_filename),
+                     "%s/index_%02u",
+                     dir,
+                     id);
+
+  if ((ret <= 0) || (static_cast<size_t>(ret) >= sizeof(_M_filename))) {
+    return false;
+  }
+
+  int fd;
+  if ((fd = ::open(_M_filename, O_CREAT | O_RDWR, 0644)) < 0) {
+    return false;
+  }
+
+  // If the index is new or invalid...
+  if (!map(fd, true)) {
+    if ((ftruncate(fd, 0) < 0) ||
+        (!init(fd, id, kInitialCapacity)) ||
+        (!map(fd, true))) {
+      close(fd);
+      return false;
+    }
+  }
+
+  _M_fd = fd;
+
+  return true;
+}
+
+bool net::http::url_index::create(const char* filename, bool keep)
+{
+  int ret = snprintf(_M_filename, sizeof(_M_filename), "%s", filename);
+  if ((ret <= 0) || (static_cast<size_t>(ret) >= sizeof(_M_filename))) {
+    return false;
+  }
+
+  int fd;
+  if ((fd = ::open(_M_filename,
+                   keep ? O_CREAT | O_RDWR : O_CREAT | O_TRUNC | O_RDWR,
+                   0644)) < 0) {
+    return false;
+  }
+
+  // If the index is new, invalid or not wanted...
+  if ((!keep) || (!map(fd, true))) {
+    if ((ftruncate(fd, 0) < 0) ||
+        (!init(fd, 0, kInitialCapacity)) ||
+        (!map(fd, true))) {
+      close(fd);
+      return false;
+    }
+  }
+
+  _M_fd = fd;
+
+  return true;
+}
+
+bool net::http::url_index::open(const char* filename)
+{
+  int fd;
+  if ((fd = ::open(filename, O_RDONLY)) < 0) {
+    return false;
+  }
+
+  if (!map(fd, false)) {
+    close(fd);
+    return false;
+  }
+
+  _M_fd = fd;
+
+  return true;
+}
+
+bool net::http::url_index::add(const string::slice& url, const entry& e)
+{
+  // Keep the table at most half full.
+  if (((_M_header->count + 1) * 2 > _M_header->capacity) && (!grow())) {
+    return false;
+  }
+
+  entry tmp = e;
+  tmp.hash = hash(url);
+
+  if (insert(_M_entries, _M_header->capacity, tmp)) {
+    _M_header->count++;
+  }
+
+  return true;
+}
+
+const net::http::url_index::entry*
+net::http::url_index::find(const string::slice& url) const
+{
+  if (!_M_header) {
+    return NULL;
+  }
+
+  uint64_t h = hash(url);
+  uint64_t mask = _M_header->capacity - 1;
+
+  for (uint64_t i = h & mask; _M_entries[i].hash != 0; i = (i + 1) & mask) {
+    if (_M_entries[i].hash == h) {
+      return &_M_entries[i];
+    }
+  }
+
+  return NULL;
+}
+
+bool net::http::url_index::path(const char* dir,
+                                const entry& e,
+                                char* buf,
+                                size_t size) const
+{
+  int ret;
+  if (e.flags & kArchived) {
+    // Same name as the segments of the archive.
+    ret = snprintf(buf,
+                   size,
+                   "%s/segment_%02u_%06lu",
+                   dir,
+                   _M_header->id,
+                   static_cast<unsigned long>(e.file));
+  } else {
+    ret = snprintf(buf,
+                   size,
+                   "%s/%012lu",
+                   dir,
+                   static_cast<unsigned long>(e.file));
+  }
+
+  return ((ret > 0) && (static_cast<size_t>(ret) < size));
+}
+
+bool net::http::url_index::find(const char* dir,
+                                const string::slice& url,
+                                entry& e,
+                                char* buf,
+                                size_t size)
+{
+  DIR* d;
+  if ((d = opendir(dir)) == NULL) {
+    return false;
+  }
+
+  bool found = false;
+
+  struct dirent* ent;
+  while ((!found) && ((ent = readdir(d)) != NULL)) {
+    // Skip files which are not indexes (and temporary indexes).
+    if ((strncmp(ent->d_name, "index_", 6) != 0) ||
+        (strchr(ent->d_name, '.'))) {
+      continue;
+    }
+
+    char filename[PATH_MAX];
+    int ret = snprintf(filename, sizeof(filename), "%s/%s", dir, ent->d_name);
+    if ((ret <= 0) || (static_cast<size_t>(ret) >= sizeof(filename))) {
+      continue;
+    }
+
+    url_index index;
+    if (index.open(filename)) {
+      const entry* p;
+      if ((p = index.find(url)) != NULL) {
+        e = *p;
+        found = index.path(dir, e, buf, size);
+      }
+    }
+  }
+
+  closedir(d);
+
+  return found;
+}
+
+uint64_t net::http::url_index::hash(const string::slice& url)
+{
+  // FNV-1a.
+  uint64_t h = 14695981039346656037ull;
+
+  const char* ptr = url.data();
+  const char* end = ptr + url.length();
+
+  while (ptr < end) {
+    h ^= static_cast<uint8_t>(*ptr++);
+    h *= 1099511628211ull;
+  }
+
+  // 0 marks the empty entries.
+  return (h != 0) ? h : 1;
+}
+
+bool net::http::url_index::map(int fd, bool writable)
+{
+  struct stat buf;
+  if ((fstat(fd, &buf) < 0) ||
+      (static_cast<uint64_t>(buf.st_size) < sizeof(header))) {
+    return false;
+  }
+
+  void* data;
+  if ((data = mmap(NULL,
+                   buf.st_size,
+                   writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                   MAP_SHARED,
+                   fd,
+                   0)) == MAP_FAILED) {
+    return false;
+  }
+
+  header* hdr = reinterpret_cast<header*>(data);
+
+  // Check header.
+  if ((memcmp(hdr->magic, "DIDX", 4) != 0) ||
+      (hdr->capacity == 0) ||
+      ((hdr->capacity & (hdr->capacity - 1)) != 0) ||
+      (hdr->capacity > (static_cast<uint64_t>(buf.st_size) - sizeof(header)) /
+                       sizeof(entry)) ||
+      (sizeof(header) + hdr->capacity * sizeof(entry) !=
+       static_cast<uint64_t>(buf.st_size)) ||
+      (hdr->count >= hdr->capacity)) {
+    munmap(data, buf.st_size);
+    return false;
+  }
+
+  _M_header = hdr;
+  _M_entries = reinterpret_cast<entry*>(hdr + 1);
+  _M_size = buf.st_size;
+
+  return true;
+}
+
+void net::http::url_index::unmap()
+{
+  if (_M_header) {
+    munmap(_M_header, _M_size);
+
+    _M_header = NULL;
+    _M_entries = NULL;
+    _M_size = 0;
+  }
+}
+
+bool net::http::url_index::init(int fd, unsigned id, uint64_t capacity)
+{
+  // The entries are zero-filled (empty).
+  if (ftruncate(fd, sizeof(header) + capacity * sizeof(entry)) < 0) {
+    return false;
+  }
+
+  header hdr;
+  memset(&hdr, 0, sizeof(header));
+
+  memcpy(hdr.magic, "DIDX", 4);
+  hdr.id = id;
+  hdr.capacity = capacity;
+  hdr.count = 0;
+
+  return (pwrite(fd, &hdr, sizeof(header), 0) ==
+          static_cast<ssize_t>(sizeof(header)));
+}
+
+bool net::http::url_index::insert(entry* entries,
+                                  uint64_t capacity,
+                                  const entry& e)
+{
+  uint64_t mask = capacity - 1;
+
+  uint64_t i = e.hash & mask;
+  while ((entries[i].hash != 0) && (entries[i].hash != e.hash)) {
+    i = (i + 1) & mask;
+  }
+
+  bool inserted = (entries[i].hash == 0);
+
+  // Write the hash last, so that readers don't see incomplete entries.
+  entries[i].file = e.file;
+  entries[i].offset = e.offset;
+  entries[i].content_length = e.content_length;
+  entries[i].status_code = e.status_code;
+  entries[i].flags = e.flags;
+  entries[i].reserved = 0;
+  entries[i].hash = e.hash;
+
+  return inserted;
+}
+
+bool net::http::url_index::grow()
+{
+  char tmp[PATH_MAX];
+  int ret = snprintf(tmp, sizeof(tmp), "%s.tmp", _M_filename);
+  if ((ret <= 0) || (static_cast<size_t>(ret) >= sizeof(tmp))) {
+    return false;
+  }
+
+  int fd;
+  if ((fd = ::open(tmp, O_CREAT | O_TRUNC | O_RDWR, 0644)) < 0) {
+    return false;
+  }
+
+  uint64_t capacity = _M_header->capacity * 2;
+
+  if (init(fd, _M_header->id, capacity)) {
+    url_index index;
+    if (index.map(fd, true)) {
+      // Copy the entries.
+      for (uint64_t i = 0; i < _M_header->capacity; i++) {
+        if (_M_entries[i].hash != 0) {
+          insert(index._M_entries, capacity, _M_entries[i]);
+        }
+      }
+
+      index._M_header->count = _M_header->count;
+
+      // Replace the index.
+      if (rename(tmp, _M_filename) == 0) {
+        unmap();
+
+        _M_header = index._M_header;
+        _M_entries = index._M_entries;
+        _M_size = index._M_size;
+
+        index._M_header = NULL;
+
+        close(_M_fd);
+        _M_fd = fd;
+
+        return true;
+      }
+    }
+  }
+
+  close(fd);
+  unlink(tmp);
+
+  return false;
+}
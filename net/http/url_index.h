@@ -0,0 +1,181 @@
+#ifndef NET_HTTP_URL_INDEX_H
+#define NET_HTTP_URL_INDEX_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <sys/types.h>
+#include "string/slice.h"
+
+namespace net {
+  namespace http {
+    // Index of the saved responses (<dir>/index_<id>, one per worker).
+    // The file is a hash table (open addressing with linear probing) which
+    // is mapped into memory, so that a URL is looked up in O(1) without
+    // reading the file. The numbers are in host byte order.
+    // When the table is half full, a table twice as big is built in a
+    // temporary file which replaces the index.
+    class url_index {
+      public:
+        struct entry {
+          // Hash of the URL (0: empty entry).
+          uint64_t hash;
+
+          // Number of the file or of the segment of the archive.
+          uint64_t file;
+
+          // Offset of the record in the segment (0 for files).
+          uint64_t offset;
+
+          // Length of the body.
+          uint64_t content_length;
+
+          uint16_t status_code;
+
+          // Flags (kArchived, kTruncated, kFiltered, kPartial, kUnchanged,
+          // kDecoded).
+          uint16_t flags;
+
+          uint32_t reserved;
+        };
+
+        // The response has been appended to a segment of the archive.
+        static const uint16_t kArchived = 1;
+
+        // The body exceeded the maximum size and has been truncated.
+        static const uint16_t kTruncated = 2;
+
+        // Only the status line and the headers have been saved (the body
+        // was not wanted).
+        static const uint16_t kFiltered = 4;
+
+        // The body has not been received completely (the download can be
+        // resumed).
+        static const uint16_t kPartial = 8;
+
+        // 304 response to a conditional request: the response saved by the
+        // previous run is still valid.
+        static const uint16_t kUnchanged = 16;
+
+        // The body has been decompressed (the Content-Encoding and
+        // Content-Length headers of the response have not been saved).
+        static const uint16_t kDecoded = 32;
+
+        // Constructor.
+        url_index();
+
+        // Destructor.
+        ~url_index();
+
+        // Create (the index is opened for writing, existing entries are
+        // kept).
+        bool create(const char* dir, unsigned id);
+
+        // Create empty index (an existing file is truncated unless 'keep'
+        // is set and the file is a valid index).
+        bool create(const char* filename, bool keep = false);
+
+        // Open index for reading.
+        bool open(const char* filename);
+
+        // Add entry (the hash is computed from the URL, a previous entry of
+        // the same URL is replaced).
+        bool add(const string::slice& url, const entry& e);
+
+        // Find URL.
+        const entry* find(const string::slice& url) const;
+
+        // Get number of entries.
+        uint64_t count() const;
+
+        // Get number of slots of the table.
+        uint64_t capacity() const;
+
+        // Get slot of the table (its hash is 0 if it is empty).
+        const entry& slot(uint64_t i) const;
+
+        // Build path of the file or segment of the entry.
+        bool path(const char* dir,
+                  const entry& e,
+                  char* buf,
+                  size_t size) const;
+
+        // Search URL in all the indexes of the directory (the path of the
+        // file or segment is saved in 'buf').
+        static bool find(const char* dir,
+                         const string::slice& url,
+                         entry& e,
+                         char* buf,
+                         size_t size);
+
+        // Hash function.
+        static uint64_t hash(const string::slice& url);
+
+      private:
+        static const uint64_t kInitialCapacity = 64 * 1024;
+
+        struct header {
+          char magic[4]; // "DIDX".
+          uint32_t id;
+          uint64_t capacity; // Power of two.
+          uint64_t count;
+          uint64_t reserved;
+        };
+
+        char _M_filename[PATH_MAX];
+
+        int _M_fd;
+
+        header* _M_header;
+        entry* _M_entries;
+
+        size_t _M_size;
+
+        // Map index file.
+        bool map(int fd, bool writable);
+
+        // Unmap index file.
+        void unmap();
+
+        // Initialize empty index file.
+        static bool init(int fd, unsigned id, uint64_t capacity);
+
+        // Insert entry into the table (returns false if the entry replaced
+        // another one).
+        static bool insert(entry* entries, uint64_t capacity, const entry& e);
+
+        // Double the capacity of the table.
+        bool grow();
+
+        // Disable copy constructor and assignment operator.
+        url_index(const url_index&) = delete;
+        url_index& operator=(const url_index&) = delete;
+    };
+
+    inline url_index::url_index()
+      : _M_fd(-1),
+        _M_header(NULL),
+        _M_entries(NULL),
+        _M_size(0)
+    {
+      *_M_filename = 0;
+    }
+
+    inline uint64_t url_index::count() const
+    {
+      return _M_header ? _M_header->count : 0;
+    }
+
+    inline uint64_t url_index::capacity() const
+    {
+      return _M_header ? _M_header->capacity : 0;
+    }
+
+    inline const url_index::entry& url_index::slot(uint64_t i) const
+    {
+      return _M_entries[i];
+    }
+  }
+}
+
+#endif // NET_HTTP_URL_INDEX_H
@@ -0,0 +1,1003 @@
+#include <string.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <new>
+#include "net/http/worker.h"
+#include "net/http/methods.h"
+#include "net/uri/uri.h"
+#include "net/ipv4_address.h"
+#include "net/ports.h"
+#include "string/slice.h"
+#include "util/move.h"
+#include "util/number.h"
+
+net::http::worker::file_statistics*
+net::http::worker::file_statistics::create(const char* filename,
+                                           unsigned pending)
+{
+  file_statistics* stats;
+  if ((stats = reinterpret_cast<file_statistics*>(
+                 malloc(sizeof(file_statistics))
+               )) == NULL) {
+    return NULL;
+  }
+
+  snprintf(stats->filename, sizeof(stats->filename), "%s", filename);
+
+  stats->pending = pending;
+
+  stats->duplicates = 0;
+
+  stats->hits = 0;
+  stats->negative_hits = 0;
+  stats->misses = 0;
+
+  return stats;
+}
+
+void net::http::worker::file_statistics::release(unsigned count)
+{
+  // If there are other references...
+  if (__atomic_sub_fetch(&pending, count, __ATOMIC_ACQ_REL) != 0) {
+    return;
+  }
+
+  printf("%s: ", filename);
+
+  if (duplicates > 0) {
+    printf("%" PRIu64 " duplicates skipped, ", duplicates);
+  }
+
+  printf("DNS cache: %" PRIu64 " hits (%" PRIu64 " negative), "
+         "%" PRIu64 " misses.\n",
+         __atomic_load_n(&hits, __ATOMIC_RELAXED),
+         __atomic_load_n(&negative_hits, __ATOMIC_RELAXED),
+         __atomic_load_n(&misses, __ATOMIC_RELAXED));
+
+  fflush(stdout);
+
+  ::free(this);
+}
+
+bool net::http::worker::create(const char* dir, unsigned id, unsigned nworkers)
+{
+  if (!_M_selector.create()) {
+    return false;
+  }
+
+  if (!_M_resolver.create(_M_selector, _M_max_connections)) {
+    return false;
+  }
+
+  if ((_M_clients = new (std::nothrow) client[_M_selector.size()]) == NULL) {
+    return false;
+  }
+
+  if ((_M_requests = new (std::nothrow) request[_M_selector.size()]) == NULL) {
+    return false;
+  }
+
+  if ((_M_timings = new (std::nothrow) timing[_M_selector.size()]) == NULL) {
+    return false;
+  }
+
+  if (!_M_pool.create(_M_selector.size())) {
+    return false;
+  }
+
+  // The URLs of the hosts which have too many URLs queued are spilled to
+  // <dir>/spill_<id>.
+  char filename[PATH_MAX];
+  int ret = snprintf(filename, sizeof(filename), "%s/spill_%02u", dir, id);
+
+  if ((ret <= 0) || (static_cast<size_t>(ret) >= sizeof(filename))) {
+    return false;
+  }
+
+  if (!_M_hosts.create(_M_selector.size(), filename)) {
+    return false;
+  }
+
+  _M_hosts.max_queued(kMaxHostQueuedUrls, kMaxQueuedUrls);
+
+  // The file being read.
+  if ((_M_files = static_cast<pending_file*>(
+                    malloc(kInitialPendingFiles * sizeof(pending_file)))) ==
+      NULL) {
+    return false;
+  }
+
+  _M_files[0].stats = NULL;
+  _M_files[0].urls = 0;
+
+  _M_nfiles = 1;
+  _M_files_size = kInitialPendingFiles;
+
+  if (!_M_queue.create(kQueueSize)) {
+    return false;
+  }
+
+  if ((_M_output == output_mode::kArchive) &&
+      (!_M_archive.create(dir, id, _M_segment_size))) {
+    return false;
+  }
+
+  if (!_M_index.create(dir, id)) {
+    return false;
+  }
+
+  _M_coordinator.index(&_M_index);
+
+  if (!_M_buffers.create()) {
+    return false;
+  }
+
+#if HAVE_IO_URING
+  // If io_uring is not available, the files are written synchronously.
+  bool async = (_M_output == output_mode::kFiles) &&
+               (_M_writer.create(_M_selector));
+#endif
+
+#if HAVE_SPLICE
+  // If the pipe cannot be created, the bodies are copied.
+  bool zero_copy = (_M_output == output_mode::kFiles) && (_M_splicer.create());
+#endif
+
+  for (size_t i = 0; i < _M_selector.size(); i++) {
+    _M_clients[i].index(&_M_index);
+
+    if (_M_output == output_mode::kFiles) {
+      _M_clients[i].coordinator(&_M_coordinator);
+    }
+    _M_clients[i].buffers(&_M_buffers);
+
+#if HAVE_IO_URING
+    if (async) {
+      _M_clients[i].writer(&_M_writer);
+    }
+#endif
+
+#if HAVE_SPLICE
+    if (zero_copy) {
+      _M_clients[i].splicer(&_M_splicer);
+    }
+#endif
+  }
+
+  _M_dir = dir;
+
+  _M_id = id;
+
+  _M_count = id;
+  _M_step = nworkers;
+
+  return true;
+}
+
+bool net::http::worker::start()
+{
+  _M_running = true;
+
+  if (pthread_create(&_M_thread, NULL, run, this) != 0) {
+    _M_running = false;
+    return false;
+  }
+
+  return true;
+}
+
+void net::http::worker::run()
+{
+  while (__atomic_load_n(&_M_running, __ATOMIC_RELAXED)) {
+    if (!_M_selector.wait_for_events(kMaxWait)) {
+      update_time();
+    } else {
+      update_time();
+
+      _M_selector.process_events();
+    }
+
+#if HAVE_IO_URING
+    // Finish the responses whose writes have completed.
+    if (_M_writer.inflight() > 0) {
+      complete_writes();
+    }
+#endif
+
+    _M_scheduler.check_expired(_M_current_msec);
+    _M_resolver.check_expired(_M_current_msec);
+
+    // Retry the requests whose reused connection was closed.
+    if (_M_retry.length() > 0) {
+      retry();
+    }
+
+    // Request the ranges of the split downloads.
+    if (_M_coordinator.pending() > 0) {
+      request_ranges();
+    }
+
+    // Process the new URLs (the queue is read even if all the connections
+    // are busy, so that the end of file markers and the checkpoints don't
+    // wait).
+    process_queue();
+
+#if HAVE_IO_URING
+    // Submit the writes queued in this iteration.
+    _M_writer.submit();
+#endif
+  }
+
+#if HAVE_IO_URING
+  // Wait for the writes in flight (they use the buffers of the clients).
+  uint64_t user_data;
+  int res;
+  while ((_M_writer.inflight() > 0) && (_M_writer.wait())) {
+    while (_M_writer.completion(user_data, res));
+  }
+#endif
+
+  discard_queue();
+
+  add_statistics(NULL);
+}
+
+#if HAVE_IO_URING
+void net::http::worker::complete_writes()
+{
+  uint64_t user_data;
+  int res;
+  while (_M_writer.completion(user_data, res)) {
+    unsigned fd = client::write_owner(user_data);
+    client* client = &_M_clients[fd];
+
+    client->on_write(user_data, res);
+
+    // If the response has been received and written...
+    if (client->written()) {
+      // Run the client again.
+      if (!_M_selector.process_fd_events(fd,
+                                         fdtype::kFdSocket,
+                                         client,
+                                         io::event::kNoEvent)) {
+        _M_selector.remove(fd);
+      }
+    }
+  }
+}
+#endif
+
+void net::http::worker::process_queue()
+{
+  // Move the URLs from the downloader to the queues of their hosts. The
+  // queues don't fill up: the URLs which don't fit in memory are spilled,
+  // so that the downloader doesn't wait for a worker with a host which has
+  // many URLs while the other workers are idle. The URLs after the end of
+  // a file are queued too (the file is finished when its URLs have been
+  // sent).
+  do {
+    task t;
+    if (!_M_queue.pop(t)) {
+      break;
+    }
+
+    if (t.stats) {
+      end_of_file(t.stats);
+    } else if (t.cp) {
+      // The URLs received before the checkpoint are either in the queues
+      // of the hosts or being downloaded.
+      t.cp->release(1, save_checkpoint());
+    } else if ((!t.recovered) || (!saved(t.uri))) {
+      queue(t);
+
+      _M_urls++;
+    }
+  } while (true);
+
+  // Send the URLs of the hosts which can be sent more requests.
+  while (nclients() < _M_max_connections) {
+    task t;
+    if (!_M_hosts.pop(_M_current_msec, t)) {
+      break;
+    }
+
+    _M_files[t.file - _M_first_file].urls--;
+
+    add(t);
+  }
+
+  // If there are files whose end has been received...
+  if (_M_nfiles > 1) {
+    finish_files();
+  }
+
+  send_pipelined();
+}
+
+void net::http::worker::discard_queue()
+{
+  for (size_t i = 0; i < _M_nfiles; i++) {
+    if (_M_files[i].stats) {
+      _M_files[i].stats->release(1);
+      _M_files[i].stats = NULL;
+    }
+  }
+
+  do {
+    task t;
+    if (!_M_queue.pop(t)) {
+      return;
+    }
+
+    if (t.stats) {
+      t.stats->release(1);
+    } else if (t.cp) {
+      t.cp->release(1, false);
+    }
+  } while (true);
+}
+
+void net::http::worker::end_of_file(file_statistics* stats)
+{
+  // If the file cannot be kept, its statistics are added now.
+  if (_M_nfiles == _M_files_size) {
+    size_t size = _M_files_size * 2;
+
+    pending_file* files;
+    if ((files = static_cast<pending_file*>(
+                   realloc(_M_files, size * sizeof(pending_file)))) == NULL) {
+      add_statistics(stats);
+      stats->release(1);
+
+      return;
+    }
+
+    _M_files = files;
+    _M_files_size = size;
+  }
+
+  // The URLs which follow belong to the next file.
+  _M_files[_M_nfiles - 1].stats = stats;
+
+  _M_files[_M_nfiles].stats = NULL;
+  _M_files[_M_nfiles].urls = 0;
+
+  _M_nfiles++;
+}
+
+void net::http::worker::finish_files()
+{
+  // The last file is being read.
+  for (size_t i = 0; i + 1 < _M_nfiles; i++) {
+    pending_file* file = &_M_files[i];
+
+    if ((file->stats) && (file->urls == 0)) {
+      add_statistics(file->stats);
+      file->stats->release(1);
+
+      file->stats = NULL;
+    }
+  }
+
+  // Remove the finished files from the front.
+  size_t n = 0;
+  while ((n + 1 < _M_nfiles) && (!_M_files[n].stats)) {
+    n++;
+  }
+
+  if (n > 0) {
+    memmove(_M_files, _M_files + n, (_M_nfiles - n) * sizeof(pending_file));
+
+    _M_nfiles -= n;
+    _M_first_file += n;
+  }
+}
+
+void net::http::worker::add_statistics(file_statistics* stats)
+{
+  const dns::cache& cache = _M_resolver.host_cache();
+
+  if (stats) {
+    __atomic_add_fetch(&stats->hits, cache.hits(), __ATOMIC_RELAXED);
+    __atomic_add_fetch(&stats->negative_hits,
+                       cache.negative_hits(),
+                       __ATOMIC_RELAXED);
+    __atomic_add_fetch(&stats->misses, cache.misses(), __ATOMIC_RELAXED);
+  }
+
+  _M_hits += cache.hits();
+  _M_negative_hits += cache.negative_hits();
+  _M_misses += cache.misses();
+
+  _M_resolver.reset_cache_statistics();
+}
+
+bool net::http::worker::save_checkpoint()
+{
+  string::buffer urls;
+
+  // URLs waiting in the queues of the hosts.
+  if (!_M_hosts.for_each(add_to_checkpoint, &urls)) {
+    return false;
+  }
+
+  // URLs being downloaded.
+  for (unsigned fd = 0; fd < _M_selector.size(); fd++) {
+    // If the connection is sending requests (the ranges of the split
+    // downloads are added below)...
+    if ((_M_hosts.acquired(fd)) && (!_M_clients[fd].receiving_range())) {
+      const client* client = &_M_clients[fd];
+
+      string::slice url(_M_requests[fd].uri().string());
+      if ((!urls.append(url.data(), url.length())) || (!urls.append('\n'))) {
+        return false;
+      }
+
+      for (unsigned i = 0; i < client->pipelined(); i++) {
+        url = client->pipelined_uri(i).string();
+
+        if ((!urls.append(url.data(), url.length())) ||
+            (!urls.append('\n'))) {
+          return false;
+        }
+      }
+    }
+  }
+
+  // Downloads split in ranges.
+  for (unsigned i = 0; i < range_coordinator::kMaxDownloads; i++) {
+    const range_coordinator::download* d = _M_coordinator.get(i);
+
+    if (d->used) {
+      string::slice url(d->uri.string());
+      if ((!urls.append(url.data(), url.length())) || (!urls.append('\n'))) {
+        return false;
+      }
+    }
+  }
+
+  // URLs to be retried (one per line).
+  if (!urls.append(_M_retry.data(), _M_retry.length())) {
+    return false;
+  }
+
+  char filename[PATH_MAX];
+  return ((checkpoint::path(_M_dir, _M_id, filename, sizeof(filename))) &&
+          (checkpoint::save(filename, urls.data(), urls.length())));
+}
+
+bool net::http::worker::add_to_checkpoint(const task& t, void* arg)
+{
+  string::buffer* urls = static_cast<string::buffer*>(arg);
+
+  string::slice url(t.uri.string());
+  return ((urls->append(url.data(), url.length())) && (urls->append('\n')));
+}
+
+bool net::http::worker::saved(const uri::uri& uri) const
+{
+  const url_index::entry* e = _M_index.find(uri.string());
+
+  // The partial files are resumed.
+  return ((e) && (!(e->flags & url_index::kPartial)));
+}
+
+bool net::http::worker::task::init(const char* url, size_t len)
+{
+  uri.clear();
+
+  if (!uri.init(url, len)) {
+    return false;
+  }
+
+  // If not HTTP or HTTPS...
+  const string::slice& scheme(uri.scheme());
+  if (((scheme.length() != 4) ||
+       (strncasecmp(scheme.data(), "http", 4) != 0))
+#if HAVE_SSL
+      &&
+      ((scheme.length() != 5) ||
+       (strncasecmp(scheme.data(), "https", 5) != 0))) {
+#else
+     ) {
+#endif
+    return false;
+  }
+
+  port = worker::port(uri);
+
+  const string::slice& host(uri.host());
+  char hoststr[kMaxHostLen + 1];
+  size_t hostlen;
+
+  if ((hostlen = host.length()) > kMaxHostLen) {
+    return false;
+  }
+
+  memcpy(hoststr, host.data(), hostlen);
+  hoststr[hostlen] = 0;
+
+  // If the host is an IP address, there is no need to resolve it.
+  if (!(resolved = addr.build(hoststr, port))) {
+    addr.ss_family = AF_UNSPEC;
+  }
+
+  recovered = false;
+
+  stats = NULL;
+  cp = NULL;
+
+  return true;
+}
+
+bool net::http::worker::task::save(string::buffer& buf) const
+{
+  // Format: <recovered (0 / 1)><file> <URL>
+  string::slice url(uri.string());
+  return ((buf.format("%c%" PRIu64 " ", recovered ? '1' : '0', file)) &&
+          (buf.append(url.data(), url.length())));
+}
+
+bool net::http::worker::task::load(const char* line, size_t len)
+{
+  const char* space;
+  if ((len < 2) ||
+      ((space = static_cast<const char*>(memchr(line, ' ', len))) == NULL) ||
+      (util::number::parse(line + 1, space - (line + 1), file) !=
+       util::number::parse_result::kSucceeded) ||
+      (!init(space + 1, len - (space + 1 - line)))) {
+    return false;
+  }
+
+  recovered = (*line == '1');
+
+  return true;
+}
+
+bool net::http::worker::add_url(const char* url, size_t len)
+{
+  task t;
+  return ((t.init(url, len)) && (queue(t)));
+}
+
+bool net::http::worker::queue(task& t)
+{
+  t.file = _M_first_file + _M_nfiles - 1;
+
+  if (!_M_hosts.push(t.uri.host(), t.port, util::move(t))) {
+    return false;
+  }
+
+  _M_files[_M_nfiles - 1].urls++;
+
+  return true;
+}
+
+bool net::http::worker::add(task& t)
+{
+  uri::uri& uri = t.uri;
+  in_port_t p = t.port;
+
+  int fd;
+
+  // If there is a connection to the same server which accepts pipelined
+  // requests (the download of a partial file is resumed with its own
+  // request, the conditional requests are not pipelined)...
+  if ((!_M_revisit) &&
+      (!partial(uri)) &&
+      ((fd = _M_pool.get_pipelining(uri, p)) != -1)) {
+    return pipeline(fd, util::move(uri));
+  }
+
+  // If there is an idle connection to the same server, reuse it.
+  if ((fd = _M_pool.get(uri, p)) != -1) {
+    // If the next requests to the same server can be pipelined...
+    if ((_M_pipelining_depth > 1) &&
+        (!_M_revisit) &&
+        (_M_pool.pipelining(uri, p))) {
+      if (!reuse(fd, util::move(uri), false)) {
+        return false;
+      }
+
+      // The request will be sent when the maximum pipelining depth is
+      // reached or when all the URLs have been loaded.
+      if (!_M_pool.add_pipelining(fd, _M_requests[fd].uri(), p)) {
+        return send(fd);
+      }
+
+      return true;
+    }
+
+    return reuse(fd, util::move(uri), true);
+  }
+
+  // If the maximum number of connections has been reached, close the
+  // connection which has been idle for longest.
+  if ((_M_pool.count() > 0) &&
+      (nclients() + _M_pool.count() >= _M_max_connections)) {
+    close_idle(_M_pool.oldest());
+  }
+
+  const string::slice& host(uri.host());
+  char hoststr[kMaxHostLen + 1];
+  size_t hostlen = host.length();
+
+  memcpy(hoststr, host.data(), hostlen);
+  hoststr[hostlen] = 0;
+
+  socket_address addr(t.addr);
+  bool resolved;
+  if (!(resolved = t.resolved)) {
+    // Look up the host in the DNS cache.
+    switch (_M_resolver.lookup(hoststr, hostlen, _M_current_msec, addr)) {
+      case dns::cache::result::kHit:
+        reinterpret_cast<ipv4_address*>(&addr)->port(p);
+        resolved = true;
+
+        break;
+      case dns::cache::result::kNegativeHit:
+        // The host doesn't exist.
+        return false;
+      case dns::cache::result::kMiss:
+        break;
+    }
+  }
+
+  socket sock;
+  if (!sock.create(resolved ? addr.ss_family : AF_INET,
+                   socket::type::kStream)) {
+    return false;
+  }
+
+  request* req = &_M_requests[sock.fd()];
+  req->clear();
+
+  req->init(addr, method::kGet, util::move(uri));
+
+  client* client = &_M_clients[sock.fd()];
+
+  client->clear();
+
+  // Set socket descriptor.
+  client->fd(sock.fd());
+
+  if (!init_client(client, req)) {
+    sock.close();
+    return false;
+  }
+
+  if (resolved) {
+    if (!connect(sock.fd(), addr)) {
+      return false;
+    }
+  } else {
+    if (!_M_resolver.resolve(hoststr,
+                             hostlen,
+                             sock.fd(),
+                             _M_current_msec)) {
+      client->abort();
+      sock.close();
+
+      return false;
+    }
+
+    client->resolving(true);
+    _M_nresolving++;
+  }
+
+  // Schedule client (new connection).
+  _M_timings[client->fd()].start = _M_current_msec;
+  schedule(client);
+
+  _M_hosts.acquire(client->fd(), req->uri().host(), p, _M_current_msec);
+
+  return true;
+}
+
+void net::http::worker::retry()
+{
+  string::buffer urls;
+  urls.swap(_M_retry);
+
+  const char* ptr = urls.data();
+  const char* end = ptr + urls.length();
+
+  while (ptr < end) {
+    const char* eol = static_cast<const char*>(memchr(ptr, '\n', end - ptr));
+
+    add_url(ptr, eol - ptr);
+
+    ptr = eol + 1;
+  }
+}
+
+void net::http::worker::request_ranges()
+{
+  unsigned download, range;
+  while ((nclients() < _M_max_connections) &&
+         (_M_coordinator.next(download, range))) {
+    request_range(download, range);
+  }
+}
+
+void net::http::worker::request_range(unsigned download, unsigned range)
+{
+  const range_coordinator::download* d = _M_coordinator.get(download);
+
+  // The host has already been resolved.
+  socket sock;
+  if (!sock.create(d->addr.ss_family, socket::type::kStream)) {
+    _M_coordinator.failed(download, range);
+    return;
+  }
+
+  request* req = &_M_requests[sock.fd()];
+  req->clear();
+
+  uri::uri uri;
+  if (!uri.init(d->uri)) {
+    sock.close();
+    _M_coordinator.failed(download, range);
+
+    return;
+  }
+
+  req->init(d->addr, method::kGet, util::move(uri));
+
+  client* client = &_M_clients[sock.fd()];
+
+  client->clear();
+
+  // Set socket descriptor.
+  client->fd(sock.fd());
+
+  if (!client->receive(req, download, range)) {
+    sock.close();
+    _M_coordinator.failed(download, range);
+
+    return;
+  }
+
+  // If the connection cannot be established, the client reports the
+  // failure of the range.
+  if (!connect(sock.fd(), d->addr)) {
+    return;
+  }
+
+  // Schedule client (new connection).
+  _M_timings[client->fd()].start = _M_current_msec;
+  schedule(client);
+
+  _M_hosts.acquire(client->fd(),
+                   req->uri().host(),
+                   port(req->uri()),
+                   _M_current_msec);
+}
+
+bool net::http::worker::reuse(int fd, uri::uri&& uri, bool send_now)
+{
+  request* req = &_M_requests[fd];
+
+  socket_address addr(req->address());
+
+  req->clear();
+  req->init(addr, method::kGet, util::move(uri));
+
+  client* client = &_M_clients[fd];
+
+  client->reuse();
+
+  if (!init_client(client, req)) {
+    _M_scheduler.erase(client->timer());
+    _M_selector.remove(fd);
+
+    return false;
+  }
+
+  schedule(client);
+
+  _M_hosts.acquire(fd, req->uri().host(), port(req->uri()), _M_current_msec);
+
+  return send_now ? send(fd) : true;
+}
+
+bool net::http::worker::pipeline(int fd, uri::uri&& uri)
+{
+  client* client = &_M_clients[fd];
+
+  char path[PATH_MAX];
+  const char* filename = NULL;
+
+  if (_M_output == output_mode::kFiles) {
+    next_filename(path, sizeof(path));
+    filename = path;
+  }
+
+  if (!client->pipeline(util::move(uri), filename)) {
+    return false;
+  }
+
+  // If the maximum pipelining depth has been reached...
+  if (client->pipelined() + 1 == _M_pipelining_depth) {
+    _M_pool.remove(fd);
+    return send(fd);
+  }
+
+  return true;
+}
+
+bool net::http::worker::send(int fd)
+{
+  // Send the request(s) (the connection is writable).
+  if (!_M_selector.process_fd_events(fd,
+                                     fdtype::kFdSocket,
+                                     &_M_clients[fd],
+                                     io::event::kWrite)) {
+    _M_hosts.release(fd, _M_current_msec);
+    _M_selector.remove(fd);
+    return false;
+  }
+
+  return true;
+}
+
+void net::http::worker::send_pipelined()
+{
+  int fd;
+  while ((fd = _M_pool.pop_pipelining()) != -1) {
+    send(fd);
+  }
+}
+
+void net::http::worker::requeue(const client* client, bool timed_out)
+{
+  const uri::uri& uri = _M_requests[client->fd()].uri();
+
+  // If the server closed the reused connection before sending the
+  // response, retry the request on a new connection.
+  bool retry = (!timed_out) && (client->retryable());
+
+  // If there are pipelined requests which will not be answered...
+  if (client->pipelined() > 0) {
+    // If the server has misbehaved, don't pipeline more requests to it.
+    if (!retry) {
+      _M_pool.disable_pipelining(uri, port(uri));
+    }
+
+    for (unsigned i = 0; i < client->pipelined(); i++) {
+      string::slice url(client->pipelined_uri(i).string());
+
+      _M_retry.append(url.data(), url.length());
+      _M_retry.append('\n');
+    }
+  }
+
+  // If the partial file has been kept, resume the download.
+  if ((retry) || (client->partial())) {
+    string::slice url(uri.string());
+
+    _M_retry.append(url.data(), url.length());
+    _M_retry.append('\n');
+  }
+}
+
+bool net::http::worker::init_client(client* client, request* req)
+{
+  if (_M_output == output_mode::kArchive) {
+    client->init(req, &_M_archive, kMaxRecordSize);
+  } else {
+    char path[PATH_MAX];
+
+    // If the download of the URL can be resumed...
+    const url_index::entry* e;
+    if (((e = partial(req->uri())) != NULL) &&
+        (_M_index.path(_M_dir, *e, path, sizeof(path)))) {
+      // If the partial file is not valid, start again.
+      return ((client->resume(req, path, e->content_length)) ||
+              (client->init(req, path)));
+    }
+
+    next_filename(path, sizeof(path));
+
+    if (!client->init(req, path)) {
+      return false;
+    }
+  }
+
+  // If the URL has been saved by the previous run, only get the response
+  // if it has changed.
+  time_t last_modified;
+  if ((_M_revisit) &&
+      (_M_revisit->validators(req->uri().string(), _M_etag, last_modified)) &&
+      (!client->conditional(_M_etag, last_modified))) {
+    // Remove the file.
+    client->abort();
+    return false;
+  }
+
+  return true;
+}
+
+const net::http::url_index::entry*
+net::http::worker::partial(const uri::uri& uri) const
+{
+  if ((_M_output != output_mode::kFiles) || (client::resume_min_size() == 0)) {
+    return NULL;
+  }
+
+  const url_index::entry* e = _M_index.find(uri.string());
+
+  return ((e) &&
+          (e->flags & url_index::kPartial) &&
+          (e->content_length > 0)) ? e : NULL;
+}
+
+void net::http::worker::next_filename(char* path, size_t size)
+{
+  struct stat buf;
+
+  do {
+    snprintf(path, size, "%s/%012lu", _M_dir, _M_count);
+    _M_count += _M_step;
+  } while (stat(path, &buf) == 0);
+}
+
+in_port_t net::http::worker::port(const uri::uri& uri)
+{
+  if (uri.port() != 0) {
+    return uri.port();
+  }
+
+  const string::slice& scheme(uri.scheme());
+  return standard_port(scheme.data(), scheme.length());
+}
+
+void net::http::worker::on_resolved(unsigned id,
+                                        const socket_address& addr)
+{
+  client* client = &_M_clients[id];
+  request* req = &_M_requests[id];
+
+  socket_address a(addr);
+  reinterpret_cast<ipv4_address*>(&a)->port(port(req->uri()));
+
+  req->address(a);
+
+  _M_nresolving--;
+
+  if (!connect(id, a)) {
+    _M_scheduler.erase(client->timer());
+    return;
+  }
+
+  client->resolving(false);
+}
+
+bool net::http::worker::connect(int fd, const socket_address& addr)
+{
+  socket sock(fd);
+  if (!sock.connect(addr)) {
+    abort(fd);
+    return false;
+  }
+
+  if (!_M_selector.add(fd,
+                       fdtype::kFdSocket,
+                       &_M_clients[fd],
+                       io::event::kWrite)) {
+    abort(fd);
+    return false;
+  }
+
+  return true;
+}
+
+void net::http::worker::abort(int fd)
+{
+  _M_hosts.release(fd, _M_current_msec);
+
+  _M_clients[fd].abort();
+  close(fd);
+}
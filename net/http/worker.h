@@ -0,0 +1,844 @@
+#ifndef NET_HTTP_WORKER_H
+#define NET_HTTP_WORKER_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/time.h>
+#include <pthread.h>
+#include "net/selector.h"
+#include "net/socket_address.h"
+#include "net/dns/resolver.h"
+#include "net/dns/observer.h"
+#include "net/http/client.h"
+#include "net/http/request.h"
+#include "net/http/connection_pool.h"
+#include "net/http/host_scheduler.h"
+#include "net/http/archive.h"
+#include "net/http/url_index.h"
+#include "net/http/range_coordinator.h"
+#include "net/http/revisit_index.h"
+#include "net/http/checkpoint.h"
+
+#if HAVE_IO_URING
+  #include "fs/uring_writer.h"
+#endif
+
+#if HAVE_SPLICE
+  #include "net/splicer.h"
+#endif
+
+#include "net/uri/uri.h"
+#include "string/buffer.h"
+#include "string/buffer_pool.h"
+#include "timer/wheel.h"
+#include "timer/observer.h"
+#include "io/observer.h"
+#include "util/spsc_queue.h"
+
+namespace net {
+  namespace http {
+    // Event loop running in its own thread, which downloads the URLs it
+    // receives from the downloader.
+    class worker : public io::observer,
+                   public timer::observer,
+                   public dns::observer {
+      public:
+        static const size_t kQueueSize = 1024;
+
+        // Responses bigger than kMaxRecordSize are discarded when they are
+        // appended to the archive.
+        static const size_t kMaxRecordSize = 64 * 1024 * 1024;
+
+        // Where the responses are saved.
+        enum class output_mode {
+          kFiles, // One file per URL.
+          kArchive
+        };
+
+        // Statistics of a file with URLs (each worker adds its counters
+        // when it reaches the end of the file, the last one prints them).
+        struct file_statistics {
+          char filename[PATH_MAX];
+
+          // Number of workers which haven't added their counters yet.
+          unsigned pending;
+
+          // Number of duplicate URLs skipped by the downloader.
+          uint64_t duplicates;
+
+          uint64_t hits;
+          uint64_t negative_hits;
+          uint64_t misses;
+
+          // Create.
+          static file_statistics* create(const char* filename,
+                                         unsigned pending);
+
+          // Release references (the last one prints the statistics).
+          void release(unsigned count);
+        };
+
+        // URL parsed by the downloader (ready to be downloaded), end of
+        // file marker or checkpoint.
+        struct task {
+          uri::uri uri;
+          in_port_t port;
+
+          // Address (if the host is an IP address).
+          socket_address addr;
+          bool resolved;
+
+          // URL which had not been finished when the previous run saved
+          // its last checkpoint (it is skipped if it is in the index).
+          bool recovered;
+
+          // End of file (NULL: not end of file).
+          file_statistics* stats;
+
+          // Checkpoint (NULL: not a checkpoint).
+          checkpoint* cp;
+
+          // Number of the file with URLs the URL belongs to (see _M_files).
+          uint64_t file;
+
+          // Constructor.
+          task();
+
+          // Initialize from URL.
+          bool init(const char* url, size_t len);
+
+          // Save to / load from a line of the spill file of the queues of
+          // the hosts.
+          bool save(string::buffer& buf) const;
+          bool load(const char* line, size_t len);
+        };
+
+        // Constructor.
+        worker();
+
+        // Destructor.
+        ~worker();
+
+        // Create.
+        bool create(const char* dir, unsigned id, unsigned nworkers);
+
+        // Start thread.
+        bool start();
+
+        // Stop thread.
+        void stop();
+
+        // Wait for the thread to finish.
+        void join();
+
+        // Add URL (called by the downloader, the task is moved into the
+        // queue if there is room).
+        bool push(task& t);
+
+        // Mark the end of a file with URLs (called by the downloader).
+        bool push(file_statistics* stats);
+
+        // Save the URLs which have not been finished (called by the
+        // downloader).
+        bool push(checkpoint* cp);
+
+        // Set maximum number of simultaneous connections.
+        void max_connections(size_t value);
+
+        // Set timeout of a phase of the requests (the timeout of the idle
+        // phase is how long idle connections are kept open).
+        void timeout(client::phase phase, unsigned seconds);
+
+        // Set maximum duration of a request (0: no limit).
+        void total_timeout(unsigned seconds);
+
+        // Set minimum transfer rate while receiving the body of a response
+        // (0: no minimum).
+        void min_speed(unsigned bytes_per_second);
+
+        // Set maximum number of requests in flight per connection.
+        void pipelining_depth(unsigned depth);
+
+        // Set where the responses are saved.
+        void output(output_mode mode);
+
+        // Set maximum size of the segments of the archive.
+        void segment_size(off_t size);
+
+        // Set maximum number of simultaneous connections per host.
+        void max_host_connections(unsigned n);
+
+        // Set minimum delay between requests to the same host.
+        void host_delay(unsigned msec);
+
+        // Set number of ranges in which the big responses are split and
+        // minimum Content-Length of the responses which are split.
+        void ranges(unsigned n, uint64_t min_size);
+
+        // Set indexes of the previous run (the requests of the URLs saved
+        // by that run are conditional and are not pipelined).
+        void revisit(const revisit_index* r);
+
+        // Set name server.
+        void nameserver(const socket_address& addr);
+
+        // Get number of URLs received.
+        uint64_t urls() const;
+
+        // Get number of DNS cache hits (positive and negative).
+        uint64_t hits() const;
+
+        // Get number of DNS cache negative hits.
+        uint64_t negative_hits() const;
+
+        // Get number of DNS cache misses.
+        uint64_t misses() const;
+
+        // On I/O success.
+        void on_success(io::event_handler* handler);
+
+        // On I/O error.
+        void on_error(io::event_handler* handler);
+
+        // On timer.
+        void on_timer(timer::event_handler* handler);
+
+        // On host resolved.
+        void on_resolved(unsigned id, const socket_address& addr);
+
+        // On resolution error.
+        void on_resolve_error(unsigned id);
+
+      private:
+        // The transfer rate is measured over periods of kSpeedPeriod
+        // seconds.
+        static const unsigned kSpeedPeriod = 30;
+
+        static const size_t kMaxHostLen = 511;
+
+        // Maximum time waiting for events (new URLs are only checked
+        // between waits).
+        static const unsigned kMaxWait = 100; // Milliseconds.
+
+        // Maximum number of URLs waiting in memory in the queues of the
+        // hosts, in total and per host (the rest wait in the spill file).
+        static const size_t kMaxQueuedUrls = 64 * 1024;
+        static const size_t kMaxHostQueuedUrls = 1024;
+
+        selector _M_selector;
+        timer::wheel _M_scheduler;
+
+        dns::resolver _M_resolver;
+
+        // Number of clients waiting for their host to be resolved.
+        size_t _M_nresolving;
+
+        // Idle connections.
+        connection_pool _M_pool;
+        unsigned _M_pipelining_depth;
+
+        // Timeouts (seconds).
+        unsigned _M_timeouts[client::kNumberPhases];
+        unsigned _M_total_timeout;
+
+        // Bytes per second.
+        unsigned _M_min_speed;
+
+        // URLs waiting for their host to accept more requests.
+        host_scheduler<task> _M_hosts;
+
+        // Files whose end has been received while there were URLs of the
+        // file in the queues of the hosts, followed by the file being read
+        // (the statistics of a file are added when all its URLs have been
+        // sent).
+        struct pending_file {
+          // End of file (NULL: the file is being read or it is finished).
+          file_statistics* stats;
+
+          // URLs of the file in the queues of the hosts.
+          size_t urls;
+        };
+
+        static const size_t kInitialPendingFiles = 4;
+
+        pending_file* _M_files;
+        size_t _M_nfiles;
+        size_t _M_files_size;
+
+        // Number of the first file of _M_files.
+        uint64_t _M_first_file;
+
+        // URLs to be retried (their reused connection was closed by the
+        // server).
+        string::buffer _M_retry;
+
+        client* _M_clients;
+        request* _M_requests;
+
+        // Timing of the request of each client.
+        struct timing {
+          // Phase when the timer was scheduled.
+          client::phase phase;
+
+          // When the request started (milliseconds).
+          uint64_t start;
+
+          // Current period for measuring the transfer rate.
+          uint64_t period_start;
+          uint64_t period_response_size;
+        };
+
+        timing* _M_timings;
+
+        const char* _M_dir;
+
+        output_mode _M_output;
+        archive _M_archive;
+        off_t _M_segment_size;
+
+        // Index of the saved responses.
+        url_index _M_index;
+
+        // Downloads split in ranges.
+        range_coordinator _M_coordinator;
+
+        // Indexes of the previous run (NULL: the requests are not
+        // conditional).
+        const revisit_index* _M_revisit;
+
+        // ETag of the response saved by the previous run.
+        string::buffer _M_etag;
+
+        // Input buffers of the clients.
+        string::buffer_pool _M_buffers;
+
+#if HAVE_IO_URING
+        // Asynchronous writes of the files.
+        fs::uring_writer _M_writer;
+#endif
+
+#if HAVE_SPLICE
+        // Zero-copy transfer of the bodies to the files.
+        net::splicer _M_splicer;
+#endif
+
+        size_t _M_max_connections;
+
+        // Tasks from the downloader.
+        util::spsc_queue<task> _M_queue;
+
+        unsigned _M_id;
+
+        // Filenames are <id>, <id> + <nworkers>, <id> + 2 * <nworkers>...
+        size_t _M_count;
+        size_t _M_step;
+
+        // Counters.
+        uint64_t _M_urls;
+        uint64_t _M_hits;
+        uint64_t _M_negative_hits;
+        uint64_t _M_misses;
+
+        time_t _M_current_time;
+        uint64_t _M_current_msec;
+        struct tm _M_localtime;
+
+        pthread_t _M_thread;
+        bool _M_running;
+
+        // Thread function.
+        static void* run(void* arg);
+
+        // Run event loop.
+        void run();
+
+        // Update time.
+        void update_time();
+
+        // Get number of clients (neither the resolver's socket nor the idle
+        // connections are clients).
+        size_t nclients() const;
+
+#if HAVE_IO_URING
+        // Handle the completed writes.
+        void complete_writes();
+#endif
+
+        // Process the messages from the downloader.
+        void process_queue();
+
+        // Discard the messages from the downloader.
+        void discard_queue();
+
+        // End of file (the statistics are added when all the URLs of the
+        // file have been sent).
+        void end_of_file(file_statistics* stats);
+
+        // Add the statistics of the files whose URLs have been sent.
+        void finish_files();
+
+        // Add the DNS cache counters to the statistics.
+        void add_statistics(file_statistics* stats);
+
+        // Save the URLs which have not been finished yet
+        // (<dir>/checkpoint_<id>).
+        bool save_checkpoint();
+
+        // Add URL to the checkpoint.
+        static bool add_to_checkpoint(const task& t, void* arg);
+
+        // Has the response of the URL been saved?
+        bool saved(const uri::uri& uri) const;
+
+        // Add URL to the queue of its host.
+        bool add_url(const char* url, size_t len);
+
+        // Add task to the queue of its host (the URL is counted in the file
+        // being read).
+        bool queue(task& t);
+
+        // Add task.
+        bool add(task& t);
+
+        // Retry URLs.
+        void retry();
+
+        // Request the ranges of the split downloads (while there are free
+        // connections).
+        void request_ranges();
+
+        // Request range over a new connection.
+        void request_range(unsigned download, unsigned range);
+
+        // Send request over an idle connection (or just prepare it if
+        // more requests are going to be pipelined).
+        bool reuse(int fd, uri::uri&& uri, bool send_now);
+
+        // Pipeline request.
+        bool pipeline(int fd, uri::uri&& uri);
+
+        // Send the request(s) of a reused connection.
+        bool send(int fd);
+
+        // Send the requests of the connections which accept pipelined
+        // requests.
+        void send_pipelined();
+
+        // Retry the requests which will not be answered.
+        void requeue(const client* client, bool timed_out);
+
+        // Close idle connection.
+        void close_idle(int fd);
+
+        // Set where the response of the client is saved.
+        bool init_client(client* client, request* req);
+
+        // Get the index entry of the partial file of the URL (if the
+        // download can be resumed).
+        const url_index::entry* partial(const uri::uri& uri) const;
+
+        // Get next filename.
+        void next_filename(char* path, size_t size);
+
+        // Get port.
+        static in_port_t port(const uri::uri& uri);
+
+        // Schedule the timer of the client for its current phase.
+        void schedule(client* client);
+
+        // Is the body of the response being received too slowly?
+        bool too_slow(const client* client);
+
+        // Connect client.
+        bool connect(int fd, const socket_address& addr);
+
+        // Abort client which has not been added to the selector.
+        void abort(int fd);
+
+        // Disable copy constructor and assignment operator.
+        worker(const worker&) = delete;
+        worker& operator=(const worker&) = delete;
+    };
+
+    inline worker::worker()
+      : _M_nresolving(0),
+        _M_pipelining_depth(1),
+        _M_total_timeout(0),
+        _M_min_speed(0),
+        _M_files(NULL),
+        _M_nfiles(0),
+        _M_files_size(0),
+        _M_first_file(0),
+        _M_clients(NULL),
+        _M_requests(NULL),
+        _M_timings(NULL),
+        _M_dir(NULL),
+        _M_output(output_mode::kFiles),
+        _M_segment_size(archive::kDefaultMaxSegmentSize),
+        _M_revisit(NULL),
+        _M_max_connections(1),
+        _M_id(0),
+        _M_count(0),
+        _M_step(1),
+        _M_urls(0),
+        _M_hits(0),
+        _M_negative_hits(0),
+        _M_misses(0),
+        _M_running(false)
+    {
+      for (size_t i = 0; i < client::kNumberPhases; i++) {
+        _M_timeouts[i] = 0;
+      }
+
+      _M_selector.set_io_observer(this);
+      _M_scheduler.set_observer(this);
+      _M_resolver.set_observer(this);
+
+      update_time();
+
+      _M_scheduler.clear(_M_current_msec);
+    }
+
+    inline worker::~worker()
+    {
+      if (_M_clients) {
+        delete [] _M_clients;
+      }
+
+      if (_M_requests) {
+        delete [] _M_requests;
+      }
+
+      if (_M_timings) {
+        delete [] _M_timings;
+      }
+
+      if (_M_files) {
+        ::free(_M_files);
+      }
+    }
+
+    inline void worker::stop()
+    {
+      __atomic_store_n(&_M_running, false, __ATOMIC_RELAXED);
+    }
+
+    inline void worker::join()
+    {
+      pthread_join(_M_thread, NULL);
+    }
+
+    inline worker::task::task()
+      : port(0),
+        resolved(false),
+        recovered(false),
+        stats(NULL),
+        cp(NULL),
+        file(0)
+    {
+    }
+
+    inline bool worker::push(task& t)
+    {
+      return _M_queue.push(util::move(t));
+    }
+
+    inline bool worker::push(file_statistics* stats)
+    {
+      task t;
+      t.stats = stats;
+
+      return _M_queue.push(util::move(t));
+    }
+
+    inline bool worker::push(checkpoint* cp)
+    {
+      task t;
+      t.cp = cp;
+
+      return _M_queue.push(util::move(t));
+    }
+
+    inline void worker::max_connections(size_t value)
+    {
+      _M_max_connections = value;
+    }
+
+    inline void worker::timeout(client::phase phase, unsigned seconds)
+    {
+      _M_timeouts[static_cast<size_t>(phase)] = seconds;
+    }
+
+    inline void worker::total_timeout(unsigned seconds)
+    {
+      _M_total_timeout = seconds;
+    }
+
+    inline void worker::min_speed(unsigned bytes_per_second)
+    {
+      _M_min_speed = bytes_per_second;
+    }
+
+    inline void worker::pipelining_depth(unsigned depth)
+    {
+      _M_pipelining_depth = depth;
+    }
+
+    inline void worker::output(output_mode mode)
+    {
+      _M_output = mode;
+    }
+
+    inline void worker::segment_size(off_t size)
+    {
+      _M_segment_size = size;
+    }
+
+    inline void worker::max_host_connections(unsigned n)
+    {
+      _M_hosts.max_connections(n);
+    }
+
+    inline void worker::host_delay(unsigned msec)
+    {
+      _M_hosts.delay(msec);
+    }
+
+    inline void worker::ranges(unsigned n, uint64_t min_size)
+    {
+      _M_coordinator.ranges(n, min_size);
+    }
+
+    inline void worker::revisit(const revisit_index* r)
+    {
+      _M_revisit = r;
+    }
+
+    inline void worker::nameserver(const socket_address& addr)
+    {
+      _M_resolver.nameserver(addr);
+    }
+
+    inline uint64_t worker::urls() const
+    {
+      return _M_urls;
+    }
+
+    inline uint64_t worker::hits() const
+    {
+      return _M_hits;
+    }
+
+    inline uint64_t worker::negative_hits() const
+    {
+      return _M_negative_hits;
+    }
+
+    inline uint64_t worker::misses() const
+    {
+      return _M_misses;
+    }
+
+    inline void worker::on_success(io::event_handler* handler)
+    {
+      if (handler == &_M_resolver) {
+        return;
+      }
+
+#if HAVE_IO_URING
+      // The completions are handled after processing the events.
+      if (handler == &_M_writer) {
+        return;
+      }
+#endif
+
+      client* client = static_cast<http::client*>(handler);
+
+      client::phase phase = client->current_phase();
+
+      if (phase != client::phase::kIdle) {
+        // The deadline of each phase is set when the phase begins (except
+        // while receiving the body, when the timer is restarted whenever
+        // some data is received).
+        if (phase != _M_timings[client->fd()].phase) {
+          schedule(client);
+        } else if (phase == client::phase::kReceivingBody) {
+          if (!too_slow(client)) {
+            schedule(client);
+          } else {
+            // Close the connection as soon as possible.
+            _M_scheduler.reschedule(client->timer(), _M_current_msec);
+          }
+        }
+      } else if (!_M_pool.contains(client->fd())) {
+        _M_hosts.release(client->fd(), _M_current_msec);
+
+        // The response has been received, keep the connection open.
+        const uri::uri& uri = _M_requests[client->fd()].uri();
+        if (_M_pool.add(client->fd(), uri, port(uri))) {
+          schedule(client);
+        } else {
+          // Close the connection as soon as possible.
+          _M_scheduler.reschedule(client->timer(), _M_current_msec);
+        }
+      }
+    }
+
+    inline void worker::on_error(io::event_handler* handler)
+    {
+      if (handler == &_M_resolver) {
+        return;
+      }
+
+#if HAVE_IO_URING
+      if (handler == &_M_writer) {
+        return;
+      }
+#endif
+
+      client* client = static_cast<http::client*>(handler);
+
+      _M_scheduler.erase(client->timer());
+
+      _M_pool.remove(client->fd());
+      _M_hosts.release(client->fd(), _M_current_msec);
+
+      requeue(client, false);
+    }
+
+    inline void worker::on_timer(timer::event_handler* handler)
+    {
+      client* client = static_cast<http::client*>(handler);
+
+      _M_hosts.release(client->fd(), _M_current_msec);
+
+      if (!client->resolving()) {
+        _M_pool.remove(client->fd());
+
+        requeue(client, true);
+
+        _M_selector.remove(client->fd());
+      } else {
+        // The host could not be resolved in time (as on_resolve_error()).
+        _M_resolver.cancel(client->fd());
+
+        _M_nresolving--;
+
+        abort(client->fd());
+      }
+    }
+
+    inline void worker::on_resolve_error(unsigned id)
+    {
+      _M_scheduler.erase(_M_clients[id].timer());
+
+      _M_nresolving--;
+
+      abort(id);
+    }
+
+    inline void* worker::run(void* arg)
+    {
+      static_cast<worker*>(arg)->run();
+      return NULL;
+    }
+
+    inline size_t worker::nclients() const
+    {
+#if HAVE_IO_URING
+      // The ring of the writer is not a client either.
+      if (_M_writer.created()) {
+        return _M_selector.count() - 2 + _M_nresolving - _M_pool.count();
+      }
+#endif
+
+      return _M_selector.count() - 1 + _M_nresolving - _M_pool.count();
+    }
+
+    inline void worker::close_idle(int fd)
+    {
+      _M_pool.remove(fd);
+      _M_scheduler.erase(_M_clients[fd].timer());
+      _M_selector.remove(fd);
+    }
+
+    inline void worker::schedule(client* client)
+    {
+      timing* t = &_M_timings[client->fd()];
+      client::phase phase = client->current_phase();
+
+      if (phase != t->phase) {
+        switch (phase) {
+          case client::phase::kWaitingForResponse:
+            // If the request has been sent over a reused connection or
+            // has been pipelined...
+            if ((t->phase != client::phase::kConnecting) &&
+                (t->phase != client::phase::kPerformingHandshake)) {
+              t->start = _M_current_msec;
+            }
+
+            break;
+          case client::phase::kReceivingBody:
+            t->period_start = _M_current_msec;
+            t->period_response_size = client->response_size();
+            break;
+          default:
+            ;
+        }
+
+        t->phase = phase;
+      }
+
+      uint64_t expiration_time =
+        _M_current_msec + (_M_timeouts[static_cast<size_t>(phase)] * 1000);
+
+      if ((_M_total_timeout > 0) && (phase != client::phase::kIdle)) {
+        uint64_t deadline = t->start + (_M_total_timeout * 1000);
+        if (deadline < expiration_time) {
+          expiration_time = deadline;
+        }
+      }
+
+      _M_scheduler.reschedule(client->timer(), expiration_time);
+    }
+
+    inline bool worker::too_slow(const client* client)
+    {
+      timing* t = &_M_timings[client->fd()];
+
+      uint64_t elapsed = _M_current_msec - t->period_start;
+
+      if ((_M_min_speed == 0) || (elapsed < kSpeedPeriod * 1000)) {
+        return false;
+      }
+
+      uint64_t received = client->response_size() - t->period_response_size;
+
+      if (received * 1000 < static_cast<uint64_t>(_M_min_speed) * elapsed) {
+        return true;
+      }
+
+      // Start a new period.
+      t->period_start = _M_current_msec;
+      t->period_response_size = client->response_size();
+
+      return false;
+    }
+
+    inline void worker::update_time()
+    {
+      struct timeval tv;
+      gettimeofday(&tv, NULL);
+
+      _M_current_time = tv.tv_sec;
+      _M_current_msec = (static_cast<uint64_t>(_M_current_time) * 1000) +
+                        (tv.tv_usec / 1000);
+
+      localtime_r(&_M_current_time, &_M_localtime);
+    }
+  }
+}
+
+#endif // NET_HTTP_WORKER_H
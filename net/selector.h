@@ -1,7 +1,9 @@
 #ifndef NET_SELECTOR_H
 #define NET_SELECTOR_H
 
-#if HAVE_EPOLL
+#if HAVE_URING_SELECTOR
+  #include "net/uring_selector.h"
+#elif HAVE_EPOLL
   #include "net/epoll_selector.h"
 #elif HAVE_KQUEUE
   #include "net/kqueue_selector.h"
@@ -72,10 +72,7 @@ bool net::socket::connect(type type, const socket_address& addr, int timeout)
   }
 
   // Connect.
-  if ((::connect(_M_fd,
-                 reinterpret_cast<const struct sockaddr*>(&addr),
-                 addr.size()) < 0) &&
-      (errno != EINPROGRESS)) {
+  if (!connect(addr)) {
     close();
     return false;
   }
@@ -96,6 +93,18 @@ bool net::socket::connect(type type, const socket_address& addr, int timeout)
   return true;
 }
 
+bool net::socket::connect(const socket_address& addr)
+{
+  if ((::connect(_M_fd,
+                 reinterpret_cast<const struct sockaddr*>(&addr),
+                 addr.size()) < 0) &&
+      (errno != EINPROGRESS)) {
+    return false;
+  }
+
+  return true;
+}
+
 bool net::socket::bind(const socket_address& addr)
 {
   // Reuse address.
@@ -676,7 +685,7 @@ ssize_t net::socket::_M_recvfrom(void* buf,
                               buf,
                               len,
                               0,
-                              reinterpret_cast<struct sockaddr*>(&addr),
+                              reinterpret_cast<struct sockaddr*>(addr),
                               addrlen)) < 0) &&
            (errno == EINTR));
   } else {
@@ -685,7 +694,7 @@ ssize_t net::socket::_M_recvfrom(void* buf,
                             buf,
                             len,
                             0,
-                            reinterpret_cast<struct sockaddr*>(&addr),
+                            reinterpret_cast<struct sockaddr*>(addr),
                             addrlen)) < 0) {
         switch (errno) {
           case EAGAIN:
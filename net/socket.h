@@ -40,6 +40,9 @@ namespace net {
       // Connect.
       bool connect(type type, const socket_address& addr, int timeout = -1);
 
+      // Connect an already created socket (non-blocking).
+      bool connect(const socket_address& addr);
+
       // Bind.
       bool bind(const socket_address& addr);
 
@@ -0,0 +1,74 @@
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include "net/splicer.h"
+
+bool net::splicer::create()
+{
+  if (pipe2(_M_pipe, O_NONBLOCK | O_CLOEXEC) < 0) {
+    return false;
+  }
+
+  // If the size of the pipe cannot be changed, the default is used.
+  fcntl(_M_pipe[1], F_SETPIPE_SZ, kPipeSize);
+
+  return true;
+}
+
+ssize_t net::splicer::splice(int sock, int fd, off_t* offset, size_t len)
+{
+  // If the pipe couldn't be recreated after an error...
+  if ((_M_pipe[0] == -1) && (!create())) {
+    return -1;
+  }
+
+  // Move the data from the socket to the pipe.
+  ssize_t ret;
+  while (((ret = ::splice(sock,
+                          NULL,
+                          _M_pipe[1],
+                          NULL,
+                          len,
+                          SPLICE_F_MOVE | SPLICE_F_NONBLOCK)) < 0) &&
+         (errno == EINTR));
+
+  if (ret <= 0) {
+    return ret;
+  }
+
+  // Move the data from the pipe to the file.
+  size_t left = ret;
+  do {
+    ssize_t n;
+    if ((n = ::splice(_M_pipe[0],
+                      NULL,
+                      fd,
+                      offset,
+                      left,
+                      SPLICE_F_MOVE)) > 0) {
+      left -= n;
+    } else if ((n == 0) || (errno != EINTR)) {
+      // The data left in the pipe would be moved to the next file.
+      int error = (n == 0) ? EIO : errno;
+
+      close();
+      create();
+
+      errno = error;
+      return -1;
+    }
+  } while (left > 0);
+
+  return ret;
+}
+
+void net::splicer::close()
+{
+  if (_M_pipe[0] != -1) {
+    ::close(_M_pipe[0]);
+    ::close(_M_pipe[1]);
+
+    _M_pipe[0] = -1;
+    _M_pipe[1] = -1;
+  }
+}
@@ -0,0 +1,54 @@
+#ifndef NET_SPLICER_H
+#define NET_SPLICER_H
+
+#include <stdlib.h>
+#include <sys/types.h>
+
+namespace net {
+  // Moves data from a socket to a file through a pipe with splice(), so
+  // that the data is not copied to user space.
+  class splicer {
+    public:
+      // Size of the pipe (maximum number of bytes moved at once).
+      static const size_t kPipeSize = 256 * 1024;
+
+      // Constructor.
+      splicer();
+
+      // Destructor.
+      ~splicer();
+
+      // Create.
+      bool create();
+
+      // Move up to 'len' bytes from the socket to the file, at 'offset' (if
+      // not NULL, it is incremented) or at the current position of the
+      // file. Returns the number of bytes moved, 0 if the peer has closed
+      // the connection or -1 on error (errno is EAGAIN if the socket is
+      // not readable).
+      ssize_t splice(int sock, int fd, off_t* offset, size_t len);
+
+    private:
+      int _M_pipe[2];
+
+      // Close pipe.
+      void close();
+
+      // Disable copy constructor and assignment operator.
+      splicer(const splicer&) = delete;
+      splicer& operator=(const splicer&) = delete;
+  };
+
+  inline splicer::splicer()
+  {
+    _M_pipe[0] = -1;
+    _M_pipe[1] = -1;
+  }
+
+  inline splicer::~splicer()
+  {
+    close();
+  }
+}
+
+#endif // NET_SPLICER_H
@@ -33,6 +33,8 @@ net::tcp_connection::tcp_connection()
   : _M_timer(this),
     _M_inp(0),
     _M_outp(0),
+    _M_read_size(kMinReadSize),
+    _M_buffers(NULL),
 #if HAVE_SSL
     _M_file_offset(0),
 #endif
@@ -89,8 +91,13 @@ io::event_handler::result net::tcp_connection::_M_read(tcp_connection* conn,
                                                        string::buffer& buf,
                                                        size_t& count)
 {
+  // Take a buffer from the pool.
+  if (conn->_M_buffers) {
+    conn->_M_buffers->get(buf);
+  }
+
   // Allocate memory.
-  if (!buf.allocate(kReadBufferSize)) {
+  if (!buf.allocate(conn->_M_read_size)) {
     return io::event_handler::result::kError;
   }
 
@@ -114,9 +121,15 @@ io::event_handler::result net::tcp_connection::_M_read(tcp_connection* conn,
       buf.increment_length(ret);
       count = ret;
 
-      if (static_cast<size_t>(ret) < remaining) {
-        conn->_M_readable = 0;
+      // If the buffer has been filled, read more the next time.
+      if ((static_cast<size_t>(ret) == remaining) &&
+          (conn->_M_read_size < kMaxReadSize)) {
+        conn->_M_read_size *= 2;
       }
+
+      // A short read doesn't mean that the socket has been drained: the
+      // peer might have closed the connection after sending the data, and
+      // (with edge-triggered notifications) there won't be another event.
   }
 
   return io::event_handler::result::kSuccess;
@@ -239,8 +252,13 @@ net::tcp_connection::_M_sendfile(tcp_connection* conn,
                                    string::buffer& buf,
                                    size_t& count)
   {
+    // Take a buffer from the pool.
+    if (conn->_M_buffers) {
+      conn->_M_buffers->get(buf);
+    }
+
     // Allocate memory.
-    if (!buf.allocate(kReadBufferSize)) {
+    if (!buf.allocate(conn->_M_read_size)) {
       return io::event_handler::result::kError;
     }
 
@@ -268,6 +286,11 @@ net::tcp_connection::_M_sendfile(tcp_connection* conn,
         count += ret;
 
         if (buf.remaining() == 0) {
+          // Read more the next time.
+          if (conn->_M_read_size < kMaxReadSize) {
+            conn->_M_read_size *= 2;
+          }
+
           return io::event_handler::result::kSuccess;
         }
       }
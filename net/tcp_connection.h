@@ -12,6 +12,7 @@
 #endif
 
 #include "string/buffer.h"
+#include "string/buffer_pool.h"
 #include "fs/file.h"
 #include "util/ranges.h"
 
@@ -94,8 +95,14 @@ namespace net {
       // Get timer.
       timer::timer* timer();
 
+      // Set pool of input buffers.
+      void buffers(string::buffer_pool* pool);
+
     protected:
-      static const size_t kReadBufferSize = 2 * 1024;
+      // The reads start with kMinReadSize bytes and double while they fill
+      // the input buffer.
+      static const size_t kMinReadSize = 2 * 1024;
+      static const size_t kMaxReadSize = 256 * 1024;
 
       socket _M_socket;
 
@@ -112,6 +119,12 @@ namespace net {
       off_t _M_inp;
       off_t _M_outp;
 
+      size_t _M_read_size;
+
+      // The input buffer is taken from the pool when data has to be
+      // received.
+      string::buffer_pool* _M_buffers;
+
 #if HAVE_SSL
       off_t _M_file_offset;
 #endif
@@ -119,6 +132,9 @@ namespace net {
       unsigned _M_readable:1;
       unsigned _M_writable:1;
 
+      // Give the input buffer back to the pool (its data is discarded).
+      void release_input();
+
 #if HAVE_SSL
       unsigned _M_ssl:1;
 #endif
@@ -215,8 +231,7 @@ namespace net {
     _M_ssl_buf.clear();
 #endif // HAVE_SSL
 
-    _M_in.clear();
-    _M_inp = 0;
+    release_input();
 
     _M_readable = 0;
     _M_writable = 0;
@@ -232,6 +247,8 @@ namespace net {
     _M_out.clear();
     _M_outp = 0;
 
+    _M_read_size = kMinReadSize;
+
 #if HAVE_SSL
     _M_file_offset = 0;
 #endif
@@ -334,6 +351,21 @@ namespace net {
     return _M_current_operations->sendfile(this, f, filesize, NULL);
   }
 
+  inline void tcp_connection::buffers(string::buffer_pool* pool)
+  {
+    _M_buffers = pool;
+  }
+
+  inline void tcp_connection::release_input()
+  {
+    _M_in.clear();
+    _M_inp = 0;
+
+    if (_M_buffers) {
+      _M_buffers->put(_M_in);
+    }
+  }
+
   inline bool tcp_connection::readable() const
   {
     return _M_readable;
@@ -0,0 +1,328 @@
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "net/uring_selector.h"
+
+net::selector::~selector()
+{
+  if (_M_sqes) {
+    munmap(_M_sqes, _M_sq_entries * sizeof(struct io_uring_sqe));
+  }
+
+  if ((_M_cq_ring) && (_M_cq_ring != _M_sq_ring)) {
+    munmap(_M_cq_ring, _M_cq_ring_size);
+  }
+
+  if (_M_sq_ring) {
+    munmap(_M_sq_ring, _M_sq_ring_size);
+  }
+
+  // Closing the ring releases the descriptors which are still polled.
+  if (_M_fd != -1) {
+    close(_M_fd);
+  }
+
+  if (_M_generations) {
+    free(_M_generations);
+  }
+}
+
+bool net::selector::create()
+{
+  if (!_M_fdmap.create()) {
+    return false;
+  }
+
+  if ((_M_generations = reinterpret_cast<uint32_t*>(
+                          calloc(_M_fdmap.size(), sizeof(uint32_t))
+                        )) == NULL) {
+    return false;
+  }
+
+  // The completion queue should have room for an event per descriptor
+  // (if it overflows, the kernel keeps the completions).
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(struct io_uring_params));
+  params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+  params.cq_entries = (_M_fdmap.size() > kSubmissionQueueEntries) ?
+                        _M_fdmap.size() :
+                        kSubmissionQueueEntries;
+
+  if ((_M_fd = syscall(__NR_io_uring_setup,
+                       kSubmissionQueueEntries,
+                       &params)) < 0) {
+    _M_fd = -1;
+    return false;
+  }
+
+  // Multishot polls are available since the same kernel version as
+  // IORING_FEAT_RSRC_TAGS (5.13).
+  if (((params.features & IORING_FEAT_NODROP) == 0) ||
+      ((params.features & IORING_FEAT_EXT_ARG) == 0) ||
+      ((params.features & IORING_FEAT_RSRC_TAGS) == 0)) {
+    return false;
+  }
+
+  _M_sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  _M_cq_ring_size = params.cq_off.cqes +
+                    params.cq_entries * sizeof(struct io_uring_cqe);
+
+  // If both rings can be mapped with a single mmap()...
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    if (_M_cq_ring_size > _M_sq_ring_size) {
+      _M_sq_ring_size = _M_cq_ring_size;
+    }
+  }
+
+  if ((_M_sq_ring = mmap(NULL,
+                         _M_sq_ring_size,
+                         PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE,
+                         _M_fd,
+                         IORING_OFF_SQ_RING)) == MAP_FAILED) {
+    _M_sq_ring = NULL;
+    return false;
+  }
+
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    _M_cq_ring = _M_sq_ring;
+  } else if ((_M_cq_ring = mmap(NULL,
+                                _M_cq_ring_size,
+                                PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_POPULATE,
+                                _M_fd,
+                                IORING_OFF_CQ_RING)) == MAP_FAILED) {
+    _M_cq_ring = NULL;
+    return false;
+  }
+
+  void* sqes;
+  if ((sqes = mmap(NULL,
+                   params.sq_entries * sizeof(struct io_uring_sqe),
+                   PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE,
+                   _M_fd,
+                   IORING_OFF_SQES)) == MAP_FAILED) {
+    return false;
+  }
+
+  _M_sqes = static_cast<struct io_uring_sqe*>(sqes);
+
+  uint8_t* sq = static_cast<uint8_t*>(_M_sq_ring);
+  _M_sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+  _M_sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+  _M_sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+  _M_sq_entries = params.sq_entries;
+  _M_sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+  uint8_t* cq = static_cast<uint8_t*>(_M_cq_ring);
+  _M_cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+  _M_cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+  _M_cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+  _M_cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+
+  return true;
+}
+
+bool net::selector::add(unsigned fd,
+                        fdtype type,
+                        io::event_handler* handler,
+                        io::event events)
+{
+  if (!_M_fdmap.add(fd, type, handler)) {
+    // The file descriptor has been already inserted.
+    return true;
+  }
+
+  if (!poll(fd, type)) {
+    _M_fdmap.remove(fd);
+    return false;
+  }
+
+  return true;
+}
+
+bool net::selector::remove(unsigned fd)
+{
+  if (!_M_fdmap.remove(fd)) {
+    // The file descriptor has not been inserted.
+    return true;
+  }
+
+  // The poll keeps a reference to the file, it has to be removed (the
+  // completions of the old poll will be discarded).
+  struct io_uring_sqe* sqe;
+  if ((sqe = get_sqe()) != NULL) {
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = user_data(fd, _M_generations[fd]);
+    sqe->user_data = kIgnore;
+  }
+
+  _M_generations[fd]++;
+
+  // Submit the removal before closing the descriptor, so that the old
+  // poll is cancelled before the number can be reused.
+  if (_M_queued > 0) {
+    enter(0, 0, NULL);
+  }
+
+  close(fd);
+
+  return true;
+}
+
+bool net::selector::wait_for_events(unsigned timeout)
+{
+  struct __kernel_timespec ts;
+  ts.tv_sec = timeout / 1000;
+  ts.tv_nsec = (timeout % 1000) * 1000000L;
+
+  struct io_uring_getevents_arg arg;
+  memset(&arg, 0, sizeof(struct io_uring_getevents_arg));
+  arg.ts = reinterpret_cast<uintptr_t>(&ts);
+
+  enter(1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg);
+
+  return completions();
+}
+
+void net::selector::process_events()
+{
+  // For each completion...
+  while (completions()) {
+    unsigned head = *_M_cq_head;
+    const struct io_uring_cqe* cqe = &_M_cqes[head & _M_cq_mask];
+
+    uint64_t data = cqe->user_data;
+    int res = cqe->res;
+    unsigned flags = cqe->flags;
+
+    __atomic_store_n(_M_cq_head, head + 1, __ATOMIC_RELEASE);
+
+    if (data == kIgnore) {
+      continue;
+    }
+
+    unsigned fd = static_cast<uint32_t>(data);
+
+    // Skip completions of removed polls.
+    if (static_cast<uint32_t>(data >> 32) != _M_generations[fd]) {
+      continue;
+    }
+
+    fdtype type;
+    io::event_handler* handler;
+    if (_M_fdmap.get(fd, type, handler)) {
+      // If an error happened but POLLIN / POLLOUT were not set...
+      if ((res < 0) ||
+          ((res & (POLLERR | POLLHUP)) && ((res & (POLLIN | POLLOUT)) == 0))) {
+        res = POLLIN | POLLOUT;
+      }
+
+      io::event events = io::event::kNoEvent;
+
+      if (res & POLLIN) {
+        events = static_cast<io::event>(
+                   static_cast<unsigned>(events) |
+                   static_cast<unsigned>(io::event::kRead)
+                 );
+      }
+
+      if (res & POLLOUT) {
+        events = static_cast<io::event>(
+                   static_cast<unsigned>(events) |
+                   static_cast<unsigned>(io::event::kWrite)
+                 );
+      }
+
+      if (!process_fd_events(fd, type, handler, events)) {
+        remove(fd);
+      } else if ((flags & IORING_CQE_F_MORE) == 0) {
+        // The multishot poll has been terminated, poll again.
+        if (!poll(fd, type)) {
+          if (_M_io_observer) {
+            _M_io_observer->on_error(handler);
+          }
+
+          remove(fd);
+        }
+      }
+    }
+  }
+}
+
+bool net::selector::poll(unsigned fd, fdtype type)
+{
+  struct io_uring_sqe* sqe;
+  if ((sqe = get_sqe()) == NULL) {
+    return false;
+  }
+
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = fd;
+  sqe->len = IORING_POLL_ADD_MULTI;
+  sqe->user_data = user_data(fd, _M_generations[fd]);
+
+  if (type == fdtype::kFdSocket) {
+    sqe->poll32_events = POLLIN | POLLOUT | POLLRDHUP;
+  } else {
+    sqe->poll32_events = POLLIN;
+  }
+
+  return true;
+}
+
+struct io_uring_sqe* net::selector::get_sqe()
+{
+  unsigned tail = *_M_sq_tail;
+
+  // If the submission queue is full...
+  if (tail - __atomic_load_n(_M_sq_head, __ATOMIC_ACQUIRE) == _M_sq_entries) {
+    // Submit the queued requests to make room.
+    enter(0, 0, NULL);
+
+    if (tail - __atomic_load_n(_M_sq_head, __ATOMIC_ACQUIRE) ==
+        _M_sq_entries) {
+      return NULL;
+    }
+  }
+
+  unsigned idx = tail & _M_sq_mask;
+
+  struct io_uring_sqe* sqe = &_M_sqes[idx];
+  memset(sqe, 0, sizeof(struct io_uring_sqe));
+
+  _M_sq_array[idx] = idx;
+
+  __atomic_store_n(_M_sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+  _M_queued++;
+
+  return sqe;
+}
+
+int net::selector::enter(unsigned min_complete,
+                         unsigned flags,
+                         const void* arg)
+{
+  int ret;
+  do {
+    ret = syscall(__NR_io_uring_enter,
+                  _M_fd,
+                  _M_queued,
+                  min_complete,
+                  flags,
+                  arg,
+                  arg ? sizeof(struct io_uring_getevents_arg) : 0);
+  } while ((ret < 0) && (errno == EINTR));
+
+  if (ret > 0) {
+    _M_queued -= ret;
+  }
+
+  return ret;
+}
@@ -0,0 +1,184 @@
+#ifndef NET_URING_SELECTOR_H
+#define NET_URING_SELECTOR_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <linux/io_uring.h>
+#include "net/fdmap.h"
+#include "io/observer.h"
+#include "io/event.h"
+
+namespace net {
+  // Selector based on io_uring: each descriptor has a multishot poll
+  // (edge-triggered, like the epoll selector). The polls which are added
+  // are queued and submitted with the next wait, so that a single
+  // io_uring_enter() replaces the epoll_ctl() and epoll_wait() calls of an
+  // iteration (the removals are submitted before closing the descriptor).
+  class selector {
+    public:
+      // Constructor.
+      selector();
+
+      // Destructor.
+      ~selector();
+
+      // Set I/O observer.
+      void set_io_observer(io::observer* obs);
+
+      // Get size.
+      size_t size() const;
+
+      // Get count.
+      size_t count() const;
+
+      // Create.
+      bool create();
+
+      // Add descriptor.
+      bool add(unsigned fd,
+               fdtype type,
+               io::event_handler* handler,
+               io::event events);
+
+      // Remove descriptor.
+      bool remove(unsigned fd);
+
+      // Wait for events.
+      bool wait_for_events();
+      bool wait_for_events(unsigned timeout); // Timeout in ms.
+
+      // Process file descriptor's events.
+      bool process_fd_events(unsigned fd,
+                             fdtype type,
+                             io::event_handler* handler,
+                             io::event events);
+
+      // Process all events.
+      void process_events();
+
+    private:
+      static const unsigned kSubmissionQueueEntries = 4096;
+
+      // User data of the completions which have to be ignored (removal of
+      // polls).
+      static const uint64_t kIgnore = ~static_cast<uint64_t>(0);
+
+      fdmap _M_fdmap;
+
+      int _M_fd;
+
+      // Submission queue.
+      void* _M_sq_ring;
+      size_t _M_sq_ring_size;
+      unsigned* _M_sq_head;
+      unsigned* _M_sq_tail;
+      unsigned _M_sq_mask;
+      unsigned _M_sq_entries;
+      unsigned* _M_sq_array;
+
+      struct io_uring_sqe* _M_sqes;
+
+      // Completion queue.
+      void* _M_cq_ring;
+      size_t _M_cq_ring_size;
+      unsigned* _M_cq_head;
+      unsigned* _M_cq_tail;
+      unsigned _M_cq_mask;
+      struct io_uring_cqe* _M_cqes;
+
+      // Number of queued requests which have not been submitted yet.
+      unsigned _M_queued;
+
+      // Generation of the poll of each descriptor (the completions of
+      // removed polls are discarded).
+      uint32_t* _M_generations;
+
+      io::observer* _M_io_observer;
+
+      // Queue poll of the descriptor.
+      bool poll(unsigned fd, fdtype type);
+
+      // Get free submission queue entry.
+      struct io_uring_sqe* get_sqe();
+
+      // Enter the kernel.
+      int enter(unsigned min_complete, unsigned flags, const void* arg);
+
+      // Are there completions?
+      bool completions() const;
+
+      // Build user data.
+      static uint64_t user_data(unsigned fd, uint32_t generation);
+
+      // Disable copy constructor and assignment operator.
+      selector(const selector&) = delete;
+      selector& operator=(const selector&) = delete;
+  };
+
+  inline selector::selector()
+    : _M_fd(-1),
+      _M_sq_ring(NULL),
+      _M_sq_ring_size(0),
+      _M_sq_entries(0),
+      _M_sqes(NULL),
+      _M_cq_ring(NULL),
+      _M_cq_ring_size(0),
+      _M_queued(0),
+      _M_generations(NULL),
+      _M_io_observer(NULL)
+  {
+  }
+
+  inline void selector::set_io_observer(io::observer* obs)
+  {
+    _M_io_observer = obs;
+  }
+
+  inline size_t selector::size() const
+  {
+    return _M_fdmap.size();
+  }
+
+  inline size_t selector::count() const
+  {
+    return _M_fdmap.count();
+  }
+
+  inline bool selector::wait_for_events()
+  {
+    enter(1, IORING_ENTER_GETEVENTS, NULL);
+    return completions();
+  }
+
+  inline bool selector::process_fd_events(unsigned fd,
+                                          fdtype type,
+                                          io::event_handler* handler,
+                                          io::event events)
+  {
+    if (handler->on_io(events) == io::event_handler::result::kError) {
+      if (_M_io_observer) {
+        _M_io_observer->on_error(handler);
+      }
+
+      return false;
+    }
+
+    if (_M_io_observer) {
+      _M_io_observer->on_success(handler);
+    }
+
+    return true;
+  }
+
+  inline bool selector::completions() const
+  {
+    return (*_M_cq_head != __atomic_load_n(_M_cq_tail, __ATOMIC_ACQUIRE));
+  }
+
+  inline uint64_t selector::user_data(unsigned fd, uint32_t generation)
+  {
+    return (static_cast<uint64_t>(generation) << 32) | fd;
+  }
+}
+
+#endif // NET_URING_SELECTOR_H
@@ -0,0 +1,464 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "net/dns/resolver.h"
+#include "net/ipv4_address.h"
+
+// Resolves names with a stub name server on 127.0.0.1 (in the same event
+// loop) which answers depending on the first label of the name:
+//   a:      A record.
+//   cname:  CNAME (with compression pointers) followed by an A record.
+//   nx:     NXDOMAIN.
+//   retry:  the first query is dropped (the query is retransmitted).
+//   spoof:  responses with a wrong transaction id, with a wrong question
+//           and from another port are sent before the right one.
+//   lost:   no response (the resolution fails after kMaxAttempts).
+// Then it cancels queries and checks that their slots are released.
+
+static const uint16_t kFlagResponse = 0x8000;
+static const uint16_t kRcodeNameError = 3;
+
+static uint64_t now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return static_cast<uint64_t>(ts.tv_sec) * 1000ull + ts.tv_nsec / 1000000;
+}
+
+struct test {
+  const char* name;
+  const char* address; // NULL: the resolution fails.
+  unsigned queries; // Queries expected by the name server.
+
+  // Results.
+  bool done;
+  bool resolved;
+  char resolved_address[INET_ADDRSTRLEN];
+  unsigned received;
+};
+
+static test tests[] = {
+  {"a.example.com", "10.0.0.1", 1},
+  {"cname.example.com", "10.0.0.2", 1},
+  {"nx.example.com", NULL, 1},
+  {"retry.example.com", "10.0.0.4", 2},
+  {"spoof.example.com", "10.0.0.5", 1},
+  {"lost.example.com", NULL, net::dns::resolver::kMaxAttempts}
+};
+
+static const unsigned kNumberTests = sizeof(tests) / sizeof(tests[0]);
+
+class nameserver : public io::event_handler {
+  public:
+    // Constructor.
+    nameserver();
+
+    // Create.
+    bool create(net::selector& sel, net::socket_address& addr);
+
+    // On I/O.
+    result on_io(io::event events);
+
+  private:
+    int _M_fd;
+
+    // Socket of the spoofed responses (another port).
+    int _M_spoof;
+
+    // Build response.
+    static size_t response(const uint8_t* query,
+                           size_t querylen,
+                           uint16_t txid,
+                           uint16_t rcode,
+                           const char* cname,
+                           const char* address,
+                           uint8_t* msg);
+};
+
+nameserver::nameserver()
+  : _M_fd(-1),
+    _M_spoof(-1)
+{
+}
+
+bool nameserver::create(net::selector& sel, net::socket_address& addr)
+{
+  struct sockaddr_in sin;
+  memset(&sin, 0, sizeof(struct sockaddr_in));
+  sin.sin_family = AF_INET;
+  sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  socklen_t addrlen = sizeof(struct sockaddr_in);
+
+  if (((_M_fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0)) < 0) ||
+      (bind(_M_fd,
+            reinterpret_cast<const struct sockaddr*>(&sin),
+            addrlen) < 0) ||
+      (getsockname(_M_fd,
+                   reinterpret_cast<struct sockaddr*>(&sin),
+                   &addrlen) < 0) ||
+      ((_M_spoof = socket(AF_INET, SOCK_DGRAM, 0)) < 0)) {
+    return false;
+  }
+
+  return ((addr.build("127.0.0.1", ntohs(sin.sin_port))) &&
+          (sel.add(_M_fd, net::fdtype::kFdDatagram, this, io::event::kRead)));
+}
+
+io::event_handler::result nameserver::on_io(io::event events)
+{
+  uint8_t query[512];
+  struct sockaddr_in from;
+  socklen_t fromlen = sizeof(struct sockaddr_in);
+
+  ssize_t ret;
+  while ((ret = recvfrom(_M_fd,
+                         query,
+                         sizeof(query),
+                         0,
+                         reinterpret_cast<struct sockaddr*>(&from),
+                         &fromlen)) > 0) {
+    // Header (12 bytes) + question.
+    if (ret < 12 + 1 + 4) {
+      continue;
+    }
+
+    uint16_t txid = (static_cast<uint16_t>(query[0]) << 8) | query[1];
+
+    // Decode the name of the question.
+    char name[256];
+    size_t namelen = 0;
+    const uint8_t* ptr = query + 12;
+    const uint8_t* end = query + ret;
+
+    while ((ptr < end) && (*ptr) && (namelen + *ptr + 1 < sizeof(name))) {
+      if (namelen > 0) {
+        name[namelen++] = '.';
+      }
+
+      memcpy(name + namelen, ptr + 1, *ptr);
+      namelen += *ptr;
+      ptr += (1 + *ptr);
+    }
+
+    name[namelen] = 0;
+
+    // Query length (up to the end of the question).
+    size_t querylen = (ptr + 5) - query;
+
+    test* t = NULL;
+    for (unsigned i = 0; i < kNumberTests; i++) {
+      if (strcmp(tests[i].name, name) == 0) {
+        t = &tests[i];
+        break;
+      }
+    }
+
+    if ((!t) || (querylen > static_cast<size_t>(ret))) {
+      continue;
+    }
+
+    t->received++;
+
+    uint8_t msg[512];
+    size_t len = 0;
+
+    if (strncmp(name, "a.", 2) == 0) {
+      len = response(query, querylen, txid, 0, NULL, t->address, msg);
+    } else if (strncmp(name, "cname.", 6) == 0) {
+      len = response(query, querylen, txid, 0, "www", t->address, msg);
+    } else if (strncmp(name, "nx.", 3) == 0) {
+      len = response(query, querylen, txid, kRcodeNameError, NULL, NULL, msg);
+    } else if (strncmp(name, "retry.", 6) == 0) {
+      if (t->received > 1) {
+        len = response(query, querylen, txid, 0, NULL, t->address, msg);
+      }
+    } else if (strncmp(name, "spoof.", 6) == 0) {
+      // Wrong transaction id.
+      len = response(query,
+                     querylen,
+                     txid ^ 0x5a5a,
+                     0,
+                     NULL,
+                     "6.6.6.6",
+                     msg);
+
+      sendto(_M_fd,
+             msg,
+             len,
+             0,
+             reinterpret_cast<const struct sockaddr*>(&from),
+             fromlen);
+
+      // Wrong question (the last letter of the name is changed).
+      len = response(query, querylen, txid, 0, NULL, "6.6.6.7", msg);
+      msg[querylen - 6]++;
+
+      sendto(_M_fd,
+             msg,
+             len,
+             0,
+             reinterpret_cast<const struct sockaddr*>(&from),
+             fromlen);
+
+      // Another port.
+      len = response(query, querylen, txid, 0, NULL, "6.6.6.8", msg);
+
+      sendto(_M_spoof,
+             msg,
+             len,
+             0,
+             reinterpret_cast<const struct sockaddr*>(&from),
+             fromlen);
+
+      len = response(query, querylen, txid, 0, NULL, t->address, msg);
+    }
+
+    if (len > 0) {
+      sendto(_M_fd,
+             msg,
+             len,
+             0,
+             reinterpret_cast<const struct sockaddr*>(&from),
+             fromlen);
+    }
+  }
+
+  return result::kSuccess;
+}
+
+size_t nameserver::response(const uint8_t* query,
+                            size_t querylen,
+                            uint16_t txid,
+                            uint16_t rcode,
+                            const char* cname,
+                            const char* address,
+                            uint8_t* msg)
+{
+  memcpy(msg, query, querylen);
+
+  uint16_t flags = kFlagResponse | 0x0100 | 0x0080 | rcode; // RD, RA.
+  uint16_t ancount = (address ? 1 : 0) + (cname ? 1 : 0);
+
+  msg[0] = static_cast<uint8_t>(txid >> 8);
+  msg[1] = static_cast<uint8_t>(txid);
+  msg[2] = static_cast<uint8_t>(flags >> 8);
+  msg[3] = static_cast<uint8_t>(flags);
+  msg[6] = static_cast<uint8_t>(ancount >> 8);
+  msg[7] = static_cast<uint8_t>(ancount);
+
+  uint8_t* ptr = msg + querylen;
+
+  // Offset of the name of the next record.
+  uint16_t name = 12;
+
+  if (cname) {
+    // <name of the question> CNAME <cname>.<name of the question>
+    size_t len = strlen(cname);
+
+    *ptr++ = 0xc0;
+    *ptr++ = 12;
+    *ptr++ = 0; *ptr++ = 5; // Type CNAME.
+    *ptr++ = 0; *ptr++ = 1; // Class IN.
+    *ptr++ = 0; *ptr++ = 0; *ptr++ = 0; *ptr++ = 60; // TTL.
+    *ptr++ = 0; *ptr++ = static_cast<uint8_t>(1 + len + 2);
+
+    name = ptr - msg;
+
+    *ptr++ = static_cast<uint8_t>(len);
+    memcpy(ptr, cname, len);
+    ptr += len;
+    *ptr++ = 0xc0;
+    *ptr++ = 12;
+  }
+
+  if (address) {
+    *ptr++ = static_cast<uint8_t>(0xc0 | (name >> 8));
+    *ptr++ = static_cast<uint8_t>(name);
+    *ptr++ = 0; *ptr++ = 1; // Type A.
+    *ptr++ = 0; *ptr++ = 1; // Class IN.
+    *ptr++ = 0; *ptr++ = 0; *ptr++ = 0; *ptr++ = 60; // TTL.
+    *ptr++ = 0; *ptr++ = 4;
+
+    inet_pton(AF_INET, address, ptr);
+    ptr += 4;
+  }
+
+  return ptr - msg;
+}
+
+class observer : public net::dns::observer {
+  public:
+    // Number of resolutions which have finished.
+    unsigned done;
+
+    // Constructor.
+    observer();
+
+    // On host resolved.
+    void on_resolved(unsigned id, const net::socket_address& addr);
+
+    // On resolution error.
+    void on_resolve_error(unsigned id);
+};
+
+observer::observer()
+  : done(0)
+{
+}
+
+void observer::on_resolved(unsigned id, const net::socket_address& addr)
+{
+  const struct sockaddr_in* sin =
+    reinterpret_cast<const struct sockaddr_in*>(&addr);
+
+  inet_ntop(AF_INET,
+            &sin->sin_addr,
+            tests[id].resolved_address,
+            sizeof(tests[id].resolved_address));
+
+  tests[id].resolved = true;
+  tests[id].done = true;
+
+  done++;
+}
+
+void observer::on_resolve_error(unsigned id)
+{
+  tests[id].done = true;
+
+  done++;
+}
+
+int main()
+{
+  net::selector selector;
+  if (!selector.create()) {
+    fprintf(stderr, "Error creating selector.\n");
+    return -1;
+  }
+
+  nameserver ns;
+  net::socket_address addr;
+  if (!ns.create(selector, addr)) {
+    fprintf(stderr, "Error creating name server.\n");
+    return -1;
+  }
+
+  observer obs;
+
+  net::dns::resolver resolver;
+  resolver.nameserver(addr);
+  resolver.set_observer(&obs);
+
+  if (!resolver.create(selector, kNumberTests)) {
+    fprintf(stderr, "Error creating resolver.\n");
+    return -1;
+  }
+
+  uint64_t start = now();
+
+  for (unsigned i = 0; i < kNumberTests; i++) {
+    if (!resolver.resolve(tests[i].name, strlen(tests[i].name), i, now())) {
+      fprintf(stderr, "Error resolving '%s'.\n", tests[i].name);
+      return -1;
+    }
+  }
+
+  // The last query is lost after kMaxAttempts timeouts.
+  uint64_t limit = start +
+                   (net::dns::resolver::kMaxAttempts + 1) *
+                   net::dns::resolver::kQueryTimeout;
+
+  while ((obs.done < kNumberTests) && (now() < limit)) {
+    if (selector.wait_for_events(100)) {
+      selector.process_events();
+    }
+
+    resolver.check_expired(now());
+  }
+
+  int ret = 0;
+
+  for (unsigned i = 0; i < kNumberTests; i++) {
+    const test* t = &tests[i];
+
+    bool ok = (t->done) &&
+              (t->received == t->queries) &&
+              ((t->address) ?
+                 ((t->resolved) &&
+                  (strcmp(t->address, t->resolved_address) == 0)) :
+                 (!t->resolved));
+
+    printf("%s: %s, %u queries: %s.\n",
+           t->name,
+           !t->done ?
+             "not finished" :
+             t->resolved ? t->resolved_address : "not resolved",
+           t->received,
+           ok ? "OK" : "FAILED");
+
+    if (!ok) {
+      ret = -1;
+    }
+  }
+
+  // The responses are cached.
+  net::socket_address cached;
+  if ((resolver.lookup("a.example.com", 13, now(), cached) !=
+       net::dns::cache::result::kHit) ||
+      (resolver.lookup("nx.example.com", 14, now(), cached) !=
+       net::dns::cache::result::kNegativeHit)) {
+    printf("Cache: FAILED.\n");
+    ret = -1;
+  } else {
+    printf("Cache: OK.\n");
+  }
+
+  // Cancelled queries release their slots (the first two ids are in the
+  // same bucket of the index of the queries by id). The events are not
+  // processed any more, so the observer is not called.
+  static const unsigned kCancelIds[] = {100, 100 + 1024, 101};
+  static const unsigned kNumberCancelIds = sizeof(kCancelIds) /
+                                           sizeof(kCancelIds[0]);
+
+  bool ok = true;
+
+  for (unsigned i = 0; i < kNumberCancelIds; i++) {
+    ok &= resolver.resolve("lost.example.com", 16, kCancelIds[i], now());
+  }
+
+  // Unknown id.
+  resolver.cancel(102);
+
+  resolver.cancel(kCancelIds[1]);
+  resolver.cancel(kCancelIds[0]);
+  resolver.cancel(kCancelIds[2]);
+
+  // All the slots are free again.
+  for (unsigned i = 0; i < kNumberTests; i++) {
+    ok &= resolver.resolve("lost.example.com", 16, 200 + i, now());
+  }
+
+  ok &= !resolver.resolve("lost.example.com", 16, 200 + kNumberTests, now());
+
+  for (unsigned i = 0; i < kNumberTests; i++) {
+    resolver.cancel(200 + i);
+  }
+
+  if (ok) {
+    printf("Cancel: OK.\n");
+  } else {
+    printf("Cancel: FAILED.\n");
+    ret = -1;
+  }
+
+  return ret;
+}
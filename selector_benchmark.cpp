@@ -0,0 +1,313 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <inttypes.h>
+#include <new>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "net/selector.h"
+#include "util/number.h"
+
+// Measures the cost of the event loop of the selector the program has been
+// built with (make -f Makefile.selector_benchmark [SELECTOR=uring]).
+// Each connection is a nonblocking UDP socket on 127.0.0.1 (a single
+// descriptor per connection, so that more connections fit under the limit
+// of open files); in each round, a datagram is sent to some of them and
+// the time spent waiting for and processing the events is measured.
+
+#if HAVE_URING_SELECTOR
+  static const char* kSelector = "io_uring";
+#else
+  static const char* kSelector = "epoll";
+#endif
+
+static const unsigned kMinConnections = 1;
+static const unsigned kMaxConnections = 1000000;
+static const unsigned kDefaultActive = 100;
+static const unsigned kDefaultRounds = 1000;
+
+class connection : public io::event_handler {
+  public:
+    // Constructor.
+    connection();
+
+    // Create.
+    bool create(struct sockaddr_in& addr);
+
+    // On I/O.
+    result on_io(io::event events);
+
+    // Get descriptor.
+    int fd() const;
+
+    // Number of notifications and of datagrams received by all the
+    // connections.
+    static uint64_t notified;
+    static uint64_t received;
+
+  private:
+    int _M_fd;
+};
+
+uint64_t connection::notified = 0;
+uint64_t connection::received = 0;
+
+connection::connection()
+  : _M_fd(-1)
+{
+}
+
+bool connection::create(struct sockaddr_in& addr)
+{
+  if ((_M_fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0)) < 0) {
+    return false;
+  }
+
+  memset(&addr, 0, sizeof(struct sockaddr_in));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  socklen_t addrlen = sizeof(struct sockaddr_in);
+
+  return ((bind(_M_fd,
+                reinterpret_cast<const struct sockaddr*>(&addr),
+                addrlen) == 0) &&
+          (getsockname(_M_fd,
+                       reinterpret_cast<struct sockaddr*>(&addr),
+                       &addrlen) == 0));
+}
+
+io::event_handler::result connection::on_io(io::event events)
+{
+  notified++;
+
+  if (static_cast<unsigned>(events) &
+      static_cast<unsigned>(io::event::kRead)) {
+    // Edge-triggered: read until the socket is empty.
+    char buf[16];
+    while (recv(_M_fd, buf, sizeof(buf), 0) >= 0) {
+      received++;
+    }
+
+    if (errno != EAGAIN) {
+      return result::kError;
+    }
+  }
+
+  return result::kSuccess;
+}
+
+inline int connection::fd() const
+{
+  return _M_fd;
+}
+
+static uint64_t now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+// Wait for and process events until 'count' datagrams have been received
+// (or until no events arrive for a second), returns the number of waits.
+static unsigned run(net::selector& selector, uint64_t count)
+{
+  unsigned waits = 0;
+
+  while (connection::received < count) {
+    waits++;
+
+    if (!selector.wait_for_events(1000)) {
+      break;
+    }
+
+    selector.process_events();
+  }
+
+  return waits;
+}
+
+int main(int argc, const char** argv)
+{
+  // Check usage.
+  if ((argc < 2) || (argc > 4)) {
+    printf("Usage: %s <connections> [<active> [<rounds>]]\n", argv[0]);
+    printf("<connections> (%u - %u).\n", kMinConnections, kMaxConnections);
+    printf("<active>: connections which receive a datagram per round "
+           "(default: %u).\n",
+           kDefaultActive);
+    printf("<rounds> (default: %u).\n", kDefaultRounds);
+
+    return -1;
+  }
+
+  unsigned nconnections;
+  if (util::number::parse(argv[1],
+                          strlen(argv[1]),
+                          nconnections,
+                          kMinConnections,
+                          kMaxConnections) !=
+      util::number::parse_result::kSucceeded) {
+    fprintf(stderr, "Invalid number of connections '%s'.\n", argv[1]);
+    return -1;
+  }
+
+  unsigned active = kDefaultActive;
+  if ((argc > 2) &&
+      (util::number::parse(argv[2],
+                           strlen(argv[2]),
+                           active,
+                           1,
+                           nconnections) !=
+       util::number::parse_result::kSucceeded)) {
+    fprintf(stderr, "Invalid number of active connections '%s'.\n", argv[2]);
+    return -1;
+  }
+
+  unsigned rounds = kDefaultRounds;
+  if ((argc > 3) &&
+      (util::number::parse(argv[3], strlen(argv[3]), rounds, 1) !=
+       util::number::parse_result::kSucceeded)) {
+    fprintf(stderr, "Invalid number of rounds '%s'.\n", argv[3]);
+    return -1;
+  }
+
+  // Raise the limit of open files (the selector allocates an entry per
+  // possible descriptor).
+  struct rlimit rlim;
+  if (getrlimit(RLIMIT_NOFILE, &rlim) < 0) {
+    fprintf(stderr, "Error getting the limit of open files.\n");
+    return -1;
+  }
+
+  rlim_t needed = static_cast<rlim_t>(nconnections) + 16;
+  if (rlim.rlim_cur < needed) {
+    if (rlim.rlim_max < needed) {
+      fprintf(stderr,
+              "%u connections need %" PRIu64 " descriptors, the limit of "
+              "open files is %" PRIu64 ".\n",
+              nconnections,
+              static_cast<uint64_t>(needed),
+              static_cast<uint64_t>(rlim.rlim_max));
+
+      return -1;
+    }
+
+    rlim.rlim_cur = needed;
+    if (setrlimit(RLIMIT_NOFILE, &rlim) < 0) {
+      fprintf(stderr, "Error setting the limit of open files.\n");
+      return -1;
+    }
+  }
+
+  net::selector selector;
+  if (!selector.create()) {
+    fprintf(stderr, "Error creating %s selector.\n", kSelector);
+    return -1;
+  }
+
+  connection* connections = new (std::nothrow) connection[nconnections];
+  struct sockaddr_in* addrs = new (std::nothrow) sockaddr_in[nconnections];
+  if ((!connections) || (!addrs)) {
+    fprintf(stderr, "Error allocating memory.\n");
+    return -1;
+  }
+
+  int sender;
+  if ((sender = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+    fprintf(stderr, "Error creating socket.\n");
+    return -1;
+  }
+
+  for (unsigned i = 0; i < nconnections; i++) {
+    if (!connections[i].create(addrs[i])) {
+      fprintf(stderr, "Error creating connection %u.\n", i);
+      return -1;
+    }
+  }
+
+  // Add the connections and consume the first notification of each one
+  // (the sockets are writable).
+  uint64_t start = now();
+
+  for (unsigned i = 0; i < nconnections; i++) {
+    if (!selector.add(connections[i].fd(),
+                      net::fdtype::kFdSocket,
+                      &connections[i],
+                      io::event::kRead)) {
+      fprintf(stderr, "Error adding connection %u.\n", i);
+      return -1;
+    }
+  }
+
+  while ((connection::notified < nconnections) &&
+         (selector.wait_for_events(1000))) {
+    selector.process_events();
+  }
+
+  uint64_t add = now() - start;
+
+  // The active connections of a round are spread over all the
+  // connections and change from round to round.
+  unsigned step = (nconnections > active) ? nconnections / active : 1;
+
+  uint64_t elapsed = 0;
+  uint64_t waits = 0;
+
+  for (unsigned r = 0; r < rounds; r++) {
+    for (unsigned i = 0; i < active; i++) {
+      unsigned idx = ((i * step) + r) % nconnections;
+
+      if (sendto(sender,
+                 "x",
+                 1,
+                 0,
+                 reinterpret_cast<const struct sockaddr*>(&addrs[idx]),
+                 sizeof(struct sockaddr_in)) != 1) {
+        fprintf(stderr, "Error sending datagram.\n");
+        return -1;
+      }
+    }
+
+    start = now();
+    waits += run(selector, static_cast<uint64_t>(r + 1) * active);
+    elapsed += now() - start;
+  }
+
+  uint64_t expected = static_cast<uint64_t>(rounds) * active;
+
+  printf("%s: %u connections, %u active, %u rounds.\n",
+         kSelector,
+         nconnections,
+         active,
+         rounds);
+
+  printf("  Add + first event: %" PRIu64 " us.\n", add / 1000);
+
+  printf("  Event loop: %" PRIu64 " ns / round, %" PRIu64 " ns / event, "
+         "%.2f waits / round.\n",
+         elapsed / rounds,
+         elapsed / expected,
+         static_cast<double>(waits) / rounds);
+
+  if (connection::received != expected) {
+    printf("  Received %" PRIu64 " datagrams of %" PRIu64 ".\n",
+           connection::received,
+           expected);
+  }
+
+  close(sender);
+
+  delete [] addrs;
+  delete [] connections;
+
+  return (connection::received == expected) ? 0 : -1;
+}
@@ -0,0 +1,33 @@
+#include <new>
+#include "string/buffer_pool.h"
+
+bool string::buffer_pool::create(size_t max_size)
+{
+  size_t max_buffers = max_size / kMinBufferSize;
+
+  if ((_M_buffers = new (std::nothrow) buffer[max_buffers]) == NULL) {
+    return false;
+  }
+
+  _M_max_buffers = max_buffers;
+  _M_max_size = max_size;
+
+  return true;
+}
+
+void string::buffer_pool::put(buffer& buf)
+{
+  size_t capacity = buf.capacity();
+
+  if ((capacity >= kMinBufferSize) &&
+      (capacity <= kMaxBufferSize) &&
+      (_M_size + capacity <= _M_max_size) &&
+      (_M_count < _M_max_buffers)) {
+    buf.clear();
+    buf.swap(_M_buffers[_M_count++]);
+
+    _M_size += capacity;
+  } else {
+    buf.free();
+  }
+}
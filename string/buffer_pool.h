@@ -0,0 +1,84 @@
+#ifndef STRING_BUFFER_POOL_H
+#define STRING_BUFFER_POOL_H
+
+#include <stdlib.h>
+#include "string/buffer.h"
+
+namespace string {
+  // Pool of buffers: a buffer is taken when data has to be received and
+  // given back when it is empty, so that idle connections don't keep
+  // memory. The pool keeps up to a maximum amount of memory, the rest is
+  // freed.
+  class buffer_pool {
+    public:
+      static const size_t kDefaultMaxSize = 16 * 1024 * 1024;
+
+      // Bigger buffers are freed instead of being kept.
+      static const size_t kMaxBufferSize = 512 * 1024;
+
+      // Constructor.
+      buffer_pool();
+
+      // Destructor.
+      ~buffer_pool();
+
+      // Create.
+      bool create(size_t max_size = kDefaultMaxSize);
+
+      // Take buffer (a buffer which already has memory is kept).
+      void get(buffer& buf);
+
+      // Give buffer back (the buffer is left empty).
+      void put(buffer& buf);
+
+      // Get number of buffers in the pool.
+      size_t count() const;
+
+    private:
+      // Smallest buffer which is kept.
+      static const size_t kMinBufferSize = 2 * 1024;
+
+      buffer* _M_buffers;
+      size_t _M_max_buffers;
+      size_t _M_count;
+
+      // Memory of the buffers in the pool.
+      size_t _M_size;
+      size_t _M_max_size;
+
+      // Disable copy constructor and assignment operator.
+      buffer_pool(const buffer_pool&) = delete;
+      buffer_pool& operator=(const buffer_pool&) = delete;
+  };
+
+  inline buffer_pool::buffer_pool()
+    : _M_buffers(NULL),
+      _M_max_buffers(0),
+      _M_count(0),
+      _M_size(0),
+      _M_max_size(0)
+  {
+  }
+
+  inline buffer_pool::~buffer_pool()
+  {
+    if (_M_buffers) {
+      delete [] _M_buffers;
+    }
+  }
+
+  inline void buffer_pool::get(buffer& buf)
+  {
+    if ((buf.capacity() == 0) && (_M_count > 0)) {
+      buf.swap(_M_buffers[--_M_count]);
+      _M_size -= buf.capacity();
+    }
+  }
+
+  inline size_t buffer_pool::count() const
+  {
+    return _M_count;
+  }
+}
+
+#endif // STRING_BUFFER_POOL_H
@@ -118,9 +118,11 @@ namespace timer {
       timer* t;
       while (((t = _M_timers[i]._M_next) != &_M_timers[i]) &&
              (t->_M_expiration_time <= current_msec)) {
-        handle_expired(t->_M_handler);
-
+        // Erase the timer before handling it, so the handler can
+        // schedule it again.
         erase(t);
+
+        handle_expired(t->_M_handler);
       }
     }
   }
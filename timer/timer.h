@@ -10,6 +10,8 @@ namespace timer {
     template<priority_t kNumberPriorities>
     friend class scheduler;
 
+    friend class wheel;
+
     public:
       // Constructor.
       timer(event_handler* handler = NULL);
@@ -23,7 +25,9 @@ namespace timer {
   };
 
   inline timer::timer(event_handler* handler)
-    : _M_handler(handler)
+    : _M_handler(handler),
+      _M_prev(NULL),
+      _M_next(NULL)
   {
   }
 }
@@ -0,0 +1,265 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "timer/timer.h"
+#include "timer/observer.h"
+
+namespace timer {
+  // Hierarchical timing wheel: timers with any mix of timeouts are
+  // scheduled and erased in O(1).
+  // The wheel has kLevels levels of kSlots slots, the slots of the first
+  // level are one millisecond wide, the slots of the next level are
+  // kSlots times wider, and so on. When the first level wraps around, the
+  // timers of the next slot of the second level are redistributed
+  // (cascaded) among the slots of the first level.
+  class wheel {
+    public:
+      // Constructor.
+      wheel();
+
+      // Clear wheel (the time starts at current_msec).
+      void clear(uint64_t current_msec);
+
+      // Set observer.
+      void set_observer(observer* obs);
+
+      // Schedule timer.
+      void schedule(timer* t, uint64_t expiration_time);
+
+      // Reschedule timer.
+      void reschedule(timer* t, uint64_t expiration_time);
+
+      // Erase timer (if it is scheduled).
+      void erase(timer* t);
+
+      // Check expired timers.
+      void check_expired(uint64_t current_msec);
+
+      // Get number of scheduled timers.
+      size_t count() const;
+
+    private:
+      static const unsigned kSlotBits = 6;
+      static const size_t kSlots = static_cast<size_t>(1) << kSlotBits;
+      static const size_t kSlotMask = kSlots - 1;
+      static const unsigned kLevels = 4;
+
+      // Timers expiring later are kept in the last slot of the last level
+      // until they get closer.
+      static const uint64_t kMaxTimeout =
+                              static_cast<uint64_t>(1) << (kLevels * kSlotBits);
+
+      timer _M_slots[kLevels][kSlots];
+
+      // Next millisecond to be processed.
+      uint64_t _M_current_msec;
+
+      size_t _M_count;
+
+      observer* _M_observer;
+
+      // Add timer to the corresponding slot.
+      void add(timer* t);
+
+      // Cascade the timers of a slot to the lower levels.
+      void cascade(unsigned level, size_t slot);
+
+      // Handle expired timer.
+      void handle_expired(event_handler* handler);
+
+      // Insert timer at the end of the list.
+      static void link(timer* head, timer* t);
+
+      // Remove timer from its list.
+      static void unlink(timer* t);
+
+      // Move the timers of the list 'from' to the empty list 'to'.
+      static void move(timer* from, timer* to);
+
+      // Disable copy constructor and assignment operator.
+      wheel(const wheel&) = delete;
+      wheel& operator=(const wheel&) = delete;
+  };
+
+  inline wheel::wheel()
+    : _M_observer(NULL)
+  {
+    clear(0);
+  }
+
+  inline void wheel::clear(uint64_t current_msec)
+  {
+    for (unsigned i = 0; i < kLevels; i++) {
+      for (size_t j = 0; j < kSlots; j++) {
+        _M_slots[i][j]._M_prev = &_M_slots[i][j];
+        _M_slots[i][j]._M_next = &_M_slots[i][j];
+      }
+    }
+
+    _M_current_msec = current_msec;
+    _M_count = 0;
+  }
+
+  inline void wheel::set_observer(observer* obs)
+  {
+    _M_observer = obs;
+  }
+
+  inline void wheel::schedule(timer* t, uint64_t expiration_time)
+  {
+    t->_M_expiration_time = expiration_time;
+
+    add(t);
+
+    _M_count++;
+  }
+
+  inline void wheel::reschedule(timer* t, uint64_t expiration_time)
+  {
+    erase(t);
+    schedule(t, expiration_time);
+  }
+
+  inline void wheel::erase(timer* t)
+  {
+    if (t->_M_next) {
+      unlink(t);
+      _M_count--;
+    }
+  }
+
+  inline void wheel::check_expired(uint64_t current_msec)
+  {
+    // If there are no timers, just move the time forward.
+    if (_M_count == 0) {
+      if (current_msec >= _M_current_msec) {
+        _M_current_msec = current_msec + 1;
+      }
+
+      return;
+    }
+
+    while (_M_current_msec <= current_msec) {
+      size_t slot = _M_current_msec & kSlotMask;
+
+      // If the first level wraps around...
+      if (slot == 0) {
+        for (unsigned i = 1; i < kLevels; i++) {
+          size_t s = (_M_current_msec >> (i * kSlotBits)) & kSlotMask;
+
+          cascade(i, s);
+
+          // If the level doesn't wrap around...
+          if (s != 0) {
+            break;
+          }
+        }
+      }
+
+      // Move the timers out of the slot, so the handlers can schedule
+      // timers which have already expired (they will go to the next
+      // slot).
+      timer expired;
+      move(&_M_slots[0][slot], &expired);
+
+      _M_current_msec++;
+
+      timer* t;
+      while ((t = expired._M_next) != &expired) {
+        // Erase the timer before handling it, so the handler can
+        // schedule it again.
+        erase(t);
+
+        handle_expired(t->_M_handler);
+      }
+    }
+  }
+
+  inline size_t wheel::count() const
+  {
+    return _M_count;
+  }
+
+  inline void wheel::add(timer* t)
+  {
+    uint64_t expiration_time = (t->_M_expiration_time > _M_current_msec) ?
+                               t->_M_expiration_time :
+                               _M_current_msec;
+
+    uint64_t timeout = expiration_time - _M_current_msec;
+
+    if (timeout >= kMaxTimeout) {
+      expiration_time = _M_current_msec + kMaxTimeout - 1;
+      timeout = kMaxTimeout - 1;
+    }
+
+    unsigned level = 0;
+    while (timeout >= (static_cast<uint64_t>(1) << ((level + 1) * kSlotBits))) {
+      level++;
+    }
+
+    link(&_M_slots[level][(expiration_time >> (level * kSlotBits)) &
+                          kSlotMask],
+         t);
+  }
+
+  inline void wheel::cascade(unsigned level, size_t slot)
+  {
+    timer timers;
+    move(&_M_slots[level][slot], &timers);
+
+    timer* t;
+    while ((t = timers._M_next) != &timers) {
+      unlink(t);
+      add(t);
+    }
+  }
+
+  inline void wheel::handle_expired(event_handler* handler)
+  {
+    handler->on_timer();
+
+    if (_M_observer) {
+      _M_observer->on_timer(handler);
+    }
+  }
+
+  inline void wheel::link(timer* head, timer* t)
+  {
+    t->_M_prev = head->_M_prev;
+    t->_M_next = head;
+
+    head->_M_prev->_M_next = t;
+    head->_M_prev = t;
+  }
+
+  inline void wheel::unlink(timer* t)
+  {
+    t->_M_prev->_M_next = t->_M_next;
+    t->_M_next->_M_prev = t->_M_prev;
+
+    t->_M_prev = NULL;
+    t->_M_next = NULL;
+  }
+
+  inline void wheel::move(timer* from, timer* to)
+  {
+    if (from->_M_next != from) {
+      to->_M_next = from->_M_next;
+      to->_M_prev = from->_M_prev;
+
+      to->_M_next->_M_prev = to;
+      to->_M_prev->_M_next = to;
+
+      from->_M_next = from;
+      from->_M_prev = from;
+    } else {
+      to->_M_next = to;
+      to->_M_prev = to;
+    }
+  }
+}
+
+#endif // TIMER_WHEEL_H
@@ -0,0 +1,395 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <inttypes.h>
+#include <new>
+#include "timer/scheduler.h"
+#include "timer/wheel.h"
+#include "util/number.h"
+
+// Compares the timing wheel with the list scheduler (a list per timeout,
+// so that each list is sorted, and a single list, as the workers used it
+// before the timing wheel) with the timers of the workers: every
+// timer has one of kNumberTimeouts timeouts; in each millisecond, some
+// timers are restarted (data received) and the expired timers are
+// scheduled again with another timeout (next phase).
+
+static const unsigned kMinTimers = 1;
+static const unsigned kMaxTimers = 10000000;
+static const unsigned kDefaultTimers = 100000;
+
+// Milliseconds simulated.
+static const unsigned kDuration = 120 * 1000;
+
+// Timers restarted per millisecond.
+static const unsigned kRestarts = 100;
+
+static const unsigned kTimeouts[] = {10000, 30000, 30000, 60000, 5000};
+static const unsigned kNumberTimeouts = sizeof(kTimeouts) /
+                                        sizeof(kTimeouts[0]);
+
+class handler : public timer::event_handler {
+  public:
+    timer::timer t;
+    unsigned timeout; // Index in kTimeouts.
+    uint64_t expiration;
+
+    // Constructor.
+    handler();
+
+    // On timer.
+    bool on_timer();
+};
+
+handler::handler()
+  : t(this),
+    timeout(0),
+    expiration(0)
+{
+}
+
+bool handler::on_timer()
+{
+  return true;
+}
+
+static uint64_t now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+// Pseudo-random numbers (the same sequence for both schedulers).
+static uint32_t next_random(uint64_t& state)
+{
+  state = state * 6364136223846793005ull + 1442695040888963407ull;
+  return static_cast<uint32_t>(state >> 33);
+}
+
+struct result {
+  uint64_t schedule; // ns.
+  uint64_t run; // ns.
+  uint64_t expired;
+  uint64_t late; // Timers which expired late.
+};
+
+// Adapters, so that both schedulers are driven by the same code.
+class list_scheduler {
+  public:
+    static const char* kName;
+
+    // Clear scheduler.
+    void clear(uint64_t current_msec);
+
+    // Set observer.
+    void set_observer(timer::observer* obs);
+
+    // Schedule timer (in the list of its timeout).
+    void schedule(handler* h, uint64_t expiration_time);
+
+    // Reschedule timer.
+    void reschedule(handler* h, uint64_t expiration_time);
+
+    // Check expired timers.
+    void check_expired(uint64_t current_msec);
+
+  private:
+    timer::scheduler<kNumberTimeouts> _M_scheduler;
+};
+
+const char* list_scheduler::kName = "list";
+
+inline void list_scheduler::clear(uint64_t current_msec)
+{
+  _M_scheduler.clear();
+}
+
+inline void list_scheduler::set_observer(timer::observer* obs)
+{
+  _M_scheduler.set_observer(obs);
+}
+
+inline void list_scheduler::schedule(handler* h, uint64_t expiration_time)
+{
+  _M_scheduler.schedule(h->timeout, &h->t, expiration_time);
+}
+
+inline void list_scheduler::reschedule(handler* h, uint64_t expiration_time)
+{
+  _M_scheduler.reschedule(h->timeout, &h->t, expiration_time);
+}
+
+inline void list_scheduler::check_expired(uint64_t current_msec)
+{
+  _M_scheduler.check_expired(current_msec);
+}
+
+// A single list for all the timeouts (the timers expire late when a timer
+// with a shorter timeout is behind one with a longer timeout).
+class single_list_scheduler {
+  public:
+    static const char* kName;
+
+    // Clear scheduler.
+    void clear(uint64_t current_msec);
+
+    // Set observer.
+    void set_observer(timer::observer* obs);
+
+    // Schedule timer.
+    void schedule(handler* h, uint64_t expiration_time);
+
+    // Reschedule timer.
+    void reschedule(handler* h, uint64_t expiration_time);
+
+    // Check expired timers.
+    void check_expired(uint64_t current_msec);
+
+  private:
+    timer::scheduler<1> _M_scheduler;
+};
+
+const char* single_list_scheduler::kName = "single list";
+
+inline void single_list_scheduler::clear(uint64_t current_msec)
+{
+  _M_scheduler.clear();
+}
+
+inline void single_list_scheduler::set_observer(timer::observer* obs)
+{
+  _M_scheduler.set_observer(obs);
+}
+
+inline void single_list_scheduler::schedule(handler* h,
+                                            uint64_t expiration_time)
+{
+  _M_scheduler.schedule(0, &h->t, expiration_time);
+}
+
+inline void single_list_scheduler::reschedule(handler* h,
+                                              uint64_t expiration_time)
+{
+  _M_scheduler.reschedule(0, &h->t, expiration_time);
+}
+
+inline void single_list_scheduler::check_expired(uint64_t current_msec)
+{
+  _M_scheduler.check_expired(current_msec);
+}
+
+class wheel_scheduler {
+  public:
+    static const char* kName;
+
+    // Clear scheduler.
+    void clear(uint64_t current_msec);
+
+    // Set observer.
+    void set_observer(timer::observer* obs);
+
+    // Schedule timer.
+    void schedule(handler* h, uint64_t expiration_time);
+
+    // Reschedule timer.
+    void reschedule(handler* h, uint64_t expiration_time);
+
+    // Check expired timers.
+    void check_expired(uint64_t current_msec);
+
+  private:
+    timer::wheel _M_wheel;
+};
+
+const char* wheel_scheduler::kName = "wheel";
+
+inline void wheel_scheduler::clear(uint64_t current_msec)
+{
+  _M_wheel.clear(current_msec);
+}
+
+inline void wheel_scheduler::set_observer(timer::observer* obs)
+{
+  _M_wheel.set_observer(obs);
+}
+
+inline void wheel_scheduler::schedule(handler* h, uint64_t expiration_time)
+{
+  _M_wheel.schedule(&h->t, expiration_time);
+}
+
+inline void wheel_scheduler::reschedule(handler* h, uint64_t expiration_time)
+{
+  _M_wheel.reschedule(&h->t, expiration_time);
+}
+
+inline void wheel_scheduler::check_expired(uint64_t current_msec)
+{
+  _M_wheel.check_expired(current_msec);
+}
+
+template<typename _Scheduler>
+class benchmark : public timer::observer {
+  public:
+    // Constructor.
+    benchmark(handler* handlers, unsigned count);
+
+    // Run.
+    void run(result& res);
+
+    // On timer.
+    void on_timer(timer::event_handler* h);
+
+  private:
+    _Scheduler _M_scheduler;
+
+    handler* _M_handlers;
+    unsigned _M_count;
+
+    uint64_t _M_current_msec;
+
+    result* _M_result;
+};
+
+template<typename _Scheduler>
+benchmark<_Scheduler>::benchmark(handler* handlers, unsigned count)
+  : _M_handlers(handlers),
+    _M_count(count),
+    _M_current_msec(0),
+    _M_result(NULL)
+{
+  _M_scheduler.set_observer(this);
+}
+
+template<typename _Scheduler>
+void benchmark<_Scheduler>::run(result& res)
+{
+  memset(&res, 0, sizeof(result));
+  _M_result = &res;
+
+  uint64_t state = 1;
+
+  _M_current_msec = 1000;
+  _M_scheduler.clear(_M_current_msec);
+
+  uint64_t start = now();
+
+  for (unsigned i = 0; i < _M_count; i++) {
+    handler* h = &_M_handlers[i];
+
+    h->timeout = next_random(state) % kNumberTimeouts;
+    h->expiration = _M_current_msec + kTimeouts[h->timeout];
+
+    _M_scheduler.schedule(h, h->expiration);
+  }
+
+  res.schedule = now() - start;
+
+  start = now();
+
+  for (unsigned ms = 0; ms < kDuration; ms++) {
+    _M_current_msec++;
+
+    // Restart some timers.
+    for (unsigned i = 0; i < kRestarts; i++) {
+      handler* h = &_M_handlers[next_random(state) % _M_count];
+
+      h->expiration = _M_current_msec + kTimeouts[h->timeout];
+      _M_scheduler.reschedule(h, h->expiration);
+    }
+
+    _M_scheduler.check_expired(_M_current_msec);
+  }
+
+  res.run = now() - start;
+}
+
+template<typename _Scheduler>
+void benchmark<_Scheduler>::on_timer(timer::event_handler* eh)
+{
+  handler* h = static_cast<handler*>(eh);
+
+  _M_result->expired++;
+
+  if (h->expiration != _M_current_msec) {
+    _M_result->late++;
+  }
+
+  // Next phase.
+  h->timeout = (h->timeout + 1) % kNumberTimeouts;
+  h->expiration = _M_current_msec + kTimeouts[h->timeout];
+
+  _M_scheduler.schedule(h, h->expiration);
+}
+
+template<typename _Scheduler>
+static bool run(unsigned count, result& res)
+{
+  handler* handlers;
+  if ((handlers = new (std::nothrow) handler[count]) == NULL) {
+    fprintf(stderr, "Error allocating memory.\n");
+    return false;
+  }
+
+  benchmark<_Scheduler> b(handlers, count);
+  b.run(res);
+
+  uint64_t operations = static_cast<uint64_t>(kDuration) * kRestarts +
+                        res.expired;
+
+  printf("%s: %u timers, schedule: %" PRIu64 " ns / timer, "
+         "%" PRIu64 " ns / ms simulated, %" PRIu64 " ns / operation "
+         "(%" PRIu64 " expired, %" PRIu64 " late).\n",
+         _Scheduler::kName,
+         count,
+         res.schedule / count,
+         res.run / kDuration,
+         res.run / operations,
+         res.expired,
+         res.late);
+
+  delete [] handlers;
+
+  return true;
+}
+
+int main(int argc, const char** argv)
+{
+  // Check usage.
+  if (argc > 2) {
+    printf("Usage: %s [<timers>]\n", argv[0]);
+    printf("<timers> (%u - %u, default: %u).\n",
+           kMinTimers,
+           kMaxTimers,
+           kDefaultTimers);
+
+    return -1;
+  }
+
+  unsigned count = kDefaultTimers;
+  if ((argc == 2) &&
+      (util::number::parse(argv[1],
+                           strlen(argv[1]),
+                           count,
+                           kMinTimers,
+                           kMaxTimers) !=
+       util::number::parse_result::kSucceeded)) {
+    fprintf(stderr, "Invalid number of timers '%s'.\n", argv[1]);
+    return -1;
+  }
+
+  result list, single_list, wheel;
+  if ((!run<list_scheduler>(count, list)) ||
+      (!run<single_list_scheduler>(count, single_list)) ||
+      (!run<wheel_scheduler>(count, wheel))) {
+    return -1;
+  }
+
+  // Both schedulers have to expire the same timers at the same time.
+  return ((list.expired == wheel.expired) &&
+          (list.late == 0) &&
+          (wheel.late == 0)) ? 0 : -1;
+}
@@ -0,0 +1,64 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <inttypes.h>
+#include "net/http/url_index.h"
+
+int main(int argc, const char** argv)
+{
+  // Check usage.
+  if (argc < 3) {
+    printf("Usage: %s <directory> <url> ...\n", argv[0]);
+    return -1;
+  }
+
+  int ret = 0;
+
+  for (int i = 2; i < argc; i++) {
+    net::http::url_index::entry e;
+    char path[PATH_MAX];
+    if (net::http::url_index::find(argv[1],
+                                   string::slice(argv[i], strlen(argv[i])),
+                                   e,
+                                   path,
+                                   sizeof(path))) {
+      printf("%s: status code: %u, content length: %" PRIu64 ", file: %s",
+             argv[i],
+             e.status_code,
+             e.content_length,
+             path);
+
+      if (e.flags & net::http::url_index::kArchived) {
+        printf(", offset: %" PRIu64, e.offset);
+      }
+
+      if (e.flags & net::http::url_index::kTruncated) {
+        printf(", truncated");
+      }
+
+      if (e.flags & net::http::url_index::kFiltered) {
+        printf(", body not saved");
+      }
+
+      if (e.flags & net::http::url_index::kPartial) {
+        printf(", partial");
+      }
+
+      if (e.flags & net::http::url_index::kUnchanged) {
+        printf(", unchanged");
+      }
+
+      if (e.flags & net::http::url_index::kDecoded) {
+        printf(", decoded");
+      }
+
+      printf(".\n");
+    } else {
+      printf("%s: not found.\n", argv[i]);
+      ret = -1;
+    }
+  }
+
+  return ret;
+}
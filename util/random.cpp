@@ -0,0 +1,25 @@
+#include <string.h>
+#include "util/random.h"
+
+bool util::random::create()
+{
+  return _M_file.open("/dev/urandom", O_RDONLY);
+}
+
+bool util::random::next(uint16_t& n)
+{
+  // If the buffer has been used up...
+  if (_M_pos + sizeof(uint16_t) > kBufferSize) {
+    if (_M_file.read(_M_buf, kBufferSize) !=
+        static_cast<ssize_t>(kBufferSize)) {
+      return false;
+    }
+
+    _M_pos = 0;
+  }
+
+  memcpy(&n, _M_buf + _M_pos, sizeof(uint16_t));
+  _M_pos += sizeof(uint16_t);
+
+  return true;
+}
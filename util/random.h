@@ -0,0 +1,40 @@
+#ifndef UTIL_RANDOM_H
+#define UTIL_RANDOM_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "fs/file.h"
+
+namespace util {
+  // Unpredictable numbers (read from /dev/urandom in blocks).
+  class random {
+    public:
+      // Constructor.
+      random();
+
+      // Create.
+      bool create();
+
+      // Get random number (returns false if it couldn't be read).
+      bool next(uint16_t& n);
+
+    private:
+      static const size_t kBufferSize = 256;
+
+      fs::file _M_file;
+
+      uint8_t _M_buf[kBufferSize];
+      size_t _M_pos;
+
+      // Disable copy constructor and assignment operator.
+      random(const random&) = delete;
+      random& operator=(const random&) = delete;
+  };
+
+  inline random::random()
+    : _M_pos(kBufferSize)
+  {
+  }
+}
+
+#endif // UTIL_RANDOM_H
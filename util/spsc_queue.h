@@ -0,0 +1,136 @@
+#ifndef UTIL_SPSC_QUEUE_H
+#define UTIL_SPSC_QUEUE_H
+
+#include <stdlib.h>
+#include <new>
+#include "util/move.h"
+
+namespace util {
+  // Bounded lock-free queue for one producer thread and one consumer
+  // thread.
+  template<typename _T>
+  class spsc_queue {
+    public:
+      // Constructor.
+      spsc_queue();
+
+      // Destructor.
+      ~spsc_queue();
+
+      // Create (the size is rounded up to a power of two).
+      bool create(size_t size);
+
+      // Push element (only called by the producer, the element is moved
+      // into the queue if there is room).
+      bool push(_T&& elem);
+
+      // Pop element (only called by the consumer).
+      bool pop(_T& elem);
+
+    private:
+      static const size_t kCacheLineSize = 64;
+
+      _T* _M_elems;
+      size_t _M_mask;
+
+      // Written by the consumer.
+      size_t _M_head;
+
+      // Last value of _M_tail seen by the consumer.
+      size_t _M_cached_tail;
+
+      char _M_pad[kCacheLineSize];
+
+      // Written by the producer.
+      size_t _M_tail;
+
+      // Last value of _M_head seen by the producer.
+      size_t _M_cached_head;
+
+      // Disable copy constructor and assignment operator.
+      spsc_queue(const spsc_queue&) = delete;
+      spsc_queue& operator=(const spsc_queue&) = delete;
+  };
+
+  template<typename _T>
+  inline spsc_queue<_T>::spsc_queue()
+    : _M_elems(NULL),
+      _M_mask(0),
+      _M_head(0),
+      _M_cached_tail(0),
+      _M_tail(0),
+      _M_cached_head(0)
+  {
+  }
+
+  template<typename _T>
+  inline spsc_queue<_T>::~spsc_queue()
+  {
+    if (_M_elems) {
+      delete [] _M_elems;
+    }
+  }
+
+  template<typename _T>
+  bool spsc_queue<_T>::create(size_t size)
+  {
+    size_t s = 1;
+    while (s < size) {
+      s <<= 1;
+    }
+
+    if ((_M_elems = new (std::nothrow) _T[s]) == NULL) {
+      return false;
+    }
+
+    _M_mask = s - 1;
+
+    return true;
+  }
+
+  template<typename _T>
+  inline bool spsc_queue<_T>::push(_T&& elem)
+  {
+    size_t tail = _M_tail;
+
+    // If the queue seems to be full...
+    if (tail - _M_cached_head > _M_mask) {
+      _M_cached_head = __atomic_load_n(&_M_head, __ATOMIC_ACQUIRE);
+
+      if (tail - _M_cached_head > _M_mask) {
+        return false;
+      }
+    }
+
+    _M_elems[tail & _M_mask] = util::move(elem);
+
+    // Publish the element.
+    __atomic_store_n(&_M_tail, tail + 1, __ATOMIC_RELEASE);
+
+    return true;
+  }
+
+  template<typename _T>
+  inline bool spsc_queue<_T>::pop(_T& elem)
+  {
+    size_t head = _M_head;
+
+    // If the queue seems to be empty...
+    if (head == _M_cached_tail) {
+      _M_cached_tail = __atomic_load_n(&_M_tail, __ATOMIC_ACQUIRE);
+
+      if (head == _M_cached_tail) {
+        return false;
+      }
+    }
+
+    elem = util::move(_M_elems[head & _M_mask]);
+
+    // Release the slot.
+    __atomic_store_n(&_M_head, head + 1, __ATOMIC_RELEASE);
+
+    return true;
+  }
+}
+
+#endif // UTIL_SPSC_QUEUE_H
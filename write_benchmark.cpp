@@ -0,0 +1,299 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <inttypes.h>
+#include "fs/file.h"
+#include "string/buffer.h"
+#include "util/number.h"
+
+// Writes a body received in fragments of <fragment> bytes (the data
+// returned by each read() of the socket) to a file, like the clients do
+// when the body is not spliced (TLS, decoded bodies): the fragments are
+// staged until the flush threshold is reached and then written together
+// with the fragment which reaches it with a single writev().
+// The number of write system calls is taken from /proc/self/io (syscw),
+// the data stays in the page cache (the file is not synced).
+
+static const unsigned kMinMegabytes = 1;
+static const unsigned kMaxMegabytes = 16 * 1024;
+static const unsigned kDefaultMegabytes = 256;
+
+static const unsigned kMinFragment = 1;
+static const unsigned kMaxFragment = 1024 * 1024;
+static const unsigned kDefaultFragment = 1448; // TCP segment.
+
+// Flush thresholds (0: each fragment is written as it is received).
+static const size_t kThresholds[] = {
+  0,
+  4 * 1024,
+  64 * 1024,
+  256 * 1024, // Default.
+  1024 * 1024,
+  16 * 1024 * 1024
+};
+
+static const unsigned kNumberThresholds = sizeof(kThresholds) /
+                                          sizeof(kThresholds[0]);
+
+static const char* kFilename = "write_benchmark.tmp";
+
+static uint64_t now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+// Get the number of write system calls of the process.
+static bool write_syscalls(uint64_t& n)
+{
+  // The size of the files of /proc is 0 (fs::file::read_all() cannot be
+  // used).
+  fs::file f;
+  if (!f.open("/proc/self/io", O_RDONLY)) {
+    return false;
+  }
+
+  char buf[512];
+  ssize_t ret;
+  if ((ret = f.read(buf, sizeof(buf) - 1)) <= 0) {
+    return false;
+  }
+
+  buf[ret] = 0;
+
+  const char* syscw;
+  if ((syscw = strstr(buf, "syscw: ")) == NULL) {
+    return false;
+  }
+
+  n = strtoull(syscw + 7, NULL, 10);
+
+  return true;
+}
+
+class writer {
+  public:
+    // Constructor.
+    writer(size_t threshold);
+
+    // Open file.
+    bool open(const char* filename);
+
+    // Write (as client::write_file()).
+    bool write(const void* data, size_t len);
+
+    // End of the body.
+    bool finish();
+
+    // Number of writes.
+    uint64_t writes() const;
+
+  private:
+    size_t _M_threshold;
+
+    fs::file _M_file;
+    string::buffer _M_staging;
+
+    uint64_t _M_writes;
+
+    // Write the staged data and 'data'.
+    bool flush(const void* data = NULL, size_t len = 0);
+};
+
+writer::writer(size_t threshold)
+  : _M_threshold(threshold),
+    _M_writes(0)
+{
+}
+
+bool writer::open(const char* filename)
+{
+  return _M_file.open(filename, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+}
+
+bool writer::write(const void* data, size_t len)
+{
+  // If the threshold has not been reached yet...
+  if (_M_staging.length() + len < _M_threshold) {
+    return _M_staging.append(reinterpret_cast<const char*>(data), len);
+  }
+
+  return flush(data, len);
+}
+
+bool writer::finish()
+{
+  // Write the staged data.
+  return ((_M_staging.length() == 0) || (flush()));
+}
+
+bool writer::flush(const void* data, size_t len)
+{
+  // Write both buffers with a single system call.
+  struct iovec iov[2];
+  iov[0].iov_base = _M_staging.data();
+  iov[0].iov_len = _M_staging.length();
+  iov[1].iov_base = const_cast<void*>(data);
+  iov[1].iov_len = len;
+
+  unsigned iovcnt = (len > 0) ? 2 : 1;
+  size_t total = iov[0].iov_len + len;
+
+  _M_writes++;
+
+  bool ret = (_M_file.writev(iov, iovcnt) == static_cast<ssize_t>(total));
+
+  _M_staging.clear();
+
+  return ret;
+}
+
+inline uint64_t writer::writes() const
+{
+  return _M_writes;
+}
+
+static bool run(size_t threshold,
+                uint64_t size,
+                const char* fragment,
+                size_t fragmentlen,
+                uint64_t& syscalls)
+{
+  writer w(threshold);
+  if (!w.open(kFilename)) {
+    fprintf(stderr, "Error opening file '%s'.\n", kFilename);
+    return false;
+  }
+
+  uint64_t before;
+  if (!write_syscalls(before)) {
+    fprintf(stderr, "Error reading /proc/self/io.\n");
+    return false;
+  }
+
+  uint64_t start = now();
+
+  for (uint64_t written = 0; written < size; written += fragmentlen) {
+    size_t len = (size - written < fragmentlen) ? size - written : fragmentlen;
+
+    if (!w.write(fragment, len)) {
+      fprintf(stderr, "Error writing to file '%s'.\n", kFilename);
+      return false;
+    }
+  }
+
+  if (!w.finish()) {
+    fprintf(stderr, "Error writing to file '%s'.\n", kFilename);
+    return false;
+  }
+
+  uint64_t elapsed = now() - start;
+
+  uint64_t after;
+  if (!write_syscalls(after)) {
+    fprintf(stderr, "Error reading /proc/self/io.\n");
+    return false;
+  }
+
+  syscalls = after - before;
+
+  if (threshold == 0) {
+    printf("No staging:");
+  } else {
+    printf("%zu KB:", threshold / 1024);
+  }
+
+  printf(" %" PRIu64 " write system calls (%" PRIu64 " writes), "
+         "%" PRIu64 " ms, %" PRIu64 " MB/s.\n",
+         syscalls,
+         w.writes(),
+         elapsed / 1000000,
+         (elapsed > 0) ? (size * 1000000000ull / elapsed) >> 20 : 0);
+
+  return true;
+}
+
+int main(int argc, const char** argv)
+{
+  // Check usage.
+  if (argc > 3) {
+    printf("Usage: %s [<megabytes> [<fragment>]]\n", argv[0]);
+    printf("<megabytes> (%u - %u, default: %u).\n",
+           kMinMegabytes,
+           kMaxMegabytes,
+           kDefaultMegabytes);
+
+    printf("<fragment>: bytes per read (%u - %u, default: %u).\n",
+           kMinFragment,
+           kMaxFragment,
+           kDefaultFragment);
+
+    return -1;
+  }
+
+  unsigned megabytes = kDefaultMegabytes;
+  if ((argc > 1) &&
+      (util::number::parse(argv[1],
+                           strlen(argv[1]),
+                           megabytes,
+                           kMinMegabytes,
+                           kMaxMegabytes) !=
+       util::number::parse_result::kSucceeded)) {
+    fprintf(stderr, "Invalid number of megabytes '%s'.\n", argv[1]);
+    return -1;
+  }
+
+  unsigned fragmentlen = kDefaultFragment;
+  if ((argc > 2) &&
+      (util::number::parse(argv[2],
+                           strlen(argv[2]),
+                           fragmentlen,
+                           kMinFragment,
+                           kMaxFragment) !=
+       util::number::parse_result::kSucceeded)) {
+    fprintf(stderr, "Invalid fragment size '%s'.\n", argv[2]);
+    return -1;
+  }
+
+  char* fragment;
+  if ((fragment = reinterpret_cast<char*>(malloc(fragmentlen))) == NULL) {
+    fprintf(stderr, "Error allocating memory.\n");
+    return -1;
+  }
+
+  memset(fragment, 'x', fragmentlen);
+
+  uint64_t size = static_cast<uint64_t>(megabytes) * 1024 * 1024;
+
+  printf("%u MB in fragments of %u bytes.\n", megabytes, fragmentlen);
+
+  int ret = 0;
+
+  // Number of system calls without staging.
+  uint64_t unstaged = 0;
+
+  for (unsigned i = 0; i < kNumberThresholds; i++) {
+    uint64_t syscalls;
+    if (!run(kThresholds[i], size, fragment, fragmentlen, syscalls)) {
+      ret = -1;
+      break;
+    }
+
+    if (kThresholds[i] == 0) {
+      unstaged = syscalls;
+    } else if ((kThresholds[i] > fragmentlen) && (syscalls >= unstaged)) {
+      // Staging has to save system calls.
+      printf("FAILED: the writes were not coalesced.\n");
+      ret = -1;
+    }
+  }
+
+  unlink(kFilename);
+  free(fragment);
+
+  return ret;
+}